@@ -0,0 +1,120 @@
+//
+//  arena.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "arena.h"
+#include "error.h"
+#include "memory.h"
+
+typedef struct ArenaBlock_tag
+{
+    struct ArenaBlock_tag *next;
+    size_t used;
+    size_t size;
+    // NOTE: the memory of the block follows the header
+} ArenaBlock;
+
+typedef struct ArenaCleanupEntry_tag
+{
+    struct ArenaCleanupEntry_tag *next;
+    ArenaCleanup cleanup;
+    void *data;
+} ArenaCleanupEntry;
+
+// NOTE: all allocations are aligned as the block headers
+#define ARENA_ALIGNMENT sizeof(ArenaBlock *)
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+static void arena_addBlock(size_t size, Arena *arena)
+{
+    size_t totalSize = sizeof(ArenaBlock) + size;
+    ArenaBlock *block = (ArenaBlock *)lox_allocn(uint8_t, totalSize);
+    if (block == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    block->used = 0;
+    block->size = size;
+    block->next = arena->firstBlock;
+    arena->firstBlock = block;
+}
+
+Arena * arena_init()
+{
+    return arena_initSized(ARENA_BLOCK_SIZE);
+}
+
+// Returns an arena with blocks of `blockSize` bytes, e.g. smaller ones for
+// the short compilation units.
+Arena * arena_initSized(size_t blockSize)
+{
+    assert(blockSize > 4 * sizeof(ArenaBlock));
+    Arena *arena = lox_alloc(Arena);
+    if (arena == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    arena->firstBlock = NULL;
+    arena->firstCleanup = NULL;
+    arena->blockSize = blockSize;
+    arena_addBlock(blockSize - sizeof(ArenaBlock), arena);
+    return arena;
+}
+
+// Runs the cleanup functions, in the reverse order they were added, and
+// frees all the memory allocated in the arena.
+void arena_free(Arena *arena)
+{
+    for (ArenaCleanupEntry *entry = arena->firstCleanup; entry != NULL; entry = entry->next)
+    {
+        entry->cleanup(entry->data);
+    }
+    while (arena->firstBlock)
+    {
+        ArenaBlock *block = arena->firstBlock;
+        arena->firstBlock = block->next;
+        lox_free(block);
+    }
+    lox_free(arena);
+}
+
+// Returns `size` bytes of uninitialized memory from the arena.
+void * arena_alloc_(size_t size, Arena *arena)
+{
+    size = ARENA_ALIGN(size);
+    ArenaBlock *block = arena->firstBlock;
+    if (block->used + size > block->size)
+    {
+        size_t blockSize = arena->blockSize - sizeof(ArenaBlock);
+        if (size > blockSize / 4)
+        {
+            // NOTE: large allocations get their own block, after the
+            //       current one, so that its free space is not wasted.
+            arena_addBlock(size, arena);
+            ArenaBlock *large = arena->firstBlock;
+            arena->firstBlock = large->next;
+            large->next = block->next;
+            block->next = large;
+            large->used = size;
+            return (uint8_t *)(large + 1);
+        }
+        arena_addBlock(blockSize, arena);
+        block = arena->firstBlock;
+    }
+    void *memory = (uint8_t *)(block + 1) + block->used;
+    block->used += size;
+    return memory;
+}
+
+// Registers `cleanup`, that is called with `data` when the arena is freed.
+void arena_addCleanup(ArenaCleanup cleanup, void *data, Arena *arena)
+{
+    ArenaCleanupEntry *entry = arena_alloc(ArenaCleanupEntry, arena);
+    entry->cleanup = cleanup;
+    entry->data = data;
+    entry->next = arena->firstCleanup;
+    arena->firstCleanup = entry;
+}
@@ -0,0 +1,45 @@
+//
+//  arena.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef arena_h
+#define arena_h
+
+#include "common.h"
+
+/*
+ An arena allocates memory by bumping a pointer in large blocks, and frees
+ it all at once. The nodes of a syntax tree are allocated in the arena of
+ their compilation unit, so that they are laid out in the order the parser
+ creates them, and the tree is freed in one step.
+ Resources owned by the allocations that are not in the arena (e.g. the
+ chunks of the functions) are released by cleanup functions, that run when
+ the arena is freed.
+ */
+
+typedef void (*ArenaCleanup)(void *data);
+
+struct ArenaBlock_tag;
+struct ArenaCleanupEntry_tag;
+
+typedef struct
+{
+    struct ArenaBlock_tag *firstBlock;
+    struct ArenaCleanupEntry_tag *firstCleanup;
+    // NOTE: size of the blocks, with their header
+    size_t blockSize;
+} Arena;
+
+#define arena_alloc(type, arena) ((type *)arena_alloc_(sizeof(type), arena))
+#define arena_allocn(type, count, arena) ((type *)arena_alloc_((size_t)(count) * sizeof(type), arena))
+
+Arena * arena_init(void);
+Arena * arena_initSized(size_t blockSize);
+void arena_free(Arena *arena);
+void * arena_alloc_(size_t size, Arena *arena);
+void arena_addCleanup(ArenaCleanup cleanup, void *data, Arena *arena);
+
+#endif /* arena_h */
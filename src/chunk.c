@@ -0,0 +1,282 @@
+//
+//  chunk.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "chunk.h"
+
+#include "error.h"
+#include "memory.h"
+#include "stmt.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern inline int32_t chunk_readOperand(const uint8_t *ip);
+
+#define CHUNK_INITIAL_CAPACITY 64
+
+// Array of the opcode names
+static const char * const opcode_string[] =
+{
+#define DEFINE_TYPE_STRING(type) XSTR(type),
+    FOREACH_OPCODE(DEFINE_TYPE_STRING)
+#undef DEFINE_TYPE_STRING
+};
+
+// Returns a copy of the array `array`, that holds `count` elements of
+// size `elementSize`, with room for `newCapacity` elements.
+// NOTE: lox_realloc only works for chars, so we copy the array instead.
+static void * chunk_growArray(void *array, size_t elementSize, int32_t count, int32_t newCapacity)
+{
+    uint8_t *newArray = lox_allocn(uint8_t, elementSize * newCapacity);
+    if (newArray == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    if (array != NULL)
+    {
+        memcpy(newArray, array, elementSize * count);
+        lox_free(array);
+    }
+    return newArray;
+}
+
+Chunk * chunk_init()
+{
+    Chunk *chunk = lox_alloc(Chunk);
+    if (chunk == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    chunk->code = NULL;
+    chunk->count = 0;
+    chunk->capacity = 0;
+    chunk->constants = NULL;
+    chunk->constantsCount = 0;
+    chunk->constantsCapacity = 0;
+    chunk->tokens = NULL;
+    chunk->tokensCount = 0;
+    chunk->tokensCapacity = 0;
+    return chunk;
+}
+
+void chunk_free(Chunk *chunk)
+{
+    if (chunk->code)
+    {
+        lox_free(chunk->code);
+    }
+    if (chunk->constants)
+    {
+        lox_free(chunk->constants);
+    }
+    if (chunk->tokens)
+    {
+        lox_free(chunk->tokens);
+    }
+    lox_free(chunk);
+}
+
+static void chunk_writeByte(uint8_t byte, Chunk *chunk)
+{
+    if (chunk->count == chunk->capacity)
+    {
+        int32_t capacity = max(CHUNK_INITIAL_CAPACITY, 2 * chunk->capacity);
+        chunk->code = chunk_growArray(chunk->code, sizeof(uint8_t), chunk->count, capacity);
+        chunk->capacity = capacity;
+    }
+    chunk->code[chunk->count++] = byte;
+}
+
+// Appends the opcode `byte` to the chunk. `token` is the token
+// associated to the instruction to report runtime errors.
+void chunk_write(uint8_t byte, const Token *token, Chunk *chunk)
+{
+    if (chunk->tokensCount == 0 || chunk->tokens[chunk->tokensCount - 1].token != token)
+    {
+        if (chunk->tokensCount == chunk->tokensCapacity)
+        {
+            int32_t capacity = max(CHUNK_INITIAL_CAPACITY, 2 * chunk->tokensCapacity);
+            chunk->tokens = chunk_growArray(chunk->tokens, sizeof(ChunkTokenEntry), chunk->tokensCount, capacity);
+            chunk->tokensCapacity = capacity;
+        }
+        chunk->tokens[chunk->tokensCount].offset = chunk->count;
+        chunk->tokens[chunk->tokensCount].token = token;
+        chunk->tokensCount++;
+    }
+    chunk_writeByte(byte, chunk);
+}
+
+void chunk_writeOperand(int32_t operand, Chunk *chunk)
+{
+    uint32_t bits = (uint32_t)operand;
+    for (int32_t i = 0; i < CHUNK_OPERAND_SIZE; i++)
+    {
+        chunk_writeByte((uint8_t)(bits >> (8 * i)), chunk);
+    }
+}
+
+// Overwrites the operand at `offset`, e.g. to patch a jump.
+void chunk_patchOperand(int32_t offset, int32_t operand, Chunk *chunk)
+{
+    assert(offset + CHUNK_OPERAND_SIZE <= chunk->count);
+    uint32_t bits = (uint32_t)operand;
+    for (int32_t i = 0; i < CHUNK_OPERAND_SIZE; i++)
+    {
+        chunk->code[offset + i] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+// Adds a constant to the chunk and returns its index.
+int32_t chunk_addConstant(const void *constant, Chunk *chunk)
+{
+    if (chunk->constantsCount == chunk->constantsCapacity)
+    {
+        int32_t capacity = max(CHUNK_INITIAL_CAPACITY, 2 * chunk->constantsCapacity);
+        chunk->constants = chunk_growArray(chunk->constants, sizeof(void *), chunk->constantsCount, capacity);
+        chunk->constantsCapacity = capacity;
+    }
+    chunk->constants[chunk->constantsCount] = constant;
+    return chunk->constantsCount++;
+}
+
+// Returns the token associated to the instruction at `offset`.
+const Token * chunk_tokenAt(int32_t offset, const Chunk *chunk)
+{
+    assert(chunk->tokensCount > 0);
+    int32_t low = 0;
+    int32_t high = chunk->tokensCount - 1;
+    while (low < high)
+    {
+        int32_t middle = (low + high + 1) / 2;
+        if (chunk->tokens[middle].offset <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return chunk->tokens[low].token;
+}
+
+/* Disassembler */
+
+static void chunk_printToken(const Token *token, const char *source)
+{
+    if (token == NULL)
+    {
+        return;
+    }
+    if (token->type == TT_NUMBER)
+    {
+        printf(" %g", get_number_value(token));
+    }
+    else if (token->type == TT_STRING)
+    {
+        printf(" \"%s\"", get_string_value(token));
+    }
+    else if (source != NULL && token->type != TT_EOF)
+    {
+        char *lexeme = str_substring(source, token->lexeme.index);
+        printf(" '%s'", lexeme);
+        str_free(lexeme);
+    }
+}
+
+void chunk_disassemble(const Chunk *chunk, const char *name, const char *source)
+{
+    printf("== %s ==\n", name);
+    int32_t offset = 0;
+    while (offset < chunk->count)
+    {
+        uint8_t opcode = chunk->code[offset];
+        const Token *token = chunk_tokenAt(offset, chunk);
+        printf("%04d %4d %-14s", offset, token ? token->lexeme.line + 1 : 0, opcode_string[opcode]);
+        const uint8_t *operands = chunk->code + offset + 1;
+        switch (opcode)
+        {
+            case OP_CONSTANT:
+            case OP_DEFINE:
+            case OP_DECLARE:
+            case OP_CHECK_FIELDS:
+            case OP_BINARY:
+            case OP_UNARY:
+            {
+                int32_t constant = chunk_readOperand(operands);
+                printf(" %4d", constant);
+                chunk_printToken(chunk->constants[constant], source);
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            {
+                printf(" %4d", chunk_readOperand(operands));
+                chunk_printToken(token, source);
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+            {
+                printf(" %4d %4d", chunk_readOperand(operands), chunk_readOperand(operands + CHUNK_OPERAND_SIZE));
+                offset += 1 + 2 * CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_GET_SUPER:
+            {
+                printf(" %4d %4d %4d", chunk_readOperand(operands), chunk_readOperand(operands + CHUNK_OPERAND_SIZE), chunk_readOperand(operands + 2 * CHUNK_OPERAND_SIZE));
+                offset += 1 + 3 * CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            {
+                printf(" -> %04d", offset + 1 + CHUNK_OPERAND_SIZE + chunk_readOperand(operands));
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_LOOP:
+            {
+                printf(" -> %04d", offset + 1 + CHUNK_OPERAND_SIZE - chunk_readOperand(operands));
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_CALL:
+            case OP_BEGIN_SCOPE:
+            case OP_BEGIN_FRAME:
+            {
+                printf(" %4d", chunk_readOperand(operands));
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_INVOKE:
+            {
+                int32_t constant = chunk_readOperand(operands);
+                const Call *call = chunk->constants[constant];
+                printf(" %4d %4d", constant, chunk_readOperand(operands + CHUNK_OPERAND_SIZE));
+                chunk_printToken(((const Get *)call->callee)->name, source);
+                offset += 1 + 2 * CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_FUNCTION:
+            {
+                int32_t constant = chunk_readOperand(operands);
+                const FunctionStmt *function = chunk->constants[constant];
+                printf(" %4d <fn %s>", constant, get_identifier_name(function->name));
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            case OP_CLASS:
+            {
+                int32_t constant = chunk_readOperand(operands);
+                const ClassStmt *klass = chunk->constants[constant];
+                printf(" %4d <class %s>", constant, get_identifier_name(klass->name));
+                offset += 1 + CHUNK_OPERAND_SIZE;
+            } break;
+            default:
+            {
+                offset += 1;
+            } break;
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,104 @@
+//
+//  chunk.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef chunk_h
+#define chunk_h
+
+#include "common.h"
+#include "token.h"
+
+#include <stdint.h>
+
+/*
+ A chunk is the bytecode compiled from a list of statements: the top-level
+ code of a program, or the body of a function. Each instruction is a one
+ byte opcode followed by its operands, which are 32 bits wide, so that the
+ slots, constants and jumps are not limited below the size of a chunk.
+ Constants are pointers into the AST the chunk was compiled from (tokens,
+ function and class declarations), which outlives the chunk.
+ */
+
+#define CHUNK_OPERAND_SIZE 4
+
+// NOTE: operands are listed in the comment next to each opcode.
+#define FOREACH_OPCODE(code)                                                  \
+    code(CONSTANT)      /* token: push the value of a literal token */        \
+    code(NIL)                                                                 \
+    code(TRUE)                                                                \
+    code(FALSE)                                                               \
+    code(POP)                                                                 \
+    code(GET_LOCAL)     /* depth, index */                                    \
+    code(SET_LOCAL)     /* depth, index */                                    \
+    code(GET_GLOBAL)    /* slot */                                            \
+    code(SET_GLOBAL)    /* slot */                                            \
+    code(DEFINE)        /* token: pops the value of the variable */           \
+    code(DECLARE)       /* token: defines a variable with no value */         \
+    code(GET_PROPERTY)  /* get expression */                                  \
+    code(CHECK_FIELDS)  /* token: checks that the top value is an instance */ \
+    code(SET_PROPERTY)  /* set expression */                                  \
+    code(GET_SUPER)     /* super expression, depth, index */                  \
+    code(BINARY)        /* operator token */                                  \
+    code(UNARY)         /* operator token */                                  \
+    code(PRINT)                                                               \
+    code(JUMP)          /* offset */                                          \
+    code(JUMP_IF_FALSE) /* offset: does not pop the condition */              \
+    code(LOOP)          /* offset */                                          \
+    code(CALL)          /* arguments count */                                 \
+    code(INVOKE)        /* call of a get expression, arguments count */       \
+    code(FUNCTION)      /* function declaration */                            \
+    code(CLASS)         /* class declaration */                               \
+    code(BEGIN_SCOPE)   /* slots count */                                     \
+    code(BEGIN_FRAME)   /* slots count: scope on the frame stack */           \
+    code(END_SCOPE)                                                           \
+    code(RETURN)
+
+typedef enum OpCode
+{
+#define DEFINE_ENUM_TYPE(type) OP_##type,
+    FOREACH_OPCODE(DEFINE_ENUM_TYPE)
+#undef DEFINE_ENUM_TYPE
+} OpCode;
+
+// NOTE: Maps the instructions starting at `offset` to the token
+//       used to report runtime errors.
+typedef struct
+{
+    int32_t offset;
+    const Token *token;
+} ChunkTokenEntry;
+
+typedef struct Chunk_tag
+{
+    uint8_t *code;
+    int32_t count;
+    int32_t capacity;
+
+    const void **constants;
+    int32_t constantsCount;
+    int32_t constantsCapacity;
+
+    ChunkTokenEntry *tokens;
+    int32_t tokensCount;
+    int32_t tokensCapacity;
+} Chunk;
+
+Chunk * chunk_init(void);
+void chunk_free(Chunk *chunk);
+void chunk_write(uint8_t byte, const Token *token, Chunk *chunk);
+void chunk_writeOperand(int32_t operand, Chunk *chunk);
+void chunk_patchOperand(int32_t offset, int32_t operand, Chunk *chunk);
+int32_t chunk_addConstant(const void *constant, Chunk *chunk);
+const Token * chunk_tokenAt(int32_t offset, const Chunk *chunk);
+void chunk_disassemble(const Chunk *chunk, const char *name, const char *source);
+
+inline int32_t chunk_readOperand(const uint8_t *ip)
+{
+    uint32_t operand = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8) | ((uint32_t)ip[2] << 16) | ((uint32_t)ip[3] << 24);
+    return (int32_t)operand;
+}
+
+#endif /* chunk_h */
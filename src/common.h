@@ -20,20 +20,71 @@
 // Maximum input line length in the repl
 #define REPL_MAX_INPUT_LENGTH 1024
 
-// Maximum number of variables that can be stored in a local environment
-#define LOX_MAX_LOCAL_VARIABLES 255
-
-// Maximum number of methods that can be defined in a class
-#define LOX_METHODS_MAX_COUNT 32
+// Size in bytes of the blocks of the arenas of the lines of the repl, and
+// number of lines declaring functions that are kept before a collection is
+// forced to free the ones that are no longer referenced.
+#define REPL_ARENA_BLOCK_SIZE 4096
+#define REPL_COLLECT_LINES 256
+
+// Maximum number of global variables. The global environment has a fixed
+// capacity, so that its values are never moved, and has LOX_MAX_NATIVES more
+// slots for the native functions, that do not take the slots of the scripts.
+#define LOX_MAX_GLOBAL_VARIABLES 256
+#define LOX_MAX_NATIVES 64
+
+// Minimum capacity of the method table of a class, a power of 2. The table
+// grows to hold the methods of the class and of its superclasses.
+#define LOX_CLASS_MIN_METHOD_TABLE 8
 
 // Maximum number of fields that can be stored in an instance
 #define LOX_INSTANCE_MAX_FIELDS 256
 
-// Maximum number of environments that can be simultaneously
-#define LOX_MAX_ENVIRONMENTS 31*1024
+// Number of fields allocated when the first field of an instance is set;
+// the storage doubles when the instance needs more.
+#define LOX_INSTANCE_INITIAL_FIELDS 2
+
+// Number of values allocated when the first value is pushed to an array;
+// the storage doubles when the array needs more.
+// NOTE: with MEMORY_DEBUG, the values must fit in a 64KB allocation.
+#define LOX_ARRAY_INITIAL_CAPACITY 8
+
+// Maximum number of values that can be stored in an array
+#define LOX_ARRAY_MAX_COUNT (256*1024*1024)
+
+// Number of entries allocated when the first key is set in a map, a power
+// of 2; the table doubles when it is three quarters full.
+// NOTE: with MEMORY_DEBUG, the entries must fit in a 64KB allocation.
+#define LOX_MAP_INITIAL_CAPACITY 8
+
+// Maximum number of keys that can be stored in a map
+#define LOX_MAP_MAX_COUNT (256*1024*1024)
+
+// Number of shapes remembered by the inline cache of a property access;
+// when the cache is full, the oldest entry is replaced.
+#define LOX_INLINE_CACHE_SIZE 4
+
+// If defined, the inline caches count their hits and misses, and the
+// counters are printed on the standard error when the program ends.
+//#define INLINE_CACHE_STATS 1
+
+// Maximum number of environments that can be simultaneously allocated;
+// most frames only need a few slots, see ENV_MIN_CAPACITY.
+#define LOX_MAX_ENVIRONMENTS 256*1024
 
-// Maximum number of function arguments
-#define LOX_MAX_ARG_COUNT 8
+// Maximum number of nested calls. The tree-walking interpreter recurses on
+// the C stack, so it also reports a stack overflow when less than
+// LOX_STACK_RESERVE bytes of the stack of the thread remain, whatever the
+// depth, see stack_initLimit().
+#define LOX_MAX_CALL_DEPTH 8192
+#define LOX_STACK_RESERVE (64*1024)
+
+// Size of the stack of the threads that run the scripts of a batch, enough
+// for LOX_MAX_CALL_DEPTH calls of the tree-walking interpreter.
+#define LOX_THREAD_STACK_SIZE (16*1024*1024)
+
+// Maximum number of function arguments; the arguments are passed on the
+// stack of locked values, so this only bounds the size of a declaration.
+#define LOX_MAX_ARG_COUNT 255
 
 // Store global variables in a hash table
 #define ENV_GLOBALS_USE_HASH 1
@@ -44,6 +95,22 @@
 #define ENV_GLOBAL_HASH_MASK (ENV_GLOBAL_HASH_SIZE - 1)
 #endif
 
+/* Scanner */
+
+// Initial number of tokens of the array of tokens of the scanner
+// NOTE: with MEMORY_DEBUG, the tokens must fit in a 64KB allocation.
+#define SCANNER_INITIAL_TOKENS 256
+
+// Numbers with a longer lexeme are copied to the heap to be parsed
+#define SCANNER_NUMBER_MAX_LENGTH 64
+
+/* Output */
+
+// Size in bytes of the buffer that the print statements write to, see
+// output.h.
+// NOTE: with MEMORY_DEBUG, the buffer must fit in a 64KB allocation.
+#define OUTPUT_BUFFER_SIZE (32 * 1024)
+
 /* Time */
 
 // If defined, clock() uses the mach absolute time instead of using
@@ -52,11 +119,23 @@
 
 //#if (defined (__APPLE__) && defined (__MACH__))
 
+/* Memory pools */
+
+// If defined, the runtime structures (instances and their fields, classes,
+// functions, native functions, environments, and the pooled strings) are
+// allocated from the size classes of the slab allocator, see memory_pool.h.
+// The allocations larger than SLAB_MAX_SIZE use the usual allocate/free.
+#define MEMORY_USE_SLABS 1
+#define SLAB_MAX_SIZE 1024
+// NOTE: the chunks of a pool grow geometrically up to this number of pages.
+#define POOL_MAX_CHUNK_PAGES 64
+
 /* Strings */
 
-// If defined, two pools of strings are created, one for small size
-// strings and one for medium size strings. If the needed capacity
-// exceeds the latter, usual allocate/free takes place.
+// If defined, two pools of strings are used, one for small size strings
+// and one for medium size strings, i.e. the slab size classes of the two
+// sizes. If the needed capacity exceeds the latter, usual allocate/free
+// takes place.
 #define STR_USE_MEMORY_POOLS 1
 
 // Maximum capacities of small and medium size strings.
@@ -68,10 +147,103 @@
 // If defined, the string stores its hash value when calculated.
 #define STR_STORE_HASH 1
 
+// Minimum length of the result of a concatenation that is stored in a
+// string builder, so that the following appends do not copy it.
+#define STR_BUILDER_MIN_LENGTH 64
+
+// Initial number of entries of the table of interned strings. Must be a
+// power of two.
+#define STR_INTERN_INITIAL_CAPACITY 256
+
+/* Interpreter */
+
+// If defined, the tree-walking interpreter dispatches the statements of a
+// block with computed gotos, where the compiler supports them, instead of a
+// switch on their type.
+#if defined(__GNUC__)
+#define INTERPRETER_COMPUTED_GOTO 1
+#endif
+
+// If defined, the interpreter specializes the binary, unary and logical
+// expressions and the calls for the types they see, e.g. an addition of two
+// numbers, so that the following evaluations only check these types.
+#define INTERPRETER_QUICKENING 1
+
+// If defined, --jit compiles the hot loops and functions of the tree-walking
+// interpreter to native code, on x86-64 and AArch64, see jit.h. It needs the
+// specializations of INTERPRETER_QUICKENING, and writable pages that can be
+// made executable.
+#if defined(__GNUC__) && (defined(__unix__) || defined(__APPLE__)) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define INTERPRETER_JIT 1
+#endif
+
+#ifdef INTERPRETER_JIT
+// Number of iterations of a loop, and of calls of a function, after which
+// the interpreter compiles it
+#define JIT_HOT_LOOP_ITERATIONS 1000
+#define JIT_HOT_FUNCTION_CALLS 1000
+#endif
+
+// If defined, the JIT prints the loops and functions it compiles, and the
+// bailouts of their native code
+//#define JIT_VERBOSE 1
+
+// If defined, the environments of the scopes that are never captured by a
+// closure, as found by the resolver, are allocated on a stack of frames and
+// released when the scope ends, instead of being recycled by the garbage
+// collector.
+#define ENV_USE_FRAME_STACK 1
+
+// Size in bytes of the segments of the frame stack
+// NOTE: with MEMORY_DEBUG, the segments must fit in a 64KB allocation.
+#define ENV_FRAME_SEGMENT_SIZE (16 * 1024)
+
 /* Garbage collector */
 
 #define GC_INITIAL_ENVIRONMENTS_THRESHOLD 32
-#define GC_LOCKS_STACK_SIZE 4096
+
+// Initial and maximum number of values in the stack of locked values, that
+// doubles its capacity when it is full.
+// NOTE: with MEMORY_DEBUG, the stack must fit in a 64KB allocation.
+#define GC_LOCKS_INITIAL_SIZE 1024
+#define GC_LOCKS_MAX_SIZE (1024*1024)
+
+// If defined, the garbage collector is generational: new objects and
+// environments are allocated in a nursery, that is reclaimed by minor
+// collections that do not visit the old generation. The survivors are
+// promoted to the old generation, which is only collected when it has
+// doubled in size. If not defined, every collection marks and sweeps the
+// whole heap.
+#define GC_GENERATIONAL 1
+
+#ifdef GC_GENERATIONAL
+// Number of objects and environments allocated between two minor collections
+#define GC_NURSERY_OBJECTS 4096
+#define GC_NURSERY_ENVIRONMENTS 512
+#endif
+
+// Number of entries of the segments of the mark stack, that holds the
+// structures marked but not scanned yet.
+#define GC_MARK_SEGMENT_ENTRIES 1024
+
+// With the incremental marking, number of allocations between two slices
+// of marking, and number of structures scanned by each slice.
+#define GC_INCREMENTAL_SLICE_ALLOCATIONS 1024
+#define GC_INCREMENTAL_SLICE_WORK 8192
+
+// If defined, the major collections of large heaps can be marked by several
+// threads, see gcSetMarking().
+#if defined(__GNUC__) && (defined(__unix__) || defined(__APPLE__))
+#define GC_PARALLEL_MARK 1
+#endif
+
+#ifdef GC_PARALLEL_MARK
+// Maximum number of marking threads, and minimum number of live objects
+// for a collection to be marked in parallel.
+#define GC_MAX_MARK_THREADS 16
+#define GC_PARALLEL_MIN_OBJECTS (64 * 1024)
+#endif
 
 // If defined, triggers a garbage collection at every place where
 // a garbage collection could be triggered.
@@ -84,8 +256,15 @@
 //#define MEMORY_FREE_ON_EXIT 1
 
 // If defined, tracks all memory allocations and checks that there are no leaks.
+// NOTE: the tracking is shared by the whole process, so only one thread can
+//       run interpreters.
 //#define MEMORY_DEBUG 1
 
+// If defined, the allocations can be sampled by call site, see
+// memory_sampler.h. The sampler is disabled by MEMORY_DEBUG, that tracks
+// every allocation instead.
+#define MEMORY_SAMPLING 1
+
 // If defined, (some of the) unused memory is set to a special value.
 //#define DEBUG_SCRAMBLE_MEMORY 1
 
@@ -95,18 +274,58 @@
 // If defined, some extra debugging info is displayed
 //#define DEBUG_VERBOSE 1
 
-/* Resolver */
+/* Syntax tree */
 
-// If defined, the resolved variable depth and index corresponding to expressions
-// are stored in a hash map instead of a simple array.
-#define USE_LOCALS_HASH_MAP 1
+// Size in bytes of the blocks of the arenas the syntax trees are allocated in
+// NOTE: with MEMORY_DEBUG, the blocks must fit in a 64KB allocation.
+#define ARENA_BLOCK_SIZE (32 * 1024)
 
-// Size of the resolver hash table (must be >= LOX_MAX_LOCAL_VARIABLES)
-#define RESOLVER_HASH_TABLE_SIZE 255
+/* Program cache */
+
+// Extension of the cache files of the scripts, that replaces ".lox"
+#define CACHE_FILE_EXTENSION ".loxc"
+
+// Extension of the heap snapshots of the preludes, that replaces ".lox"
+#define SNAPSHOT_FILE_EXTENSION ".loxs"
+
+// Version of the format of the cache files; must be incremented when the
+// format or the syntax tree changes, so that the old cache files are ignored.
+#define CACHE_FORMAT_VERSION 4
+
+/* Profiler */
+
+// Initial number of functions, call stacks and nested calls recorded by the
+// profiler; the storage doubles when it is full. Must be a power of two.
+#define PROFILER_INITIAL_CAPACITY 64
+
+/* Tracer */
+
+// Size in bytes of the buffer of the trace file, see tracer.h
+#define TRACER_BUFFER_SIZE (64 * 1024)
+
+/* Resolver */
+
+// Initial capacities of the stack of the variables declared in the scopes
+// being resolved, and of the table of their names; they double when they
+// are full. The capacity of the table must be a power of two.
+#define RESOLVER_INITIAL_SYMBOLS 256
+#define RESOLVER_INITIAL_NAMES 256
+// Size of the blocks of the arena that allocates the scopes
+#define RESOLVER_ARENA_BLOCK_SIZE 1024
 
 // If defined, the debuggers prints debugging information
 //#define RESOLVER_VERBOSE 1
 
+/* Virtual machine */
+
+// Initial number of frames of the virtual machine; the frames grow up to
+// LOX_MAX_CALL_DEPTH.
+// NOTE: with MEMORY_DEBUG, the frames must fit in a 64KB allocation.
+#define VM_INITIAL_FRAMES 64
+
+// If defined, the bytecode is disassembled before being executed
+//#define VM_PRINT_CODE 1
+
 /* Exit codes */
 
 #define LOX_EXIT_CODE_OK                 0
@@ -125,8 +344,19 @@
 #define MEMORY_FREE_ON_EXIT 1
 #endif
 
-// NOTE: to check for memory leaks of strings with MEMORY_DEBUG, we need to disable the memory pools first.
-#if defined(MEMORY_DEBUG) && defined(STR_USE_MEMORY_POOLS)
+#if defined(INTERPRETER_JIT) && !defined(INTERPRETER_QUICKENING)
+#undef INTERPRETER_JIT
+#endif
+
+#if defined(MEMORY_DEBUG) && defined(MEMORY_SAMPLING)
+#undef MEMORY_SAMPLING
+#endif
+
+// NOTE: to check for memory leaks with MEMORY_DEBUG, we need to disable the memory pools first.
+#if defined(MEMORY_DEBUG) && defined(MEMORY_USE_SLABS)
+#undef MEMORY_USE_SLABS
+#endif
+#if !defined(MEMORY_USE_SLABS) && defined(STR_USE_MEMORY_POOLS)
 #undef STR_USE_MEMORY_POOLS
 #endif
 
@@ -140,8 +370,6 @@
 #include <stddef.h> // Defines NULL
 #include <stdlib.h>
 
-#include "memory.h"
-
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE 4096
@@ -152,9 +380,17 @@
 #endif
 
 #define max(a,b) (((a)<(b))?(b):(a))
+#define min(a,b) (((a)<(b))?(a):(b))
 
 #define global
 
+// NOTE: the state that is not kept by an interpreter, e.g. the memory pools
+//       and the interned strings, is local to each thread, so that the
+//       threads can run their own interpreters, see loxi.h.
+#define thread_global _Thread_local
+
+#include "memory.h"
+
 #ifdef DEBUG
 #define FATAL_ERROR assert(false);
 #else
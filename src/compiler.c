@@ -0,0 +1,466 @@
+//
+//  compiler.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "compiler.h"
+
+#include "common.h"
+#include "error.h"
+#include "memory.h"
+
+/*
+ The compiler walks the resolved AST and emits the bytecode executed by the
+ virtual machine. Function bodies are compiled eagerly, and each chunk is
+ stored in the declaration of the function it belongs to. The bodies that
+ are not parsed yet are compiled by their first call, see
+ compileLazyFunction().
+ */
+
+typedef struct
+{
+    ExprVisitor exprVisitor;
+    StmtVisitor stmtVisitor;
+    Interpreter *interpreter;
+    Chunk *chunk;
+    // NOTE: token used to report runtime errors of the instructions that
+    //       do not have a token of their own.
+    const Token *token;
+} Compiler;
+
+/* Emitters */
+
+static inline void emitOp(OpCode op, const Token *token, Compiler *compiler)
+{
+    if (token != NULL)
+    {
+        compiler->token = token;
+    }
+    chunk_write((uint8_t)op, compiler->token, compiler->chunk);
+}
+
+static inline void emitOperand(int32_t operand, Compiler *compiler)
+{
+    chunk_writeOperand(operand, compiler->chunk);
+}
+
+static inline void emitConstant(OpCode op, const void *constant, const Token *token, Compiler *compiler)
+{
+    emitOp(op, token, compiler);
+    emitOperand(chunk_addConstant(constant, compiler->chunk), compiler);
+}
+
+// Emits a jump instruction and returns the offset of its operand, that
+// is patched with patchJump once the destination is known.
+static int32_t emitJump(OpCode op, Compiler *compiler)
+{
+    emitOp(op, NULL, compiler);
+    chunk_writeOperand(INT32_MAX, compiler->chunk);
+    return compiler->chunk->count - CHUNK_OPERAND_SIZE;
+}
+
+static void patchJump(int32_t offset, Compiler *compiler)
+{
+    int32_t jump = compiler->chunk->count - offset - CHUNK_OPERAND_SIZE;
+    chunk_patchOperand(offset, jump, compiler->chunk);
+}
+
+static void emitLoop(int32_t loopStart, Compiler *compiler)
+{
+    emitOp(OP_LOOP, NULL, compiler);
+    int32_t offset = compiler->chunk->count - loopStart + CHUNK_OPERAND_SIZE;
+    chunk_writeOperand(offset, compiler->chunk);
+}
+
+// Emits the instruction that reads (if `isGet` is true) or writes the
+// variable at the location `slot`, as resolved by the resolver.
+static void emitVariable(bool isGet, const Token *name, const VariableSlot *slot, Compiler *compiler)
+{
+    assert(slot->index >= 0);
+    if (slot->depth != VAR_DEPTH_GLOBAL)
+    {
+        emitOp(isGet ? OP_GET_LOCAL : OP_SET_LOCAL, name, compiler);
+        emitOperand(slot->depth, compiler);
+        emitOperand(slot->index, compiler);
+    }
+    else
+    {
+        emitOp(isGet ? OP_GET_GLOBAL : OP_SET_GLOBAL, name, compiler);
+        emitOperand(slot->index, compiler);
+    }
+}
+
+static inline void compileExpr(Expr *expr, Compiler *compiler)
+{
+    expr_accept_visitor(expr, &compiler->exprVisitor, compiler);
+}
+
+static void compileStmtList(Stmt *statements, Compiler *compiler)
+{
+    Stmt *statement = statements;
+    while (statement)
+    {
+        stmt_accept_visitor(statement, &compiler->stmtVisitor, compiler);
+        statement = statement->next;
+    }
+}
+
+// Compiles the body of the function declared by `stmt` in its own chunk.
+static void compileFunction(FunctionStmt *stmt, Compiler *compiler)
+{
+    if (stmt->chunk != NULL || stmt->lazyBody != NULL)
+    {
+        return;
+    }
+    Chunk *enclosing = compiler->chunk;
+    compiler->chunk = chunk_init();
+    compileStmtList(stmt->body, compiler);
+    emitOp(OP_NIL, stmt->name, compiler);
+    emitOp(OP_RETURN, NULL, compiler);
+    stmt->chunk = compiler->chunk;
+    compiler->chunk = enclosing;
+#ifdef VM_PRINT_CODE
+    char *name = token_to_string(stmt->name, compiler->interpreter->source);
+    chunk_disassemble(stmt->chunk, name, compiler->interpreter->source);
+    str_free(name);
+#endif
+}
+
+/* Expr visitors */
+
+static void * compiler_visitAssignExpr(Assign *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->value, compiler);
+    emitVariable(false, expr->name, &expr->slot, compiler);
+    return NULL;
+}
+
+static void * compiler_visitBinaryExpr(Binary *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->left, compiler);
+    compileExpr(expr->right, compiler);
+    emitConstant(OP_BINARY, expr->operator, expr->operator, compiler);
+    return NULL;
+}
+
+static void * compiler_visitCallExpr(Call *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    // NOTE: a method called on an instance is invoked without being bound
+    bool isInvoke = expr->callee->type == EXPR_Get;
+    if (isInvoke)
+    {
+        compileExpr(((Get *)expr->callee)->object, compiler);
+    }
+    else
+    {
+        compileExpr(expr->callee, compiler);
+    }
+    int32_t argumentsCount = 0;
+    Expr *argument = expr->arguments;
+    while (argument)
+    {
+        compileExpr(argument, compiler);
+        ++argumentsCount;
+        argument = argument->next;
+    }
+    if (isInvoke)
+    {
+        emitConstant(OP_INVOKE, expr, expr->paren, compiler);
+    }
+    else
+    {
+        emitOp(OP_CALL, expr->paren, compiler);
+    }
+    emitOperand(argumentsCount, compiler);
+    return NULL;
+}
+
+static void * compiler_visitGetExpr(Get *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->object, compiler);
+    emitConstant(OP_GET_PROPERTY, expr, expr->name, compiler);
+    return NULL;
+}
+
+static void * compiler_visitGroupingExpr(Grouping *expr, void *context)
+{
+    compileExpr(expr->expression, (Compiler *)context);
+    return NULL;
+}
+
+static void * compiler_visitLiteralExpr(Literal *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    switch (expr->value.type)
+    {
+        case TT_NIL:
+        {
+            emitOp(OP_NIL, NULL, compiler);
+        } break;
+        case TT_TRUE:
+        {
+            emitOp(OP_TRUE, NULL, compiler);
+        } break;
+        case TT_FALSE:
+        {
+            emitOp(OP_FALSE, NULL, compiler);
+        } break;
+        default:
+        {
+            emitConstant(OP_CONSTANT, &expr->value, NULL, compiler);
+        } break;
+    }
+    return NULL;
+}
+
+// NOTE: JUMP_IF_FALSE leaves the condition on the stack, so that it can
+//       be the value of the expression.
+static void * compiler_visitLogicalExpr(Logical *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->left, compiler);
+    compiler->token = expr->operator;
+    if (expr->operator->type == TT_OR)
+    {
+        int32_t elseJump = emitJump(OP_JUMP_IF_FALSE, compiler);
+        int32_t endJump = emitJump(OP_JUMP, compiler);
+        patchJump(elseJump, compiler);
+        emitOp(OP_POP, NULL, compiler);
+        compileExpr(expr->right, compiler);
+        patchJump(endJump, compiler);
+    }
+    else
+    {
+        assert(expr->operator->type == TT_AND);
+        int32_t endJump = emitJump(OP_JUMP_IF_FALSE, compiler);
+        emitOp(OP_POP, NULL, compiler);
+        compileExpr(expr->right, compiler);
+        patchJump(endJump, compiler);
+    }
+    return NULL;
+}
+
+// NOTE: The object is checked before the value is evaluated, as in the
+//       tree-walking interpreter.
+static void * compiler_visitSetExpr(Set *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->object, compiler);
+    emitOp(OP_CHECK_FIELDS, expr->name, compiler);
+    compileExpr(expr->value, compiler);
+    emitConstant(OP_SET_PROPERTY, expr, expr->name, compiler);
+    return NULL;
+}
+
+static void * compiler_visitSuperExpr(Super *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    assert(expr->slot.depth != VAR_DEPTH_GLOBAL);
+    emitConstant(OP_GET_SUPER, expr, expr->keyword, compiler);
+    emitOperand(expr->slot.depth, compiler);
+    emitOperand(expr->slot.index, compiler);
+    return NULL;
+}
+
+static void * compiler_visitThisExpr(This *expr, void *context)
+{
+    emitVariable(true, expr->keyword, &expr->slot, (Compiler *)context);
+    return NULL;
+}
+
+static void * compiler_visitUnaryExpr(Unary *expr, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(expr->right, compiler);
+    emitConstant(OP_UNARY, expr->operator, expr->operator, compiler);
+    return NULL;
+}
+
+static void * compiler_visitVariableExpr(Variable *expr, void *context)
+{
+    emitVariable(true, expr->name, &expr->slot, (Compiler *)context);
+    return NULL;
+}
+
+/* Stmt visitors */
+
+static void * compiler_visitBlockStmt(BlockStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    emitOp(stmt->isCaptured ? OP_BEGIN_SCOPE : OP_BEGIN_FRAME, NULL, compiler);
+    emitOperand(stmt->slotsCount, compiler);
+    compileStmtList(stmt->statements, compiler);
+    emitOp(OP_END_SCOPE, NULL, compiler);
+    return NULL;
+}
+
+static void * compiler_visitClassStmt(ClassStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    emitConstant(OP_DECLARE, stmt->name, stmt->name, compiler);
+    if (stmt->superClass != NULL)
+    {
+        compileExpr(stmt->superClass, compiler);
+    }
+    FunctionStmt *method = stmt->methods;
+    while (method)
+    {
+        compileFunction(method, compiler);
+        method = (FunctionStmt *)method->stmt.next;
+    }
+    emitConstant(OP_CLASS, stmt, stmt->name, compiler);
+    emitVariable(false, stmt->name, &stmt->slot, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    return NULL;
+}
+
+static void * compiler_visitExpressionStmt(ExpressionStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(stmt->expression, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    return NULL;
+}
+
+static void * compiler_visitFunctionStmt(FunctionStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileFunction(stmt, compiler);
+    emitConstant(OP_FUNCTION, stmt, stmt->name, compiler);
+    emitConstant(OP_DEFINE, stmt->name, stmt->name, compiler);
+    return NULL;
+}
+
+static void * compiler_visitIfStmt(IfStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(stmt->condition, compiler);
+    int32_t thenJump = emitJump(OP_JUMP_IF_FALSE, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    stmt_accept_visitor(stmt->thenBranch, &compiler->stmtVisitor, compiler);
+    int32_t elseJump = emitJump(OP_JUMP, compiler);
+    patchJump(thenJump, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    if (stmt->elseBranch != NULL)
+    {
+        stmt_accept_visitor(stmt->elseBranch, &compiler->stmtVisitor, compiler);
+    }
+    patchJump(elseJump, compiler);
+    return NULL;
+}
+
+static void * compiler_visitPrintStmt(PrintStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    compileExpr(stmt->expression, compiler);
+    emitOp(OP_PRINT, NULL, compiler);
+    return NULL;
+}
+
+static void * compiler_visitReturnStmt(ReturnStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    if (stmt->value != NULL)
+    {
+        compileExpr(stmt->value, compiler);
+    }
+    else
+    {
+        emitOp(OP_NIL, stmt->keyword, compiler);
+    }
+    emitOp(OP_RETURN, stmt->keyword, compiler);
+    return NULL;
+}
+
+static void * compiler_visitVarStmt(VarStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    if (stmt->initializer != NULL)
+    {
+        compileExpr(stmt->initializer, compiler);
+        emitConstant(OP_DEFINE, stmt->name, stmt->name, compiler);
+    }
+    else
+    {
+        emitConstant(OP_DECLARE, stmt->name, stmt->name, compiler);
+    }
+    return NULL;
+}
+
+static void * compiler_visitWhileStmt(WhileStmt *stmt, void *context)
+{
+    Compiler *compiler = (Compiler *)context;
+    int32_t loopStart = compiler->chunk->count;
+    compileExpr(stmt->condition, compiler);
+    int32_t exitJump = emitJump(OP_JUMP_IF_FALSE, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    stmt_accept_visitor(stmt->body, &compiler->stmtVisitor, compiler);
+    emitLoop(loopStart, compiler);
+    patchJump(exitJump, compiler);
+    emitOp(OP_POP, NULL, compiler);
+    return NULL;
+}
+
+/* Compiler */
+
+static Compiler * compiler_init(Interpreter *interpreter)
+{
+    Compiler *compiler = lox_alloc(Compiler);
+    if (compiler == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    compiler->interpreter = interpreter;
+    compiler->chunk = NULL;
+    compiler->token = NULL;
+
+    // Initialize expression visitor
+    {
+        ExprVisitor *visitor = &compiler->exprVisitor;
+#define DEFINE_VISITOR(type) \
+        visitor->visit##type = compiler_visit##type##Expr;
+        FOREACH_AST_NODE(DEFINE_VISITOR)
+#undef DEFINE_VISITOR
+    }
+
+    // Initialize statement visitor
+    {
+        StmtVisitor *visitor = &compiler->stmtVisitor;
+#define DEFINE_VISITOR(type) \
+        visitor->visit##type = compiler_visit##type##Stmt;
+        FOREACH_STMT_NODE(DEFINE_VISITOR)
+#undef DEFINE_VISITOR
+    }
+
+    return compiler;
+}
+
+// Compiles the top-level statements in a chunk, that is owned by the
+// caller.
+Chunk * compile(Stmt *statements, Interpreter *interpreter)
+{
+    Compiler *compiler = compiler_init(interpreter);
+    compiler->chunk = chunk_init();
+    compileStmtList(statements, compiler);
+    emitOp(OP_NIL, NULL, compiler);
+    emitOp(OP_RETURN, NULL, compiler);
+
+    Chunk *chunk = compiler->chunk;
+    lox_free(compiler);
+    return chunk;
+}
+
+// Compiles the body of `function`, that was parsed lazily, in its chunk.
+void compileLazyFunction(FunctionStmt *function, Interpreter *interpreter)
+{
+    assert(function->chunk == NULL && function->lazyBody == NULL);
+    Compiler *compiler = compiler_init(interpreter);
+    compileFunction(function, compiler);
+    lox_free(compiler);
+}
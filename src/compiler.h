@@ -0,0 +1,18 @@
+//
+//  compiler.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef compiler_h
+#define compiler_h
+
+#include "chunk.h"
+#include "interpreter.h"
+#include "stmt.h"
+
+Chunk * compile(Stmt *statements, Interpreter *interpreter);
+void compileLazyFunction(FunctionStmt *function, Interpreter *interpreter);
+
+#endif /* compiler_h */
@@ -10,20 +10,25 @@
 #include "garbage_collector.h"
 #include "lox_function.h"
 #include "memory.h"
+#include "memory_pool.h"
 #include "string.h"
 #include "token.h"
 
+extern inline int32_t env_sizeClass(int32_t slotsCount);
 extern inline bool env_isGlobal(const Environment *environment);
-extern inline void env_release(Environment *environment);
-extern inline Error * env_defineLocal(const Token *var, Object *value, Environment *environment);
-extern inline void env_defineThis(Object *value, Environment *environment);
-extern inline void env_defineSuper(Object *value, Environment *environment);
-
-// Initializes and returns a new environment.
-// Returns NULL and sets error if there was a stack overflow.
-Environment * env_init(Environment *enclosing, Error **error, GarbageCollector *collector)
+extern inline Value env_getGlobal(const Token *identifier, int32_t index, Environment *globals, Error **error);
+extern inline Error * env_assignGlobal(const Token *identifier, int32_t index, Value value, Environment *globals);
+extern inline void env_popFrame(Environment *environment, FrameStack *frames);
+extern inline void env_release(Environment *environment, FrameStack *frames);
+extern inline Error * env_defineLocal(const Token *var, Value value, Environment *environment);
+extern inline void env_defineThis(Value value, Environment *environment);
+extern inline void env_defineSuper(Value value, Environment *environment);
+
+// Initializes and returns a new environment, that can store `slotsCount`
+// variables. Returns NULL and sets error if there was a stack overflow.
+Environment * env_init_(Environment *enclosing, int32_t slotsCount, Error **error, GarbageCollector *collector, const char *file, int line)
 {
-    Environment *environment = gcGetEnvironment(collector);
+    Environment *environment = gcGetEnvironment_(slotsCount, collector, file, line);
     if (environment == NULL)
     {
         *error = initError(NULL, "Stack overflow.");
@@ -32,9 +37,10 @@ Environment * env_init(Environment *enclosing, Error **error, GarbageCollector *
     environment->enclosing = enclosing;
     environment->slotsUsed = 0;
     environment->isActive = true;
+    environment->isFrame = false;
 
 #ifdef DEBUG
-    static int32_t debugID = 1;
+    static thread_global int32_t debugID = 1;
     if(enclosing == NULL)
     {
         // NOTE: global environment has id 0.
@@ -51,11 +57,17 @@ Environment * env_init(Environment *enclosing, Error **error, GarbageCollector *
 // Initializes and returns the global environment.
 Environment * env_initGlobal(GarbageCollector *collector)
 {
-    EnvironmentGlobal *globals = lox_alloc(EnvironmentGlobal);
-    Environment *environment = &globals->environment;
+    size_t size = ENV_SIZE(ENV_GLOBALS_CAPACITY) + sizeof(EnvironmentGlobalNames);
+    Environment *environment = (Environment *)lox_allocn(uint8_t, size);
+    if (environment == NULL)
+    {
+        fatal_outOfMemory();
+    }
     environment->enclosing = NULL;
     environment->slotsUsed = 0;
+    environment->capacity = ENV_GLOBALS_CAPACITY;
     environment->isActive = true;
+    environment->isFrame = false;
     
 #ifdef DEBUG
     // NOTE: global environment has always id 0.
@@ -65,10 +77,10 @@ Environment * env_initGlobal(GarbageCollector *collector)
 #ifdef ENV_GLOBALS_USE_HASH
     for(int32_t index = 0; index < ENV_GLOBAL_HASH_SIZE; ++index)
 #else
-    for(int32_t index = 0; index < ENV_MAX_CAPACITY; ++index)
+    for(int32_t index = 0; index < ENV_GLOBALS_CAPACITY; ++index)
 #endif
     {
-        GLOBALS_NAME(globals, index) = NULL;
+        GLOBALS_NAME(environment, index) = NULL;
     }
 
     gcSetGlobalEnvironment(environment, collector);
@@ -76,33 +88,145 @@ Environment * env_initGlobal(GarbageCollector *collector)
     return environment;
 }
 
+static_assert(ENV_SIZE(ENV_GLOBALS_CAPACITY) > SLAB_MAX_SIZE, "The global environment must not fit in a slab size class.");
+#ifdef ENV_GLOBALS_USE_HASH
+static_assert(ENV_GLOBAL_HASH_SIZE > ENV_GLOBALS_CAPACITY, "The hash table of the globals must have a free entry.");
+#endif
+
 // Frees the environment and its contents.
 // NOTE: The garbage collector takes care of freeing the values.
 void env_free(Environment *environment)
 {
-    if (env_isGlobal(environment))
+    // NOTE: the names of the globals are interned, and are not freed here.
+    //       The global environment is larger than SLAB_MAX_SIZE, and is
+    //       released like the environments of the largest size class.
+    slabRelease(environment, ENV_SIZE(environment->capacity));
+}
+
+/* Frame stack */
+
+// Allocates a segment that can store a frame of `size` bytes.
+static FrameSegment * env_allocFrameSegment(FrameSegment *previous, size_t size)
+{
+    size += sizeof(FrameSegment);
+    if (size < ENV_FRAME_SEGMENT_SIZE)
     {
-#ifdef ENV_GLOBALS_USE_HASH
-        for(int32_t index = 0; index < ENV_GLOBAL_HASH_SIZE; ++index)
-        {
-            if (GLOBALS_NAME(environment, index) != NULL)
-            {
-                str_free(GLOBALS_NAME(environment, index));
-            }
-        }
-#else
-        for(int32_t index = 0; index < environment->slotsUsed; ++index)
+        size = ENV_FRAME_SEGMENT_SIZE;
+    }
+    FrameSegment *segment = (FrameSegment *)lox_allocn(uint8_t, size);
+    if (segment == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    segment->previous = previous;
+    segment->next = NULL;
+    segment->top = FRAME_SEGMENT_BASE(segment);
+    segment->end = (uint8_t *)segment + size;
+    return segment;
+}
+
+void env_initFrames(FrameStack *frames)
+{
+    frames->segment = env_allocFrameSegment(NULL, 0);
+    frames->framesCount = 0;
+}
+
+void env_freeFrames(FrameStack *frames)
+{
+    FrameSegment *segment = frames->segment;
+    while (segment->previous != NULL)
+    {
+        segment = segment->previous;
+    }
+    while (segment != NULL)
+    {
+        FrameSegment *next = segment->next;
+        lox_free(segment);
+        segment = next;
+    }
+    frames->segment = NULL;
+}
+
+// Pops all the frames, e.g. after a runtime error.
+void env_clearFrames(FrameStack *frames)
+{
+    FrameSegment *segment = frames->segment;
+    segment->top = FRAME_SEGMENT_BASE(segment);
+    while (segment->previous != NULL)
+    {
+        segment = segment->previous;
+        segment->top = FRAME_SEGMENT_BASE(segment);
+    }
+    frames->segment = segment;
+}
+
+// Moves the top of `frames` to the next segment, that can store a frame of
+// `size` bytes and is allocated if needed, and returns it.
+static FrameSegment * env_nextFrameSegment(FrameStack *frames, size_t size)
+{
+    FrameSegment *segment = frames->segment;
+    FrameSegment *next = segment->next;
+    if (next != NULL && (size_t)(next->end - next->top) < size)
+    {
+        // NOTE: the next segment is empty, and is replaced by a larger one
+        segment->next = next->next;
+        lox_free(next);
+        next = NULL;
+    }
+    if (next == NULL)
+    {
+        next = env_allocFrameSegment(segment, size);
+        next->next = segment->next;
+        if (next->next != NULL)
         {
-            str_free(GLOBALS_NAME(environment, index));
+            next->next->previous = next;
         }
-#endif
+        segment->next = next;
+    }
+    frames->segment = segment->next;
+    assert(frames->segment->top == FRAME_SEGMENT_BASE(frames->segment));
+    return frames->segment;
+}
+
+// Pushes on `frames` and returns a new environment, that can store
+// `slotsCount` variables.
+// NOTE: the environment must be released before the frames pushed before
+//       it, and it must not be captured, as it is overwritten by the
+//       following frames once released.
+Environment * env_pushFrame(Environment *enclosing, int32_t slotsCount, FrameStack *frames)
+{
+    size_t size = ENV_SIZE(slotsCount);
+    FrameSegment *segment = frames->segment;
+    if ((size_t)(segment->end - segment->top) < size)
+    {
+        segment = env_nextFrameSegment(frames, size);
     }
-    lox_free(environment);
+    Environment *environment = (Environment *)segment->top;
+    segment->top += size;
+    ++frames->framesCount;
+
+    environment->enclosing = enclosing;
+    environment->slotsUsed = 0;
+    environment->capacity = slotsCount;
+    environment->marked = GC_CLEAR;
+    environment->next = NULL;
+    environment->isActive = true;
+    environment->isFrame = true;
+#ifdef GC_GENERATIONAL
+    environment->isOld = false;
+    environment->isRemembered = false;
+#endif
+#ifdef DEBUG
+    // NOTE: the frames are not numbered
+    environment->debugID = -1;
+#endif
+    return environment;
 }
 
 // Returns the index of the variable `name` in the global environment.
 // If a variable with that name is not yet defined, returns the index
 // of the next free slot.
+// NOTE: `name` must be interned, so that names are compared as pointers.
 static int32_t env_indexOf(const char *name, Environment *globals)
 {
     assert(env_isGlobal(globals));
@@ -113,10 +237,10 @@ static int32_t env_indexOf(const char *name, Environment *globals)
     int32_t startIndex = (int32_t)(hash & ENV_GLOBAL_HASH_MASK);
     int32_t index = startIndex;
     while ((GLOBALS_NAME(globals, index) != NULL) &&
-           (!str_isEqual(GLOBALS_NAME(globals, index), name)))
+           (GLOBALS_NAME(globals, index) != name))
     {
         ++index;
-        if (index > ENV_GLOBAL_HASH_SIZE)
+        if (index == ENV_GLOBAL_HASH_SIZE)
         {
             index = 0;
         }
@@ -125,7 +249,7 @@ static int32_t env_indexOf(const char *name, Environment *globals)
     int32_t index = 0;
     while(index < globals->slotsUsed)
     {
-        if (str_isEqual(GLOBALS_NAME(globals, index), name))
+        if (GLOBALS_NAME(globals, index) == name)
         {
             break;
         }
@@ -139,7 +263,7 @@ static int32_t env_indexOf(const char *name, Environment *globals)
 // Defines in `environment` a new variable. Its name is in the
 // identifier token `var`, its value is carried by the object `value`.
 // Returns NULL
-Error * env_define(const Token *var, Object *value, Environment *environment)
+Error * env_define(const Token *var, Value value, Environment *environment)
 {
     Error *error;
     if (env_isGlobal(environment))
@@ -155,55 +279,33 @@ Error * env_define(const Token *var, Object *value, Environment *environment)
 
 // Defines a new variable in the global environment.
 // NOTE: we allow redefinitions of global variables
-Error * env_defineGlobal(const Token *var, Object *value, Environment *globals)
+Error * env_defineGlobal(const Token *var, Value value, Environment *globals)
 {
     assert(env_isGlobal(globals));
 
-    const char *name = get_identifier_name(var);
-#ifdef ENV_GLOBALS_USE_HASH
-    int32_t hashIndex = env_indexOf(name, globals);
-    if (GLOBALS_NAME(globals, hashIndex) == NULL)
+    int32_t index = env_globalSlot(get_identifier_name(var), globals);
+    if (index == -1)
     {
-        if (globals->slotsUsed == ENV_MAX_CAPACITY)
-        {
-            return initError(var, "Too many constants in one chunk.");
-        }
-        GLOBALS_NAME(globals, hashIndex) = str_dup(name);
-        GLOBALS_INDEX(globals, hashIndex) = globals->slotsUsed;
-        globals->slotsUsed++;
-    }
-    int32_t index = GLOBALS_INDEX(globals, hashIndex);
-#else
-    int32_t index = env_indexOf(name, globals);
-    if (index == globals->slotsUsed)
-    {
-        // NOTE: This test could be directly handled by the resolver.
-        if (globals->slotsUsed == ENV_MAX_CAPACITY)
-        {
-            return initError(var, "Too many constants in one chunk.");
-        }
-        GLOBALS_NAME(globals, globals->slotsUsed) = str_dup(name);
-        globals->slotsUsed++;
+        return initError(var, "Too many global variables.");
     }
-#endif
     globals->values[index] = value;
     
     return NULL;
 }
 
 // Defines a native function in the global environment.
-void env_defineNative(const char *name, Object *value, Environment *globals)
+void env_defineNative(const char *name, Value value, Environment *globals)
 {
     assert(env_isGlobal(globals));
-    assert(globals->slotsUsed < ENV_MAX_CAPACITY);
+    assert(globals->slotsUsed < ENV_GLOBALS_CAPACITY);
 #ifdef ENV_GLOBALS_USE_HASH
-    char *nameStr = str_fromLiteral(name);
+    const char *nameStr = str_intern(name);
     int32_t hashIndex = env_indexOf(nameStr, globals);
-    assert(GLOBALS_NAME((EnvironmentGlobal *)globals, hashIndex) == NULL);
+    assert(GLOBALS_NAME(globals, hashIndex) == NULL);
     GLOBALS_NAME(globals, hashIndex) = nameStr;
     GLOBALS_INDEX(globals, hashIndex) = globals->slotsUsed;
 #else
-    GLOBALS_NAME(globals, globals->slotsUsed) = str_fromLiteral(name);
+    GLOBALS_NAME(globals, globals->slotsUsed) = str_intern(name);
 #endif
     globals->values[globals->slotsUsed] = value;
     globals->slotsUsed++;
@@ -220,107 +322,127 @@ static inline Environment * env_ancestor(int32_t distance, Environment *environm
 }
 
 // Looks up the variable `identifier` in `environment` and returns
-// a duplicate object carrying its value if it finds it, or NULL
-// in which case `error` is set to an appropriate value.
+// its value if it finds it, or nil in which case
+// `error` is set to an appropriate value.
 // The variable location is determined by `distance` and `index`, as
 // calculated by the resolver.
-Object * env_getAt(const Token *identifier, int32_t distance, int32_t index, Environment *environment, Error **error, GarbageCollector *collector)
+Value env_getAt(const Token *identifier, int32_t distance, int32_t index, Environment *environment, Error **error)
 {
     assert(!env_isGlobal(environment));
     Environment *env = env_ancestor(distance, environment);
     assert(index >= 0 && index < env->slotsUsed);
-    Object *value = env->values[index];
-    if(value == NULL)
+    Value value = env->values[index];
+    if(val_isUndefined(value))
     {
         // NOTE: the variable was defined but not assigned a value.
+        value = VAL_NIL;
 #ifdef LOX_ACCESSING_UNINIT_VAR_ERROR
         *error = initErrorIdentifier("Accessing uninitialized variable '", identifier, "'.");
-#else
-        value = obj_newNil(collector);
 #endif
     }
-    else
-    {
-        value = obj_dup(value, collector);
-    }
 
     return value;
 }
 
 // Assigns a new value to the object at (`distance`, `index`) relative to `environment`.
-void env_assignAt(Object *value, int32_t distance, int32_t index, Environment *environment, GarbageCollector *collector)
+void env_assignAt(Value value, int32_t distance, int32_t index, Environment *environment, GarbageCollector *collector)
 {
-    assert(value != NULL);
+    assert(!val_isUndefined(value));
     Environment *env = env_ancestor(distance, environment);
     
     assert(index >= 0 && index < env->slotsUsed);
+    gcOverwrite(env->values[index], collector);
     env->values[index] = value;
+#ifdef GC_GENERATIONAL
+    // NOTE: write barrier: an old environment may now reference a young
+    //       object. The active environments are always remembered.
+    if (env->isOld && !env->isRemembered)
+    {
+        gcRememberEnvironment(env, collector);
+    }
+#endif
 }
 
-// Looks up the variable in the global environment, using a hash table.
-// If it is defined, returns a duplicate of its value, otherwise NULL and
-// error is set to an appropriate value.
-Object * env_getGlobal(const Token *identifier, Environment *globals, Error **error, GarbageCollector *collector)
+// Returns the slot of the global variable `name`. If the variable is not
+// yet defined, a slot is reserved for it so that the resolver can bind
+// references to globals that are defined later (e.g. in the REPL).
+// Returns -1 if there are no slots available.
+// NOTE: `name` must be interned.
+int32_t env_globalSlot(const char *name, Environment *globals)
 {
     assert(env_isGlobal(globals));
-    Object *value;
 #ifdef ENV_GLOBALS_USE_HASH
-    int32_t hashIndex = env_indexOf(get_identifier_name(identifier), globals);
-    if(GLOBALS_NAME(globals, hashIndex) != NULL)
+    int32_t hashIndex = env_indexOf(name, globals);
+    if (GLOBALS_NAME(globals, hashIndex) != NULL)
     {
-        int32_t index = GLOBALS_INDEX(globals, hashIndex);
-#else
-    int32_t index = env_indexOf(get_identifier_name(identifier), globals);
-    if(index < globals->slotsUsed)
+        return GLOBALS_INDEX(globals, hashIndex);
+    }
+    if (globals->slotsUsed == ENV_GLOBALS_CAPACITY)
     {
-#endif
-        value = globals->values[index];
-        if(value == NULL)
-        {
-            // NOTE: the variable was defined but not assigned a value.
-#ifdef LOX_ACCESSING_UNINIT_VAR_ERROR
-            *error = initErrorIdentifier("Accessing uninitialized variable '", identifier, "'.");
+        return -1;
+    }
+    GLOBALS_NAME(globals, hashIndex) = name;
+    GLOBALS_INDEX(globals, hashIndex) = globals->slotsUsed;
 #else
-            value = obj_newNil(collector);
-#endif
-        }
-        else
-        {
-            value = obj_dup(value, collector);
-        }
+    int32_t index = env_indexOf(name, globals);
+    if (index < globals->slotsUsed)
+    {
+        return index;
     }
-    else
+    if (globals->slotsUsed == ENV_GLOBALS_CAPACITY)
     {
-        value = NULL;
-        *error = initErrorIdentifier("Undefined variable '", identifier, "'.");
+        return -1;
     }
-    return value;
+    GLOBALS_NAME(globals, globals->slotsUsed) = name;
+#endif
+    globals->values[globals->slotsUsed] = VAL_UNBOUND;
+    return globals->slotsUsed++;
 }
 
-Error *env_assignGlobal(const Token *identifier, Object *value, Environment *globals, GarbageCollector *collector)
+// Returns the name of the global variable stored in the slot `index`.
+const char * env_globalName(int32_t index, const Environment *globals)
 {
     assert(env_isGlobal(globals));
-    assert(value != NULL);
-    
-    Error *error = NULL;
-    const char *name = get_identifier_name(identifier);
+    assert(index >= 0 && index < globals->slotsUsed);
 #ifdef ENV_GLOBALS_USE_HASH
-    int32_t hashIndex = env_indexOf(name, globals);
-    if ( GLOBALS_NAME(globals, hashIndex) != NULL)
+    for (int32_t hashIndex = 0; hashIndex < ENV_GLOBAL_HASH_SIZE; ++hashIndex)
     {
-        int32_t index = GLOBALS_INDEX(globals, hashIndex);
+        if (GLOBALS_NAME(globals, hashIndex) != NULL && GLOBALS_INDEX(globals, hashIndex) == (uint32_t)index)
+        {
+            return GLOBALS_NAME(globals, hashIndex);
+        }
+    }
+    INVALID_PATH;
+    return NULL;
 #else
-    int32_t index = env_indexOf(name, globals);
-    if(index < globals->slotsUsed)
-    {
+    return GLOBALS_NAME(globals, index);
 #endif
-        globals->values[index] = value;
+}
+
+// Removes the global variables stored after the first `slotsCount` slots.
+// NOTE: the slots are assigned in the order the names are added, so the
+//       names that are kept were all added to the hash table before the
+//       ones that are removed, and their probe sequences do not go through
+//       the entries that are cleared.
+void env_truncateGlobals(int32_t slotsCount, Environment *globals)
+{
+    assert(env_isGlobal(globals));
+    assert(slotsCount <= globals->slotsUsed);
+#ifdef ENV_GLOBALS_USE_HASH
+    for (int32_t index = 0; index < ENV_GLOBAL_HASH_SIZE; ++index)
+    {
+        if (GLOBALS_NAME(globals, index) != NULL && GLOBALS_INDEX(globals, index) >= (uint32_t)slotsCount)
+        {
+            GLOBALS_NAME(globals, index) = NULL;
+        }
     }
-    else
+#else
+    for (int32_t index = slotsCount; index < globals->slotsUsed; ++index)
     {
-        error = initErrorIdentifier("Undefined variable '", identifier, "'.");
+        GLOBALS_NAME(globals, index) = NULL;
     }
-    return error;
+#endif
+    globals->slotsUsed = slotsCount;
 }
 
 /***********************/
@@ -358,7 +480,8 @@ static void env_printGlobal(const Environment *globals)
 #ifdef ENV_GLOBALS_USE_HASH
     for(int32_t index = 0; index < ENV_GLOBAL_HASH_SIZE; ++index)
     {
-        if (GLOBALS_NAME(globals, index) != NULL)
+        if ((GLOBALS_NAME(globals, index) != NULL) &&
+            !val_isUnbound(globals->values[GLOBALS_INDEX(globals, index)]))
         {
             char *value = obj_description(globals->values[GLOBALS_INDEX(globals, index)]);
             printf(" %d. %s: %s\n", GLOBALS_INDEX(globals, index), GLOBALS_NAME(globals, index), value);
@@ -368,6 +491,10 @@ static void env_printGlobal(const Environment *globals)
 #else
     for(int32_t index = 0; index < globals->slotsUsed; ++index)
     {
+        if (val_isUnbound(globals->values[index]))
+        {
+            continue;
+        }
         char *value = obj_description(globals->values[index]);
         printf(" %d. %s: %s\n", index,  GLOBALS_NAME(globals, index), value);
         str_free(value);
@@ -16,13 +16,23 @@
 
 /* Local environments */
 
-#define ENV_MAX_CAPACITY (LOX_MAX_LOCAL_VARIABLES + 1)
+// NOTE: local environments are allocated with the number of slots computed
+//       by the resolver, rounded up to the capacity of a size class. The
+//       capacity of the size class `k` is ENV_MIN_CAPACITY << k.
+#define ENV_MIN_CAPACITY 4
+#define ENV_SIZE_CLASSES_COUNT 24
+
+// NOTE: the capacity of the largest size class, 32M slots
+#define ENV_MAX_CAPACITY (ENV_MIN_CAPACITY << (ENV_SIZE_CLASSES_COUNT - 1))
+
+#define ENV_GLOBALS_CAPACITY (LOX_MAX_GLOBAL_VARIABLES + LOX_MAX_NATIVES)
 
 typedef struct Environment_tag
 {
     struct Environment_tag *enclosing;
-    Object *values[ENV_MAX_CAPACITY];
     int32_t slotsUsed;
+    // NOTE: number of slots allocated for the values
+    int32_t capacity;
 
     /* Members used by the garbage collector */
     int32_t marked;
@@ -31,25 +41,36 @@ typedef struct Environment_tag
     // NOTE: if true, the environment and all the values it contains are
     //       marked by the garbage collector
     bool isActive;
+    // NOTE: if true, the environment is on the frame stack, and is not
+    //       recycled by the garbage collector
+    bool isFrame;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+    // NOTE: true if the environment is in the remembered set of the
+    //       garbage collector
+    bool isRemembered;
+#endif
 
 #ifdef DEBUG
     int32_t debugID;
 #endif
+    Value values[];
 } Environment;
 
 #ifdef ENV_GLOBALS_USE_HASH
 typedef struct
 {
-    char *name;
+    const char *name;
     uint32_t index;
 } EnvHashEntry;
 #endif
 
 /* Global environment */
 
+// NOTE: The global environment has ENV_GLOBALS_CAPACITY slots, followed in
+//       memory by the names of the global variables.
 typedef struct
 {
-    Environment environment;
     // NOTE: This is the hash table for the global variables.
     // If names[i] == NULL, the i-th slot is available; if not
     // index[i] yields the index in the values array where the
@@ -57,57 +78,173 @@ typedef struct
 #ifdef ENV_GLOBALS_USE_HASH
     EnvHashEntry table[ENV_GLOBAL_HASH_SIZE];
 #else
-    char *names[ENV_MAX_CAPACITY];
+    const char *names[ENV_GLOBALS_CAPACITY];
 #endif
-} EnvironmentGlobal;
+} EnvironmentGlobalNames;
 
+// Size in bytes of an environment with `capacity` slots
+#define ENV_SIZE(capacity) (sizeof(Environment) + (size_t)(capacity) * sizeof(Value))
+
+#define GLOBALS_NAMES(env) ((EnvironmentGlobalNames *)((uint8_t *)(env) + ENV_SIZE(ENV_GLOBALS_CAPACITY)))
 #ifdef ENV_GLOBALS_USE_HASH
-#define GLOBALS_NAME(env, i) ((EnvironmentGlobal *)env)->table[i].name
-#define GLOBALS_INDEX(env, i) ((EnvironmentGlobal *)env)->table[i].index
+#define GLOBALS_NAME(env, i) GLOBALS_NAMES(env)->table[i].name
+#define GLOBALS_INDEX(env, i) GLOBALS_NAMES(env)->table[i].index
 #else
-#define GLOBALS_NAME(env, i) ((EnvironmentGlobal *)env)->names[i]
+#define GLOBALS_NAME(env, i) GLOBALS_NAMES(env)->names[i]
 #endif
 
-Environment * env_init(Environment *enclosing, Error **error, GarbageCollector *collector);
+/* Frame stack */
+
+// NOTE: the environments of the scopes that are not captured by a closure
+//       are pushed on the frame stack, and popped in LIFO order when their
+//       scope ends. The garbage collector marks the values of the frames,
+//       but does not recycle them. The stack is made of segments, that are
+//       kept when they are emptied, so that the frames are never moved; a
+//       frame does not straddle two segments, and a segment is larger than
+//       ENV_FRAME_SEGMENT_SIZE when it stores a larger frame.
+typedef struct FrameSegment_tag
+{
+    struct FrameSegment_tag *previous;
+    struct FrameSegment_tag *next;
+    // NOTE: end of the frames of the segment
+    uint8_t *top;
+    uint8_t *end;
+} FrameSegment;
+
+#define FRAME_SEGMENT_BASE(segment) ((uint8_t *)(segment) + sizeof(FrameSegment))
+
+typedef struct
+{
+    // NOTE: segment of the top frame; the following ones are empty
+    FrameSegment *segment;
+    // NOTE: number of frames pushed since the stack was created
+    uint64_t framesCount;
+} FrameStack;
+
+Environment * env_init_(Environment *enclosing, int32_t slotsCount, Error **error, GarbageCollector *collector, const char *file, int line);
+// NOTE: the call site is recorded by the allocation sampler, see
+//       memory_sampler.h.
+#define env_init(enclosing, slotsCount, error, collector) env_init_(enclosing, slotsCount, error, collector, __FILE__, __LINE__)
 Environment * env_initGlobal(GarbageCollector *collector);
 void env_free(Environment *environment);
 void env_freeObjects(Environment *environment);
 
-Error * env_define(const Token *var, Object *value, Environment *environment);
-Error * env_defineGlobal(const Token *var, Object *value, Environment *globals);
-void env_defineNative(const char *name, Object *value, Environment *globals);
-Object * env_getAt(const Token *identifier, int32_t distance, int32_t index, Environment *environment, Error **error, GarbageCollector *collector);
-Error * env_assign(const char *name, Object *value, Environment *environment);
-void env_assignAt(Object *value, int32_t distance, int32_t index, Environment *environment, GarbageCollector *collector);
+void env_initFrames(FrameStack *frames);
+void env_freeFrames(FrameStack *frames);
+void env_clearFrames(FrameStack *frames);
+Environment * env_pushFrame(Environment *enclosing, int32_t slotsCount, FrameStack *frames);
+
+Error * env_define(const Token *var, Value value, Environment *environment);
+Error * env_defineGlobal(const Token *var, Value value, Environment *globals);
+void env_defineNative(const char *name, Value value, Environment *globals);
+Value env_getAt(const Token *identifier, int32_t distance, int32_t index, Environment *environment, Error **error);
+Error * env_assign(const char *name, Value value, Environment *environment);
+void env_assignAt(Value value, int32_t distance, int32_t index, Environment *environment, GarbageCollector *collector);
 
-Object * env_getGlobal(const Token *identifier, Environment *globals, Error **error, GarbageCollector *collector);
-Error * env_assignGlobal(const Token *identifier, Object *value, Environment *globals, GarbageCollector *collector);
+int32_t env_globalSlot(const char *name, Environment *globals);
+const char * env_globalName(int32_t index, const Environment *globals);
+void env_truncateGlobals(int32_t slotsCount, Environment *globals);
 
 void env_printReport(const Environment *environment);
 void env_printReportAll(const Environment *environment);
 
+// Returns the size class of the environments that can store `slotsCount` values.
+inline int32_t env_sizeClass(int32_t slotsCount)
+{
+    assert(slotsCount >= 0 && slotsCount <= ENV_MAX_CAPACITY);
+    int32_t sizeClass = 0;
+    while ((ENV_MIN_CAPACITY << sizeClass) < slotsCount)
+    {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
 // Returns true iff `environment` is the global environment
 inline bool env_isGlobal(const Environment *environment)
 {
     return environment->enclosing == NULL;
 }
 
-// Tell the garbage collector that it shouldn't automatically
-// retain all objects stored in `environment`.
-inline void env_release(Environment *environment)
+// Returns the value of the global variable stored in the slot `index`,
+// as assigned by the resolver. If the variable is not defined, returns
+// nil and `error` is set to an appropriate value.
+inline Value env_getGlobal(const Token *identifier, int32_t index, Environment *globals, Error **error)
+{
+    assert(env_isGlobal(globals));
+    assert(index >= 0 && index < globals->slotsUsed);
+    Value value = globals->values[index];
+    if (val_isUnbound(value))
+    {
+        value = VAL_NIL;
+        *error = initErrorIdentifier("Undefined variable '", identifier, "'.");
+    }
+    else if (val_isUndefined(value))
+    {
+        // NOTE: the variable was defined but not assigned a value.
+        value = VAL_NIL;
+#ifdef LOX_ACCESSING_UNINIT_VAR_ERROR
+        *error = initErrorIdentifier("Accessing uninitialized variable '", identifier, "'.");
+#endif
+    }
+    return value;
+}
+
+// Assigns `value` to the global variable stored in the slot `index`.
+// Returns an error if the variable is not defined.
+// NOTE: no write barrier is needed, as the global environment is always
+//       in the remembered set of the garbage collector, and is scanned as
+//       soon as an incremental marking starts.
+inline Error * env_assignGlobal(const Token *identifier, int32_t index, Value value, Environment *globals)
+{
+    assert(env_isGlobal(globals));
+    assert(index >= 0 && index < globals->slotsUsed);
+    assert(!val_isUndefined(value));
+    if (val_isUnbound(globals->values[index]))
+    {
+        return initErrorIdentifier("Undefined variable '", identifier, "'.");
+    }
+    globals->values[index] = value;
+    return NULL;
+}
+
+// Pops `environment`, that must be the top frame of `frames`.
+inline void env_popFrame(Environment *environment, FrameStack *frames)
 {
-    environment->isActive = false;
+    FrameSegment *segment = frames->segment;
+    assert(environment->isFrame);
+    assert((uint8_t *)environment + ENV_SIZE(environment->capacity) == segment->top);
+    segment->top = (uint8_t *)environment;
+    if (segment->top == FRAME_SEGMENT_BASE(segment) && segment->previous != NULL)
+    {
+        frames->segment = segment->previous;
+    }
+}
+
+// Releases `environment` when its scope ends: a frame is popped from
+// `frames`, otherwise the garbage collector is told that it shouldn't
+// automatically retain all objects stored in `environment`.
+inline void env_release(Environment *environment, FrameStack *frames)
+{
+    if (environment->isFrame)
+    {
+        env_popFrame(environment, frames);
+    }
+    else
+    {
+        environment->isActive = false;
+    }
 }
 
 // Defines a new variable in a local environment environment. Its value
 // is retained by the environment: the object is *not* duplicated.
-inline Error * env_defineLocal(const Token *var, Object *value, Environment *environment)
+inline Error * env_defineLocal(const Token *var, Value value, Environment *environment)
 {
     assert(!env_isGlobal(environment));
     Error *error = NULL;
     
     // NOTE: This test could be directly handled by the resolver.
-    if(environment->slotsUsed < ENV_MAX_CAPACITY)
+    if(environment->slotsUsed < environment->capacity)
     {
         environment->values[environment->slotsUsed++] = value;
     }
@@ -120,18 +257,20 @@ inline Error * env_defineLocal(const Token *var, Object *value, Environment *env
 }
 
 // Defines "this" in `environment`. `value` must be an instance object.
-inline void env_defineThis(Object *value, Environment *environment)
+inline void env_defineThis(Value value, Environment *environment)
 {
     assert(!env_isGlobal(environment));
-    assert(value->type == OT_INSTANCE);
+    assert(val_isObjectType(value, OT_INSTANCE));
+    assert(environment->slotsUsed < environment->capacity);
     environment->values[environment->slotsUsed++] = value;
 }
 
 // Defines "super" in `environment`. `value` must be an class object.
-inline void env_defineSuper(Object *value, Environment *environment)
+inline void env_defineSuper(Value value, Environment *environment)
 {
     assert(!env_isGlobal(environment));
-    assert(value->type == OT_CLASS);
+    assert(val_isObjectType(value, OT_CLASS));
+    assert(environment->slotsUsed < environment->capacity);
     environment->values[environment->slotsUsed++] = value;
 }
 
@@ -63,8 +63,8 @@ void freeError(Error *error)
 /* Error handling */
 /******************/
 
-extern bool lox_hadError_;
-extern bool lox_hadRuntimeError_;
+thread_global bool lox_hadError_ = false;
+thread_global bool lox_hadRuntimeError_ = false;
 
 static void lox_report(int line, const char *location, const char *message)
 {
@@ -95,7 +95,14 @@ void lox_error(int line, const char *message)
 
 void lox_runtimeError(Error *error)
 {
-    fprintf(stderr, "%s\n[line %d]\n", error->message, error->token->lexeme.line + 1);
+    if (error->token != NULL)
+    {
+        fprintf(stderr, "%s\n[line %d]\n", error->message, error->token->lexeme.line + 1);
+    }
+    else
+    {
+        fprintf(stderr, "%s\n", error->message);
+    }
     lox_hadRuntimeError_ = true;
 }
 
@@ -8,6 +8,8 @@
 #ifndef error_h
 #define error_h
 
+#include "common.h"
+
 struct Token_tag;
 typedef struct Token_tag Token;
 
@@ -21,6 +23,12 @@ Error * initError(const Token *token, const char *message);
 Error * initErrorString(const Token *token, char *message);
 Error * initErrorIdentifier(const char *prefixLiteral, const Token *identifier, const char *suffixLiteral);
 void freeError(Error *error);
+
+// NOTE: set when a syntax, resolution or runtime error is reported; each
+//       thread has its own flags.
+extern thread_global bool lox_hadError_;
+extern thread_global bool lox_hadRuntimeError_;
+
 void lox_token_error(const char *source, const Token *token, const char *message);
 void lox_error(int line, const char *message);
 void lox_runtimeError(Error *error);
@@ -10,223 +10,169 @@
 
 /* Expressions */
 
-Expr * init_assign(Token *name, Expr *value)
+Expr * init_assign(Token *name, Expr *value, Arena *arena)
 {
-    Assign *assign = lox_alloc(Assign);
+    Assign *assign = arena_alloc(Assign, arena);
     assign->expr.type = EXPR_Assign;
     assign->expr.next = NULL;
     assign->name = name;
     assign->value = value;
+    assign->slot = VAR_SLOT_UNRESOLVED;
     return AS_EXPR(assign);
 }
 
-Expr * init_binary(Expr *left, Token *operator, Expr *right)
+Expr * init_binary(Expr *left, Token *operator, Expr *right, Arena *arena)
 {
-    Binary *binary = lox_alloc(Binary);
+    Binary *binary = arena_alloc(Binary, arena);
     binary->expr.type = EXPR_Binary;
     binary->expr.next = NULL;
     binary->left = left;
     binary->operator = operator;
     binary->right = right;
+    binary->kind = BINARY_UNINITIALIZED;
     return AS_EXPR(binary);
 }
 
-Expr * init_call(Expr *callee, Token *paren, Expr *arguments)
+Expr * init_call(Expr *callee, Token *paren, Expr *arguments, Arena *arena)
 {
-    Call *call = lox_alloc(Call);
+    Call *call = arena_alloc(Call, arena);
     call->expr.type = EXPR_Call;
     call->expr.next = NULL;
     call->callee = callee;
     call->paren = paren;
     call->arguments = arguments;
+    call->kind = CALL_UNINITIALIZED;
     return AS_EXPR(call);
 }
 
-Expr * init_get(Expr *object, Token *name)
+Expr * init_get(Expr *object, Token *name, Arena *arena)
 {
-    Get *get = lox_alloc(Get);
+    Get *get = arena_alloc(Get, arena);
     get->expr.type = EXPR_Get;
     get->expr.next = NULL;
     get->object = object;
     get->name = name;
+    ic_init(&get->cache, IC_GET, name);
     return AS_EXPR(get);
 }
 
-Expr * init_grouping(Expr *expression)
+Expr * init_grouping(Expr *expression, Arena *arena)
 {
-    Grouping *grouping = lox_alloc(Grouping);
+    Grouping *grouping = arena_alloc(Grouping, arena);
     grouping->expr.type = EXPR_Grouping;
     grouping->expr.next = NULL;
     grouping->expression = expression;
     return AS_EXPR(grouping);
 }
 
-Expr * init_literal(Token *value)
+Expr * init_literal(Token *value, Arena *arena)
 {
-    Literal *literal = lox_alloc(Literal);
+    Literal *literal = arena_alloc(Literal, arena);
     literal->expr.type = EXPR_Literal;
     literal->expr.next = NULL;
     literal->value = *value;
     return AS_EXPR(literal);
 }
 
-Expr * init_logical(Expr *left, Token *operator, Expr *right)
+Expr * init_logical(Expr *left, Token *operator, Expr *right, Arena *arena)
 {
-    Logical *logical = lox_alloc(Logical);
+    Logical *logical = arena_alloc(Logical, arena);
     logical->expr.type = EXPR_Logical;
     logical->expr.next = NULL;
     logical->left = left;
     logical->operator = operator;
     logical->right = right;
+    logical->kind = LOGICAL_UNINITIALIZED;
     return AS_EXPR(logical);
 }
 
-Expr * init_set(Expr *object, Token *name, Expr *value)
+Expr * init_set(Expr *object, Token *name, Expr *value, Arena *arena)
 {
-    Set *set = lox_alloc(Set);
+    Set *set = arena_alloc(Set, arena);
     set->expr.type = EXPR_Set;
     set->expr.next = NULL;
     set->object = object;
     set->name = name;
     set->value = value;
+    ic_init(&set->cache, IC_SET, name);
     return AS_EXPR(set);
 }
 
-Expr * init_super(Token *keyword, Token *method)
+Expr * init_super(Token *keyword, Token *method, Arena *arena)
 {
-    Super *super = lox_alloc(Super);
+    Super *super = arena_alloc(Super, arena);
     super->expr.type = EXPR_Super;
     super->expr.next = NULL;
     super->keyword = keyword;
     super->method = method;
+    super->slot = VAR_SLOT_UNRESOLVED;
+    ic_init(&super->cache, IC_SUPER, method);
     return AS_EXPR(super);
 }
 
 
-Expr * init_this(Token *keyword)
+Expr * init_this(Token *keyword, Arena *arena)
 {
-    This *this = lox_alloc(This);
+    This *this = arena_alloc(This, arena);
     this->expr.type = EXPR_This;
     this->expr.next = NULL;
     this->keyword = keyword;
+    this->slot = VAR_SLOT_UNRESOLVED;
     return AS_EXPR(this);
 }
 
-Expr * init_unary(Token *operator, Expr *right)
+Expr * init_unary(Token *operator, Expr *right, Arena *arena)
 {
-    Unary *unary = lox_alloc(Unary);
+    Unary *unary = arena_alloc(Unary, arena);
     unary->expr.type = EXPR_Unary;
     unary->expr.next = NULL;
     unary->operator = operator;
     unary->right = right;
+    unary->kind = UNARY_UNINITIALIZED;
     return AS_EXPR(unary);
 }
 
-Expr * init_variable(Token *name)
+Expr * init_variable(Token *name, Arena *arena)
 {
-    Variable *variable = lox_alloc(Variable);
+    Variable *variable = arena_alloc(Variable, arena);
     variable->expr.type = EXPR_Variable;
     variable->expr.next = NULL;
     variable->name = name;
+    variable->slot = VAR_SLOT_UNRESOLVED;
     return AS_EXPR(variable);
 }
 
-Expr * init_bool_literal(bool value)
+Expr * init_bool_literal(bool value, Arena *arena)
 {
-    Literal *literal = lox_alloc(Literal);
+    Literal *literal = arena_alloc(Literal, arena);
     literal->expr.type = EXPR_Literal;
     literal->expr.next = NULL;
     literal->value.type = value ? TT_TRUE : TT_FALSE;
     literal->value.literal = NULL;
-    literal->value.nextInScan = NULL;
     return AS_EXPR(literal);
 }
 
-Expr * init_nil_literal()
+Expr * init_nil_literal(Arena *arena)
 {
-    Literal *literal = lox_alloc(Literal);
+    Literal *literal = arena_alloc(Literal, arena);
     literal->expr.type = EXPR_Literal;
     literal->expr.next = NULL;
     literal->value.type = TT_NIL;
     literal->value.literal = NULL;
-    literal->value.nextInScan = NULL;
     return AS_EXPR(literal);
 }
 
-Expr * init_number_literal(double value)
+Expr * init_number_literal(double value, Arena *arena)
 {
-    Literal *literal = lox_alloc(Literal);
+    Literal *literal = arena_alloc(Literal, arena);
     literal->expr.type = EXPR_Literal;
     literal->expr.next = NULL;
     literal->value.type = TT_NUMBER;
     literal->value.number = value;
     literal->value.literal = NULL;
-    literal->value.nextInScan = NULL;
     return AS_EXPR(literal);
 }
 
-// NOTE: The tokens are owned by the token list in the scanner,
-//       and must not be freed here.
-void free_expr(Expr *expr)
-{
-   while(expr)
-   {
-       switch (expr->type) {
-           case EXPR_Assign: {
-               Assign *assign = (Assign *)expr;
-               free_expr(assign->value);
-           } break;
-           case EXPR_Binary: {
-               Binary *binary = (Binary *)expr;
-               free_expr(binary->left);
-               free_expr(binary->right);
-           } break;
-           case EXPR_Call: {
-               Call *call = (Call *)expr;
-               free_expr(call->callee);
-               free_expr(call->arguments);
-           } break;
-           case EXPR_Get: {
-               Get *get = (Get *)expr;
-               free_expr(get->object);
-           } break;
-           case EXPR_Grouping: {
-               Grouping *grouping = (Grouping *)expr;
-               free_expr(grouping->expression);
-           } break;
-           case EXPR_Literal: {
-               // do nothing
-           } break;
-           case EXPR_Logical: {
-               Logical *logical = (Logical *)expr;
-               free_expr(logical->left);
-               free_expr(logical->right);
-           } break;
-           case EXPR_Set: {
-               Set *set = (Set *)expr;
-               free_expr(set->object);
-               free_expr(set->value);
-           } break;
-           case EXPR_Super: {
-               // do nothing
-           } break;
-           case EXPR_This: {
-               // do nothing
-           } break;
-           case EXPR_Unary: {
-               Unary *unary = (Unary *)expr;
-               free_expr(unary->right);
-           } break;
-           case EXPR_Variable: {
-               // do nothing
-           } break;
-       }
-       Expr *next = expr->next;
-       lox_free(expr);
-       expr = next;
-   }
-}
-
 // Returns the count of element in the list elements
 int32_t expr_count(Expr *elements)
 {
@@ -263,11 +209,17 @@ Expr * expr_appendTo(Expr *head, Expr *tail)
     return head;
 }
 
-Expr * make_test_expr()
+Expr * make_test_expr(Arena *arena)
 {
-    Expr *expr = init_binary(init_unary(token_atomic(TT_MINUS, (Lexeme){{0, 0, 0}}), init_number_literal(123)),
-                             token_atomic(TT_STAR, (Lexeme){{0, 0, 0}}),
-                             init_grouping(init_number_literal(45.67)));
+    // NOTE: the expression references the tokens, that must outlive it
+    static thread_global Token minus;
+    static thread_global Token star;
+    minus = token_atomic(TT_MINUS, (Lexeme){{0, 0, 0}});
+    star = token_atomic(TT_STAR, (Lexeme){{0, 0, 0}});
+    Expr *expr = init_binary(init_unary(&minus, init_number_literal(123, arena), arena),
+                             &star,
+                             init_grouping(init_number_literal(45.67, arena), arena),
+                             arena);
     return expr;
 }
 
@@ -8,6 +8,8 @@
 #ifndef expr_h
 #define expr_h
 
+#include "arena.h"
+#include "inline_cache.h"
 #include "token.h"
 
 /*
@@ -49,31 +51,92 @@ typedef struct Expr_tag
     struct Expr_tag *next;
 } Expr;
 
+// NOTE: Location of a variable, as computed by the resolver. For local
+//       variables, `depth` is the number of environments between the
+//       current one and the one where the variable is stored, and `index`
+//       its slot in that environment. Global variables have depth
+//       VAR_DEPTH_GLOBAL, and `index` is their slot in the globals.
+typedef struct
+{
+    int32_t depth;
+    int32_t index;
+} VariableSlot;
+
+#define VAR_DEPTH_GLOBAL -1
+
+// NOTE: the slot of a variable that has not been resolved yet
+#define VAR_SLOT_UNRESOLVED ((VariableSlot){VAR_DEPTH_GLOBAL, -1})
+
 #define AS_EXPR(expr) (Expr *)expr
 
-Expr * init_assign(Token *name, Expr *value);
-Expr * init_binary(Expr *left, Token *operator, Expr *right);
-Expr * init_call(Expr *callee, Token *paren, Expr *arguments);
-Expr * init_get(Expr *object, Token *name);
-Expr * init_grouping(Expr *expression);
-Expr * init_literal(Token *value);
-Expr * init_logical(Expr *left, Token *operator, Expr *right);
-Expr * init_set(Expr *object, Token *name, Expr *value);
-Expr * init_super(Token *keyword, Token *method);
-Expr * init_this(Token *keyword);
-Expr * init_unary(Token *operator, Expr *right);
-Expr * init_variable(Token *name);
-
-Expr * init_bool_literal(bool value);
-Expr * init_nil_literal(void);
-Expr * init_number_literal(double value);
-
-void free_expr(Expr *expr);
+// NOTE: the specializations of the nodes for the types of the operands or of
+//       the callee seen by the interpreter. A node is uninitialized until its
+//       first evaluation, that specializes it, and each evaluation guards
+//       the types it was specialized for. When a guard fails, the node falls
+//       back to the generic evaluation for good. See INTERPRETER_QUICKENING.
+typedef enum
+{
+    BINARY_UNINITIALIZED,
+    BINARY_GENERIC,
+    BINARY_CONCAT_STRINGS,
+    // NOTE: the operations on two numbers must come last
+    BINARY_ADD_NUMBERS,
+    BINARY_SUBTRACT_NUMBERS,
+    BINARY_MULTIPLY_NUMBERS,
+    BINARY_DIVIDE_NUMBERS,
+    BINARY_GREATER_NUMBERS,
+    BINARY_GREATER_EQUAL_NUMBERS,
+    BINARY_LESS_NUMBERS,
+    BINARY_LESS_EQUAL_NUMBERS,
+} BinaryKind;
+
+typedef enum
+{
+    UNARY_UNINITIALIZED,
+    UNARY_GENERIC,
+    UNARY_NEGATE_NUMBER,
+    UNARY_NOT_BOOLEAN,
+} UnaryKind;
+
+typedef enum
+{
+    LOGICAL_UNINITIALIZED,
+    LOGICAL_GENERIC,
+    // NOTE: the left operand is a boolean
+    LOGICAL_BOOLEAN,
+} LogicalKind;
+
+typedef enum
+{
+    CALL_UNINITIALIZED,
+    CALL_GENERIC,
+    CALL_METHOD,
+    CALL_FUNCTION,
+    CALL_NATIVE,
+    CALL_CLASS,
+} CallKind;
+
+Expr * init_assign(Token *name, Expr *value, Arena *arena);
+Expr * init_binary(Expr *left, Token *operator, Expr *right, Arena *arena);
+Expr * init_call(Expr *callee, Token *paren, Expr *arguments, Arena *arena);
+Expr * init_get(Expr *object, Token *name, Arena *arena);
+Expr * init_grouping(Expr *expression, Arena *arena);
+Expr * init_literal(Token *value, Arena *arena);
+Expr * init_logical(Expr *left, Token *operator, Expr *right, Arena *arena);
+Expr * init_set(Expr *object, Token *name, Expr *value, Arena *arena);
+Expr * init_super(Token *keyword, Token *method, Arena *arena);
+Expr * init_this(Token *keyword, Arena *arena);
+Expr * init_unary(Token *operator, Expr *right, Arena *arena);
+Expr * init_variable(Token *name, Arena *arena);
+
+Expr * init_bool_literal(bool value, Arena *arena);
+Expr * init_nil_literal(Arena *arena);
+Expr * init_number_literal(double value, Arena *arena);
 
 int32_t expr_count(Expr *elements);
 Expr * expr_appendTo(Expr *head, Expr *tail);
 
-Expr * make_test_expr(void);
+Expr * make_test_expr(Arena *arena);
 
 // NOTE:   "Assign   : Token name, Expr value",
 typedef struct
@@ -81,6 +144,7 @@ typedef struct
     Expr expr;
     Token *name;
     Expr *value;
+    VariableSlot slot;
 } Assign;
 
 // NOTE: "Binary   : Expr left, Token operator, Expr right",
@@ -90,6 +154,7 @@ typedef struct
     Expr *left;
     Token *operator;
     Expr *right;
+    BinaryKind kind;
 } Binary;
 
 // NOTE:  "Call     : Expr callee, Token paren, List<Expr> arguments",
@@ -99,6 +164,7 @@ typedef struct
     Expr *callee;
     Token *paren; // token for the closing parenthesis; its location is used when reporting a runtime error
     Expr *arguments; // List of expressions
+    CallKind kind;
 } Call;
 
 // NOTE:  "Get      : Expr object, Token name",
@@ -107,6 +173,7 @@ typedef struct
     Expr expr;
     Expr *object;
     Token *name;
+    InlineCache cache;
 } Get;
 
 // NOTE:  "Grouping : Expr expression",
@@ -130,6 +197,7 @@ typedef struct
     Expr *left;
     Token *operator;
     Expr *right;
+    LogicalKind kind;
 } Logical;
 
 // NOTE: "Set      : Expr object, Token name, Expr value",
@@ -139,6 +207,7 @@ typedef struct
     Expr *object;
     Token *name;
     Expr *value;
+    InlineCache cache;
 } Set;
 
 // NOTE: "Super    : Token keyword, Token method",
@@ -147,6 +216,8 @@ typedef struct
     Expr expr;
     Token *keyword;
     Token *method;
+    VariableSlot slot;
+    InlineCache cache;
 } Super;
 
 // NOTE: "This     : Token keyword",
@@ -154,6 +225,7 @@ typedef struct
 {
     Expr expr;
     Token *keyword;
+    VariableSlot slot;
 } This;
 
 // NOTE: "Unary    : Token operator, Expr right",
@@ -162,6 +234,7 @@ typedef struct
     Expr expr;
     Token *operator;
     Expr *right;
+    UnaryKind kind;
 } Unary;
 
 // NOTE: "Variable : Token name"
@@ -169,6 +242,7 @@ typedef struct
 {
     Expr expr;
     Token *name;
+    VariableSlot slot;
 } Variable;
 
 /***********/
@@ -8,26 +8,50 @@
 #include "garbage_collector.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "common.h"
+#include "lox_array.h"
 #include "lox_class.h"
 #include "lox_function.h"
 #include "lox_instance.h"
+#include "lox_map.h"
+#include "memory_pool.h"
 #include "objects.h"
 #include "string.h"
+#include "tracer.h"
+#include "utility.h"
 
-extern inline bool gcLock(Object *object, GarbageCollector *collector);
+#ifdef GC_PARALLEL_MARK
+#include <pthread.h>
+#endif
+
+extern inline bool gcLock(Value value, GarbageCollector *collector);
+extern inline void gcOverwrite(Value value, GarbageCollector *collector);
 extern inline void gcPopLock(GarbageCollector *collector);
 extern inline void gcPopLockn(int32_t n, GarbageCollector *collector);
 extern inline void gcClearLocks(GarbageCollector *collector);
 
 
+static void gcCollectMajor(GarbageCollector *collector);
+static void gcMarkSlice(int32_t budget, GarbageCollector *collector);
+static void gcInitMarker(GCMarker *marker, GarbageCollector *collector);
+static void gcFreeMarker(GCMarker *marker);
+
+#ifdef GC_GENERATIONAL
+static void gcCollectMinor(GarbageCollector *collector);
+
+// NOTE: initial capacity of the arrays of the remembered set
+#define GC_REMEMBERED_INITIAL_CAPACITY 64
+#endif
+
 #define GC_OBJECT_SIZE (sizeof(Object))
 #define GC_OBJECTS_PER_PAGE ((PAGE_SIZE - sizeof(MemoryPage)) / GC_OBJECT_SIZE)
 
 static void gcAllocObjects(GarbageCollector *collector)
 {
-    MemoryPage *page = (MemoryPage *)lox_allocn(uint8_t, PAGE_SIZE);
+    // NOTE: the objects are sampled one by one in objNew()
+    MemoryPage *page = (MemoryPage *)lox_allocnUnsampled(uint8_t, PAGE_SIZE);
     if(page == NULL)
     {
         fatal_outOfMemory();
@@ -74,20 +98,64 @@ GarbageCollector *gcInit()
     collector->maxObjects = 0;
     
     collector->firstEnvironment = NULL;
-    collector->firstUnusedEnvironment = NULL;
+    for (int32_t sizeClass = 0; sizeClass < ENV_SIZE_CLASSES_COUNT; ++sizeClass)
+    {
+        collector->firstUnusedEnvironment[sizeClass] = NULL;
+    }
 
     collector->environmentsCount = 0;
     collector->maxEnvironments = GC_INITIAL_ENVIRONMENTS_THRESHOLD;
 
     collector->visitedMark = 0;
     collector->recycledMark = 1;
+    collector->locked = lox_allocn(Value, GC_LOCKS_INITIAL_SIZE);
+    if (collector->locked == NULL)
+    {
+        fatal_outOfMemory();
+    }
     collector->lockedCount = 0;
+    collector->lockedCapacity = GC_LOCKS_INITIAL_SIZE;
+    collector->frames = NULL;
+    collector->globals = NULL;
+
+    gcInitMarker(&collector->marker, collector);
+    collector->allocationMark = GC_CLEAR;
+    collector->isIncremental = false;
+    collector->isMarking = false;
+    collector->sliceAllocationsCount = 0;
+    collector->markThreadsCount = 1;
+    collector->isPaused = false;
 
     collector->memoryPages = NULL;
 
     collector->activeObjectsCount = 0;
     collector->activeEnvironmentsCount = 0;
 
+    memset(&collector->stats, 0, sizeof(GCStats));
+    collector->log = NULL;
+
+#ifdef GC_GENERATIONAL
+    collector->firstYoungObject = NULL;
+    collector->youngObjectsCount = 0;
+    collector->firstYoungEnvironment = NULL;
+    collector->youngEnvironmentsCount = 0;
+    collector->rememberedEnvironments = NULL;
+    collector->rememberedEnvironmentsCount = 0;
+    collector->rememberedEnvironmentsCapacity = 0;
+    collector->rememberedInstances = NULL;
+    collector->rememberedInstancesCount = 0;
+    collector->rememberedInstancesCapacity = 0;
+    collector->rememberedArrays = NULL;
+    collector->rememberedArraysCount = 0;
+    collector->rememberedArraysCapacity = 0;
+    collector->rememberedMaps = NULL;
+    collector->rememberedMapsCount = 0;
+    collector->rememberedMapsCapacity = 0;
+    collector->maxOldObjects = GC_NURSERY_OBJECTS;
+    collector->maxOldEnvironments = GC_NURSERY_ENVIRONMENTS;
+    collector->isMinorCollection = false;
+#endif
+
 #ifdef GC_KEEPS_STATS
     collector->unusedObjectsCount = 0;
     collector->unusedEnvironmentsCount = 0;
@@ -109,14 +177,48 @@ static inline void objFree(Object *object)
 #endif
 }
 
-Object * gcGetObject(GarbageCollector *collector)
+// Counts an allocation that takes place while an incremental marking is in
+// progress, and marks a slice of the heap every
+// GC_INCREMENTAL_SLICE_ALLOCATIONS allocations.
+static inline void gcStepMarking(GarbageCollector *collector)
 {
 #ifdef GC_DEBUG
-    gcCollect(collector);
+    gcMarkSlice(GC_INCREMENTAL_SLICE_WORK, collector);
+#else
+    if (++collector->sliceAllocationsCount >= GC_INCREMENTAL_SLICE_ALLOCATIONS)
+    {
+        gcMarkSlice(GC_INCREMENTAL_SLICE_WORK, collector);
+    }
+#endif
+}
+
+// Collects the heap before an allocation, when it is needed.
+static void gcCollectBeforeObject(GarbageCollector *collector)
+{
+    if (collector->isMarking)
+    {
+        gcStepMarking(collector);
+    }
+#ifdef GC_DEBUG
+    else
+    {
+#ifdef GC_GENERATIONAL
+        gcCollectMinor(collector);
+#else
+        gcCollect(collector);
+#endif
+    }
 #endif
 #ifdef GC_KEEPS_STATS
     assert(collector->activeObjectsCount + collector->unusedObjectsCount == collector->objectsCount);
 #endif
+#ifdef GC_GENERATIONAL
+    // NOTE: the nursery grows while an incremental marking is in progress
+    if (collector->youngObjectsCount >= GC_NURSERY_OBJECTS && !collector->isMarking)
+    {
+        gcCollectMinor(collector);
+    }
+#else
     if (collector->firstUnused == NULL)
     {
 #ifdef GC_KEEPS_STATS
@@ -124,49 +226,137 @@ Object * gcGetObject(GarbageCollector *collector)
 #endif
         if (collector->objectsCount >= collector->maxObjects)
         {
-            gcCollect(collector);
-        }
-        if (collector->firstUnused == NULL)
-        {
-            gcAllocObjects(collector);
+            gcCollectMajor(collector);
         }
     }
+#endif
+}
+
+Object * gcGetObject(GarbageCollector *collector)
+{
+    if (!collector->isPaused)
+    {
+        gcCollectBeforeObject(collector);
+    }
+    if (collector->firstUnused == NULL)
+    {
+        gcAllocObjects(collector);
+    }
     
     Object *object = collector->firstUnused;
     collector->firstUnused = object->next;
 
+#ifdef GC_GENERATIONAL
+    object->next = collector->firstYoungObject;
+    collector->firstYoungObject = object;
+    object->isOld = false;
+    ++collector->youngObjectsCount;
+#else
     object->next = collector->firstObject;
     collector->firstObject = object;
+#endif
     ++collector->activeObjectsCount;
+    ++collector->stats.allocatedObjectsCount;
+    if (collector->activeObjectsCount > collector->stats.peakObjectsCount)
+    {
+        collector->stats.peakObjectsCount = collector->activeObjectsCount;
+    }
 
 #ifdef GC_KEEPS_STATS
     --collector->unusedObjectsCount;
 #endif
     
-    object->marked = GC_CLEAR;
+    object->marked = collector->allocationMark;
+    if (collector->isMarking)
+    {
+        ++collector->markingSample.activeObjectsCount;
+        ++collector->markingSample.visitedObjectsCount;
+    }
 
     return object;
 }
 
-// Returns a new environment, or NULL if it could not be allocated.
-Environment * gcGetEnvironment(GarbageCollector *collector)
+// Doubles the capacity of the stack of locked values. Returns false if the
+// stack already has the maximum size.
+bool gcGrowLocks(GarbageCollector *collector)
 {
+    if (collector->lockedCapacity >= GC_LOCKS_MAX_SIZE)
+    {
+        return false;
+    }
+    int32_t capacity = min(2 * collector->lockedCapacity, GC_LOCKS_MAX_SIZE);
+    Value *locked = lox_allocn(Value, capacity);
+    if (locked == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memcpy(locked, collector->locked, collector->lockedCount * sizeof(Value));
+    lox_free(collector->locked);
+    collector->locked = locked;
+    collector->lockedCapacity = capacity;
+    return true;
+}
+
+// Returns a new environment with at least `slotsCount` slots, or NULL if
+// it could not be allocated.
+// Collects the heap before the allocation of an environment of the size
+// class `sizeClass`, when it is needed.
+static void gcCollectBeforeEnvironment(int32_t sizeClass, GarbageCollector *collector)
+{
+    if (collector->isMarking)
+    {
+        gcStepMarking(collector);
+    }
 #ifdef GC_DEBUG
-    gcCollect(collector);
+    else
+    {
+#ifdef GC_GENERATIONAL
+        gcCollectMinor(collector);
+#else
+        gcCollect(collector);
 #endif
-    if(collector->firstUnusedEnvironment == NULL)
+    }
+#endif
+#ifdef GC_GENERATIONAL
+    if (collector->youngEnvironmentsCount >= GC_NURSERY_ENVIRONMENTS && !collector->isMarking)
+    {
+        gcCollectMinor(collector);
+    }
+    // NOTE: the old generation may hold enough garbage to reach the
+    //       maximum number of environments before a major collection.
+    if (collector->firstUnusedEnvironment[sizeClass] == NULL &&
+        collector->environmentsCount >= LOX_MAX_ENVIRONMENTS)
+    {
+        gcCollect(collector);
+    }
+#else
+    if(collector->firstUnusedEnvironment[sizeClass] == NULL)
     {
-        if (collector->environmentsCount >= collector->maxEnvironments)
+        if (collector->environmentsCount >= LOX_MAX_ENVIRONMENTS)
         {
             gcCollect(collector);
         }
+        else if (collector->environmentsCount >= collector->maxEnvironments)
+        {
+            gcCollectMajor(collector);
+        }
+    }
+#endif
+}
+
+Environment * gcGetEnvironment_(int32_t slotsCount, GarbageCollector *collector, const char *file, int line)
+{
+    int32_t sizeClass = env_sizeClass(slotsCount);
+    if (!collector->isPaused)
+    {
+        gcCollectBeforeEnvironment(sizeClass, collector);
     }
     
     Environment *environment;
-    if (collector->firstUnusedEnvironment)
+    if (collector->firstUnusedEnvironment[sizeClass])
     {
-        environment = collector->firstUnusedEnvironment;
-        collector->firstUnusedEnvironment = environment->next;
+        environment = collector->firstUnusedEnvironment[sizeClass];
+        collector->firstUnusedEnvironment[sizeClass] = environment->next;
 #ifdef GC_KEEPS_STATS
         --collector->unusedEnvironmentsCount;
 #endif
@@ -177,17 +367,29 @@ Environment * gcGetEnvironment(GarbageCollector *collector)
         {
             return NULL;
         }
-        environment = lox_alloc(Environment);
-        if(environment == NULL)
-        {
-            fatal_outOfMemory();
-        }
+        int32_t capacity = ENV_MIN_CAPACITY << sizeClass;
+        size_t size = ENV_SIZE(capacity);
+        environment = (Environment *)slabAlloc_(size, file, line);
+        environment->capacity = capacity;
         ++collector->environmentsCount;
     }
+#ifdef GC_GENERATIONAL
+    environment->next = collector->firstYoungEnvironment;
+    collector->firstYoungEnvironment = environment;
+    environment->isOld = false;
+    environment->isRemembered = false;
+    ++collector->youngEnvironmentsCount;
+#else
     environment->next = collector->firstEnvironment;
     collector->firstEnvironment = environment;
-    environment->marked = GC_CLEAR;
+#endif
+    environment->marked = collector->allocationMark;
     ++collector->activeEnvironmentsCount;
+    if (collector->isMarking)
+    {
+        ++collector->markingSample.activeEnvironmentsCount;
+        ++collector->markingSample.visitedEnvironmentsCount;
+    }
 
     return environment;
 }
@@ -200,94 +402,797 @@ void gcSetGlobalEnvironment(Environment *globals, GarbageCollector *collector)
     collector->firstEnvironment = globals;
     globals->marked = GC_CLEAR;
     ++collector->activeEnvironmentsCount;
+    collector->globals = globals;
+#ifdef GC_GENERATIONAL
+    // NOTE: the global environment is old and always remembered, so that
+    //       the assignments of global variables need no write barrier.
+    globals->isOld = true;
+    globals->isRemembered = false;
+    gcRememberEnvironment(globals, collector);
+#endif
+}
+
+// Sets the frame stack of the interpreter, whose frames are roots of the
+// collections.
+void gcSetFrameStack(const FrameStack *frames, GarbageCollector *collector)
+{
+    collector->frames = frames;
+}
+
+#ifdef GC_GENERATIONAL
+// Adds the old `environment` to the remembered set, so that the young
+// objects it references are marked by the next minor collection.
+void gcRememberEnvironment(Environment *environment, GarbageCollector *collector)
+{
+    assert(environment->isOld && !environment->isRemembered);
+    if (collector->rememberedEnvironmentsCount == collector->rememberedEnvironmentsCapacity)
+    {
+        int32_t capacity = collector->rememberedEnvironmentsCapacity == 0 ? GC_REMEMBERED_INITIAL_CAPACITY : 2 * collector->rememberedEnvironmentsCapacity;
+        Environment **environments = lox_allocn(Environment *, capacity);
+        if (environments == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        for (int32_t index = 0; index < collector->rememberedEnvironmentsCount; ++index)
+        {
+            environments[index] = collector->rememberedEnvironments[index];
+        }
+        if (collector->rememberedEnvironments != NULL)
+        {
+            lox_free(collector->rememberedEnvironments);
+        }
+        collector->rememberedEnvironments = environments;
+        collector->rememberedEnvironmentsCapacity = capacity;
+    }
+    collector->rememberedEnvironments[collector->rememberedEnvironmentsCount++] = environment;
+    environment->isRemembered = true;
+}
+
+// Adds the old `instance` to the remembered set, so that the young objects
+// stored in its fields are marked by the next minor collection.
+void gcRememberInstance(LoxInstance *instance, GarbageCollector *collector)
+{
+    assert(instance->isOld && !instance->isRemembered);
+    if (collector->rememberedInstancesCount == collector->rememberedInstancesCapacity)
+    {
+        int32_t capacity = collector->rememberedInstancesCapacity == 0 ? GC_REMEMBERED_INITIAL_CAPACITY : 2 * collector->rememberedInstancesCapacity;
+        LoxInstance **instances = lox_allocn(LoxInstance *, capacity);
+        if (instances == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        for (int32_t index = 0; index < collector->rememberedInstancesCount; ++index)
+        {
+            instances[index] = collector->rememberedInstances[index];
+        }
+        if (collector->rememberedInstances != NULL)
+        {
+            lox_free(collector->rememberedInstances);
+        }
+        collector->rememberedInstances = instances;
+        collector->rememberedInstancesCapacity = capacity;
+    }
+    collector->rememberedInstances[collector->rememberedInstancesCount++] = instance;
+    instance->isRemembered = true;
+}
+
+// Adds the old `array` to the remembered set, so that the young objects
+// stored in its values are marked by the next minor collection.
+void gcRememberArray(LoxArray *array, GarbageCollector *collector)
+{
+    assert(array->isOld && !array->isRemembered);
+    if (collector->rememberedArraysCount == collector->rememberedArraysCapacity)
+    {
+        int32_t capacity = collector->rememberedArraysCapacity == 0 ? GC_REMEMBERED_INITIAL_CAPACITY : 2 * collector->rememberedArraysCapacity;
+        LoxArray **arrays = lox_allocn(LoxArray *, capacity);
+        if (arrays == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        for (int32_t index = 0; index < collector->rememberedArraysCount; ++index)
+        {
+            arrays[index] = collector->rememberedArrays[index];
+        }
+        if (collector->rememberedArrays != NULL)
+        {
+            lox_free(collector->rememberedArrays);
+        }
+        collector->rememberedArrays = arrays;
+        collector->rememberedArraysCapacity = capacity;
+    }
+    collector->rememberedArrays[collector->rememberedArraysCount++] = array;
+    array->isRemembered = true;
+}
+
+// Adds the old `map` to the remembered set, so that the young objects
+// stored in its keys and values are marked by the next minor collection.
+void gcRememberMap(LoxMap *map, GarbageCollector *collector)
+{
+    assert(map->isOld && !map->isRemembered);
+    if (collector->rememberedMapsCount == collector->rememberedMapsCapacity)
+    {
+        int32_t capacity = collector->rememberedMapsCapacity == 0 ? GC_REMEMBERED_INITIAL_CAPACITY : 2 * collector->rememberedMapsCapacity;
+        LoxMap **maps = lox_allocn(LoxMap *, capacity);
+        if (maps == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        for (int32_t index = 0; index < collector->rememberedMapsCount; ++index)
+        {
+            maps[index] = collector->rememberedMaps[index];
+        }
+        if (collector->rememberedMaps != NULL)
+        {
+            lox_free(collector->rememberedMaps);
+        }
+        collector->rememberedMaps = maps;
+        collector->rememberedMapsCapacity = capacity;
+    }
+    collector->rememberedMaps[collector->rememberedMapsCount++] = map;
+    map->isRemembered = true;
+}
+
+// Empties the remembered set, once the young objects it references have
+// been marked. The active environments stay, as their variables can be
+// assigned without a write barrier.
+// NOTE: must be called before the sweep, that may free the instances, the
+//       arrays, the maps and the inactive environments.
+static void gcForgetRemembered(GarbageCollector *collector)
+{
+    int32_t count = 0;
+    for (int32_t index = 0; index < collector->rememberedEnvironmentsCount; ++index)
+    {
+        Environment *environment = collector->rememberedEnvironments[index];
+        if (environment->isActive)
+        {
+            collector->rememberedEnvironments[count++] = environment;
+        }
+        else
+        {
+            environment->isRemembered = false;
+        }
+    }
+    collector->rememberedEnvironmentsCount = count;
+
+    for (int32_t index = 0; index < collector->rememberedInstancesCount; ++index)
+    {
+        collector->rememberedInstances[index]->isRemembered = false;
+    }
+    collector->rememberedInstancesCount = 0;
+
+    for (int32_t index = 0; index < collector->rememberedArraysCount; ++index)
+    {
+        collector->rememberedArrays[index]->isRemembered = false;
+    }
+    collector->rememberedArraysCount = 0;
+
+    for (int32_t index = 0; index < collector->rememberedMapsCount; ++index)
+    {
+        collector->rememberedMaps[index]->isRemembered = false;
+    }
+    collector->rememberedMapsCount = 0;
+}
+#endif
+
+/* Marking */
+
+// NOTE: the entries of the mark stack are pointers to the structures, with
+//       their type in the lowest bits.
+#define GC_ENTRY_ENVIRONMENT 0
+#define GC_ENTRY_CLASS 1
+#define GC_ENTRY_FUNCTION 2
+#define GC_ENTRY_INSTANCE 3
+#define GC_ENTRY_ARRAY 4
+#define GC_ENTRY_MAP 5
+// NOTE: the structures are allocated at least 8 bytes aligned
+#define GC_ENTRY_TYPE_MASK ((uintptr_t)7)
+#define GC_ENTRY(pointer, type) ((uintptr_t)(pointer) | (type))
+#define GC_ENTRY_POINTER(entry) ((void *)((entry) & ~GC_ENTRY_TYPE_MASK))
+
+#ifdef GC_PARALLEL_MARK
+// NOTE: the threads of a parallel marking look for idle threads to share
+//       their work with every GC_SHARE_INTERVAL structures, a power of 2.
+#define GC_SHARE_INTERVAL 64
+
+typedef struct GCParallelMark_tag
+{
+    // NOTE: also serializes the allocations of the threads
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    // NOTE: segments given away by the threads, for the idle ones
+    GCMarkSegment *sharedSegments;
+    int32_t markersCount;
+    int32_t idleCount;
+    bool isDone;
+} GCParallelMark;
+#endif
+
+static inline void gcLockAllocator(GCMarker *marker)
+{
+#ifdef GC_PARALLEL_MARK
+    if (marker->parallel != NULL)
+    {
+        pthread_mutex_lock(&marker->parallel->mutex);
+    }
+#endif
+}
+
+static inline void gcUnlockAllocator(GCMarker *marker)
+{
+#ifdef GC_PARALLEL_MARK
+    if (marker->parallel != NULL)
+    {
+        pthread_mutex_unlock(&marker->parallel->mutex);
+    }
+#endif
+}
+
+static GCMarkSegment * gcAllocMarkSegment(GCMarker *marker)
+{
+    GCMarkSegment *segment = marker->spare;
+    if (segment != NULL)
+    {
+        marker->spare = NULL;
+        return segment;
+    }
+    gcLockAllocator(marker);
+    segment = lox_alloc(GCMarkSegment);
+    gcUnlockAllocator(marker);
+    if (segment == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    segment->previous = NULL;
+    segment->count = 0;
+    return segment;
+}
+
+// Keeps the empty `segment` for reuse, or frees it.
+static void gcReleaseMarkSegment(GCMarkSegment *segment, GCMarker *marker)
+{
+    assert(segment->count == 0);
+    if (marker->spare == NULL)
+    {
+        segment->previous = NULL;
+        marker->spare = segment;
+        return;
+    }
+    gcLockAllocator(marker);
+    lox_free(segment);
+    gcUnlockAllocator(marker);
+}
+
+static void gcInitMarker(GCMarker *marker, GarbageCollector *collector)
+{
+    marker->collector = collector;
+    marker->parallel = NULL;
+    marker->spare = NULL;
+    marker->segment = gcAllocMarkSegment(marker);
+}
+
+static void gcFreeMarker(GCMarker *marker)
+{
+    assert(marker->parallel == NULL);
+    GCMarkSegment *segment = marker->segment;
+    while (segment != NULL)
+    {
+        GCMarkSegment *previous = segment->previous;
+        lox_free(segment);
+        segment = previous;
+    }
+    if (marker->spare != NULL)
+    {
+        lox_free(marker->spare);
+    }
+}
+
+static inline bool gcIsMarkStackEmpty(const GCMarker *marker)
+{
+    return marker->segment->count == 0 && marker->segment->previous == NULL;
+}
+
+static void gcGrowMarkStack(GCMarker *marker)
+{
+    GCMarkSegment *segment = gcAllocMarkSegment(marker);
+    segment->previous = marker->segment;
+    marker->segment = segment;
+}
+
+static inline void gcPush(uintptr_t entry, GCMarker *marker)
+{
+    if (marker->segment->count == GC_MARK_SEGMENT_ENTRIES)
+    {
+        gcGrowMarkStack(marker);
+    }
+    GCMarkSegment *segment = marker->segment;
+    segment->entries[segment->count++] = entry;
 }
 
-static void gcMarkEnvironment(Environment *environment, GarbageCollector *collector);
-static void gcMarkObject(Object *object, GarbageCollector *collector);
+// Pops an entry of the mark stack in `entry`. Returns false if the stack
+// is empty.
+// NOTE: the segments below the top one are full.
+static inline bool gcPop(uintptr_t *entry, GCMarker *marker)
+{
+    GCMarkSegment *segment = marker->segment;
+    if (segment->count == 0)
+    {
+        if (segment->previous == NULL)
+        {
+            return false;
+        }
+        marker->segment = segment->previous;
+        gcReleaseMarkSegment(segment, marker);
+        segment = marker->segment;
+        assert(segment->count == GC_MARK_SEGMENT_ENTRIES);
+    }
+    *entry = segment->entries[--segment->count];
+    return true;
+}
+
+// Sets `mark` to the visited mark of the current collection. Returns false
+// if it was already set.
+// NOTE: the threads of a parallel marking may race to visit a structure;
+//       only one of them wins, and scans it.
+static inline bool gcClaim(int32_t *mark, GCMarker *marker)
+{
+    int32_t visitedMark = marker->collector->visitedMark;
+#ifdef GC_PARALLEL_MARK
+    if (marker->parallel != NULL)
+    {
+        return (__atomic_load_n(mark, __ATOMIC_RELAXED) != visitedMark &&
+                __atomic_exchange_n(mark, visitedMark, __ATOMIC_RELAXED) != visitedMark);
+    }
+#endif
+    if (*mark == visitedMark)
+    {
+        return false;
+    }
+    *mark = visitedMark;
+    return true;
+}
+
+// NOTE: classes, functions, instances, arrays and maps are visited once per
+//       collection, and the minor collections do not visit the old ones.
+//       With GC_GENERATIONAL, they become old as soon as they are visited.
+#ifdef GC_GENERATIONAL
+#define GC_IS_VISITED(payload) \
+    ((payload)->marked == collector->visitedMark || ((payload)->isOld && collector->isMinorCollection))
+#define GC_IS_SKIPPED(structure, marker) ((marker)->collector->isMinorCollection && (structure)->isOld)
+#define GC_VISIT(payload, marker) (gcClaim(&(payload)->marked, marker) && ((payload)->isOld = true))
+#else
+#define GC_IS_VISITED(payload) ((payload)->marked == collector->visitedMark)
+#define GC_IS_SKIPPED(structure, marker) false
+#define GC_VISIT(payload, marker) gcClaim(&(payload)->marked, marker)
+#endif
+
+static inline void gcMarkClass(LoxClass *klass, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(klass, marker) && GC_VISIT(klass, marker))
+    {
+        gcPush(GC_ENTRY(klass, GC_ENTRY_CLASS), marker);
+    }
+}
+
+static inline void gcMarkFunction(LoxFunction *function, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(function, marker) && GC_VISIT(function, marker))
+    {
+        gcPush(GC_ENTRY(function, GC_ENTRY_FUNCTION), marker);
+    }
+}
+
+static inline void gcMarkInstance(LoxInstance *instance, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(instance, marker) && GC_VISIT(instance, marker))
+    {
+        gcPush(GC_ENTRY(instance, GC_ENTRY_INSTANCE), marker);
+    }
+}
+
+static inline void gcMarkArray(LoxArray *array, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(array, marker) && GC_VISIT(array, marker))
+    {
+        gcPush(GC_ENTRY(array, GC_ENTRY_ARRAY), marker);
+    }
+}
+
+static inline void gcMarkMap(LoxMap *map, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(map, marker) && GC_VISIT(map, marker))
+    {
+        gcPush(GC_ENTRY(map, GC_ENTRY_MAP), marker);
+    }
+}
+
+// Marks the class, function, instance, array or map wrapped by `object`, if
+// any.
+static inline void gcMarkPayload(Object *object, GCMarker *marker)
+{
+    switch (object->type)
+    {
+        case OT_CLASS: {
+            gcMarkClass(object->klass, marker);
+        } break;
+        case OT_FUNCTION: {
+            gcMarkFunction(object->function, marker);
+        } break;
+        case OT_INSTANCE: {
+            gcMarkInstance(object->instance, marker);
+        } break;
+        case OT_ARRAY: {
+            gcMarkArray(object->array, marker);
+        } break;
+        case OT_MAP: {
+            gcMarkMap(object->map, marker);
+        } break;
+        case OT_CALLABLE:
+        case OT_STRING:
+        case OT_STRING_VIEW:
+            break;
+        case OT_BOOLEAN:
+        case OT_NIL:
+        case OT_NUMBER:
+        case OT_UNUSED:
+            INVALID_CASE;
+    }
+}
+
+static inline void gcMarkObject(Object *object, GCMarker *marker)
+{
+    if (!GC_IS_SKIPPED(object, marker) && gcClaim(&object->marked, marker))
+    {
+        gcMarkPayload(object, marker);
+    }
+}
+
+static inline void gcMarkValue(Value value, GCMarker *marker)
+{
+    if (val_isObject(value))
+    {
+        gcMarkObject(val_asObject(value), marker);
+    }
+}
+
+static inline void gcMarkEnvironment(Environment *environment, GCMarker *marker)
+{
+    if (environment != NULL && !GC_IS_SKIPPED(environment, marker) && gcClaim(&environment->marked, marker))
+    {
+        // NOTE: the frames are scanned when they are marked, see gcMarkFrames().
+        assert(!environment->isFrame);
+        gcPush(GC_ENTRY(environment, GC_ENTRY_ENVIRONMENT), marker);
+    }
+}
+
+static inline void gcScanEnvironment(Environment *environment, GCMarker *marker)
+{
+    for (int32_t index = 0; index < environment->slotsUsed; ++index)
+    {
+        gcMarkValue(environment->values[index], marker);
+    }
+    gcMarkEnvironment(environment->enclosing, marker);
+}
 
-static inline void gcMarkArguments(LoxArguments *args, GarbageCollector *collector)
+static inline void gcScanInstanceFields(LoxInstance *instance, GCMarker *marker)
 {
-    for (int32_t i = 0; i < args->count; ++i)
+    for (int32_t index = 0; index < instanceFieldsCount(instance); ++index)
     {
-        gcMarkObject(args->values[i], collector);
+        gcMarkValue(instance->fields[index], marker);
     }
 }
 
-static inline void gcMarkClass(LoxClass *klass, GarbageCollector *collector)
+static inline void gcScanArrayValues(LoxArray *array, GCMarker *marker)
 {
-    klass->marked = collector->visitedMark;
-    for(int32_t index = 0; index < klass->methodsCount; ++index)
+    for (int32_t index = 0; index < array->count; ++index)
     {
-        gcMarkEnvironment(klass->methods[index].function->closure, collector);
+        gcMarkValue(array->values[index], marker);
     }
-    if ((klass->superClass) && (klass->superClass->marked != collector->visitedMark))
+}
+
+// NOTE: the keys of the empty and deleted entries are not objects
+static inline void gcScanMapEntries(LoxMap *map, GCMarker *marker)
+{
+    for (int32_t index = 0; index < map->capacity; ++index)
+    {
+        gcMarkValue(map->entries[index].key, marker);
+        gcMarkValue(map->entries[index].value, marker);
+    }
+}
+
+static inline void gcScanEntry(uintptr_t entry, GCMarker *marker)
+{
+    switch (entry & GC_ENTRY_TYPE_MASK)
+    {
+        case GC_ENTRY_ENVIRONMENT: {
+            gcScanEnvironment((Environment *)GC_ENTRY_POINTER(entry), marker);
+        } break;
+        case GC_ENTRY_CLASS: {
+            LoxClass *klass = (LoxClass *)GC_ENTRY_POINTER(entry);
+            for (int32_t index = 0; index < klass->methodsCount; ++index)
+            {
+                gcMarkEnvironment(klass->methods[index].function->closure, marker);
+            }
+            if (klass->superClass)
+            {
+                gcMarkClass(klass->superClass, marker);
+            }
+        } break;
+        case GC_ENTRY_FUNCTION: {
+            LoxFunction *function = (LoxFunction *)GC_ENTRY_POINTER(entry);
+            gcMarkEnvironment(function->closure, marker);
+            gcMarkValue(function->receiver, marker);
+        } break;
+        case GC_ENTRY_INSTANCE: {
+            LoxInstance *instance = (LoxInstance *)GC_ENTRY_POINTER(entry);
+            gcScanInstanceFields(instance, marker);
+            gcMarkClass(instance->klass, marker);
+        } break;
+        case GC_ENTRY_ARRAY: {
+            gcScanArrayValues((LoxArray *)GC_ENTRY_POINTER(entry), marker);
+        } break;
+        case GC_ENTRY_MAP: {
+            gcScanMapEntries((LoxMap *)GC_ENTRY_POINTER(entry), marker);
+        } break;
+    }
+}
+
+// Scans the structures on the mark stack, until it is empty or `budget`
+// structures have been scanned. Returns true if the stack is empty.
+static bool gcDrainMarkStack(int32_t budget, GCMarker *marker)
+{
+    uintptr_t entry;
+    while (budget > 0 && gcPop(&entry, marker))
+    {
+        gcScanEntry(entry, marker);
+        --budget;
+    }
+    return gcIsMarkStackEmpty(marker);
+}
+
+// Marks the frames on the frame stack. They are scanned right away, as they
+// may be popped before the mark stack is emptied.
+// NOTE: the frames are young, and are visited by the minor collections too.
+static void gcMarkFrames(GCMarker *marker)
+{
+    const FrameStack *frames = marker->collector->frames;
+    if (frames == NULL)
+    {
+        return;
+    }
+    // NOTE: all the frames are marked first, so that the frames enclosing
+    //       other frames are not pushed on the mark stack.
+    for (int32_t pass = 0; pass < 2; ++pass)
+    {
+        for (const FrameSegment *segment = frames->segment;
+             segment != NULL;
+             segment = segment->previous)
+        {
+            uint8_t *frame = FRAME_SEGMENT_BASE(segment);
+            while (frame < segment->top)
+            {
+                Environment *environment = (Environment *)frame;
+                if (pass == 0)
+                {
+                    gcClaim(&environment->marked, marker);
+                }
+                else
+                {
+                    gcScanEnvironment(environment, marker);
+                }
+                frame += ENV_SIZE(environment->capacity);
+            }
+        }
+    }
+}
+
+// Marks the roots of a major collection: the locked values, the frames, and
+// the active environments.
+static void gcMarkRoots(GCMarker *marker)
+{
+    GarbageCollector *collector = marker->collector;
+    for(int32_t index = 0; index < collector->lockedCount; ++index)
+    {
+        gcMarkValue(collector->locked[index], marker);
+    }
+    gcMarkFrames(marker);
+    // NOTE: the global environment is scanned right away, so that the global
+    //       variables need no write barrier during an incremental marking.
+    Environment *globals = collector->globals;
+    if (globals != NULL && gcClaim(&globals->marked, marker))
+    {
+        gcScanEnvironment(globals, marker);
+    }
+    for(Environment *env = collector->firstEnvironment;
+        env != NULL;
+        env = env->next)
+    {
+        if(env->isActive)
+        {
+            gcMarkEnvironment(env, marker);
+        }
+    }
+#ifdef GC_GENERATIONAL
+    for(Environment *env = collector->firstYoungEnvironment;
+        env != NULL;
+        env = env->next)
+    {
+        if(env->isActive)
+        {
+            gcMarkEnvironment(env, marker);
+        }
+    }
+#endif
+}
+
+// Marks `object`, whose reference is about to be overwritten while an
+// incremental marking is in progress, see gcOverwrite().
+void gcShadeObject(Object *object, GarbageCollector *collector)
+{
+    assert(collector->isMarking);
+    gcMarkObject(object, &collector->marker);
+}
+
+#ifdef GC_PARALLEL_MARK
+// Gives a part of the mark stack of `marker` to the idle threads, unless
+// they have not taken the part shared before yet.
+static void gcShareWork(GCMarker *marker)
+{
+    GCParallelMark *parallel = marker->parallel;
+    GCMarkSegment *top = marker->segment;
+    if (top->previous == NULL && top->count < 2)
+    {
+        return;
+    }
+    GCMarkSegment *shared = top->previous == NULL ? gcAllocMarkSegment(marker) : NULL;
+    pthread_mutex_lock(&parallel->mutex);
+    if (parallel->sharedSegments == NULL)
+    {
+        if (top->previous != NULL)
+        {
+            // NOTE: the segment below the top one is given away whole
+            GCMarkSegment *full = top->previous;
+            top->previous = full->previous;
+            full->previous = NULL;
+            parallel->sharedSegments = full;
+        }
+        else
+        {
+            // NOTE: the bottom half of the top segment, that was pushed
+            //       first and likely leads to more work
+            int32_t count = top->count / 2;
+            memcpy(shared->entries, top->entries, (size_t)count * sizeof(uintptr_t));
+            memmove(top->entries, top->entries + count, (size_t)(top->count - count) * sizeof(uintptr_t));
+            top->count -= count;
+            shared->count = count;
+            shared->previous = NULL;
+            parallel->sharedSegments = shared;
+            shared = NULL;
+        }
+        pthread_cond_signal(&parallel->condition);
+    }
+    pthread_mutex_unlock(&parallel->mutex);
+    if (shared != NULL)
+    {
+        gcReleaseMarkSegment(shared, marker);
+    }
+}
+
+// Waits for a segment shared by the other threads, and moves it to the
+// empty mark stack of `marker`. Returns false if the marking is over, i.e.
+// all the threads are idle.
+static bool gcTakeWork(GCMarker *marker)
+{
+    assert(gcIsMarkStackEmpty(marker));
+    GCParallelMark *parallel = marker->parallel;
+    pthread_mutex_lock(&parallel->mutex);
+    // NOTE: the count of idle threads is read by the busy ones without the lock
+    __atomic_add_fetch(&parallel->idleCount, 1, __ATOMIC_RELAXED);
+    while (parallel->sharedSegments == NULL && !parallel->isDone)
+    {
+        if (parallel->idleCount == parallel->markersCount)
+        {
+            parallel->isDone = true;
+            pthread_cond_broadcast(&parallel->condition);
+        }
+        else
+        {
+            pthread_cond_wait(&parallel->condition, &parallel->mutex);
+        }
+    }
+    GCMarkSegment *empty = NULL;
+    if (!parallel->isDone)
+    {
+        GCMarkSegment *segment = parallel->sharedSegments;
+        parallel->sharedSegments = segment->previous;
+        __atomic_sub_fetch(&parallel->idleCount, 1, __ATOMIC_RELAXED);
+        empty = marker->segment;
+        segment->previous = NULL;
+        marker->segment = segment;
+    }
+    bool isDone = parallel->isDone;
+    pthread_mutex_unlock(&parallel->mutex);
+    if (empty != NULL)
+    {
+        gcReleaseMarkSegment(empty, marker);
+    }
+    return !isDone;
+}
+
+static void gcMarkShared(GCMarker *marker)
+{
+    do
     {
-        gcMarkClass(klass->superClass, collector);
-    }
+        uintptr_t entry;
+        uint32_t scannedCount = 0;
+        while (gcPop(&entry, marker))
+        {
+            gcScanEntry(entry, marker);
+            if ((++scannedCount & (GC_SHARE_INTERVAL - 1)) == 0 &&
+                __atomic_load_n(&marker->parallel->idleCount, __ATOMIC_RELAXED) > 0)
+            {
+                gcShareWork(marker);
+            }
+        }
+    } while (gcTakeWork(marker));
 }
 
-static inline void gcMarkFunction(LoxFunction *function, GarbageCollector *collector)
+static void * gcMarkerThread(void *marker)
 {
-    function->marked = collector->visitedMark;
-    gcMarkEnvironment(function->closure, collector);
+    gcMarkShared((GCMarker *)marker);
+    return NULL;
 }
 
-static inline void gcMarkInstance(LoxInstance *instance, GarbageCollector *collector)
+// Empties the mark stack of the collector with `markThreadsCount` threads,
+// including the calling one.
+static void gcMarkParallel(GarbageCollector *collector)
 {
-    instance->marked = collector->visitedMark;
-    for (int32_t index = 0; index < instance->fieldsCount; ++index)
+    GCParallelMark parallel;
+    pthread_mutex_init(&parallel.mutex, NULL);
+    pthread_cond_init(&parallel.condition, NULL);
+    parallel.sharedSegments = NULL;
+    parallel.markersCount = collector->markThreadsCount;
+    parallel.idleCount = 0;
+    parallel.isDone = false;
+
+    GCMarker markers[GC_MAX_MARK_THREADS];
+    pthread_t threads[GC_MAX_MARK_THREADS];
+    for (int32_t index = 1; index < collector->markThreadsCount; ++index)
     {
-        gcMarkObject(instance->fields[index].value, collector);
+        gcInitMarker(&markers[index], collector);
+        markers[index].parallel = &parallel;
     }
-    gcMarkClass(instance->klass, collector);
-}
-
-static void gcMarkObject(Object *object, GarbageCollector *collector)
-{
-    if (object == NULL || object->marked == collector->visitedMark)
+    collector->marker.parallel = &parallel;
+    int32_t markersCount = 1;
+    while (markersCount < collector->markThreadsCount &&
+           pthread_create(&threads[markersCount], NULL, gcMarkerThread, &markers[markersCount]) == 0)
     {
-        return;
+        ++markersCount;
     }
-    object->marked = collector->visitedMark;
-    switch (object->type)
+    if (markersCount < collector->markThreadsCount)
     {
-        case OT_ARGUMENTS: {
-            gcMarkArguments(obj_unwrapArguments(object), collector);
-        } break;
-        case OT_CLASS: {
-            gcMarkClass(obj_unwrapClass(object), collector);
-        } break;
-        case OT_FUNCTION: {
-            gcMarkFunction(object->function, collector);
-        } break;
-        case OT_INSTANCE: {
-            gcMarkInstance(obj_unwrapInstance(object), collector);
-        } break;
-        case OT_BOOLEAN:
-        case OT_CALLABLE:
-        case OT_NIL:
-        case OT_NUMBER:
-        case OT_STRING:
-            break;
-        case OT_UNUSED:
-            INVALID_CASE;
+        // NOTE: the marking goes on with the threads that could be created
+        pthread_mutex_lock(&parallel.mutex);
+        parallel.markersCount = markersCount;
+        pthread_cond_broadcast(&parallel.condition);
+        pthread_mutex_unlock(&parallel.mutex);
     }
-}
 
-static void gcMarkEnvironment(Environment *environment, GarbageCollector *collector)
-{
-    if(environment == NULL || environment->marked == collector->visitedMark)
+    gcMarkShared(&collector->marker);
+    for (int32_t index = 1; index < markersCount; ++index)
     {
-        return;
+        pthread_join(threads[index], NULL);
     }
-    environment->marked = collector->visitedMark;
 
-    for (int32_t index = 0; index < environment->slotsUsed; ++index)
+    collector->marker.parallel = NULL;
+    for (int32_t index = 1; index < collector->markThreadsCount; ++index)
     {
-        gcMarkObject(environment->values[index], collector);
+        markers[index].parallel = NULL;
+        gcFreeMarker(&markers[index]);
     }
-    gcMarkEnvironment(environment->enclosing, collector);
+    pthread_cond_destroy(&parallel.condition);
+    pthread_mutex_destroy(&parallel.mutex);
 }
+#endif
 
 // Releases an object. The Object structure is moved to the unused objects list so
 // that it can be reused. If its value cannot be shared it's freed if appropriate.
@@ -301,18 +1206,14 @@ static void gcRelease(Object *object, GarbageCollector *collector)
     assert(object->marked != collector->visitedMark && object->marked != collector->recycledMark);
     switch (object->type)
     {
-        case OT_ARGUMENTS:
-        {
-            argumentsFree(object->arguments);
-        } break;
         case OT_CALLABLE:
         {
-            callableFree(object->callable);
+            // NOTE: the native functions are static
         } break;
         case OT_CLASS:
         {
-            LoxClass *klass = obj_unwrapClass(object);
-            if((klass->marked != collector->visitedMark) && (klass->marked != collector->recycledMark))
+            LoxClass *klass = object->klass;
+            if(!GC_IS_VISITED(klass) && (klass->marked != collector->recycledMark))
             {
                 klass->marked = collector->recycledMark;
                 object->next = collector->laundryList;
@@ -322,9 +1223,8 @@ static void gcRelease(Object *object, GarbageCollector *collector)
         } break;
         case OT_FUNCTION:
         {
-            LoxFunction *function = obj_unwrapFunction(object);
-            if ((function->marked != collector->visitedMark) &&
-                (function->marked != collector->recycledMark))
+            LoxFunction *function = object->function;
+            if (!GC_IS_VISITED(function) && (function->marked != collector->recycledMark))
             {
                 function->marked = collector->recycledMark;
                 object->next = collector->laundryList;
@@ -334,8 +1234,8 @@ static void gcRelease(Object *object, GarbageCollector *collector)
         } break;
         case OT_INSTANCE:
         {
-            LoxInstance *instance = obj_unwrapInstance(object);
-            if((instance->marked != collector->visitedMark) && (instance->marked != collector->recycledMark))
+            LoxInstance *instance = object->instance;
+            if(!GC_IS_VISITED(instance) && (instance->marked != collector->recycledMark))
             {
                 instance->marked = collector->recycledMark;
                 object->next = collector->laundryList;
@@ -343,20 +1243,34 @@ static void gcRelease(Object *object, GarbageCollector *collector)
                 return;
             }
         } break;
+        case OT_ARRAY:
+        {
+            // NOTE: the array is only wrapped by `object`
+            arrayFree(object->array);
+        } break;
+        case OT_MAP:
+        {
+            // NOTE: the map is only wrapped by `object`
+            mapFree(object->map);
+        } break;
         case OT_STRING:
         {
             str_free(object->string);
         } break;
+        case OT_STRING_VIEW:
+        {
+            str_builderRelease(object->builder);
+        } break;
         case OT_BOOLEAN:
         case OT_NIL:
         case OT_NUMBER:
-        {
-            // do nothing
-        } break;
         case OT_UNUSED:
             INVALID_PATH;
     }
     object->type = OT_UNUSED;
+#ifdef MEMORY_SAMPLING
+    sampler_countRelease(object);
+#endif
 #ifdef DEBUG_SCRAMBLE_MEMORY
     object->klass = DEBUG_SCRAMBLE_VALUE;
 #endif
@@ -368,12 +1282,9 @@ static void gcRelease(Object *object, GarbageCollector *collector)
 #endif
 }
 
-// Sweep step of the mark & sweep garbage collector
-static void gcSweep(GarbageCollector *collector)
+// Releases the objects in the `list` that were not marked.
+static void gcSweepObjects(Object **object, GarbageCollector *collector)
 {
-    // NOTE: Visits all active objects and releases the ones
-    // that were not marked.
-    Object **object = &collector->firstObject;
     while (*object)
     {
         assert((*object)->marked != collector->recycledMark);
@@ -389,10 +1300,15 @@ static void gcSweep(GarbageCollector *collector)
             --collector->activeObjectsCount;
         }
     }
+}
 
-    // NOTE: Free the objects in the laundry list
+// Frees the payloads of the objects in the laundry list
+static void gcFreeLaundry(GarbageCollector *collector)
+{
+    int32_t laundrySize = 0;
     while(collector->laundryList != NULL)
     {
+        ++laundrySize;
         Object *object = collector->laundryList;
         switch (object->type)
         {
@@ -400,9 +1316,6 @@ static void gcSweep(GarbageCollector *collector)
                 assert(object->klass->marked == collector->recycledMark);
                 classFree(object->klass);
             } break;
-            case OT_CALLABLE: {
-                callableFree(object->callable);
-            } break;
             case OT_FUNCTION: {
                 assert(object->function->marked == collector->recycledMark);
                 function_free(object->function);
@@ -415,6 +1328,9 @@ static void gcSweep(GarbageCollector *collector)
         collector->laundryList = object->next;
         
         object->type = OT_UNUSED;
+#ifdef MEMORY_SAMPLING
+        sampler_countRelease(object);
+#endif
 #ifdef DEBUG_SCRAMBLE_MEMORY
         object->klass = DEBUG_SCRAMBLE_VALUE;
 #endif
@@ -425,9 +1341,28 @@ static void gcSweep(GarbageCollector *collector)
         ++collector->debug_recycledObjCount;
 #endif
     }
-    
-    // NOTE: Recycle the environments that were not marked.
-    Environment **env = &collector->firstEnvironment;
+    collector->stats.launderedObjectsCount += laundrySize;
+    if (laundrySize > collector->stats.maxLaundrySize)
+    {
+        collector->stats.maxLaundrySize = laundrySize;
+    }
+}
+
+static inline void gcRecycleEnvironment(Environment *released, GarbageCollector *collector)
+{
+    int32_t sizeClass = env_sizeClass(released->capacity);
+    released->next = collector->firstUnusedEnvironment[sizeClass];
+    collector->firstUnusedEnvironment[sizeClass] = released;
+    --collector->activeEnvironmentsCount;
+#ifdef GC_KEEPS_STATS
+    ++collector->unusedEnvironmentsCount;
+    ++collector->debug_recycledEnvCount;
+#endif
+}
+
+// Recycles the environments in the `list` that were not marked.
+static void gcSweepEnvironments(Environment **env, GarbageCollector *collector)
+{
     while (*env)
     {
         assert((*env)->marked != collector->recycledMark);
@@ -439,56 +1374,498 @@ static void gcSweep(GarbageCollector *collector)
         {
             Environment *released = *env;
             *env = released->next;
-            released->next = collector->firstUnusedEnvironment;
-            collector->firstUnusedEnvironment = released;
-            --collector->activeEnvironmentsCount;
-#ifdef GC_KEEPS_STATS
-            ++collector->unusedEnvironmentsCount;
-            ++collector->debug_recycledEnvCount;
+            gcRecycleEnvironment(released, collector);
+        }
+    }
+}
+
+// Sweep step of the mark & sweep garbage collector
+static void gcSweep(GarbageCollector *collector)
+{
+    // NOTE: Visits all active objects and releases the ones
+    // that were not marked.
+    gcSweepObjects(&collector->firstObject, collector);
+#ifdef GC_GENERATIONAL
+    gcSweepObjects(&collector->firstYoungObject, collector);
 #endif
+    gcFreeLaundry(collector);
+    
+    // NOTE: Recycle the environments that were not marked.
+    gcSweepEnvironments(&collector->firstEnvironment, collector);
+#ifdef GC_GENERATIONAL
+    gcSweepEnvironments(&collector->firstYoungEnvironment, collector);
+#endif
+}
+
+// NOTE: define new values for the marks, so we do not reset the marks of all remaining objects
+static inline void gcNextMarks(GarbageCollector *collector)
+{
+    collector->visitedMark += 2;
+    collector->recycledMark += 2;
+    if(collector->visitedMark == (1 << 30))
+    {
+        collector->visitedMark = 0;
+        collector->recycledMark = 1;
+    }
+}
+
+#ifdef GC_GENERATIONAL
+// Releases the young objects that were not marked, and moves the survivors
+// to the old generation.
+static void gcSweepNurseryObjects(GarbageCollector *collector)
+{
+    Object **object = &collector->firstYoungObject;
+    while (*object)
+    {
+        Object *current = *object;
+        assert(current->marked != collector->recycledMark);
+        if (current->marked != collector->visitedMark)
+        {
+            *object = current->next;
+            gcRelease(current, collector);
+            --collector->activeObjectsCount;
+            --collector->youngObjectsCount;
+        }
+        else
+        {
+            *object = current->next;
+            current->isOld = true;
+            current->next = collector->firstObject;
+            collector->firstObject = current;
+            --collector->youngObjectsCount;
+        }
+    }
+}
+
+// Recycles the young environments that were not marked, and moves the
+// survivors to the old generation. The active ones are remembered, as
+// their variables are defined and assigned without write barrier.
+static void gcSweepNurseryEnvironments(GarbageCollector *collector)
+{
+    Environment *env = collector->firstYoungEnvironment;
+    while (env)
+    {
+        Environment *next = env->next;
+        assert(env->marked != collector->recycledMark);
+        if (env->marked != collector->visitedMark)
+        {
+            gcRecycleEnvironment(env, collector);
+        }
+        else
+        {
+            env->isOld = true;
+            env->next = collector->firstEnvironment;
+            collector->firstEnvironment = env;
+            if (env->isActive)
+            {
+                gcRememberEnvironment(env, collector);
+            }
         }
+        env = next;
+    }
+    collector->firstYoungEnvironment = NULL;
+    collector->youngEnvironmentsCount = 0;
+}
+
+#endif
+
+/* Statistics */
+
+typedef enum
+{
+    GC_COLLECTION_MINOR,
+    GC_COLLECTION_MAJOR,
+    GC_COLLECTION_INCREMENTAL,
+    GC_COLLECTION_PARALLEL,
+} GCCollectionKind;
+
+static const char *gc_collectionKindNames[] = { "minor", "major", "incremental", "parallel" };
+static const char *gc_collectionSpanNames[] = { "minor collection", "major collection", "incremental collection", "parallel collection" };
+
+static inline GCSample gcBeginSample(bool isMinorCollection, GarbageCollector *collector)
+{
+    GCSample sample;
+    sample.activeObjectsCount = collector->activeObjectsCount;
+    sample.activeEnvironmentsCount = collector->activeEnvironmentsCount;
+    sample.visitedObjectsCount = collector->activeObjectsCount;
+    sample.visitedEnvironmentsCount = collector->activeEnvironmentsCount;
+#ifdef GC_GENERATIONAL
+    if (isMinorCollection)
+    {
+        sample.visitedObjectsCount = collector->youngObjectsCount;
+        sample.visitedEnvironmentsCount = collector->youngEnvironmentsCount;
+    }
+#endif
+    sample.launderedObjectsCount = collector->stats.launderedObjectsCount;
+    // NOTE: the live environments only decrease in a collection, so their
+    //       peak is reached at the start of one, or at the end of the script.
+    //       This keeps the check out of gcGetEnvironment().
+    collector->stats.peakEnvironmentsCount = max(collector->stats.peakEnvironmentsCount,
+                                                 collector->activeEnvironmentsCount);
+    sample.pauseTime = 0;
+    sample.startTime = timer_nanoSec();
+    return sample;
+}
+
+// Adds the collection that started with `sample` to the statistics, and
+// logs it. The pause ends now, and started at the start of the sample or,
+// for an incremental marking, at the start of its last slice.
+static void gcEndSample(const GCSample *sample, GCCollectionKind kind, GarbageCollector *collector)
+{
+    uint64_t pauseTime = timer_nanoSec() - sample->startTime;
+    GCStats *stats = &collector->stats;
+    int32_t recycledObjects = sample->activeObjectsCount - collector->activeObjectsCount;
+    int32_t recycledEnvironments = sample->activeEnvironmentsCount - collector->activeEnvironmentsCount;
+    int32_t markedObjects = sample->visitedObjectsCount - recycledObjects;
+    int32_t markedEnvironments = sample->visitedEnvironmentsCount - recycledEnvironments;
+
+    if (kind == GC_COLLECTION_MINOR)
+    {
+        ++stats->minorCollectionsCount;
+    }
+    else
+    {
+        ++stats->collectionsCount;
     }
+    if (kind == GC_COLLECTION_INCREMENTAL)
+    {
+        ++stats->incrementalCollectionsCount;
+        ++stats->markSlicesCount;
+    }
+    else if (kind == GC_COLLECTION_PARALLEL)
+    {
+        ++stats->parallelCollectionsCount;
+    }
+    stats->totalPauseTime += pauseTime;
+    stats->maxPauseTime = max(stats->maxPauseTime, pauseTime);
+    stats->markedObjectsCount += markedObjects;
+    stats->recycledObjectsCount += recycledObjects;
+    stats->markedEnvironmentsCount += markedEnvironments;
+    stats->recycledEnvironmentsCount += recycledEnvironments;
+
+    if (tracer_isEnabled())
+    {
+        TraceArg args[] = {
+            {"marked_objects", markedObjects},
+            {"recycled_objects", recycledObjects},
+            {"marked_environments", markedEnvironments},
+            {"recycled_environments", recycledEnvironments},
+        };
+        tracer_writeSpan("gc", gc_collectionSpanNames[kind], sample->startTime, args, 4);
+    }
+    if (collector->log != NULL)
+    {
+        fprintf(collector->log, "%s,%.3f,%d,%d,%d,%d,%llu,%d,%d,%d,%d\n",
+                gc_collectionKindNames[kind], (double)(sample->pauseTime + pauseTime) / 1e3,
+                markedObjects, recycledObjects, markedEnvironments, recycledEnvironments,
+                (unsigned long long)(stats->launderedObjectsCount - sample->launderedObjectsCount),
+                collector->activeObjectsCount, collector->activeEnvironmentsCount,
+                collector->objectsCount, collector->environmentsCount);
+    }
+}
+
+// Logs each collection in the file `filename`, as a line of comma separated
+// values; the first line of the file has the names of the columns.
+// Returns false if the file could not be opened.
+// NOTE: the pause of an incremental collection is the total of its slices.
+bool gcSetLog(const char *filename, GarbageCollector *collector)
+{
+    assert(collector->log == NULL);
+    collector->log = fopen(filename, "w");
+    if (collector->log == NULL)
+    {
+        return false;
+    }
+    fprintf(collector->log, "kind,pause_us,marked_objects,recycled_objects,marked_environments,recycled_environments,laundered_objects,live_objects,live_environments,objects,environments\n");
+    return true;
+}
+
+// Returns a description of the statistics of `collector`, one per line.
+// The returned string must be freed with str_free().
+// Calls `visit` with each object in use, i.e. the live objects and the
+// garbage that has not been collected yet.
+// NOTE: no allocation can take place during the visit.
+void gcForEachObject(GCObjectVisitor visit, void *context, const GarbageCollector *collector)
+{
+    for (Object *object = collector->firstObject; object != NULL; object = object->next)
+    {
+        visit(object, context);
+    }
+#ifdef GC_GENERATIONAL
+    for (Object *object = collector->firstYoungObject; object != NULL; object = object->next)
+    {
+        visit(object, context);
+    }
+#endif
+}
+
+char * gcStatsDescription(const GarbageCollector *collector)
+{
+    const GCStats *stats = &collector->stats;
+    // NOTE: the last slice of an incremental collection is its own pause
+    int32_t pausesCount = stats->collectionsCount + stats->minorCollectionsCount +
+                          stats->markSlicesCount - stats->incrementalCollectionsCount;
+    double totalPause = (double)stats->totalPauseTime / 1e6;
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "collections: %d major, %d minor\n"
+             "pause (ms): %.3f total, %.3f mean, %.3f max\n"
+             "marking: %d incremental in %d slices, %d parallel\n"
+             "objects: %llu allocated, %llu marked, %llu recycled, %llu laundered (at most %d in one collection)\n"
+             "environments: %llu marked, %llu recycled, %llu frames\n"
+             "peak live: %d objects, %d environments\n"
+             "heap capacity: %d objects, %d environments",
+             stats->collectionsCount, stats->minorCollectionsCount,
+             totalPause, pausesCount > 0 ? totalPause / pausesCount : 0.0, (double)stats->maxPauseTime / 1e6,
+             stats->incrementalCollectionsCount, stats->markSlicesCount, stats->parallelCollectionsCount,
+             (unsigned long long)stats->allocatedObjectsCount, (unsigned long long)stats->markedObjectsCount,
+             (unsigned long long)stats->recycledObjectsCount, (unsigned long long)stats->launderedObjectsCount,
+             stats->maxLaundrySize,
+             (unsigned long long)stats->markedEnvironmentsCount, (unsigned long long)stats->recycledEnvironmentsCount,
+             (unsigned long long)(collector->frames != NULL ? collector->frames->framesCount : 0),
+             stats->peakObjectsCount, max(stats->peakEnvironmentsCount, collector->activeEnvironmentsCount),
+             collector->objectsCount, collector->environmentsCount);
+    return str_fromLiteral(buffer);
+}
+
+// Sets how the major collections are marked: incrementally, in slices
+// interleaved with the execution of the script, or else with `threadsCount`
+// threads if the heap has at least GC_PARALLEL_MIN_OBJECTS live objects.
+// NOTE: without GC_PARALLEL_MARK, the heap is always marked by one thread.
+void gcSetMarking(bool isIncremental, int32_t threadsCount, GarbageCollector *collector)
+{
+    assert(!collector->isMarking);
+    collector->isIncremental = isIncremental;
+#ifdef GC_PARALLEL_MARK
+    collector->markThreadsCount = min(max(threadsCount, 1), GC_MAX_MARK_THREADS);
+#else
+    collector->markThreadsCount = 1;
+#endif
+}
+
+// Sweep step of a major collection, once everything reachable is marked
+static void gcSweepHeap(GarbageCollector *collector)
+{
+#ifdef GC_GENERATIONAL
+    // NOTE: everything reachable has been marked, so the remembered set can
+    //       be emptied, as long as the survivors in the nursery are promoted.
+    gcForgetRemembered(collector);
+
+    gcSweepObjects(&collector->firstObject, collector);
+    gcSweepNurseryObjects(collector);
+    gcFreeLaundry(collector);
+    gcSweepEnvironments(&collector->firstEnvironment, collector);
+    gcSweepNurseryEnvironments(collector);
+
+    // NOTE: Update the thresholds of the old generation for the next major collection
+    collector->maxOldObjects = max(2*collector->activeObjectsCount, GC_NURSERY_OBJECTS);
+    collector->maxOldEnvironments = max(2*collector->activeEnvironmentsCount, GC_NURSERY_ENVIRONMENTS);
+#else
+    gcSweep(collector);
+
+    // NOTE: Update the thresholds for the next garbage collection
+    collector->maxObjects = max(2*collector->activeObjectsCount, collector->objectsCount);
+    // NOTE: the environments threshold must stay below the maximum number of
+    //       environments, otherwise we run out of them before collecting.
+    collector->maxEnvironments = min(max(2*collector->activeEnvironmentsCount, collector->objectsCount), LOX_MAX_ENVIRONMENTS);
+#endif
+
+    gcNextMarks(collector);
+    // NOTE: the payloads of the recycled objects have been released, and
+    //       the chunks left empty can be returned.
+    slabTrim();
 }
 
-// Run the mark & sweep garbage collector
+// Run the mark & sweep garbage collector. If an incremental marking is in
+// progress, it is completed.
 void gcCollect(GarbageCollector *collector)
 {
+    if (collector->isMarking)
+    {
+        gcMarkSlice(INT32_MAX, collector);
+        return;
+    }
 #ifdef GC_KEEPS_STATS
     assert(collector->activeObjectsCount + collector->unusedObjectsCount == collector->objectsCount);
 #endif
-    // NOTE: First we mark all objects that have been locked
+#ifdef GC_GENERATIONAL
+    collector->isMinorCollection = false;
+#endif
+    GCSample sample = gcBeginSample(false, collector);
+
+    gcMarkRoots(&collector->marker);
+    GCCollectionKind kind = GC_COLLECTION_MAJOR;
+#ifdef GC_PARALLEL_MARK
+    if (collector->markThreadsCount > 1 && collector->activeObjectsCount >= GC_PARALLEL_MIN_OBJECTS)
+    {
+        gcMarkParallel(collector);
+        kind = GC_COLLECTION_PARALLEL;
+    }
+    else
+#endif
+    {
+        gcDrainMarkStack(INT32_MAX, &collector->marker);
+    }
+
+    gcSweepHeap(collector);
+    gcEndSample(&sample, kind, collector);
+}
+
+/* Incremental marking */
+
+// Adds the pause of a slice of the incremental marking, that started at
+// `startTime`, to the statistics.
+static void gcEndSlice(uint64_t startTime, GarbageCollector *collector)
+{
+    uint64_t pauseTime = timer_nanoSec() - startTime;
+    collector->markingSample.pauseTime += pauseTime;
+    collector->stats.totalPauseTime += pauseTime;
+    collector->stats.maxPauseTime = max(collector->stats.maxPauseTime, pauseTime);
+    ++collector->stats.markSlicesCount;
+    if (tracer_isEnabled())
+    {
+        tracer_writeSpan("gc", "mark slice", startTime, NULL, 0);
+    }
+}
+
+// Starts an incremental marking: the first slice marks the roots.
+static void gcStartMarking(GarbageCollector *collector)
+{
+    assert(!collector->isMarking && gcIsMarkStackEmpty(&collector->marker));
+#ifdef GC_GENERATIONAL
+    collector->isMinorCollection = false;
+#endif
+    collector->markingSample = gcBeginSample(false, collector);
+    gcMarkRoots(&collector->marker);
+    collector->isMarking = true;
+    collector->allocationMark = collector->visitedMark;
+    collector->sliceAllocationsCount = 0;
+    gcEndSlice(collector->markingSample.startTime, collector);
+}
+
+// Ends the incremental marking, once the mark stack is empty, and sweeps
+// the heap.
+static void gcFinishMarking(GarbageCollector *collector)
+{
+    GCMarker *marker = &collector->marker;
+    // NOTE: the objects allocated during the marking were marked, but their
+    //       classes, functions and instances were not visited; they are now,
+    //       so that they become old and are not freed through another object
+    //       that wraps them.
+#ifdef GC_GENERATIONAL
+    Object *object = collector->firstYoungObject;
+#else
+    Object *object = collector->firstObject;
+#endif
+    for (; object != NULL; object = object->next)
+    {
+        if (object->marked == collector->visitedMark)
+        {
+            gcMarkPayload(object, marker);
+        }
+    }
+    gcDrainMarkStack(INT32_MAX, marker);
+
+    collector->isMarking = false;
+    collector->allocationMark = GC_CLEAR;
+    collector->stats.peakEnvironmentsCount = max(collector->stats.peakEnvironmentsCount,
+                                                 collector->activeEnvironmentsCount);
+    gcSweepHeap(collector);
+    gcEndSample(&collector->markingSample, GC_COLLECTION_INCREMENTAL, collector);
+}
+
+// Scans at most `budget` structures of the mark stack of the incremental
+// marking, and finishes the marking if the stack is left empty.
+static void gcMarkSlice(int32_t budget, GarbageCollector *collector)
+{
+    assert(collector->isMarking);
+    uint64_t startTime = timer_nanoSec();
+    collector->sliceAllocationsCount = 0;
+    if (gcDrainMarkStack(budget, &collector->marker))
+    {
+        collector->markingSample.startTime = startTime;
+        gcFinishMarking(collector);
+    }
+    else
+    {
+        gcEndSlice(startTime, collector);
+    }
+}
+
+// Runs a major collection, or starts an incremental marking if none is in
+// progress.
+static void gcCollectMajor(GarbageCollector *collector)
+{
+    if (!collector->isIncremental)
+    {
+        gcCollect(collector);
+    }
+    else if (!collector->isMarking)
+    {
+        gcStartMarking(collector);
+    }
+}
+
+#ifdef GC_GENERATIONAL
+// Run a minor collection, that only marks and sweeps the nursery. The
+// young objects referenced by the old generation are found through the
+// remembered set, that the write barriers keep up to date.
+static void gcCollectMinor(GarbageCollector *collector)
+{
+    assert(!collector->isMarking);
+    collector->isMinorCollection = true;
+    GCSample sample = gcBeginSample(true, collector);
+    GCMarker *marker = &collector->marker;
+
     for(int32_t index = 0; index < collector->lockedCount; ++index)
     {
-        gcMarkObject(collector->locked[index], collector);
+        gcMarkValue(collector->locked[index], marker);
     }
-    
-    // NOTE: Next we mark all objects stored in active environments
-    for(Environment *env = collector->firstEnvironment;
+    gcMarkFrames(marker);
+    for(Environment *env = collector->firstYoungEnvironment;
         env != NULL;
         env = env->next)
     {
         if(env->isActive)
         {
-            gcMarkEnvironment(env, collector);
+            gcMarkEnvironment(env, marker);
         }
     }
+    for(int32_t index = 0; index < collector->rememberedEnvironmentsCount; ++index)
+    {
+        gcScanEnvironment(collector->rememberedEnvironments[index], marker);
+    }
+    for(int32_t index = 0; index < collector->rememberedInstancesCount; ++index)
+    {
+        gcScanInstanceFields(collector->rememberedInstances[index], marker);
+    }
+    for(int32_t index = 0; index < collector->rememberedArraysCount; ++index)
+    {
+        gcScanArrayValues(collector->rememberedArrays[index], marker);
+    }
+    for(int32_t index = 0; index < collector->rememberedMapsCount; ++index)
+    {
+        gcScanMapEntries(collector->rememberedMaps[index], marker);
+    }
+    gcDrainMarkStack(INT32_MAX, marker);
 
-    // NOTE: Finally we perform the sweep step
-    gcSweep(collector);
+    gcForgetRemembered(collector);
+    gcSweepNurseryObjects(collector);
+    gcFreeLaundry(collector);
+    gcSweepNurseryEnvironments(collector);
 
-    // NOTE: Update the thresholds for the next garbage collection
-    collector->maxObjects = max(2*collector->activeObjectsCount, collector->objectsCount);
-    collector->maxEnvironments = max(2*collector->activeEnvironmentsCount, collector->objectsCount);
+    collector->isMinorCollection = false;
+    gcNextMarks(collector);
+    gcEndSample(&sample, GC_COLLECTION_MINOR, collector);
 
-    // NOTE: define new values for the marks, so we do not reset the marks of all remaining objects
-    collector->visitedMark += 2;
-    collector->recycledMark += 2;
-    if(collector->visitedMark == (1 << 30))
+    int32_t oldObjectsCount = collector->activeObjectsCount - collector->youngObjectsCount;
+    if (oldObjectsCount >= collector->maxOldObjects ||
+        collector->activeEnvironmentsCount >= collector->maxOldEnvironments)
     {
-        collector->visitedMark = 0;
-        collector->recycledMark = 1;
+        gcCollectMajor(collector);
     }
 }
+#endif
 
 // Releases all objects.
 static void gcClean(GarbageCollector *collector)
@@ -497,6 +1874,24 @@ static void gcClean(GarbageCollector *collector)
     assert(collector->activeObjectsCount + collector->unusedObjectsCount == collector->objectsCount);
 #endif
     assert(collector->lockedCount == 0);
+#ifdef GC_GENERATIONAL
+    collector->isMinorCollection = false;
+    collector->rememberedEnvironmentsCount = 0;
+    collector->rememberedInstancesCount = 0;
+    collector->rememberedArraysCount = 0;
+    collector->rememberedMapsCount = 0;
+#endif
+    if (collector->isMarking)
+    {
+        // NOTE: the marking in progress is abandoned, and its marks discarded
+        uintptr_t entry;
+        while (gcPop(&entry, &collector->marker))
+        {
+        }
+        collector->isMarking = false;
+        collector->allocationMark = GC_CLEAR;
+        gcNextMarks(collector);
+    }
     // NOTE: At this point everything is unmarked, so the sweep step releases everything.
     gcSweep(collector);
    
@@ -513,6 +1908,26 @@ void gcFree(GarbageCollector *collector)
     assert(collector->firstEnvironment == NULL);
     assert(collector->firstObject == NULL);
     assert(collector->activeEnvironmentsCount == 0);
+#ifdef GC_GENERATIONAL
+    assert(collector->firstYoungEnvironment == NULL);
+    assert(collector->firstYoungObject == NULL);
+    if (collector->rememberedEnvironments != NULL)
+    {
+        lox_free(collector->rememberedEnvironments);
+    }
+    if (collector->rememberedInstances != NULL)
+    {
+        lox_free(collector->rememberedInstances);
+    }
+    if (collector->rememberedArrays != NULL)
+    {
+        lox_free(collector->rememberedArrays);
+    }
+    if (collector->rememberedMaps != NULL)
+    {
+        lox_free(collector->rememberedMaps);
+    }
+#endif
     
     Object *object = collector->firstUnused;
     while(object)
@@ -535,18 +1950,27 @@ void gcFree(GarbageCollector *collector)
         page = next;
     }
     
-    Environment *environment = collector->firstUnusedEnvironment;
-    while(environment)
+    for (int32_t sizeClass = 0; sizeClass < ENV_SIZE_CLASSES_COUNT; ++sizeClass)
     {
-        Environment *next = environment->next;
-        env_free(environment);
-        --collector->environmentsCount;
-        environment = next;
+        Environment *environment = collector->firstUnusedEnvironment[sizeClass];
+        while(environment)
+        {
+            Environment *next = environment->next;
+            env_free(environment);
+            --collector->environmentsCount;
+            environment = next;
 #ifdef GC_KEEPS_STATS
-        --collector->unusedEnvironmentsCount;
+            --collector->unusedEnvironmentsCount;
 #endif
+        }
     }
     assert(collector->environmentsCount == 0);
     
+    if (collector->log != NULL)
+    {
+        fclose(collector->log);
+    }
+    gcFreeMarker(&collector->marker);
+    lox_free(collector->locked);
     lox_free(collector);
 }
@@ -11,6 +11,8 @@
 #include "environment.h"
 #include "memory.h"
 
+#include <stdio.h>
+
 // NOTE: objects with mark set to GC_CLEAR are considered unmarked.
 #define GC_CLEAR -1
 
@@ -19,8 +21,120 @@ typedef struct MemoryPage_tag
     struct MemoryPage_tag *next;
 } MemoryPage;
 
+/*
+ With GC_GENERATIONAL, the objects and the environments are split in two
+ generations. The new ones are allocated in the nursery, and a minor
+ collection marks them from the roots: the locked values, the active
+ environments and the remembered set, made of the old environments,
+ instances, arrays and maps that may reference young objects. The old
+ generation is not visited, and the survivors are promoted to it. The write
+ barriers add an old environment, instance, array or map to the remembered
+ set when one of its slots is assigned; the active environments are always remembered, so that the
+ variables they define need no barrier.
+ A major collection marks and sweeps both generations, when the old one
+ has doubled in size since the last major collection.
+ NOTE: the classes, functions and instances are shared by the objects
+       that wrap them: they become old when they are first marked, so
+       that an old object never wraps a young one. The arrays and maps are
+       wrapped by a single object, but they age the same way.
+ */
+
+/*
+ The marking does not recurse: the marked environments, classes, functions,
+ instances, arrays and maps are pushed on a mark stack, and scanned when they are popped,
+ so that a long chain of objects cannot overflow the C stack. The frames
+ and the global environment are scanned as soon as they are marked.
+ With the incremental marking, a major collection marks the roots, and the
+ rest of the heap is marked by slices of GC_INCREMENTAL_SLICE_WORK
+ structures, one every GC_INCREMENTAL_SLICE_ALLOCATIONS allocations; the
+ minor collections wait for the end of the marking. Everything reachable
+ when the marking starts is marked: the write barriers mark the values
+ overwritten in the environments, in the fields of the instances, in the
+ arrays and in the maps, and
+ the objects and environments allocated meanwhile are marked from the
+ start. The sweep takes place when the mark stack is empty.
+ With GC_PARALLEL_MARK, the major collections of the heaps with at least
+ GC_PARALLEL_MIN_OBJECTS live objects can be marked by several threads,
+ each with its own mark stack: the threads that run out of work take the
+ segments of the stacks shared by the others.
+ */
+
+typedef struct GCMarkSegment_tag
+{
+    struct GCMarkSegment_tag *previous;
+    int32_t count;
+    // NOTE: pointers to the structures, tagged with their type
+    uintptr_t entries[GC_MARK_SEGMENT_ENTRIES];
+} GCMarkSegment;
+
+typedef struct
+{
+    // NOTE: top segment of the mark stack, and an empty one kept for reuse
+    GCMarkSegment *segment;
+    GCMarkSegment *spare;
+    struct GarbageCollector_tag *collector;
+    // NOTE: state shared by the threads of a parallel marking, or NULL
+    struct GCParallelMark_tag *parallel;
+} GCMarker;
+
+/*
+ The statistics of the collector are always kept, as they only cost a few
+ increments per collection and one per allocation. The collections are
+ timed, and the objects and environments are counted before and after each
+ collection: the marked ones are the survivors of the collection, i.e. the
+ live ones after a major collection and the young ones promoted by a minor
+ collection. The laundered objects are the classes, functions and instances
+ whose payload is freed in the laundry list.
+ */
+typedef struct
+{
+    // NOTE: collections that visit the whole heap, and with GC_GENERATIONAL
+    //       the minor collections, that only visit the nursery.
+    int32_t collectionsCount;
+    int32_t minorCollectionsCount;
+    // NOTE: in nanoseconds
+    uint64_t totalPauseTime;
+    uint64_t maxPauseTime;
+
+    uint64_t markedObjectsCount;
+    uint64_t recycledObjectsCount;
+    uint64_t launderedObjectsCount;
+    int32_t maxLaundrySize;
+    uint64_t markedEnvironmentsCount;
+    uint64_t recycledEnvironmentsCount;
+
+    // NOTE: major collections marked incrementally, and their slices, and
+    //       marked in parallel
+    int32_t incrementalCollectionsCount;
+    int32_t markSlicesCount;
+    int32_t parallelCollectionsCount;
+
+    // NOTE: highest numbers of live objects and environments; the peak of
+    //       the environments is only updated when a collection starts.
+    int32_t peakObjectsCount;
+    int32_t peakEnvironmentsCount;
+    // NOTE: number of objects allocated since the collector was created
+    uint64_t allocatedObjectsCount;
+} GCStats;
+
+// NOTE: state of the collector at the start of a collection
+typedef struct
+{
+    uint64_t startTime;
+    // NOTE: pause of the previous slices of an incremental marking
+    uint64_t pauseTime;
+    // NOTE: objects and environments visited by the collection, i.e. the
+    //       young ones for a minor collection
+    int32_t visitedObjectsCount;
+    int32_t visitedEnvironmentsCount;
+    int32_t activeObjectsCount;
+    int32_t activeEnvironmentsCount;
+    uint64_t launderedObjectsCount;
+} GCSample;
+
 typedef struct GarbageCollector_tag
 {
+    // NOTE: with GC_GENERATIONAL, the old generation
     Object *firstObject;
     Object *laundryList;
     Object *firstUnused;
@@ -31,19 +145,75 @@ typedef struct GarbageCollector_tag
     int32_t visitedMark;
     int32_t recycledMark;
     
+    // NOTE: with GC_GENERATIONAL, the old generation
     Environment *firstEnvironment;
-    Environment *firstUnusedEnvironment;
+    // NOTE: unused environments, by size class
+    Environment *firstUnusedEnvironment[ENV_SIZE_CLASSES_COUNT];
     int32_t environmentsCount;
     int32_t maxEnvironments;
 
-    Object *locked[GC_LOCKS_STACK_SIZE];
+#ifdef GC_GENERATIONAL
+    Object *firstYoungObject;
+    int32_t youngObjectsCount;
+    Environment *firstYoungEnvironment;
+    int32_t youngEnvironmentsCount;
+
+    Environment **rememberedEnvironments;
+    int32_t rememberedEnvironmentsCount;
+    int32_t rememberedEnvironmentsCapacity;
+    LoxInstance **rememberedInstances;
+    int32_t rememberedInstancesCount;
+    int32_t rememberedInstancesCapacity;
+    LoxArray **rememberedArrays;
+    int32_t rememberedArraysCount;
+    int32_t rememberedArraysCapacity;
+    LoxMap **rememberedMaps;
+    int32_t rememberedMapsCount;
+    int32_t rememberedMapsCapacity;
+
+    // NOTE: sizes of the old generation that trigger a major collection
+    int32_t maxOldObjects;
+    int32_t maxOldEnvironments;
+    bool isMinorCollection;
+#endif
+
+    // NOTE: stack of the values retained by the interpreter. It is also
+    //       used as the operand stack of the virtual machine. The stack
+    //       grows when it is full, which moves it: pointers to the locked
+    //       values are invalidated by the next call to gcLock.
+    Value *locked;
     int32_t lockedCount;
+    int32_t lockedCapacity;
+
+    // NOTE: the frames of the interpreter, whose values are marked
+    const FrameStack *frames;
+    Environment *globals;
+
+    GCMarker marker;
+    // NOTE: mark of the new objects and environments, that are allocated
+    //       marked while an incremental marking is in progress
+    int32_t allocationMark;
+    bool isIncremental;
+    bool isMarking;
+    int32_t sliceAllocationsCount;
+    GCSample markingSample;
+    // NOTE: number of threads that mark the large heaps
+    int32_t markThreadsCount;
+    // NOTE: if true, the allocations never collect the heap, e.g. while a
+    //       snapshot is restored, as the objects it links are not reachable
+    //       yet, see cache_loadSnapshot().
+    bool isPaused;
     
     MemoryPage *memoryPages;
 
     int32_t activeEnvironmentsCount;
     int32_t activeObjectsCount;
 
+    GCStats stats;
+    // NOTE: if not NULL, a line is written to this file for each
+    //       collection, see gcSetLog().
+    FILE *log;
+
     // NOTE: This is just to take some stats
 #ifdef GC_KEEPS_STATS
     int32_t unusedObjectsCount;
@@ -58,28 +228,54 @@ GarbageCollector * gcInit(void);
 void gcFree(GarbageCollector *collector);
 Object * gcGetObject(GarbageCollector *collector);
 void gcSetGlobalEnvironment(Environment *globals, GarbageCollector *collector);
-Environment * gcGetEnvironment(GarbageCollector *collector);
+void gcSetFrameStack(const FrameStack *frames, GarbageCollector *collector);
+Environment * gcGetEnvironment_(int32_t slotsCount, GarbageCollector *collector, const char *file, int line);
+#define gcGetEnvironment(slotsCount, collector) gcGetEnvironment_(slotsCount, collector, __FILE__, __LINE__)
 void gcCollect(GarbageCollector *collector);
+bool gcGrowLocks(GarbageCollector *collector);
+bool gcSetLog(const char *filename, GarbageCollector *collector);
+char * gcStatsDescription(const GarbageCollector *collector);
+void gcSetMarking(bool isIncremental, int32_t threadsCount, GarbageCollector *collector);
+void gcShadeObject(Object *object, GarbageCollector *collector);
 
-inline bool gcLock(Object *object, GarbageCollector *collector)
+typedef void (*GCObjectVisitor)(Object *object, void *context);
+void gcForEachObject(GCObjectVisitor visit, void *context, const GarbageCollector *collector);
+#ifdef GC_GENERATIONAL
+void gcRememberEnvironment(Environment *environment, GarbageCollector *collector);
+void gcRememberInstance(LoxInstance *instance, GarbageCollector *collector);
+void gcRememberArray(LoxArray *array, GarbageCollector *collector);
+void gcRememberMap(LoxMap *map, GarbageCollector *collector);
+#endif
+
+// Pushes `value` on the stack of locked values. Returns false if the stack
+// reached GC_LOCKS_MAX_SIZE values.
+inline bool gcLock(Value value, GarbageCollector *collector)
 {
-    if (collector->lockedCount == ARRAY_COUNT(collector->locked))
+    if (collector->lockedCount == collector->lockedCapacity && !gcGrowLocks(collector))
     {
-        // TODO: At the moment, a stack overflow exception is thrown here.
-        // This is fine since GC_LOCKS_STACK_SIZE is chose to be large.
-        // Should we keep it smaller and dynamically grow the stack instead?
         return false;
     }
-    collector->locked[collector->lockedCount++] = object;
+    collector->locked[collector->lockedCount++] = value;
     return true;
 }
 
+// Write barrier of the incremental marking: `value`, that is about to be
+// overwritten, is marked, as it may have been reachable when the marking
+// started.
+inline void gcOverwrite(Value value, GarbageCollector *collector)
+{
+    if (collector->isMarking && val_isObject(value))
+    {
+        gcShadeObject(val_asObject(value), collector);
+    }
+}
+
 inline void gcPopLock(GarbageCollector *collector)
 {
     assert(collector->lockedCount > 0);
     --collector->lockedCount;
 #ifdef DEBUG_SCRAMBLE_MEMORY
-    collector->locked[collector->lockedCount] = DEBUG_SCRAMBLE_VALUE;
+    collector->locked[collector->lockedCount] = (Value)(uintptr_t)DEBUG_SCRAMBLE_VALUE;
 #endif
 }
 
@@ -89,7 +285,7 @@ inline void gcPopLockn(int32_t n, GarbageCollector *collector)
 #ifdef DEBUG_SCRAMBLE_MEMORY
     for (int32_t index = 0; index < n; ++index)
     {
-        collector->locked[collector->lockedCount + index] = DEBUG_SCRAMBLE_VALUE;
+        collector->locked[collector->lockedCount + index] = (Value)(uintptr_t)DEBUG_SCRAMBLE_VALUE;
     }
 #endif
     assert(collector->lockedCount >= 0);
@@ -0,0 +1,85 @@
+//
+//  inline_cache.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "inline_cache.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+extern inline InlineCacheEntry * ic_lookup(InlineCache *cache, uint32_t shapeId);
+
+#ifdef INLINE_CACHE_STATS
+static thread_global InlineCache *ic_caches = NULL;
+
+static const char * const ic_kindName[] = {
+    [IC_GET] = "get",
+    [IC_SET] = "set",
+    [IC_SUPER] = "super",
+};
+#endif
+
+void ic_init(InlineCache *cache, InlineCacheKind kind, const Token *name)
+{
+    for (int32_t index = 0; index < LOX_INLINE_CACHE_SIZE; ++index)
+    {
+        cache->entries[index].shapeId = 0;
+        cache->entries[index].index = -1;
+        cache->entries[index].method = NULL;
+    }
+    cache->nextEntry = 0;
+#ifdef INLINE_CACHE_STATS
+    cache->kind = kind;
+    cache->name = name;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->next = NULL;
+#else
+    (void)kind;
+    (void)name;
+#endif
+}
+
+// Called after a lookup missed: returns the entry where the result of the
+// lookup for the shape `shapeId` is to be stored by the caller.
+InlineCacheEntry * ic_insert(InlineCache *cache, uint32_t shapeId)
+{
+    assert(shapeId != 0);
+#ifdef INLINE_CACHE_STATS
+    if (cache->misses++ == 0)
+    {
+        cache->next = ic_caches;
+        ic_caches = cache;
+    }
+#endif
+    InlineCacheEntry *entry = &cache->entries[cache->nextEntry];
+    cache->nextEntry = (cache->nextEntry + 1) % LOX_INLINE_CACHE_SIZE;
+    entry->shapeId = shapeId;
+    return entry;
+}
+
+// Prints the hits and misses of the caches that were used, and forgets
+// them, as the syntax trees that own the caches are about to be freed.
+void ic_printStats(void)
+{
+#ifdef INLINE_CACHE_STATS
+    int64_t hits = 0;
+    int64_t misses = 0;
+    for (InlineCache *cache = ic_caches; cache != NULL; cache = cache->next)
+    {
+        fprintf(stderr, "[line %d] %s '%s': %" PRId64 " hits, %" PRId64 " misses\n",
+                cache->name->lexeme.line + 1, ic_kindName[cache->kind],
+                get_identifier_name(cache->name), cache->hits, cache->misses);
+        hits += cache->hits;
+        misses += cache->misses;
+    }
+    if (ic_caches != NULL)
+    {
+        fprintf(stderr, "inline caches: %" PRId64 " hits, %" PRId64 " misses\n", hits, misses);
+    }
+    ic_caches = NULL;
+#endif
+}
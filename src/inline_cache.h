@@ -0,0 +1,87 @@
+//
+//  inline_cache.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef inline_cache_h
+#define inline_cache_h
+
+#include "common.h"
+#include "token.h"
+
+/*
+ Each property access in the syntax tree has an inline cache, that remembers
+ the result of the lookup for the last shapes seen at that site. Since the
+ shapes of the instances only depend on the class and on the fields that
+ were set, an entry stays valid as long as its shape exists, and a hit
+ skips the search of the field names and of the method tables.
+ The entries are keyed on the id of the shape rather than on its address,
+ as the shapes are freed together with their class.
+ */
+
+struct LoxFunction_tag;
+struct Shape_tag;
+
+typedef enum
+{
+    IC_GET,
+    IC_SET,
+    IC_SUPER,
+} InlineCacheKind;
+
+typedef struct
+{
+    // NOTE: id of the shape of the instance for Get and Set, and of the
+    //       root shape of the superclass for Super. 0 if the entry is empty.
+    uint32_t shapeId;
+    // NOTE: slot of the field, or -1 if the property is a method
+    int32_t index;
+    union
+    {
+        // NOTE: Get and Super: method found when the property is not a field
+        const struct LoxFunction_tag *method;
+        // NOTE: Set: shape of the instance once the field is set
+        struct Shape_tag *shape;
+    };
+} InlineCacheEntry;
+
+typedef struct InlineCache_tag
+{
+    InlineCacheEntry entries[LOX_INLINE_CACHE_SIZE];
+    // NOTE: index of the entry replaced on the next miss
+    int32_t nextEntry;
+#ifdef INLINE_CACHE_STATS
+    InlineCacheKind kind;
+    const Token *name;
+    int64_t hits;
+    int64_t misses;
+    // NOTE: the caches that missed at least once are linked in a list,
+    //       so that their statistics can be printed.
+    struct InlineCache_tag *next;
+#endif
+} InlineCache;
+
+void ic_init(InlineCache *cache, InlineCacheKind kind, const Token *name);
+InlineCacheEntry * ic_insert(InlineCache *cache, uint32_t shapeId);
+void ic_printStats(void);
+
+// Returns the entry of `cache` for the shape with id `shapeId`, or NULL
+// if there is none.
+inline InlineCacheEntry * ic_lookup(InlineCache *cache, uint32_t shapeId)
+{
+    for (int32_t index = 0; index < LOX_INLINE_CACHE_SIZE; ++index)
+    {
+        if (cache->entries[index].shapeId == shapeId)
+        {
+#ifdef INLINE_CACHE_STATS
+            cache->hits++;
+#endif
+            return &cache->entries[index];
+        }
+    }
+    return NULL;
+}
+
+#endif /* inline_cache_h */
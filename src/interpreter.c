@@ -9,20 +9,22 @@
 
 #include "common.h"
 #include "garbage_collector.h"
+#include "jit.h"
+#include "lox_array.h"
 #include "lox_callable.h"
 #include "lox_class.h"
 #include "lox_function.h"
 #include "lox_instance.h"
+#include "lox_map.h"
+#include "lox_math.h"
+#include "lox_string.h"
+#include "memory_pool.h"
 #include "objects.h"
 #include "return.h"
 #include "token.h"
 
 /* Exceptions */
 
-#define LOX_EXCEPTION_SETUP_LONGJMP 0
-#define LOX_EXCEPTION_RUNTIME_ERROR 1
-#define LOX_EXCEPTION_EXIT          2
-
 __attribute__((__noreturn__))
 void interpreter_throwExit(Interpreter *interpreter)
 {
@@ -30,9 +32,18 @@ void interpreter_throwExit(Interpreter *interpreter)
     longjmp(interpreter->catchLocation, LOX_EXCEPTION_EXIT);
 }
 
+// Stops the program after a syntax or resolution error of a function body
+// that was parsed at its first call, see function_parseBody(). The error was
+// already reported, and lox_hadError_ is set.
+__attribute__((__noreturn__))
+void interpreter_throwCompileError(Interpreter *interpreter)
+{
+    longjmp(interpreter->catchLocation, LOX_EXCEPTION_COMPILE_ERROR);
+}
+
 
 __attribute__((__noreturn__))
-static inline void interpreter_throwError(Error *error, Interpreter *interpreter)
+void interpreter_throwError(Error *error, Interpreter *interpreter)
 {
     // NOTE: we only keep track of the last error that occurred for now.
     if(interpreter->runtimeError)
@@ -45,21 +56,21 @@ static inline void interpreter_throwError(Error *error, Interpreter *interpreter
 }
 
 __attribute__((__noreturn__))
-static inline void interpreter_throwNewError(Token *token, const char *message, Interpreter *interpreter)
+void interpreter_throwNewError(Token *token, const char *message, Interpreter *interpreter)
 {
     Error *error = initError(token, message);
     interpreter_throwError(error, interpreter);
 }
 
 __attribute__((__noreturn__))
-static inline void interpreter_throwNewErrorString(Token *token, char *message, Interpreter *interpreter)
+void interpreter_throwNewErrorString(Token *token, char *message, Interpreter *interpreter)
 {
     Error *error = initErrorString(token, message);
     interpreter_throwError(error, interpreter);
 }
 
 __attribute__((__noreturn__))
-static inline void interpreter_throwErrorIdentifier(const char *prefixLiteral, const Token *identifier, const char *suffixLiteral, Interpreter *interpreter)
+void interpreter_throwErrorIdentifier(const char *prefixLiteral, const Token *identifier, const char *suffixLiteral, Interpreter *interpreter)
 {
     Error *error = initErrorIdentifier(prefixLiteral, identifier, suffixLiteral);
     interpreter_throwError(error, interpreter);
@@ -74,27 +85,77 @@ void interpreter_clearRuntimeError(Interpreter *interpreter)
     }
 }
 
-// NOTE: Pushes an object on the stack of locked objects. If the stack is
+// NOTE: Pushes a value on the stack of locked values. If the stack is
 //       full, throws a stack overflow exception.
-#define GC_LOCK(object, token) do {                                       \
-    if (gcLock(object, interpreter->collector) == false)                  \
+#define GC_LOCK(value, token) do {                                        \
+    if (gcLock(value, interpreter->collector) == false)                   \
         interpreter_throwNewError(token, "Stack overflow.", interpreter); \
 } while (0)
 
 /* Evaluation/execution/calls */
 
-static inline Object * evaluate(Expr *expr, Interpreter *interpreter)
+#define DECLARE_VISITOR(type) \
+static Value interpreter_visit##type##Expr(type *expr, Interpreter *interpreter);
+FOREACH_AST_NODE(DECLARE_VISITOR)
+#undef DECLARE_VISITOR
+
+#define DECLARE_VISITOR(type) \
+static Return * interpreter_visit##type##Stmt(type##Stmt *stmt, Interpreter *interpreter);
+FOREACH_STMT_NODE(DECLARE_VISITOR)
+#undef DECLARE_VISITOR
+
+// NOTE: the expressions and the statements are dispatched with a switch on
+//       their type instead of through an ExprVisitor or a StmtVisitor, so
+//       that the compiler can inline the visitors, that are typed on the
+//       interpreter. The visitors stay for the resolver and the compiler.
+static inline Value evaluate(Expr *expr, Interpreter *interpreter)
 {
-    Object *result = (Object *)expr_accept_visitor(expr, &interpreter->exprVisitor, interpreter);
+    Value result = VAL_NIL;
+    switch(expr->type)
+    {
+#define DEFINE_EVALUATE_CASE(type)                                      \
+        case EXPR_##type: {                                             \
+            result = interpreter_visit##type##Expr((type *)expr, interpreter); \
+        } break;
+        FOREACH_AST_NODE(DEFINE_EVALUATE_CASE)
+#undef DEFINE_EVALUATE_CASE
+    }
     return result;
 }
 
 static inline Return * execute(Stmt *statement, Interpreter *interpreter)
 {
-    Return *ret = (Return *)stmt_accept_visitor(statement, &interpreter->stmtVisitor, interpreter);
+    Return *ret = NULL;
+    switch(statement->type)
+    {
+#define DEFINE_EXECUTE_CASE(type)                                       \
+        case STMT_##type: {                                             \
+            ret = interpreter_visit##type##Stmt((type##Stmt *)statement, interpreter); \
+        } break;
+        FOREACH_STMT_NODE(DEFINE_EXECUTE_CASE)
+#undef DEFINE_EXECUTE_CASE
+    }
     return ret;
 }
 
+// NOTE: the entry points of the native code of the JIT into the
+//       interpreter, see jit.c.
+Return * interpreter_executeStatement(Stmt *statement, Interpreter *interpreter)
+{
+    return execute(statement, interpreter);
+}
+
+Value interpreter_evaluate(Expr *expr, Interpreter *interpreter)
+{
+    return evaluate(expr, interpreter);
+}
+
+#ifdef INTERPRETER_COMPUTED_GOTO
+// NOTE: computed gotos are an extension of GCC and Clang.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 Return * interpreter_executeBlock(Stmt *statements, Environment *environment, Interpreter *interpreter)
 {
     Environment *previous = interpreter->environment;
@@ -102,6 +163,42 @@ Return * interpreter_executeBlock(Stmt *statements, Environment *environment, In
     
     Return *ret = NULL;
     Stmt *statement = statements;
+#ifdef INTERPRETER_COMPUTED_GOTO
+    // NOTE: each statement jumps directly to the code of the next one,
+    //       which gives each of them its own indirect branch to predict.
+    static void *dispatchTable[] = {
+#define DEFINE_LABEL_ADDRESS(type) &&execute_##type,
+        FOREACH_STMT_NODE(DEFINE_LABEL_ADDRESS)
+#undef DEFINE_LABEL_ADDRESS
+    };
+#define DISPATCH_NEXT()                          \
+    do {                                         \
+        if (ret != NULL)                         \
+        {                                        \
+            goto done;                           \
+        }                                        \
+        statement = statement->next;             \
+        if (statement == NULL)                   \
+        {                                        \
+            goto done;                           \
+        }                                        \
+        goto *dispatchTable[statement->type];    \
+    } while (0)
+
+    if (statement != NULL)
+    {
+        goto *dispatchTable[statement->type];
+    }
+    goto done;
+#define DEFINE_EXECUTE_LABEL(type)                                              \
+execute_##type:                                                                 \
+    ret = interpreter_visit##type##Stmt((type##Stmt *)statement, interpreter);  \
+    DISPATCH_NEXT();
+    FOREACH_STMT_NODE(DEFINE_EXECUTE_LABEL)
+#undef DEFINE_EXECUTE_LABEL
+#undef DISPATCH_NEXT
+done:
+#else
     while(statement)
     {
         ret = execute(statement, interpreter);
@@ -111,133 +208,61 @@ Return * interpreter_executeBlock(Stmt *statements, Environment *environment, In
         }
         statement = statement->next;
     }
+#endif
 
     interpreter->environment = previous;
 
     return ret;
 }
 
-static inline Object * interpreter_call(lox_callable_function *f, LoxArguments *arguments, Interpreter *interpreter)
-{
-    Object *result = f(arguments, interpreter);
-    return result;
-}
-
-static inline Object *interpreter_callClass(LoxClass *klass, LoxArguments *arguments, Error **error, Interpreter *interpreter)
-{
-    struct LoxClassInitializerContext context = {interpreter, klass, NULL};
-    Object *result = klass->callable->function(arguments, &context);
-    *error = context.error;
-    return result;
-}
-
-/* Locals */
-
-#ifdef USE_LOCALS_HASH_MAP
-// TODO: test/tune hash function
-// NOTE: This is essentially http://xoroshiro.di.unimi.it/splitmix64.c
-static inline uint32_t hashPointer(const void *pointer)
-{
-    uint64_t z = (uint64_t)pointer;
-    z += 0x9e3779b97f4a7c15;
-    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
-    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
-    return (uint32_t)(z ^ (z >> 31));
-}
+#ifdef INTERPRETER_COMPUTED_GOTO
+#pragma GCC diagnostic pop
 #endif
 
-// Inserts expression `expr` in the hash map
-void interpreter_resolve(Expr *expr, int32_t depth, int32_t index, Interpreter *interpreter)
+static inline Value interpreter_call(lox_callable_function *f, LoxArguments *arguments, Interpreter *interpreter)
 {
-    assert(interpreter->localsCount != LOCALS_HASH_MAP_SIZE);
-#ifdef USE_LOCALS_HASH_MAP
-    uint32_t hash = hashPointer(expr) & (LOCALS_HASH_MAP_SIZE - 1);
-    while(interpreter->locals[hash].expr != 0)
-    {
-        ++hash;
-        if (hash == LOCALS_HASH_MAP_SIZE)
-        {
-            hash = 0;
-        }
-    }
-#else
-    uint32_t hash = interpreter->localsCount;
-#endif
-    interpreter->locals[hash].expr = expr;
-    interpreter->locals[hash].depth = depth;
-    interpreter->locals[hash].index = index;
-    interpreter->localsCount++;
+    Value result = f(arguments, interpreter);
+    return result;
 }
 
-// Returns the entry for the local object represented by expr.
-// If not found, returns NULL instead (the variable is a global)
-static const LocalEntry *
-localsGet(const void *expr, const LocalEntry *locals, int32_t localsCount)
+__attribute__((__noreturn__))
+void interpreter_throwArityError(Token *paren, int32_t arity, int32_t argumentsCount, Interpreter *interpreter)
 {
-#ifdef USE_LOCALS_HASH_MAP
-    uint32_t i = hashPointer(expr) & (LOCALS_HASH_MAP_SIZE - 1);
-    do {
-        const LocalEntry *entry = locals + i;
-        if (entry->expr == expr)
-        {
-            return entry;
-        }
-        if (entry->expr == 0)
-        {
-            return NULL;
-        }
-        ++i;
-        if (i == LOCALS_HASH_MAP_SIZE)
-        {
-            i = 0;
-        }
-    } while(true);
-#else
-    for (int32_t i = 0; i < localsCount; i++)
-    {
-        const LocalEntry *entry = locals + i;
-        if (entry->expr == expr)
-        {
-            return entry;
-        }
-    }
-    return NULL;
-#endif
+    char *message = str_alloc(128);
+    sprintf(message, "Expected %d arguments but got %d.", arity, argumentsCount);
+    interpreter_throwNewErrorString(paren, message, interpreter);
 }
 
 /* Variables definition/assignment */
 
-// Looks up the identifier amongs the locals, and if not found among the globals.
-// If the identifier is found, returns a copy of its value; if not returns NULL.
-// The caller is responsible for freeing the value.
-static Object *
-lookUpVariable(const Token *identifier, const void *expr, Interpreter *interpreter)
+// Looks up the variable at the location `slot` computed by the resolver.
+// If the variable is defined, returns its value; if not throws a runtime
+// error.
+static inline Value
+lookUpVariable(const Token *identifier, const VariableSlot *slot, Interpreter *interpreter)
 {
-    Object *value;
+    Value value;
     Error *error = NULL;
-    const LocalEntry *entry = localsGet(expr, interpreter->locals, interpreter->localsCount);
-    if (entry != NULL)
+    if (slot->depth != VAR_DEPTH_GLOBAL)
     {
-        value = env_getAt(identifier, entry->depth, entry->index, interpreter->environment, &error, interpreter->collector);
+        value = env_getAt(identifier, slot->depth, slot->index, interpreter->environment, &error);
     } else {
-        value = env_getGlobal(identifier, interpreter->globals, &error, interpreter->collector);
+        value = env_getGlobal(identifier, slot->index, interpreter->globals, &error);
     }
     if (error)
     {
         interpreter_throwError(error, interpreter);
-        assert(value == NULL);
     }
     return value;
 }
 
-static void assignVariable(const Token *identifier, const void *expr, Object *value, Interpreter *interpreter)
+static inline void assignVariable(const Token *identifier, const VariableSlot *slot, Value value, Interpreter *interpreter)
 {
-    const LocalEntry *entry = localsGet(expr, interpreter->locals, interpreter->localsCount);
-    if (entry != NULL)
+    if (slot->depth != VAR_DEPTH_GLOBAL)
     {
-        env_assignAt(value, entry->depth, entry->index, interpreter->environment, interpreter->collector);
+        env_assignAt(value, slot->depth, slot->index, interpreter->environment, interpreter->collector);
     } else {
-        Error *error = env_assignGlobal(identifier, value, interpreter->globals, interpreter->collector);
+        Error *error = env_assignGlobal(identifier, slot->index, value, interpreter->globals);
         if(error != NULL)
         {
             interpreter_throwError(error, interpreter);
@@ -245,18 +270,30 @@ static void assignVariable(const Token *identifier, const void *expr, Object *va
     }
 }
 
-static void interpreter_defineNative(char *name, lox_callable_function f, int32_t argsCount, Interpreter *interpreter)
+// Defines the natives of `module` as globals.
+// NOTE: the natives must be defined before the other globals, as they are
+//       kept when the interpreter is reset, see interpreter_reset().
+void interpreter_defineModule(const LoxNativeModule *module, Interpreter *interpreter)
 {
-    Object *callable = obj_wrapCallable(callableInit(f, argsCount), interpreter->collector);
-    env_defineNative(name, callable, interpreter->globals);
+    assert(interpreter->nativesCount == interpreter->globals->slotsUsed);
+    assert(interpreter->nativesCount + module->count <= LOX_MAX_NATIVES);
+    for (int32_t index = 0; index < module->count; ++index)
+    {
+        const LoxCallable *native = &module->natives[index];
+        assert(native->arity >= 0 && native->arity <= LOX_MAX_ARG_COUNT);
+        Value callable = obj_wrapCallable(native, interpreter->collector);
+        env_defineNative(native->name, callable, interpreter->globals);
+        interpreter->natives[interpreter->globals->slotsUsed - 1] = native;
+    }
+    interpreter->nativesCount = interpreter->globals->slotsUsed;
 }
 
 /* Visitors helpers */
 
 // Returns true if the operand is a number, otherwise throws a runtime error and returns false.
-static bool checkNumberOperand(Token *operator, Object *operand, Interpreter *interpreter)
+static bool checkNumberOperand(Token *operator, Value operand, Interpreter *interpreter)
 {
-    if (operand->type == OT_NUMBER)
+    if (val_isNumber(operand))
     {
         return true;
     }
@@ -265,9 +302,9 @@ static bool checkNumberOperand(Token *operator, Object *operand, Interpreter *in
 }
 
 // Returns true if the operand are numbers, otherwise throws a runtime error and returns false.
-static bool checkNumberOperands(Token *operator, Object *left, Object *right, Interpreter *interpreter)
+static bool checkNumberOperands(Token *operator, Value left, Value right, Interpreter *interpreter)
 {
-    if (left->type == OT_NUMBER && right->type == OT_NUMBER)
+    if (val_isNumber(left) && val_isNumber(right))
     {
         return true;
     }
@@ -277,79 +314,64 @@ static bool checkNumberOperands(Token *operator, Object *left, Object *right, In
 
 /* Expr visitors */
 
-static void * interpreter_visitAssignExpr(Assign *expr, void *context)
+static Value interpreter_visitAssignExpr(Assign *expr, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    
-    Object *value = evaluate(expr->value, interpreter);
-    assert(value != NULL);
-    GC_LOCK(value, expr->name);
-    Object *duplicate = obj_dup(value, interpreter->collector);
-    GC_LOCK(duplicate, expr->name);
-    assignVariable(expr->name, expr, duplicate, interpreter);
-    gcPopLock(interpreter->collector);
-    gcPopLock(interpreter->collector);
+    Value value = evaluate(expr->value, interpreter);
+    assignVariable(expr->name, &expr->slot, value, interpreter);
     
-    return (void *)value;
+    return value;
 }
 
-// NOTE: In a binary expression, we evaluate the operands in left-to-right order.
-//       Also, we evaluate the operands before checking their types.
-static void * interpreter_visitBinaryExpr(Binary *expr, void *context)
+// Applies the binary operator to the operands `left` and `right`. The
+// operands are read before the result is allocated, so they do not need to
+// be protected from the garbage collector during the call.
+Value interpreter_binaryOperation(Token *operator, Value left, Value right, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    
-    Object *left = evaluate(expr->left, context);
-    GC_LOCK(left, expr->operator);
-    
-    Object *right = evaluate(expr->right, context);
-    GC_LOCK(right, expr->operator);
-
-    Object *result = NULL;
-    TokenType type = expr->operator->type;
+    Value result = VAL_NIL;
+    TokenType type = operator->type;
     switch (type) {
         case TT_GREATER: {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newBoolean(obj_unwrapNumber(left) > obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_boolean(val_asNumber(left) > val_asNumber(right));
         } break;
         case TT_GREATER_EQUAL:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newBoolean(obj_unwrapNumber(left) >= obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_boolean(val_asNumber(left) >= val_asNumber(right));
         } break;
         case TT_LESS:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newBoolean(obj_unwrapNumber(left) < obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_boolean(val_asNumber(left) < val_asNumber(right));
         } break;
         case TT_LESS_EQUAL:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newBoolean(obj_unwrapNumber(left) <= obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_boolean(val_asNumber(left) <= val_asNumber(right));
         } break;
         case TT_MINUS:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newNumber(obj_unwrapNumber(left) - obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_number(val_asNumber(left) - val_asNumber(right));
         } break;
         case TT_PLUS:
         {
-            if (left->type == OT_NUMBER && right->type == OT_NUMBER)
+            if (val_isNumber(left) && val_isNumber(right))
             {
-                result = obj_newNumber(obj_unwrapNumber(left) + obj_unwrapNumber(right), interpreter->collector);
+                result = val_number(val_asNumber(left) + val_asNumber(right));
             }
-            else if (left->type == OT_STRING && right->type == OT_STRING)
+            else if (val_isString(left) && val_isString(right))
             {
-                result = obj_wrapString(str_concat(obj_unwrapString(left), obj_unwrapString(right)), interpreter->collector);
+                result = obj_concatStrings(left, obj_unwrapString(right), interpreter->collector);
             }
-            else if ((left->type == OT_STRING) && (right->type == OT_NUMBER))
+            else if (val_isString(left) && val_isNumber(right))
             {
                 // NOTE: LOX tests do not stringify bools and nil
                 char *rightString = obj_stringify(right);
-                result = obj_wrapString(str_concat(obj_unwrapString(left), rightString), interpreter->collector);
+                result = obj_concatStrings(left, rightString, interpreter->collector);
                 str_free(rightString);
             }
-            else if ((right->type == OT_STRING) && (left->type == OT_NUMBER))
+            else if (val_isString(right) && val_isNumber(left))
             {
                 // NOTE: LOX tests do not stringify bools and nil
                 char *leftString = obj_stringify(left);
@@ -358,213 +380,461 @@ static void * interpreter_visitBinaryExpr(Binary *expr, void *context)
             }
             else
             {
-                interpreter_throwNewError(expr->operator, "Operands must be two numbers or two strings.", interpreter);
+                interpreter_throwNewError(operator, "Operands must be two numbers or two strings.", interpreter);
             }
         } break;
         case TT_SLASH:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            double denominator = obj_unwrapNumber(right);
+            checkNumberOperands(operator, left, right, interpreter);
+            double denominator = val_asNumber(right);
             if(denominator == 0.0)
             {
-                interpreter_throwNewError(expr->operator, "Division by zero.", interpreter);
+                interpreter_throwNewError(operator, "Division by zero.", interpreter);
             }
             else
             {
-                result = obj_newNumber(obj_unwrapNumber(left) / denominator, interpreter->collector);
+                result = val_number(val_asNumber(left) / denominator);
             }
         } break;
         case TT_STAR:
         {
-            checkNumberOperands(expr->operator, left, right, interpreter);
-            result = obj_newNumber(obj_unwrapNumber(left) * obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperands(operator, left, right, interpreter);
+            result = val_number(val_asNumber(left) * val_asNumber(right));
         } break;
         case TT_BANG_EQUAL:
         {
-            result = obj_newBoolean(!isEqual(left, right), interpreter->collector);
+            result = val_boolean(!isEqual(left, right));
         } break;
         case TT_EQUAL_EQUAL:
         {
-            result = obj_newBoolean(isEqual(left, right), interpreter->collector);
+            result = val_boolean(isEqual(left, right));
         } break;
         INVALID_DEFAULT_CASE;
     }
-    
-    gcPopLock(interpreter->collector);
-    gcPopLock(interpreter->collector);
-    
-    return (void *)result;
+    return result;
 }
 
-// NOTE: the callee expression is evaluated first, then all arguments from left to right.
-static void * interpreter_visitCallExpr(Call *expr, void *context)
+#ifdef INTERPRETER_QUICKENING
+// Returns the specialization of a binary expression for the operands `left`
+// and `right`, that the generic operation has just accepted.
+static BinaryKind binary_specialize(TokenType operator, Value left, Value right)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    Object *callee = evaluate(expr->callee, interpreter);
-    GC_LOCK(callee, expr->paren);
-
-    LoxArguments *arguments = argumentsInit();
-    if(arguments == NULL)
+    if (val_isNumber(left) && val_isNumber(right))
     {
-        fatal_outOfMemory();
+        switch (operator)
+        {
+            case TT_PLUS: return BINARY_ADD_NUMBERS;
+            case TT_MINUS: return BINARY_SUBTRACT_NUMBERS;
+            case TT_STAR: return BINARY_MULTIPLY_NUMBERS;
+            case TT_SLASH: return BINARY_DIVIDE_NUMBERS;
+            case TT_GREATER: return BINARY_GREATER_NUMBERS;
+            case TT_GREATER_EQUAL: return BINARY_GREATER_EQUAL_NUMBERS;
+            case TT_LESS: return BINARY_LESS_NUMBERS;
+            case TT_LESS_EQUAL: return BINARY_LESS_EQUAL_NUMBERS;
+            default: break;
+        }
     }
-    arguments->count = 0;
-    
-    // NOTE: we wrap `arguments` in an object so that it is not leaked in case of an exception.
-    //       Then, by locking it, we protect the objects it carries too from release.
-    Object *argumentsObj = obj_wrapArguments(arguments, interpreter->collector);
-    GC_LOCK(argumentsObj, expr->paren);
-    
-    Expr *argExpr = expr->arguments;
-    while (argExpr != NULL)
+    else if (operator == TT_PLUS && val_isString(left) && val_isString(right))
     {
-        Object *argument = evaluate(argExpr, interpreter);
-        // NOTE: if the source was parsed correctly, the function must have less than LOX_MAX_ARG_COUNT arguments
-        assert(arguments->count < LOX_MAX_ARG_COUNT);
-        arguments->values[arguments->count++] = argument;
-        argExpr = argExpr->next;
+        return BINARY_CONCAT_STRINGS;
     }
+    return BINARY_GENERIC;
+}
 
-    int32_t arity;
-    if(isLoxCallable(callee))
+// Applies the operation on two numbers `expr` was specialized for.
+static inline Value binary_numbersOperation(Binary *expr, double left, double right, Interpreter *interpreter)
+{
+    switch (expr->kind)
     {
-        const LoxCallable *function = obj_unwrapCallable(callee);
-        arity = callableArity(function);
-        if(arguments->count == arity)
+        case BINARY_ADD_NUMBERS: return val_number(left + right);
+        case BINARY_SUBTRACT_NUMBERS: return val_number(left - right);
+        case BINARY_MULTIPLY_NUMBERS: return val_number(left * right);
+        case BINARY_DIVIDE_NUMBERS:
         {
-            Object *result = interpreter_call(function->function, arguments, interpreter);
-            // NOTE: unlock `arguments`
-            gcPopLock(interpreter->collector);
-            // NOTE: unlock `callee`
-            gcPopLock(interpreter->collector);
-            return (void *)result;
+            if (right == 0.0)
+            {
+                interpreter_throwNewError(expr->operator, "Division by zero.", interpreter);
+            }
+            return val_number(left / right);
         }
+        case BINARY_GREATER_NUMBERS: return val_boolean(left > right);
+        case BINARY_GREATER_EQUAL_NUMBERS: return val_boolean(left >= right);
+        case BINARY_LESS_NUMBERS: return val_boolean(left < right);
+        case BINARY_LESS_EQUAL_NUMBERS: return val_boolean(left <= right);
+        INVALID_DEFAULT_CASE;
     }
-    else if(isLoxFunction(callee))
+    return VAL_NIL;
+}
+#endif
+
+#ifdef INTERPRETER_QUICKENING
+// Applies the operator of `expr` to operands that its specialization for
+// numbers does not accept, and specializes it for them if it was not yet.
+__attribute__((__noinline__))
+static Value binary_quickenOperation(Binary *expr, Value left, Value right, Interpreter *interpreter)
+{
+    BinaryKind kind = expr->kind;
+    if (kind == BINARY_CONCAT_STRINGS && val_isString(left) && val_isString(right))
     {
-        LoxFunction *function = obj_unwrapFunction(callee);
-        arity = function->declaration->arity;
-        if(arguments->count == arity)
-        {
-            Error *error = NULL;
-            Object *result = function_call(function, arguments, &error, interpreter);
-            if (error)
-            {
-                assert(error->token == NULL);
-                error->token = expr->paren;
-                interpreter_throwError(error, interpreter);
-                return NULL;
-            }
-            // NOTE: unlock `arguments`
-            gcPopLock(interpreter->collector);
-            // NOTE: unlock `callee`
-            gcPopLock(interpreter->collector);
+        return obj_concatStrings(left, obj_unwrapString(right), interpreter->collector);
+    }
+    Value result = interpreter_binaryOperation(expr->operator, left, right, interpreter);
+    expr->kind = (kind == BINARY_UNINITIALIZED) ? binary_specialize(expr->operator->type, left, right) : BINARY_GENERIC;
+    return result;
+}
+#endif
 
-            return (void *)result;
-        }
+// NOTE: In a binary expression, we evaluate the operands in left-to-right order.
+//       Also, we evaluate the operands before checking their types.
+//       Only the left operand must be locked, while the right one is
+//       evaluated, and only if it is an object: the operation itself does
+//       not trigger a collection before it has read both operands.
+static Value interpreter_visitBinaryExpr(Binary *expr, Interpreter *interpreter)
+{
+    Value left = evaluate(expr->left, interpreter);
+    bool isLeftLocked = val_isObject(left);
+    if (isLeftLocked)
+    {
+        GC_LOCK(left, expr->operator);
+    }
+    
+    Value right = evaluate(expr->right, interpreter);
+
+#ifdef INTERPRETER_QUICKENING
+    // NOTE: the left operand of the operations on numbers is not locked.
+    if (expr->kind >= BINARY_ADD_NUMBERS && val_isNumber(left) && val_isNumber(right))
+    {
+        return binary_numbersOperation(expr, val_asNumber(left), val_asNumber(right), interpreter);
+    }
+    Value result = binary_quickenOperation(expr, left, right, interpreter);
+#else
+    Value result = interpreter_binaryOperation(expr->operator, left, right, interpreter);
+#endif
+    
+    if (isLeftLocked)
+    {
+        gcPopLock(interpreter->collector);
     }
-    else if(isLoxClass(callee))
+    
+    return result;
+}
+
+// Evaluates the callee of the call `expr`, then all arguments from left to
+// right, and locks them; returns the number of arguments.
+// NOTE: If the callee is a method of an instance, the method is stored in
+//       `method` and the instance in `callee`, so that the method is invoked
+//       with the instance as "this" without being bound to it.
+__attribute__((__always_inline__))
+static inline int32_t interpreter_pushCall(Call *expr, const LoxFunction **method, Value *callee, Interpreter *interpreter)
+{
+    *callee = VAL_NIL;
+    *method = NULL;
+    if (expr->callee->type == EXPR_Get)
     {
-        LoxClass *klass = obj_unwrapClass(callee);
-        arity = klass->callable->arity;
-        if(arguments->count == arity)
+        Get *get = (Get *)expr->callee;
+        Value object = evaluate(get->object, interpreter);
+        GC_LOCK(object, get->name);
+        *method = interpreter_getMethod(object, get->name, &get->cache, callee, interpreter);
+        if (*method != NULL)
+        {
+            // NOTE: the receiver stays locked in place of the callee
+            *callee = object;
+        }
+        else
         {
-            Error *error = NULL;
-            Object *result = interpreter_callClass(klass, arguments, &error, interpreter);
-            if (error != NULL)
-            {
-                assert(error->token == NULL);
-                error->token = expr->paren;
-                interpreter_throwError(error, interpreter);
-                return NULL;
-            }
-            
-            // NOTE: unlock `arguments`
-            gcPopLock(interpreter->collector);
-            // NOTE: unlock `callee`
             gcPopLock(interpreter->collector);
-
-            return (void *)result;
+            GC_LOCK(*callee, expr->paren);
         }
     }
     else
     {
-        interpreter_throwNewError(expr->paren, "Can only call functions and classes.", interpreter);
+        *callee = evaluate(expr->callee, interpreter);
+        GC_LOCK(*callee, expr->paren);
     }
 
-    char *message = str_alloc(128);
-    sprintf(message, "Expected %d arguments but got %d.", arity, arguments->count);
-    interpreter_throwNewErrorString(expr->paren, message, interpreter);
+    // NOTE: the arguments are pushed on the stack of locked values, right
+    //       above the callee, and are passed to the call in place.
+    int32_t argumentsCount = 0;
+    Expr *argExpr = expr->arguments;
+    while (argExpr != NULL)
+    {
+        Value argument = evaluate(argExpr, interpreter);
+        GC_LOCK(argument, expr->paren);
+        ++argumentsCount;
+        argExpr = argExpr->next;
+    }
+    return argumentsCount;
 }
 
-static void * interpreter_visitGetExpr(Get *expr, void *context)
+#ifdef INTERPRETER_QUICKENING
+// Returns true if the callee of a call specialized as `kind` is still of
+// that kind.
+static inline bool call_isKind(CallKind kind, const LoxFunction *method, Value callee)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    Object *result = NULL;
-    
-    Object *object = evaluate(expr->object, interpreter);
-    assert(object != NULL);
-    Error *error = NULL;
-    if (isLoxInstance(object))
+    switch (kind)
     {
-        GC_LOCK(object, expr->name);
-        LoxInstance *instance = obj_unwrapInstance(object);
-        result = instanceGet(instance, expr->name, &error, interpreter->collector);
-        gcPopLock(interpreter->collector);
+        case CALL_METHOD: return method != NULL;
+        case CALL_FUNCTION: return method == NULL && isLoxFunction(callee);
+        case CALL_NATIVE: return method == NULL && isLoxCallable(callee);
+        case CALL_CLASS: return method == NULL && isLoxClass(callee);
+        default: return false;
     }
-    else
+}
+#endif
+
+// Returns the kind of the callee, or CALL_GENERIC if it cannot be called.
+static inline CallKind call_kindOf(const LoxFunction *method, Value callee)
+{
+    if (method != NULL)
+    {
+        return CALL_METHOD;
+    }
+    if (isLoxCallable(callee))
+    {
+        return CALL_NATIVE;
+    }
+    if (isLoxFunction(callee))
+    {
+        return CALL_FUNCTION;
+    }
+    if (isLoxClass(callee))
+    {
+        return CALL_CLASS;
+    }
+    return CALL_GENERIC;
+}
+
+// Calls `callee`, or `method` with `callee` as "this", with the arguments
+// pushed by interpreter_pushCall(), and unlocks them.
+// NOTE: with INTERPRETER_QUICKENING, the kind of callee the call was
+//       specialized for is checked first, instead of testing each kind.
+__attribute__((__always_inline__))
+static inline Value interpreter_callValue(Call *expr, const LoxFunction *method, Value callee, int32_t argumentsCount, Interpreter *interpreter)
+{
+    LoxArguments arguments = {
+        interpreter->collector->locked + interpreter->collector->lockedCount - argumentsCount,
+        argumentsCount
+    };
+
+#ifdef INTERPRETER_QUICKENING
+    CallKind kind = expr->kind;
+    if (!call_isKind(kind, method, callee))
     {
-        error = initError(expr->name, "Only instances have properties.");
+        kind = call_kindOf(method, callee);
+        expr->kind = (expr->kind == CALL_UNINITIALIZED) ? kind : CALL_GENERIC;
     }
+#else
+    CallKind kind = call_kindOf(method, callee);
+#endif
+
+    int32_t arity = 0;
+    switch (kind)
+    {
+        case CALL_METHOD:
+        {
+            arity = method->declaration->arity;
+            if(arguments.count == arity)
+            {
+                Error *error = NULL;
+                Value result = function_invoke(method, callee, &arguments, &error, interpreter);
+                if (error)
+                {
+                    assert(error->token == NULL);
+                    error->token = expr->paren;
+                    interpreter_throwError(error, interpreter);
+                }
+                // NOTE: unlock the arguments and the callee
+                gcPopLockn(argumentsCount + 1, interpreter->collector);
+
+                return result;
+            }
+        } break;
+        case CALL_NATIVE:
+        {
+            const LoxCallable *function = obj_unwrapCallable(callee);
+            arity = callableArity(function);
+            if(arguments.count == arity)
+            {
+                interpreter->nativeCallToken = expr->paren;
+                Value result = interpreter_call(function->function, &arguments, interpreter);
+                // NOTE: unlock the arguments and the callee
+                gcPopLockn(argumentsCount + 1, interpreter->collector);
+                return result;
+            }
+        } break;
+        case CALL_FUNCTION:
+        {
+            LoxFunction *function = obj_unwrapFunction(callee);
+            arity = function->declaration->arity;
+            if(arguments.count == arity)
+            {
+                Error *error = NULL;
+                Value result = function_call(function, &arguments, &error, interpreter);
+                if (error)
+                {
+                    assert(error->token == NULL);
+                    error->token = expr->paren;
+                    interpreter_throwError(error, interpreter);
+                }
+                // NOTE: unlock the arguments and the callee
+                gcPopLockn(argumentsCount + 1, interpreter->collector);
+
+                return result;
+            }
+        } break;
+        case CALL_CLASS:
+        {
+            LoxClass *klass = obj_unwrapClass(callee);
+            arity = klass->arity;
+            if(arguments.count == arity)
+            {
+                // NOTE: the instance takes the place of the class on the stack,
+                //       so that it is retained until the initializer returns.
+                GarbageCollector *collector = interpreter->collector;
+                Value instance = obj_wrapInstance(instanceInit(klass), collector);
+                collector->locked[collector->lockedCount - argumentsCount - 1] = instance;
+                const LoxFunction *initializer = klass->initializer;
+                if (initializer != NULL)
+                {
+                    Error *error = NULL;
+                    function_invoke(initializer, instance, &arguments, &error, interpreter);
+                    if (error != NULL)
+                    {
+                        assert(error->token == NULL);
+                        error->token = expr->paren;
+                        interpreter_throwError(error, interpreter);
+                    }
+                }
+                
+                // NOTE: unlock the arguments and the instance
+                gcPopLockn(argumentsCount + 1, collector);
+
+                return instance;
+            }
+        } break;
+        default:
+        {
+            interpreter_throwNewError(expr->paren, "Can only call functions and classes.", interpreter);
+        }
+    }
+
+    interpreter_throwArityError(expr->paren, arity, argumentsCount, interpreter);
+}
+
+static Value interpreter_visitCallExpr(Call *expr, Interpreter *interpreter)
+{
+    const LoxFunction *method;
+    Value callee;
+    int32_t argumentsCount = interpreter_pushCall(expr, &method, &callee, interpreter);
+    return interpreter_callValue(expr, method, callee, argumentsCount, interpreter);
+}
+
+// Looks up the property `name` of `object` through the inline cache of the
+// access. If the property is a method, returns it without binding it to
+// `object`; if it is a field, returns NULL and stores its value in `field`.
+const LoxFunction * interpreter_getMethod(Value object, Token *name, InlineCache *cache, Value *field, Interpreter *interpreter)
+{
+    if (!isLoxInstance(object))
+    {
+        interpreter_throwNewError(name, "Only instances have properties.", interpreter);
+    }
+    Error *error = NULL;
+    const LoxFunction *method = instanceLookup(obj_unwrapInstance(object), name, cache, field, &error);
     if (error != NULL)
     {
         interpreter_throwError(error, interpreter);
     }
+    return method;
+}
+
+// Returns the value of the property `name` of `object`; methods are bound
+// to `object`. The object must be protected from the garbage collector by
+// the caller.
+Value interpreter_getProperty(Value object, Token *name, InlineCache *cache, Interpreter *interpreter)
+{
+    Value result = VAL_NIL;
+    const LoxFunction *method = interpreter_getMethod(object, name, cache, &result, interpreter);
+    if (method != NULL)
+    {
+        result = obj_wrapFunction(function_bind(method, object), interpreter->collector);
+    }
+    return result;
+}
+
+static Value interpreter_visitGetExpr(Get *expr, Interpreter *interpreter)
+{
+    Value object = evaluate(expr->object, interpreter);
+    GC_LOCK(object, expr->name);
+    Value result = interpreter_getProperty(object, expr->name, &expr->cache, interpreter);
+    gcPopLock(interpreter->collector);
     return result;
 }
 
-static void  * interpreter_visitGroupingExpr(Grouping *expr, void *context)
+static Value interpreter_visitGroupingExpr(Grouping *expr, Interpreter *interpreter)
 {
-    Object *result = evaluate(expr->expression, context);
-    return (void *)result;
+    Value result = evaluate(expr->expression, interpreter);
+    return result;
 }
 
-static void * interpreter_visitLiteralExpr(Literal *expr, void *context)
+// Returns the value of the literal token `value`. Only strings are allocated.
+Value interpreter_literalValue(const Token *value, Interpreter *interpreter)
 {
-    GarbageCollector *collector = ((Interpreter *)context)->collector;
-    Object *object;
-    Literal *literal = (Literal *)expr;
-    switch(literal->value.type) {
+    GarbageCollector *collector = interpreter->collector;
+    Value object = VAL_NIL;
+    switch(value->type) {
         case TT_NUMBER:
         {
-            object = obj_newNumber(literal->value.number, collector);
+            object = val_number(value->number);
         } break;
         case TT_STRING:
         {
-            object = obj_newString(get_string_value(&literal->value), collector);
+            object = obj_newString(get_string_value(value), collector);
         } break;
         case TT_TRUE:
         {
-            object = obj_newBoolean(true, collector);
+            object = VAL_TRUE;
         } break;
         case TT_FALSE:
         {
-            object = obj_newBoolean(false, collector);
+            object = VAL_FALSE;
         } break;
         case TT_NIL:
         {
-            object = obj_newNil(collector);
+            object = VAL_NIL;
         } break;
         INVALID_DEFAULT_CASE;
     }
-    
-    return (void *)object;
+    return object;
 }
 
-static void * interpreter_visitLogicalExpr(Logical *expr, void *context)
+static Value interpreter_visitLiteralExpr(Literal *expr, Interpreter *interpreter)
 {
-    Object *left = evaluate(expr->left, context);
+    Value object = interpreter_literalValue(&expr->value, interpreter);
+    return object;
+}
+
+static Value interpreter_visitLogicalExpr(Logical *expr, Interpreter *interpreter)
+{
+    Value left = evaluate(expr->left, interpreter);
     
+#ifdef INTERPRETER_QUICKENING
+    // NOTE: the truth of a boolean is its value, and a boolean is not an
+    //       object, so it needs no lock.
+    if (expr->kind == LOGICAL_BOOLEAN && val_isBoolean(left))
+    {
+        if (val_asBoolean(left) == (expr->operator->type == TT_OR))
+        {
+            return left;
+        }
+        return evaluate(expr->right, interpreter);
+    }
+    if (expr->kind != LOGICAL_GENERIC)
+    {
+        bool isSpecialized = (expr->kind == LOGICAL_UNINITIALIZED && val_isBoolean(left));
+        expr->kind = isSpecialized ? LOGICAL_BOOLEAN : LOGICAL_GENERIC;
+    }
+#endif
+
     if(expr->operator->type == TT_OR)
     {
         if(isTruthy(left))
@@ -581,34 +851,25 @@ static void * interpreter_visitLogicalExpr(Logical *expr, void *context)
         }
     }
     
-    Interpreter *interpreter = (Interpreter *)context;
     GC_LOCK(left, expr->operator);
-    Object *right = evaluate(expr->right, context);
+    Value right = evaluate(expr->right, interpreter);
     gcPopLock(interpreter->collector);
 
     return right;
 }
 
-static void *interpreter_visitSetExpr(Set *expr, void *context)
+static Value interpreter_visitSetExpr(Set *expr, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    Object *value = NULL;
+    Value value = VAL_NIL;
 
-    Object *object = evaluate(expr->object, context);
-    assert(object != NULL);
+    Value object = evaluate(expr->object, interpreter);
     if(isLoxInstance(object))
     {
         LoxInstance *instance = obj_unwrapInstance(object);
         
         GC_LOCK(object, expr->name);
-        value = evaluate(expr->value, context);
-        if(value != NULL)
-        {
-            GC_LOCK(value, expr->name);
-            Object *duplicate = obj_dup(value, interpreter->collector);
-            instanceSet(instance, expr->name, duplicate);
-            gcPopLock(interpreter->collector);
-        }
+        value = evaluate(expr->value, interpreter);
+        instanceSet(instance, expr->name, &expr->cache, value, interpreter->collector);
         gcPopLock(interpreter->collector);
     }
     else
@@ -618,122 +879,169 @@ static void *interpreter_visitSetExpr(Set *expr, void *context)
     return value;
 }
 
-static void * interpreter_visitSuperExpr(Super *expr, void *context)
+// Returns the method `method` of the superclass, bound to "this". `depth`
+// and `index` locate "super" as resolved by the resolver. The method is
+// cached for the superclass, keyed on its root shape.
+Value interpreter_superMethod(Token *keyword, Token *method, int32_t depth, int32_t index, InlineCache *cache, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    const LocalEntry *entry = localsGet(expr, interpreter->locals, interpreter->localsCount);
     Error *error = NULL;
-    Object *superClass = env_getAt(expr->keyword, entry->depth, entry->index, interpreter->environment, &error, interpreter->collector);
+    Value superClass = env_getAt(keyword, depth, index, interpreter->environment, &error);
     if (error)
     {
         interpreter_throwError(error, interpreter);
     }
-    GC_LOCK(superClass, expr->keyword);
+    GC_LOCK(superClass, keyword);
     
     // NOTE: "this" is always one level nearer than "super"'s environment.
-    Object *object = env_getAt(expr->keyword, entry->depth - 1, 0, interpreter->environment, &error, interpreter->collector);
+    Value object = env_getAt(keyword, depth - 1, 0, interpreter->environment, &error);
     if (error)
     {
         interpreter_throwError(error, interpreter);
     }
-    GC_LOCK(object, expr->keyword);
+    GC_LOCK(object, keyword);
     
-    const char *methodName = get_identifier_name(expr->method);
-    LoxFunction *method = findMethod(obj_unwrapInstance(object), obj_unwrapClass(superClass), methodName, &error, interpreter->collector);
-    if (error)
+    LoxClass *klass = obj_unwrapClass(superClass);
+    InlineCacheEntry *entry = ic_lookup(cache, klass->shape->id);
+    if (entry == NULL)
     {
-        interpreter_throwError(error, interpreter);
-    }
-    if (method == NULL)
-    {
-        interpreter_throwErrorIdentifier("Undefined property '", expr->method, "'.", interpreter);
+        const LoxFunction *superMethod = classFindMethod(klass, get_identifier_name(method));
+        if (superMethod == NULL)
+        {
+            interpreter_throwErrorIdentifier("Undefined property '", method, "'.", interpreter);
+        }
+        entry = ic_insert(cache, klass->shape->id);
+        entry->index = -1;
+        entry->method = superMethod;
     }
-    assert(method != NULL);
-    Object *result = obj_wrapFunction(method, interpreter->collector);
+    LoxFunction *function = function_bind(entry->method, object);
+    Value result = obj_wrapFunction(function, interpreter->collector);
     gcPopLock(interpreter->collector); // NOTE: unlocks object
     gcPopLock(interpreter->collector); // NOTE: unlocks superClass
 
-    env_release(method->closure);
-
-    return (void *)result;
+    return result;
 }
 
-static void * interpreter_visitThisExpr(This *expr, void *context)
+static Value interpreter_visitSuperExpr(Super *expr, Interpreter *interpreter)
 {
-    Object *result = lookUpVariable(expr->keyword, (Expr *)expr, (Interpreter *)context);
-    return (void *)result;
+    Value result = interpreter_superMethod(expr->keyword, expr->method, expr->slot.depth, expr->slot.index, &expr->cache, interpreter);
+    return result;
 }
 
-static void * interpreter_visitUnaryExpr(Unary *expr, void *context)
+static Value interpreter_visitThisExpr(This *expr, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
+    Value result = lookUpVariable(expr->keyword, &expr->slot, interpreter);
+    return result;
+}
 
-    Object *right = evaluate(expr->right, context);
-    
-    GC_LOCK(right, expr->operator);
-    Object *result = NULL;
-    switch (expr->operator->type)
+// Applies the unary operator to `right`, which must be protected from the
+// garbage collector by the caller.
+Value interpreter_unaryOperation(Token *operator, Value right, Interpreter *interpreter)
+{
+    Value result = VAL_NIL;
+    switch (operator->type)
     {
         case TT_MINUS:
         {
-            checkNumberOperand(expr->operator, right, interpreter);
-            result = obj_newNumber(-obj_unwrapNumber(right), interpreter->collector);
+            checkNumberOperand(operator, right, interpreter);
+            result = val_number(-val_asNumber(right));
         } break;
         case TT_BANG:
         {
-            result = obj_newBoolean(!isTruthy(right), interpreter->collector);
+            result = val_boolean(!isTruthy(right));
         } break;
         INVALID_DEFAULT_CASE;
     }
+    return result;
+}
+
+#ifdef INTERPRETER_QUICKENING
+// Returns the specialization of a unary expression for the operand `right`,
+// that the generic operation has just accepted.
+static UnaryKind unary_specialize(TokenType operator, Value right)
+{
+    if (operator == TT_MINUS && val_isNumber(right))
+    {
+        return UNARY_NEGATE_NUMBER;
+    }
+    if (operator == TT_BANG && val_isBoolean(right))
+    {
+        return UNARY_NOT_BOOLEAN;
+    }
+    return UNARY_GENERIC;
+}
+#endif
+
+static Value interpreter_visitUnaryExpr(Unary *expr, Interpreter *interpreter)
+{
+    Value right = evaluate(expr->right, interpreter);
+    
+#ifdef INTERPRETER_QUICKENING
+    // NOTE: numbers and booleans are not objects, so they need no lock.
+    UnaryKind kind = expr->kind;
+    if (kind == UNARY_NEGATE_NUMBER && val_isNumber(right))
+    {
+        return val_number(-val_asNumber(right));
+    }
+    if (kind == UNARY_NOT_BOOLEAN && val_isBoolean(right))
+    {
+        return val_boolean(!val_asBoolean(right));
+    }
+#endif
+
+    GC_LOCK(right, expr->operator);
+    Value result = interpreter_unaryOperation(expr->operator, right, interpreter);
     gcPopLock(interpreter->collector);
 
-    return (void *)result;
+#ifdef INTERPRETER_QUICKENING
+    expr->kind = (kind == UNARY_UNINITIALIZED) ? unary_specialize(expr->operator->type, right) : UNARY_GENERIC;
+#endif
+    return result;
 }
 
-static void * interpreter_visitVariableExpr(Variable *expr, void *context)
+static Value interpreter_visitVariableExpr(Variable *expr, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    Object *value = lookUpVariable(expr->name, (Expr *)expr, interpreter);
-    return (void *)value;
+    Value value = lookUpVariable(expr->name, &expr->slot, interpreter);
+    return value;
 }
 
 /* Stmt visitors */
 
-static void * interpreter_visitBlockStmt(BlockStmt *stmt, void *context)
+static Return * interpreter_visitBlockStmt(BlockStmt *stmt, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    Error *error = NULL;
-    Environment *environment = env_init(interpreter->environment, &error, interpreter->collector);
-    if (error)
+    Environment *environment;
+    if (stmt->isCaptured)
     {
-        interpreter_throwError(error, interpreter);
+        Error *error = NULL;
+        environment = env_init(interpreter->environment, stmt->slotsCount, &error, interpreter->collector);
+        if (error)
+        {
+            interpreter_throwError(error, interpreter);
+        }
+    }
+    else
+    {
+        environment = env_pushFrame(interpreter->environment, stmt->slotsCount, &interpreter->frames);
     }
     Return *ret = interpreter_executeBlock(stmt->statements, environment, interpreter);
-    env_release(environment);
+    env_release(environment, &interpreter->frames);
 
     return ret;
 }
 
-static void * interpreter_visitClassStmt(ClassStmt *stmt, void *context)
+// Creates the class declared by `stmt`. `superClass` is the evaluated
+// superclass expression, and is ignored if the class has no superclass.
+Value interpreter_createClass(ClassStmt *stmt, Value superClass, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    
-    Error *error = env_define(stmt->name, NULL, interpreter->environment);
-    if (error)
-    {
-        interpreter_throwError(error, interpreter);
-    }
-
-    Object *superClass = NULL;
+    Error *error = NULL;
     Environment *closure = interpreter->environment;
     if (stmt->superClass != NULL) {
-        superClass = evaluate(stmt->superClass, interpreter);
         if (!isLoxClass(superClass))
         {
             interpreter_throwNewError(stmt->name, "Superclass must be a class.", interpreter);
         }
         GC_LOCK(superClass, stmt->name);
-        closure = env_init(interpreter->environment, &error, interpreter->collector);
+        // NOTE: the closure of the methods only stores "super"
+        closure = env_init(interpreter->environment, 1, &error, interpreter->collector);
         gcPopLock(interpreter->collector);
         if (error)
         {
@@ -742,18 +1050,19 @@ static void * interpreter_visitClassStmt(ClassStmt *stmt, void *context)
         env_defineSuper(superClass, closure);
     }
     
-    MethodEntry *methods = lox_allocn(MethodEntry, LOX_METHODS_MAX_COUNT);
-    if(methods == NULL)
+    int32_t methodsCount = 0;
+    for (Stmt *method = AS_STMT(stmt->methods); method != NULL; method = method->next)
     {
-        fatal_outOfMemory();
+        ++methodsCount;
     }
-    int32_t methodsCount = 0;
+    MethodEntry *methods = methodsCount > 0 ? slab_allocn(MethodEntry, methodsCount) : NULL;
+    methodsCount = 0;
     FunctionStmt *method = stmt->methods;
     while(method)
     {
         assert(method->stmt.type == STMT_Function);
         const char *methodName = get_identifier_name(method->name);
-        bool isInitializer = str_isEqual(methodName, "init");
+        bool isInitializer = (methodName == str_internedInit);
         LoxFunction *function = function_init(method, closure, isInitializer);
         methods[methodsCount].name = methodName;
         methods[methodsCount].function = function;
@@ -762,27 +1071,43 @@ static void * interpreter_visitClassStmt(ClassStmt *stmt, void *context)
     }
     
     const char *name = get_identifier_name(stmt->name);
-    LoxClass *klass = classInit(name, obj_unwrapClass(superClass), methods, methodsCount);
-    Object *classObj = obj_wrapClass(klass, interpreter->collector);
+    LoxClass *superKlass = (stmt->superClass != NULL) ? obj_unwrapClass(superClass) : NULL;
+    LoxClass *klass = classInit(name, superKlass, methods, methodsCount);
+    Value classObj = obj_wrapClass(klass, interpreter->collector);
+    return classObj;
+}
+
+static Return * interpreter_visitClassStmt(ClassStmt *stmt, Interpreter *interpreter)
+{
+    Error *error = env_define(stmt->name, VAL_UNDEFINED, interpreter->environment);
+    if (error)
+    {
+        interpreter_throwError(error, interpreter);
+    }
+
+    Value superClass = VAL_NIL;
+    if (stmt->superClass != NULL) {
+        superClass = evaluate(stmt->superClass, interpreter);
+    }
+    Value classObj = interpreter_createClass(stmt, superClass, interpreter);
     
-    assignVariable(stmt->name, stmt, classObj, interpreter);
+    assignVariable(stmt->name, &stmt->slot, classObj, interpreter);
 
     return NULL;
 }
 
-static void * interpreter_visitExpressionStmt(ExpressionStmt *expr, void *context)
+static Return * interpreter_visitExpressionStmt(ExpressionStmt *expr, Interpreter *interpreter)
 {
     // Note: we discard the result of the evaluation.
-    evaluate(expr->expression, (Interpreter *)context);
+    evaluate(expr->expression, interpreter);
     
     return NULL;
 }
 
-static void * interpreter_visitFunctionStmt(FunctionStmt *stmt, void *context)
+static Return * interpreter_visitFunctionStmt(FunctionStmt *stmt, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
     LoxFunction *function = function_init(stmt, interpreter->environment, false);
-    Object *funObject = obj_wrapFunction(function, interpreter->collector);
+    Value funObject = obj_wrapFunction(function, interpreter->collector);
     Error *error = env_define(stmt->name, funObject, interpreter->environment);
     if (error)
     {
@@ -792,18 +1117,18 @@ static void * interpreter_visitFunctionStmt(FunctionStmt *stmt, void *context)
     return NULL;
 }
 
-static void * interpreter_visitIfStmt(IfStmt *stmt, void *context)
+static Return * interpreter_visitIfStmt(IfStmt *stmt, Interpreter *interpreter)
 {
     Return *ret;
     
-    Object *condition = evaluate(stmt->condition, (Interpreter *)context);
+    Value condition = evaluate(stmt->condition, interpreter);
     if (isTruthy(condition))
     {
-        ret = execute(stmt->thenBranch, (Interpreter *)context);
+        ret = execute(stmt->thenBranch, interpreter);
     }
     else if (stmt->elseBranch != NULL)
     {
-        ret = execute(stmt->elseBranch, (Interpreter *)context);
+        ret = execute(stmt->elseBranch, interpreter);
     }
     else
     {
@@ -812,38 +1137,67 @@ static void * interpreter_visitIfStmt(IfStmt *stmt, void *context)
     return ret;
 }
 
-static void * interpreter_visitPrintStmt(PrintStmt *stmt, void *context)
+static Return * interpreter_visitPrintStmt(PrintStmt *stmt, Interpreter *interpreter)
 {
-    Object *value = evaluate(stmt->expression, (Interpreter *)context);
-    assert(value != NULL);
+    Value value = evaluate(stmt->expression, interpreter);
 
-    char *str = obj_stringify(value);
-    printf("%s\n", str);
-    str_free(str);
+    output_printValue(value, &interpreter->output);
     
     return NULL;
 }
 
-static void * interpreter_visitReturnStmt(ReturnStmt *stmt, void *context)
+// NOTE: the call of a Lox function or method in a return statement is a
+//       tail call: there is nothing left to do in the calling function
+//       when it returns, as it only releases its environments. Instead of
+//       being invoked here, it is left on the stack of locked values and
+//       recorded in `interpreter->tailCall`, and function_invoke() runs it
+//       in place of the calling function.
+// NOTE: kept out of interpreter_visitReturnStmt(), so that the common
+//       return statements do not pay for a second copy of the call.
+__attribute__((__noinline__))
+static Return * interpreter_returnCall(Call *call, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-    
-    Object *value = NULL;
+    const LoxFunction *method;
+    Value callee;
+    int32_t argumentsCount = interpreter_pushCall(call, &method, &callee, interpreter);
+    const LoxFunction *function = method;
+    Value receiver = callee;
+    if (function == NULL && isLoxFunction(callee))
+    {
+        function = obj_unwrapFunction(callee);
+        receiver = function->receiver;
+    }
+    if (function != NULL && function->declaration->arity == argumentsCount)
+    {
+        interpreter->tailCall.function = function;
+        interpreter->tailCall.receiver = receiver;
+        interpreter->tailCall.argumentsCount = argumentsCount;
+        return &interpreter->returnValue;
+    }
+    Value value = interpreter_callValue(call, method, callee, argumentsCount, interpreter);
+    return return_init(value, &interpreter->returnValue);
+}
+
+static Return * interpreter_visitReturnStmt(ReturnStmt *stmt, Interpreter *interpreter)
+{
+    Value value = VAL_NIL;
     if (stmt->value != NULL)
     {
+        if (stmt->value->type == EXPR_Call && interpreter->useTailCalls)
+        {
+            return interpreter_returnCall((Call *)stmt->value, interpreter);
+        }
         value = evaluate(stmt->value, interpreter);
     }
 
-    Return *ret = return_init(value, interpreter->collector);
+    Return *ret = return_init(value, &interpreter->returnValue);
     return ret;
 }
 
 // If the variable has an initializer, evaluate it. If not, sets the variable to `nil`.
-static void * interpreter_visitVarStmt(VarStmt *stmt, void *context)
+static Return * interpreter_visitVarStmt(VarStmt *stmt, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
-
-    Object *value = NULL;
+    Value value = VAL_UNDEFINED;
     if (stmt->initializer != NULL)
     {
         value = evaluate(stmt->initializer, interpreter);
@@ -857,14 +1211,20 @@ static void * interpreter_visitVarStmt(VarStmt *stmt, void *context)
     return NULL;
 }
 
-static void * interpreter_visitWhileStmt(WhileStmt *stmt, void *context)
+static Return * interpreter_visitWhileStmt(WhileStmt *stmt, Interpreter *interpreter)
 {
-    Interpreter *interpreter = (Interpreter *)context;
     Return *ret = NULL;
 
     while (true)
     {
-        Object *condition = evaluate(stmt->condition, interpreter);
+#ifdef INTERPRETER_JIT
+        if (interpreter->jit != NULL && jit_isHotLoop(stmt))
+        {
+            // NOTE: the native code runs the rest of the loop
+            return jit_runLoop(stmt, interpreter);
+        }
+#endif
+        Value condition = evaluate(stmt->condition, interpreter);
         if (isTruthy(condition))
         {
             ret = execute(stmt->body, interpreter);
@@ -897,48 +1257,35 @@ Interpreter * interpreter_init(bool isREPL)
     }
     interpreter->globals = globals;
     interpreter->environment = interpreter->globals;
-
-    for (uint32_t index = 0; index < LOCALS_HASH_MAP_SIZE; ++index)
-    {
-        interpreter->locals[index].expr = 0;
-    }
-    
-    interpreter->localsCount = 0;
-
-    interpreter_defineNative("clock", lox_clock, 0, interpreter);
+    env_initFrames(&interpreter->frames);
+    gcSetFrameStack(&interpreter->frames, interpreter->collector);
+
+    interpreter->nativesCount = 0;
+    interpreter_defineModule(&lox_coreModule, interpreter);
+    interpreter_defineModule(&lox_arrayModule, interpreter);
+    interpreter_defineModule(&lox_mapModule, interpreter);
+    interpreter_defineModule(&lox_mathModule, interpreter);
+    interpreter_defineModule(&lox_stringModule, interpreter);
     if (isREPL)
     {
-        interpreter_defineNative("help", lox_help, 0, interpreter);
-        interpreter_defineNative("quit", lox_quit, 0, interpreter);
-        interpreter_defineNative("env", lox_env, 0, interpreter);
+        interpreter_defineModule(&lox_replModule, interpreter);
     }
 
     interpreter->runtimeError = NULL;
+    interpreter->nativeCallToken = NULL;
     interpreter->source = NULL;
+    output_init(&interpreter->output, stdout);
     
     interpreter->timer = timer_init();
     
+    interpreter->callDepth = 0;
+    interpreter->currentFunction = NULL;
+    interpreter->useTailCalls = true;
+    interpreter->tailCall.function = NULL;
+    interpreter->profiler = NULL;
+    interpreter->jit = NULL;
     interpreter->isREPL = isREPL;
     interpreter->exitREPL = false;
-
-    // Initialize expression visitor
-    {
-        ExprVisitor *visitor = &interpreter->exprVisitor;
-#define DEFINE_VISITOR(type) \
-        visitor->visit##type = interpreter_visit##type##Expr;
-        FOREACH_AST_NODE(DEFINE_VISITOR)
-#undef DEFINE_VISITOR
-    }
-    
-    // Initialize statement visitor
-    {
-    StmtVisitor *visitor = &interpreter->stmtVisitor;
-#define DEFINE_VISITOR(type) \
-    visitor->visit##type = interpreter_visit##type##Stmt;
-        
-    FOREACH_STMT_NODE(DEFINE_VISITOR)
-#undef DEFINE_VISITOR
-    }
     
     return interpreter;
 }
@@ -952,10 +1299,48 @@ void interpreter_free(Interpreter *interpreter)
         freeError(interpreter->runtimeError);
     }
     gcFree(interpreter->collector);
+    env_freeFrames(&interpreter->frames);
+    output_free(&interpreter->output);
 
     lox_free(interpreter);
 }
 
+// Removes the globals defined by the programs that have run, restores the
+// natives they replaced, and collects the objects they leave, so that the
+// interpreter runs the next program as a new one would, without allocating
+// its structures again.
+// NOTE: the syntax trees of the programs must be freed after the reset, as
+//       the objects that are collected may refer to them.
+void interpreter_reset(Interpreter *interpreter)
+{
+    assert(interpreter->environment == interpreter->globals);
+    assert(interpreter->collector->lockedCount == 0);
+    interpreter_clearRuntimeError(interpreter);
+    env_truncateGlobals(interpreter->nativesCount, interpreter->globals);
+    // NOTE: the programs may have redefined or assigned the globals of the
+    //       natives, with values that refer to their syntax trees.
+    for (int32_t slot = 0; slot < interpreter->nativesCount; ++slot)
+    {
+        const LoxCallable *native = interpreter->natives[slot];
+        Value value = interpreter->globals->values[slot];
+        if (!isLoxCallable(value) || obj_unwrapCallable(value) != native)
+        {
+            interpreter->globals->values[slot] = obj_wrapCallable(native, interpreter->collector);
+        }
+    }
+    if (interpreter->collector->isMarking)
+    {
+        // NOTE: finishes the marking in progress, that keeps the objects
+        //       allocated since it started.
+        gcCollect(interpreter->collector);
+    }
+    gcCollect(interpreter->collector);
+
+    interpreter->timer = timer_init();
+    interpreter->callDepth = 0;
+    interpreter->tailCall.function = NULL;
+}
+
 void interpret(Stmt *statements, Interpreter *interpreter)
 {
     Stmt *currentStatement = statements;
@@ -978,16 +1363,26 @@ void interpret(Stmt *statements, Interpreter *interpreter)
         case LOX_EXCEPTION_RUNTIME_ERROR:
         {
             interpreter->environment = interpreter->globals;
+            interpreter->callDepth = 0;
+            interpreter->currentFunction = NULL;
+            env_clearFrames(&interpreter->frames);
             gcClearLocks(interpreter->collector);
+            // NOTE: the output printed before the error comes first
+            output_flush(&interpreter->output);
             lox_runtimeError(interpreter->runtimeError);
         } break;
             
         case LOX_EXCEPTION_EXIT:
+        case LOX_EXCEPTION_COMPILE_ERROR:
         {
             interpreter->environment = interpreter->globals;
+            interpreter->callDepth = 0;
+            interpreter->currentFunction = NULL;
+            env_clearFrames(&interpreter->frames);
             gcClearLocks(interpreter->collector);
         } break;
             
             INVALID_DEFAULT_CASE;
     }
+    output_flush(&interpreter->output);
 }
@@ -12,39 +12,71 @@
 #include "error.h"
 #include "expr.h"
 #include "garbage_collector.h"
+#include "lox_callable.h"
+#include "output.h"
 #include "return.h"
 #include "stmt.h"
 #include "utility.h"
 
 #include <setjmp.h>
 
-// TODO: The size of the locals hash table limits the maximum size of
-// the program that can be run. We need to allow it to grow dynamically.
-// NOTE: Must be a power of 2
-#define LOCALS_HASH_MAP_SIZE 1024
+/* Exceptions */
 
+#define LOX_EXCEPTION_SETUP_LONGJMP 0
+#define LOX_EXCEPTION_RUNTIME_ERROR 1
+#define LOX_EXCEPTION_EXIT          2
+#define LOX_EXCEPTION_COMPILE_ERROR 3
+
+// NOTE: a call in a return statement, whose callee and arguments are on
+//       the top of the stack of locked values, see function_invoke().
+//       `function` is NULL if there is none.
 typedef struct
 {
-    Expr *expr;
-    int32_t depth;
-    int32_t index;
-} LocalEntry;
+    const LoxFunction *function;
+    Value receiver;
+    int32_t argumentsCount;
+} TailCall;
 
 typedef struct Interpreter_tag
 {
-    ExprVisitor exprVisitor;
-    StmtVisitor stmtVisitor;
-    
     Environment *globals;
     Environment *environment;
-    LocalEntry locals[LOCALS_HASH_MAP_SIZE];
-    int32_t localsCount;
+    // NOTE: number of global slots taken by the native functions, and the
+    //       native of each slot, that is restored by interpreter_reset()
+    int32_t nativesCount;
+    const LoxCallable *natives[LOX_MAX_NATIVES];
+    // NOTE: the environments of the scopes that are not captured
+    FrameStack frames;
 
     GarbageCollector *collector;
 
     Error *runtimeError;
     const char *source;
 
+    // NOTE: the output of the print statements
+    OutputBuffer output;
+
+    // NOTE: the parenthesis of the call of the native function being
+    //       executed, that its runtime errors are reported at
+    Token *nativeCallToken;
+
+    // NOTE: carries the value of the return statement being executed
+    Return returnValue;
+
+    // NOTE: number of nested calls of the tree-walking interpreter
+    int32_t callDepth;
+
+    // NOTE: the declaration of the Lox function being executed, NULL for
+    //       the top-level code, that the allocation sampler attributes its
+    //       samples to, see memory_sampler.h.
+    const FunctionStmt *currentFunction;
+
+    // NOTE: records the calls when not NULL, see profiler.h
+    struct Profiler_tag *profiler;
+
+    // NOTE: compiles the hot loops and functions when not NULL, see jit.h
+    struct Jit_tag *jit;
+
     Timer timer;
 
     struct timespec time_start;
@@ -56,6 +88,11 @@ typedef struct Interpreter_tag
     // NOTE: for repl use only
     bool isREPL;
     bool exitREPL;
+
+    // NOTE: if true, the calls in return statements replace the calling
+    //       function instead of nesting in it.
+    bool useTailCalls;
+    TailCall tailCall;
 } Interpreter;
 
 typedef struct
@@ -69,10 +106,35 @@ Interpreter * interpreter_init(bool isREPL);
 void interpreter_free(Interpreter *interpreter);
 void interpret(Stmt *statements, Interpreter *interpreter);
 void interpreter_clearRuntimeError(Interpreter *interpreter);
+void interpreter_reset(Interpreter *interpreter);
 Return * interpreter_executeBlock(Stmt *statements, Environment *environment, Interpreter *interpreter);
-void interpreter_resolve(Expr *expr, int32_t depth, int32_t index, Interpreter *interpreter);
+Return * interpreter_executeStatement(Stmt *statement, Interpreter *interpreter);
+Value interpreter_evaluate(Expr *expr, Interpreter *interpreter);
+
+// NOTE: The following implement the semantics of the language, and are
+//       shared by the tree-walking interpreter and the virtual machine.
+Value interpreter_literalValue(const Token *value, Interpreter *interpreter);
+Value interpreter_binaryOperation(Token *operator, Value left, Value right, Interpreter *interpreter);
+Value interpreter_unaryOperation(Token *operator, Value right, Interpreter *interpreter);
+Value interpreter_getProperty(Value object, Token *name, InlineCache *cache, Interpreter *interpreter);
+const LoxFunction * interpreter_getMethod(Value object, Token *name, InlineCache *cache, Value *field, Interpreter *interpreter);
+Value interpreter_superMethod(Token *keyword, Token *method, int32_t depth, int32_t index, InlineCache *cache, Interpreter *interpreter);
+Value interpreter_createClass(ClassStmt *stmt, Value superClass, Interpreter *interpreter);
+void interpreter_defineModule(const LoxNativeModule *module, Interpreter *interpreter);
 
 __attribute__((__noreturn__))
 void interpreter_throwExit(Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwCompileError(Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwError(Error *error, Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwNewError(Token *token, const char *message, Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwNewErrorString(Token *token, char *message, Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwErrorIdentifier(const char *prefixLiteral, const Token *identifier, const char *suffixLiteral, Interpreter *interpreter);
+__attribute__((__noreturn__))
+void interpreter_throwArityError(Token *paren, int32_t arity, int32_t argumentsCount, Interpreter *interpreter);
 
 #endif /* interpreter_h */
@@ -0,0 +1,1124 @@
+//
+//  jit.c
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#include "jit_emitter.h"
+
+#ifdef INTERPRETER_JIT
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__APPLE__) && defined(__aarch64__)
+#include <pthread.h>
+#include <libkern/OSCacheControl.h>
+#endif
+
+#include "memory.h"
+
+extern inline bool jit_isHotLoop(WhileStmt *stmt);
+extern inline bool jit_isHotFunction(FunctionStmt *declaration);
+
+// NOTE: the code of a loop or a function must fit in a jump of AArch64
+#define JIT_MAX_CODE_SIZE (1 << 20)
+// NOTE: the deepest nesting of blocks compiled; deeper blocks are run by the
+//       interpreter
+#define JIT_MAX_SCOPES 64
+
+typedef int32_t (*JitEntry)(Interpreter *interpreter, JitExit *exit);
+
+struct JitCode_tag
+{
+    JitEntry entry;
+    void *memory;
+    size_t size;
+    // NOTE: the loop or the function compiled
+    Stmt *owner;
+    // NOTE: the blocks without variables whose environment the native code
+    //       does not push, that the interpreter pushes when it resumes
+    //       after a bailout
+    BlockStmt **elidedBlocks;
+    int32_t elidedBlocksCount;
+    struct JitCode_tag *next;
+};
+
+typedef struct
+{
+    int32_t label;
+    Stmt *stmt;
+} JitBailout;
+
+typedef struct
+{
+    JitAssembler as;
+
+    // NOTE: the blocks being compiled, from the outermost: true if the
+    //       native code pushes its environment, false if it is elided
+    bool scopes[JIT_MAX_SCOPES];
+    int32_t scopesCount;
+    // NOTE: number of environments pushed by the native code, that a return
+    //       pops
+    int32_t framesCount;
+
+    JitBailout *bailouts;
+    int32_t bailoutsCount;
+    int32_t bailoutsCapacity;
+
+    BlockStmt **elidedBlocks;
+    int32_t elidedBlocksCount;
+    int32_t elidedBlocksCapacity;
+} JitCompiler;
+
+/* Assembler */
+
+static void jit_reserve(JitAssembler *as, int32_t bytes)
+{
+    if (as->size + bytes <= as->capacity)
+    {
+        return;
+    }
+    int32_t capacity = as->capacity == 0 ? 4096 : 2 * as->capacity;
+    uint8_t *code = lox_realloc(as->code, (size_t)capacity);
+    if (code == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    as->code = code;
+    as->capacity = capacity;
+}
+
+void jit_emitByte(JitAssembler *as, uint8_t byte)
+{
+    jit_reserve(as, 1);
+    as->code[as->size++] = byte;
+}
+
+void jit_emit32(JitAssembler *as, uint32_t word)
+{
+    jit_reserve(as, 4);
+    memcpy(as->code + as->size, &word, sizeof(uint32_t));
+    as->size += 4;
+}
+
+void jit_emit64(JitAssembler *as, uint64_t word)
+{
+    jit_reserve(as, 8);
+    memcpy(as->code + as->size, &word, sizeof(uint64_t));
+    as->size += 8;
+}
+
+int32_t jit_newLabel(JitAssembler *as)
+{
+    if (as->labelsCount == as->labelsCapacity)
+    {
+        int32_t capacity = as->labelsCapacity == 0 ? 64 : 2 * as->labelsCapacity;
+        int32_t *labels = lox_realloc(as->labels, (size_t)capacity * sizeof(int32_t));
+        if (labels == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        as->labels = labels;
+        as->labelsCapacity = capacity;
+    }
+    as->labels[as->labelsCount] = -1;
+    return as->labelsCount++;
+}
+
+void jit_bindLabel(JitAssembler *as, int32_t label)
+{
+    assert(as->labels[label] == -1);
+    as->labels[label] = as->size;
+}
+
+void jit_addFixup(JitAssembler *as, int32_t label, int32_t kind)
+{
+    if (as->fixupsCount == as->fixupsCapacity)
+    {
+        int32_t capacity = as->fixupsCapacity == 0 ? 64 : 2 * as->fixupsCapacity;
+        JitFixup *fixups = lox_realloc(as->fixups, (size_t)capacity * sizeof(JitFixup));
+        if (fixups == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        as->fixups = fixups;
+        as->fixupsCapacity = capacity;
+    }
+    as->fixups[as->fixupsCount++] = (JitFixup){as->size, label, kind};
+}
+
+static void jit_freeAssembler(JitAssembler *as)
+{
+    lox_free(as->code);
+    lox_free(as->labels);
+    lox_free(as->fixups);
+}
+
+/* Helpers */
+
+// NOTE: the helpers are called by the native code, with the environment of
+//       the interpreter set to the current one of the native code.
+
+static intptr_t jit_executeHelper(Interpreter *interpreter, intptr_t statement)
+{
+    return (intptr_t)interpreter_executeStatement((Stmt *)statement, interpreter);
+}
+
+static intptr_t jit_isTruthyHelper(Interpreter *interpreter, intptr_t condition)
+{
+    return isTruthy(interpreter_evaluate((Expr *)condition, interpreter));
+}
+
+static intptr_t jit_pushFrameHelper(Interpreter *interpreter, intptr_t slotsCount)
+{
+    Environment *environment = env_pushFrame(interpreter->environment, (int32_t)slotsCount, &interpreter->frames);
+    interpreter->environment = environment;
+    return (intptr_t)environment;
+}
+
+static intptr_t jit_popFrameHelper(Interpreter *interpreter, intptr_t unused)
+{
+    (void)unused;
+    Environment *environment = interpreter->environment;
+    interpreter->environment = environment->enclosing;
+    env_release(environment, &interpreter->frames);
+    return (intptr_t)interpreter->environment;
+}
+
+/* Analysis */
+
+static bool jit_isVariable(const VariableSlot *slot)
+{
+    return slot->index >= 0;
+}
+
+// Returns true if `expr` is compiled to a number in the register `number`,
+// using the registers that follow it for its operands.
+static bool jit_isNumber(const Expr *expr, int32_t number)
+{
+    if (number >= JIT_NUMBER_REGISTERS)
+    {
+        return false;
+    }
+    switch (expr->type)
+    {
+        case EXPR_Literal:
+            return ((const Literal *)expr)->value.type == TT_NUMBER;
+        case EXPR_Grouping:
+            return jit_isNumber(((const Grouping *)expr)->expression, number);
+        case EXPR_Variable:
+            return jit_isVariable(&((const Variable *)expr)->slot);
+        case EXPR_Unary:
+        {
+            const Unary *unary = (const Unary *)expr;
+            return unary->kind == UNARY_NEGATE_NUMBER && jit_isNumber(unary->right, number);
+        }
+        case EXPR_Binary:
+        {
+            const Binary *binary = (const Binary *)expr;
+            return binary->kind >= BINARY_ADD_NUMBERS && binary->kind <= BINARY_DIVIDE_NUMBERS
+                && jit_isNumber(binary->left, number) && jit_isNumber(binary->right, number + 1);
+        }
+        default:
+            return false;
+    }
+}
+
+// Returns true if the truth of `expr` is compiled to branches.
+static bool jit_isCondition(const Expr *expr)
+{
+    switch (expr->type)
+    {
+        case EXPR_Literal:
+            return true;
+        case EXPR_Grouping:
+            return jit_isCondition(((const Grouping *)expr)->expression);
+        case EXPR_Variable:
+            return jit_isVariable(&((const Variable *)expr)->slot);
+        case EXPR_Logical:
+        {
+            const Logical *logical = (const Logical *)expr;
+            return jit_isCondition(logical->left) && jit_isCondition(logical->right);
+        }
+        case EXPR_Unary:
+        {
+            const Unary *unary = (const Unary *)expr;
+            if (unary->operator->type == TT_BANG)
+            {
+                return jit_isCondition(unary->right);
+            }
+            return jit_isNumber(expr, 0);
+        }
+        case EXPR_Binary:
+        {
+            const Binary *binary = (const Binary *)expr;
+            switch (binary->operator->type)
+            {
+                case TT_GREATER:
+                case TT_GREATER_EQUAL:
+                case TT_LESS:
+                case TT_LESS_EQUAL:
+                    return binary->kind >= BINARY_GREATER_NUMBERS
+                        && jit_isNumber(binary->left, 0) && jit_isNumber(binary->right, 1);
+                case TT_EQUAL_EQUAL:
+                case TT_BANG_EQUAL:
+                    return jit_isNumber(binary->left, 0) && jit_isNumber(binary->right, 1);
+                default:
+                    // NOTE: a number is true
+                    return jit_isNumber(expr, 0);
+            }
+        }
+        default:
+            return false;
+    }
+}
+
+static bool jit_isAssignment(const Stmt *stmt)
+{
+    const Expr *expr = ((const ExpressionStmt *)stmt)->expression;
+    if (expr->type != EXPR_Assign)
+    {
+        return false;
+    }
+    const Assign *assign = (const Assign *)expr;
+    return jit_isVariable(&assign->slot) && jit_isNumber(assign->value, 0);
+}
+
+static bool jit_isReturn(const Stmt *stmt)
+{
+    const Expr *value = ((const ReturnStmt *)stmt)->value;
+    return value != NULL && jit_isNumber(value, 0);
+}
+
+static bool jit_isDeclaration(const Stmt *stmt)
+{
+    const Expr *initializer = ((const VarStmt *)stmt)->initializer;
+    return initializer != NULL && jit_isNumber(initializer, 0);
+}
+
+static bool jit_isNative(const Stmt *stmt);
+
+// Returns true if the environment of `block` needs not be pushed, i.e. it
+// has no variables and all its statements are compiled.
+static bool jit_isElided(const BlockStmt *block)
+{
+    if (block->isCaptured || block->slotsCount > 0)
+    {
+        return false;
+    }
+    for (const Stmt *statement = block->statements; statement != NULL; statement = statement->next)
+    {
+        if (!jit_isNative(statement))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns true if `stmt` is compiled without calls to the interpreter.
+static bool jit_isNative(const Stmt *stmt)
+{
+    switch (stmt->type)
+    {
+        case STMT_Expression:
+            return jit_isAssignment(stmt);
+        case STMT_Return:
+            return jit_isReturn(stmt);
+        case STMT_If:
+        {
+            const IfStmt *ifStmt = (const IfStmt *)stmt;
+            return jit_isCondition(ifStmt->condition) && jit_isNative(ifStmt->thenBranch)
+                && (ifStmt->elseBranch == NULL || jit_isNative(ifStmt->elseBranch));
+        }
+        case STMT_While:
+        {
+            const WhileStmt *whileStmt = (const WhileStmt *)stmt;
+            return jit_isCondition(whileStmt->condition) && jit_isNative(whileStmt->body);
+        }
+        case STMT_Block:
+            return jit_isElided((const BlockStmt *)stmt);
+        default:
+            return false;
+    }
+}
+
+// Returns true if some of `stmt` is compiled, so that it is worth compiling.
+static bool jit_hasNative(const Stmt *stmt)
+{
+    switch (stmt->type)
+    {
+        case STMT_Expression:
+            return jit_isAssignment(stmt);
+        case STMT_Return:
+            return jit_isReturn(stmt);
+        case STMT_Var:
+            return jit_isDeclaration(stmt);
+        case STMT_If:
+        {
+            const IfStmt *ifStmt = (const IfStmt *)stmt;
+            return jit_isCondition(ifStmt->condition) || jit_hasNative(ifStmt->thenBranch)
+                || (ifStmt->elseBranch != NULL && jit_hasNative(ifStmt->elseBranch));
+        }
+        case STMT_While:
+        {
+            const WhileStmt *whileStmt = (const WhileStmt *)stmt;
+            return jit_isCondition(whileStmt->condition) || jit_hasNative(whileStmt->body);
+        }
+        case STMT_Block:
+        {
+            const BlockStmt *block = (const BlockStmt *)stmt;
+            if (block->isCaptured)
+            {
+                return false;
+            }
+            for (const Stmt *statement = block->statements; statement != NULL; statement = statement->next)
+            {
+                if (jit_hasNative(statement))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+// Returns true if running `stmt` in the interpreter may return.
+static bool jit_mayReturn(const Stmt *stmt)
+{
+    switch (stmt->type)
+    {
+        case STMT_Return:
+        case STMT_If:
+        case STMT_While:
+        case STMT_Block:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Compiler */
+
+// Returns the label of the code that bails out to the interpreter at `stmt`.
+static int32_t jit_bailout(Stmt *stmt, JitCompiler *compiler)
+{
+    if (compiler->bailoutsCount == compiler->bailoutsCapacity)
+    {
+        int32_t capacity = compiler->bailoutsCapacity == 0 ? 16 : 2 * compiler->bailoutsCapacity;
+        JitBailout *bailouts = lox_realloc(compiler->bailouts, (size_t)capacity * sizeof(JitBailout));
+        if (bailouts == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        compiler->bailouts = bailouts;
+        compiler->bailoutsCapacity = capacity;
+    }
+    int32_t label = jit_newLabel(&compiler->as);
+    compiler->bailouts[compiler->bailoutsCount++] = (JitBailout){label, stmt};
+    return label;
+}
+
+static void jit_addElidedBlock(BlockStmt *block, JitCompiler *compiler)
+{
+    if (compiler->elidedBlocksCount == compiler->elidedBlocksCapacity)
+    {
+        int32_t capacity = compiler->elidedBlocksCapacity == 0 ? 8 : 2 * compiler->elidedBlocksCapacity;
+        BlockStmt **blocks = lox_realloc(compiler->elidedBlocks, (size_t)capacity * sizeof(BlockStmt *));
+        if (blocks == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        compiler->elidedBlocks = blocks;
+        compiler->elidedBlocksCapacity = capacity;
+    }
+    compiler->elidedBlocks[compiler->elidedBlocksCount++] = block;
+}
+
+// Returns the number of environments pushed between the current one and
+// the one `depth` scopes above it, skipping the elided blocks.
+static int32_t jit_hops(int32_t depth, const JitCompiler *compiler)
+{
+    int32_t hops = 0;
+    for (int32_t distance = 0; distance < depth; distance++)
+    {
+        int32_t scope = compiler->scopesCount - 1 - distance;
+        if (scope < 0)
+        {
+            // NOTE: the scopes enclosing the loop or the function
+            hops += depth - distance;
+            break;
+        }
+        if (compiler->scopes[scope])
+        {
+            hops++;
+        }
+    }
+    return hops;
+}
+
+static void jit_loadVariable(const VariableSlot *slot, JitCompiler *compiler)
+{
+    if (slot->depth == VAR_DEPTH_GLOBAL)
+    {
+        emit_loadGlobal(&compiler->as, slot->index);
+    }
+    else
+    {
+        emit_loadLocal(&compiler->as, jit_hops(slot->depth, compiler), slot->index);
+    }
+}
+
+static void jit_compileNumber(Expr *expr, int32_t number, int32_t bailout, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    switch (expr->type)
+    {
+        case EXPR_Literal:
+        {
+            emit_loadNumber(as, number, ((Literal *)expr)->value.number);
+        } break;
+        case EXPR_Grouping:
+        {
+            jit_compileNumber(((Grouping *)expr)->expression, number, bailout, compiler);
+        } break;
+        case EXPR_Variable:
+        {
+            jit_loadVariable(&((Variable *)expr)->slot, compiler);
+            emit_unboxNumber(as, number, bailout);
+        } break;
+        case EXPR_Unary:
+        {
+            jit_compileNumber(((Unary *)expr)->right, number, bailout, compiler);
+            emit_negate(as, number);
+        } break;
+        case EXPR_Binary:
+        {
+            Binary *binary = (Binary *)expr;
+            jit_compileNumber(binary->left, number, bailout, compiler);
+            jit_compileNumber(binary->right, number + 1, bailout, compiler);
+            if (binary->kind == BINARY_DIVIDE_NUMBERS)
+            {
+                // NOTE: the interpreter raises the error
+                emit_branchIfZero(as, number + 1, bailout);
+            }
+            emit_arithmetic(as, binary->kind, number, number + 1);
+        } break;
+        INVALID_DEFAULT_CASE;
+    }
+}
+
+// Emits a jump to `label` taken when the truth of `expr` is `jumpIf`.
+static void jit_compileCondition(Expr *expr, bool jumpIf, int32_t label, int32_t bailout, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    switch (expr->type)
+    {
+        case EXPR_Literal:
+        {
+            TokenType type = ((Literal *)expr)->value.type;
+            bool isTrue = type != TT_NIL && type != TT_FALSE;
+            if (isTrue == jumpIf)
+            {
+                emit_jump(as, label);
+            }
+        } break;
+        case EXPR_Grouping:
+        {
+            jit_compileCondition(((Grouping *)expr)->expression, jumpIf, label, bailout, compiler);
+        } break;
+        case EXPR_Variable:
+        {
+            jit_loadVariable(&((Variable *)expr)->slot, compiler);
+            emit_truthBranch(as, jumpIf, label, bailout);
+        } break;
+        case EXPR_Logical:
+        {
+            Logical *logical = (Logical *)expr;
+            bool isOr = logical->operator->type == TT_OR;
+            if (isOr == jumpIf)
+            {
+                jit_compileCondition(logical->left, jumpIf, label, bailout, compiler);
+                jit_compileCondition(logical->right, jumpIf, label, bailout, compiler);
+            }
+            else
+            {
+                int32_t skip = jit_newLabel(as);
+                jit_compileCondition(logical->left, isOr, skip, bailout, compiler);
+                jit_compileCondition(logical->right, jumpIf, label, bailout, compiler);
+                jit_bindLabel(as, skip);
+            }
+        } break;
+        case EXPR_Unary:
+        {
+            Unary *unary = (Unary *)expr;
+            if (unary->operator->type == TT_BANG)
+            {
+                jit_compileCondition(unary->right, !jumpIf, label, bailout, compiler);
+                break;
+            }
+            jit_compileNumber(expr, 0, bailout, compiler);
+            if (jumpIf)
+            {
+                emit_jump(as, label);
+            }
+        } break;
+        case EXPR_Binary:
+        {
+            Binary *binary = (Binary *)expr;
+            TokenType operator = binary->operator->type;
+            if (binary->kind >= BINARY_ADD_NUMBERS && binary->kind <= BINARY_DIVIDE_NUMBERS)
+            {
+                jit_compileNumber(expr, 0, bailout, compiler);
+                if (jumpIf)
+                {
+                    emit_jump(as, label);
+                }
+                break;
+            }
+            jit_compileNumber(binary->left, 0, bailout, compiler);
+            jit_compileNumber(binary->right, 1, bailout, compiler);
+            emit_compareBranch(as, operator, 0, 1, jumpIf, label);
+        } break;
+        INVALID_DEFAULT_CASE;
+    }
+}
+
+// Emits a jump to `label` taken when the truth of `condition` is `jumpIf`,
+// either compiled or evaluated by the interpreter.
+static void jit_compileBranch(Expr *condition, bool jumpIf, int32_t label, Stmt *stmt, JitCompiler *compiler)
+{
+    if (jit_isCondition(condition))
+    {
+        jit_compileCondition(condition, jumpIf, label, jit_bailout(stmt, compiler), compiler);
+    }
+    else
+    {
+        emit_callHelper(&compiler->as, jit_isTruthyHelper, (intptr_t)condition);
+        emit_branchOnResult(&compiler->as, jumpIf, label);
+    }
+}
+
+// Pops the environments pushed by the native code, and exits with `status`.
+static void jit_compileExit(JitExitStatus status, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    for (int32_t index = 0; index < compiler->framesCount; index++)
+    {
+        emit_callHelper(as, jit_popFrameHelper, 0);
+    }
+    emit_setStatus(as, status);
+    emit_jump(as, as->exitLabel);
+}
+
+// Emits a call to the interpreter to run `stmt`.
+static void jit_compileInterpreted(Stmt *stmt, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    emit_callHelper(as, jit_executeHelper, (intptr_t)stmt);
+    if (jit_mayReturn(stmt))
+    {
+        int32_t next = jit_newLabel(as);
+        emit_branchOnResult(as, false, next);
+        emit_storeExit(as, offsetof(JitExit, ret), true);
+        jit_compileExit(JIT_EXIT_RETURN, compiler);
+        jit_bindLabel(as, next);
+    }
+}
+
+static void jit_compileStatement(Stmt *stmt, JitCompiler *compiler);
+
+static void jit_compileWhile(WhileStmt *stmt, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    int32_t start = jit_newLabel(as);
+    int32_t end = jit_newLabel(as);
+    jit_bindLabel(as, start);
+    jit_compileBranch(stmt->condition, false, end, AS_STMT(stmt), compiler);
+    jit_compileStatement(stmt->body, compiler);
+    emit_jump(as, start);
+    jit_bindLabel(as, end);
+}
+
+static void jit_compileIf(IfStmt *stmt, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    int32_t elseLabel = jit_newLabel(as);
+    jit_compileBranch(stmt->condition, false, elseLabel, AS_STMT(stmt), compiler);
+    jit_compileStatement(stmt->thenBranch, compiler);
+    if (stmt->elseBranch != NULL)
+    {
+        int32_t end = jit_newLabel(as);
+        emit_jump(as, end);
+        jit_bindLabel(as, elseLabel);
+        jit_compileStatement(stmt->elseBranch, compiler);
+        jit_bindLabel(as, end);
+    }
+    else
+    {
+        jit_bindLabel(as, elseLabel);
+    }
+}
+
+static void jit_compileBlock(BlockStmt *stmt, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    if (!jit_hasNative(AS_STMT(stmt)) || compiler->scopesCount == JIT_MAX_SCOPES)
+    {
+        jit_compileInterpreted(AS_STMT(stmt), compiler);
+        return;
+    }
+    bool isElided = jit_isElided(stmt);
+    if (isElided)
+    {
+        jit_addElidedBlock(stmt, compiler);
+    }
+    else
+    {
+        emit_callHelper(as, jit_pushFrameHelper, stmt->slotsCount);
+        emit_setEnvironmentFromResult(as);
+        compiler->framesCount++;
+    }
+    compiler->scopes[compiler->scopesCount++] = !isElided;
+    for (Stmt *statement = stmt->statements; statement != NULL; statement = statement->next)
+    {
+        jit_compileStatement(statement, compiler);
+    }
+    compiler->scopesCount--;
+    if (!isElided)
+    {
+        compiler->framesCount--;
+        emit_callHelper(as, jit_popFrameHelper, 0);
+        emit_setEnvironmentFromResult(as);
+    }
+}
+
+static void jit_compileStatement(Stmt *stmt, JitCompiler *compiler)
+{
+    JitAssembler *as = &compiler->as;
+    switch (stmt->type)
+    {
+        case STMT_Expression:
+        {
+            if (!jit_isAssignment(stmt))
+            {
+                break;
+            }
+            Assign *assign = (Assign *)((ExpressionStmt *)stmt)->expression;
+            int32_t bailout = jit_bailout(stmt, compiler);
+            jit_compileNumber(assign->value, 0, bailout, compiler);
+            emit_boxNumber(as, 0);
+            if (assign->slot.depth == VAR_DEPTH_GLOBAL)
+            {
+                emit_storeGlobal(as, assign->slot.index, bailout);
+            }
+            else
+            {
+                emit_storeLocal(as, jit_hops(assign->slot.depth, compiler), assign->slot.index, bailout);
+            }
+        } return;
+        case STMT_Var:
+        {
+            if (!jit_isDeclaration(stmt))
+            {
+                break;
+            }
+            jit_compileNumber(((VarStmt *)stmt)->initializer, 0, jit_bailout(stmt, compiler), compiler);
+            emit_boxNumber(as, 0);
+            emit_defineLocal(as);
+        } return;
+        case STMT_Return:
+        {
+            if (!jit_isReturn(stmt))
+            {
+                break;
+            }
+            jit_compileNumber(((ReturnStmt *)stmt)->value, 0, jit_bailout(stmt, compiler), compiler);
+            emit_boxNumber(as, 0);
+            emit_storeExit(as, offsetof(JitExit, value), false);
+            jit_compileExit(JIT_EXIT_VALUE, compiler);
+        } return;
+        case STMT_If:
+        {
+            jit_compileIf((IfStmt *)stmt, compiler);
+        } return;
+        case STMT_While:
+        {
+            jit_compileWhile((WhileStmt *)stmt, compiler);
+        } return;
+        case STMT_Block:
+        {
+            jit_compileBlock((BlockStmt *)stmt, compiler);
+        } return;
+        default:
+            break;
+    }
+    jit_compileInterpreted(stmt, compiler);
+}
+
+/* Code */
+
+// Returns executable memory with a copy of `size` bytes of `code`, or NULL.
+static void * jit_allocExecutable(const uint8_t *code, size_t size)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = (size + pageSize - 1) / pageSize * pageSize;
+#if defined(__APPLE__) && defined(__aarch64__)
+    // NOTE: the memory of the JIT is either writable or executable by the
+    //       thread
+    void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | MAP_JIT, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return NULL;
+    }
+    pthread_jit_write_protect_np(0);
+    memcpy(memory, code, size);
+    pthread_jit_write_protect_np(1);
+    sys_icache_invalidate(memory, size);
+#else
+    void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return NULL;
+    }
+    memcpy(memory, code, size);
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, length);
+        return NULL;
+    }
+    __builtin___clear_cache((char *)memory, (char *)memory + size);
+#endif
+    return memory;
+}
+
+static void jit_freeCode(JitCode *code)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    munmap(code->memory, (code->size + pageSize - 1) / pageSize * pageSize);
+    lox_free(code->elidedBlocks);
+    lox_free(code);
+}
+
+// Compiles the loop or the function `owner`, and returns its native code,
+// or NULL if there is nothing to compile or it cannot be compiled.
+static JitCode * jit_compile(Stmt *owner, Jit *jit)
+{
+    bool isLoop = owner->type == STMT_While;
+    Stmt *body = isLoop ? NULL : ((FunctionStmt *)owner)->body;
+    bool hasNative = isLoop && jit_hasNative(owner);
+    for (Stmt *statement = body; statement != NULL && !hasNative; statement = statement->next)
+    {
+        hasNative = jit_hasNative(statement);
+    }
+    if (!hasNative)
+    {
+        return NULL;
+    }
+
+    JitCompiler compiler = {0};
+    JitAssembler *as = &compiler.as;
+    as->exitLabel = jit_newLabel(as);
+    emit_prologue(as);
+    if (isLoop)
+    {
+        jit_compileWhile((WhileStmt *)owner, &compiler);
+    }
+    else
+    {
+        for (Stmt *statement = body; statement != NULL; statement = statement->next)
+        {
+            jit_compileStatement(statement, &compiler);
+        }
+    }
+    emit_setStatus(as, JIT_EXIT_DONE);
+    jit_bindLabel(as, as->exitLabel);
+    emit_epilogue(as);
+
+    for (int32_t index = 0; index < compiler.bailoutsCount; index++)
+    {
+        const JitBailout *bailout = &compiler.bailouts[index];
+        jit_bindLabel(as, bailout->label);
+        emit_storeExitPointer(as, offsetof(JitExit, bailout), bailout->stmt);
+        emit_setStatus(as, JIT_EXIT_BAILOUT);
+        emit_jump(as, as->exitLabel);
+    }
+    for (int32_t index = 0; index < as->fixupsCount; index++)
+    {
+        const JitFixup *fixup = &as->fixups[index];
+        assert(as->labels[fixup->label] >= 0);
+        emit_patch(as, fixup, as->labels[fixup->label]);
+    }
+
+    JitCode *code = NULL;
+    void *memory = NULL;
+    if (!as->failed && as->size <= JIT_MAX_CODE_SIZE)
+    {
+        memory = jit_allocExecutable(as->code, (size_t)as->size);
+    }
+    if (memory != NULL)
+    {
+        code = lox_alloc(JitCode);
+        if (code == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        memcpy(&code->entry, &memory, sizeof(void *));
+        code->memory = memory;
+        code->size = (size_t)as->size;
+        code->owner = owner;
+        code->elidedBlocks = compiler.elidedBlocks;
+        code->elidedBlocksCount = compiler.elidedBlocksCount;
+        code->next = jit->codes;
+        jit->codes = code;
+        if (isLoop)
+        {
+            jit->loopsCount++;
+        }
+        else
+        {
+            jit->functionsCount++;
+        }
+#ifdef JIT_VERBOSE
+        fprintf(stderr, "[jit] compiled %s%s (%d bytes)\n", isLoop ? "a loop" : "function ",
+                isLoop ? "" : ((FunctionStmt *)owner)->name->literal, as->size);
+#endif
+    }
+    else
+    {
+        lox_free(compiler.elidedBlocks);
+    }
+    lox_free(compiler.bailouts);
+    jit_freeAssembler(as);
+    return code;
+}
+
+/* Bailouts */
+
+static bool jit_isElidedBlock(const BlockStmt *block, const JitCode *code)
+{
+    for (int32_t index = 0; index < code->elidedBlocksCount; index++)
+    {
+        if (code->elidedBlocks[index] == block)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if `stmt` is `target` or one of its statements.
+static bool jit_contains(const Stmt *stmt, const Stmt *target)
+{
+    if (stmt == target)
+    {
+        return true;
+    }
+    switch (stmt->type)
+    {
+        case STMT_Block:
+        {
+            for (const Stmt *statement = ((const BlockStmt *)stmt)->statements; statement != NULL; statement = statement->next)
+            {
+                if (jit_contains(statement, target))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        case STMT_If:
+        {
+            const IfStmt *ifStmt = (const IfStmt *)stmt;
+            return jit_contains(ifStmt->thenBranch, target)
+                || (ifStmt->elseBranch != NULL && jit_contains(ifStmt->elseBranch, target));
+        }
+        case STMT_While:
+            return jit_contains(((const WhileStmt *)stmt)->body, target);
+        default:
+            return false;
+    }
+}
+
+static Return * jit_resumeList(Stmt *statements, Stmt *target, const JitCode *code, Interpreter *interpreter);
+
+// Runs in the interpreter the rest of `stmt` from its statement `target`,
+// in the environments left by the native code.
+static Return * jit_resume(Stmt *stmt, Stmt *target, const JitCode *code, Interpreter *interpreter)
+{
+    if (stmt == target)
+    {
+        return interpreter_executeStatement(stmt, interpreter);
+    }
+    switch (stmt->type)
+    {
+        case STMT_Block:
+        {
+            BlockStmt *block = (BlockStmt *)stmt;
+            if (jit_isElidedBlock(block, code))
+            {
+                jit_pushFrameHelper(interpreter, block->slotsCount);
+            }
+            Environment *environment = interpreter->environment;
+            Return *ret = jit_resumeList(block->statements, target, code, interpreter);
+            interpreter->environment = environment->enclosing;
+            env_release(environment, &interpreter->frames);
+            return ret;
+        }
+        case STMT_If:
+        {
+            IfStmt *ifStmt = (IfStmt *)stmt;
+            if (jit_contains(ifStmt->thenBranch, target))
+            {
+                return jit_resume(ifStmt->thenBranch, target, code, interpreter);
+            }
+            return jit_resume(ifStmt->elseBranch, target, code, interpreter);
+        }
+        case STMT_While:
+        {
+            Return *ret = jit_resume(((WhileStmt *)stmt)->body, target, code, interpreter);
+            if (ret != NULL)
+            {
+                return ret;
+            }
+            return interpreter_executeStatement(stmt, interpreter);
+        }
+        INVALID_DEFAULT_CASE;
+    }
+    return NULL;
+}
+
+static Return * jit_resumeList(Stmt *statements, Stmt *target, const JitCode *code, Interpreter *interpreter)
+{
+    Stmt *statement = statements;
+    while (!jit_contains(statement, target))
+    {
+        statement = statement->next;
+    }
+    Return *ret = jit_resume(statement, target, code, interpreter);
+    if (ret != NULL || statement->next == NULL)
+    {
+        return ret;
+    }
+    return interpreter_executeBlock(statement->next, interpreter->environment, interpreter);
+}
+
+// NOTE: the native code is kept, as it may still be running.
+static void jit_disable(JitCode *code, Jit *jit)
+{
+    Stmt *owner = code->owner;
+    if (owner->type == STMT_While)
+    {
+        ((WhileStmt *)owner)->jitCode = NULL;
+        ((WhileStmt *)owner)->hotness = JIT_DISABLED;
+    }
+    else
+    {
+        ((FunctionStmt *)owner)->jitCode = NULL;
+        ((FunctionStmt *)owner)->hotness = JIT_DISABLED;
+    }
+    jit->bailoutsCount++;
+}
+
+static Return * jit_run(JitCode *code, Interpreter *interpreter)
+{
+    JitExit exit;
+    JitExitStatus status = (JitExitStatus)code->entry(interpreter, &exit);
+    switch (status)
+    {
+        case JIT_EXIT_DONE:
+            return NULL;
+        case JIT_EXIT_RETURN:
+            return exit.ret;
+        case JIT_EXIT_VALUE:
+            return return_init(exit.value, &interpreter->returnValue);
+        case JIT_EXIT_BAILOUT:
+            break;
+    }
+
+#ifdef JIT_VERBOSE
+    fprintf(stderr, "[jit] bailout at statement of type %d\n", exit.bailout->type);
+#endif
+    jit_disable(code, interpreter->jit);
+    Stmt *owner = code->owner;
+    if (owner->type == STMT_While)
+    {
+        return jit_resume(owner, exit.bailout, code, interpreter);
+    }
+    return jit_resumeList(((FunctionStmt *)owner)->body, exit.bailout, code, interpreter);
+}
+
+/* JIT */
+
+Jit * jit_init(void)
+{
+    Jit *jit = lox_alloc(Jit);
+    if (jit == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    jit->codes = NULL;
+    jit->loopsCount = 0;
+    jit->functionsCount = 0;
+    jit->bailoutsCount = 0;
+    return jit;
+}
+
+void jit_free(Jit *jit)
+{
+#ifdef JIT_VERBOSE
+    fprintf(stderr, "[jit] %d loops and %d functions compiled, %d bailouts\n",
+            jit->loopsCount, jit->functionsCount, jit->bailoutsCount);
+#endif
+    JitCode *code = jit->codes;
+    while (code != NULL)
+    {
+        JitCode *next = code->next;
+        jit_freeCode(code);
+        code = next;
+    }
+    lox_free(jit);
+}
+
+// Runs the hot loop `stmt`, compiling it first if needed.
+Return * jit_runLoop(WhileStmt *stmt, Interpreter *interpreter)
+{
+    if (stmt->jitCode == NULL)
+    {
+        stmt->jitCode = jit_compile(AS_STMT(stmt), interpreter->jit);
+        if (stmt->jitCode == NULL)
+        {
+            stmt->hotness = JIT_DISABLED;
+            return interpreter_executeStatement(AS_STMT(stmt), interpreter);
+        }
+    }
+    return jit_run(stmt->jitCode, interpreter);
+}
+
+// Runs the body of the hot function `declaration` in `environment`,
+// compiling it first if needed.
+Return * jit_runFunction(FunctionStmt *declaration, Environment *environment, Interpreter *interpreter)
+{
+    if (declaration->jitCode == NULL)
+    {
+        declaration->jitCode = jit_compile(AS_STMT(declaration), interpreter->jit);
+        if (declaration->jitCode == NULL)
+        {
+            declaration->hotness = JIT_DISABLED;
+            return interpreter_executeBlock(declaration->body, environment, interpreter);
+        }
+    }
+    Environment *previous = interpreter->environment;
+    interpreter->environment = environment;
+    Return *ret = jit_run(declaration->jitCode, interpreter);
+    interpreter->environment = previous;
+    return ret;
+}
+
+#endif
@@ -0,0 +1,86 @@
+//
+//  jit.h
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#ifndef jit_h
+#define jit_h
+
+#include "interpreter.h"
+
+/*
+ The JIT is a baseline compiler of the tree-walking interpreter: when a while
+ loop has run JIT_HOT_LOOP_ITERATIONS iterations, or a function has been
+ called JIT_HOT_FUNCTION_CALLS times, the loop or the body of the function
+ is compiled to native code from its syntax tree, with a template for each
+ node.
+ The arithmetic and the comparisons that the interpreter specialized for
+ numbers (see INTERPRETER_QUICKENING) are compiled to unboxed double
+ operations on registers, on the numbers read from the variables, and the
+ conditions of the if and while statements to branches. The variables stay
+ in their environments. The statements that are not compiled, e.g. the calls
+ and the property accesses, are run by the interpreter, called from the
+ native code, as are the blocks that declare variables, whose environments
+ are pushed by the interpreter.
+ Each compiled statement first checks the types of the values it reads, and
+ the native code bails out to the interpreter when a check fails, or when a
+ division by zero or an undefined variable should raise an error: the
+ statement has not changed anything yet, and the interpreter runs it and
+ the rest of the loop or function in the environments the native code left.
+ A loop or a function whose native code bails out is then only interpreted.
+ The native code is x86-64 (System V) or AArch64, see jit_emitter.h.
+ */
+
+#ifdef INTERPRETER_JIT
+
+// NOTE: the hotness of a loop or a function that is not compiled, either
+//       because it has nothing to compile or because its native code
+//       bailed out.
+#define JIT_DISABLED -1
+
+typedef struct JitCode_tag JitCode;
+
+typedef struct Jit_tag
+{
+    // NOTE: the native code of the loops and the functions compiled, that
+    //       is kept until the JIT is freed, as it may still run when it is
+    //       disabled, e.g. in a recursive call.
+    JitCode *codes;
+    int32_t loopsCount;
+    int32_t functionsCount;
+    int32_t bailoutsCount;
+} Jit;
+
+Jit * jit_init(void);
+void jit_free(Jit *jit);
+
+Return * jit_runLoop(WhileStmt *stmt, Interpreter *interpreter);
+Return * jit_runFunction(FunctionStmt *declaration, Environment *environment, Interpreter *interpreter);
+
+// Counts an iteration of `stmt`, and returns true if it is compiled or it
+// should be.
+inline bool jit_isHotLoop(WhileStmt *stmt)
+{
+    if (stmt->jitCode != NULL)
+    {
+        return true;
+    }
+    return stmt->hotness != JIT_DISABLED && ++stmt->hotness >= JIT_HOT_LOOP_ITERATIONS;
+}
+
+// Counts a call of `declaration`, and returns true if it is compiled or it
+// should be.
+inline bool jit_isHotFunction(FunctionStmt *declaration)
+{
+    if (declaration->jitCode != NULL)
+    {
+        return true;
+    }
+    return declaration->hotness != JIT_DISABLED && ++declaration->hotness >= JIT_HOT_FUNCTION_CALLS;
+}
+
+#endif
+
+#endif /* jit_h */
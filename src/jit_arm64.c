@@ -0,0 +1,406 @@
+//
+//  jit_arm64.c
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#include "jit_emitter.h"
+
+#if defined(INTERPRETER_JIT) && defined(__aarch64__)
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ The AArch64 backend of the JIT, for the standard procedure call standard.
+ x19 holds the interpreter, x20 the exit, x21 the current environment, x22
+ the values of the globals and x23 the quiet NaN of the boxed values. x9 is
+ the value register, x0 the result of the helpers and the status; x10, x11
+ and x16 are scratch registers, and so is d31. The numbers are held in
+ d0-d7 and d16-d22, as d8-d15 are callee-saved.
+ */
+
+#define REG_INTERPRETER 19
+#define REG_EXIT 20
+#define REG_ENVIRONMENT 21
+#define REG_GLOBALS 22
+#define REG_QNAN 23
+#define REG_VALUE 9
+#define REG_TEMP 10
+#define REG_TEMP2 11
+#define REG_CALL 16
+#define REG_RESULT 0
+#define REG_SP 31
+#define REG_ZERO 31
+#define FP_SCRATCH 31
+
+// NOTE: condition codes of the conditional branches
+enum
+{
+    COND_EQ = 0x0, COND_NE = 0x1, COND_MI = 0x4, COND_PL = 0x5,
+    COND_HI = 0x8, COND_LS = 0x9, COND_GE = 0xa, COND_LT = 0xb,
+    COND_GT = 0xc, COND_LE = 0xd,
+};
+
+// NOTE: the kinds of jumps: b with a 26-bit offset, and b.cond, cbz and cbnz
+//       with a 19-bit offset, in instructions
+#define FIXUP_BRANCH26 0
+#define FIXUP_BRANCH19 1
+
+static inline uint32_t arm64_numberRegister(int32_t number)
+{
+    assert(number >= 0 && number < JIT_NUMBER_REGISTERS);
+    return (uint32_t)(number < 8 ? number : number + 8);
+}
+
+/* Encoding */
+
+// movz and movk of the 16-bit chunks of `immediate` that are not zero
+static void arm64_moveImmediate(JitAssembler *as, uint32_t reg, uint64_t immediate)
+{
+    bool isFirst = true;
+    for (uint32_t shift = 0; shift < 4; shift++)
+    {
+        uint32_t chunk = (uint32_t)(immediate >> (16 * shift)) & 0xffff;
+        if (chunk != 0 || (shift == 3 && isFirst))
+        {
+            uint32_t opcode = isFirst ? 0xd2800000 : 0xf2800000;
+            jit_emit32(as, opcode | (shift << 21) | (chunk << 5) | reg);
+            isFirst = false;
+        }
+    }
+}
+
+// mov destination, source
+static void arm64_move(JitAssembler *as, uint32_t destination, uint32_t source)
+{
+    jit_emit32(as, 0xaa0003e0 | (source << 16) | destination);
+}
+
+// ldr reg, [base, #offset]
+static void arm64_load(JitAssembler *as, uint32_t reg, uint32_t base, int32_t offset)
+{
+    if (offset < 0 || offset % 8 != 0 || offset / 8 > 0xfff)
+    {
+        as->failed = true;
+        return;
+    }
+    jit_emit32(as, 0xf9400000 | ((uint32_t)(offset / 8) << 10) | (base << 5) | reg);
+}
+
+// str reg, [base, #offset]
+static void arm64_store(JitAssembler *as, uint32_t reg, uint32_t base, int32_t offset)
+{
+    if (offset < 0 || offset % 8 != 0 || offset / 8 > 0xfff)
+    {
+        as->failed = true;
+        return;
+    }
+    jit_emit32(as, 0xf9000000 | ((uint32_t)(offset / 8) << 10) | (base << 5) | reg);
+}
+
+#define ARM64_AND 0x8a000000
+#define ARM64_SUB 0xcb000000
+
+// `opcode` destination, left, right, for and and sub
+static void arm64_alu(JitAssembler *as, uint32_t opcode, uint32_t destination, uint32_t left, uint32_t right)
+{
+    jit_emit32(as, opcode | (right << 16) | (left << 5) | destination);
+}
+
+// cmp left, right
+static void arm64_compare(JitAssembler *as, uint32_t left, uint32_t right)
+{
+    jit_emit32(as, 0xeb00001f | (right << 16) | (left << 5));
+}
+
+// cmp reg, #immediate
+static void arm64_compareImmediate(JitAssembler *as, uint32_t reg, uint32_t immediate)
+{
+    assert(immediate <= 0xfff);
+    jit_emit32(as, 0xf100001f | (immediate << 10) | (reg << 5));
+}
+
+static void arm64_branchIf(JitAssembler *as, uint32_t condition, int32_t label)
+{
+    jit_addFixup(as, label, FIXUP_BRANCH19);
+    jit_emit32(as, 0x54000000 | condition);
+}
+
+// fmov d, reg
+static void arm64_moveToNumber(JitAssembler *as, uint32_t d, uint32_t reg)
+{
+    jit_emit32(as, 0x9e670000 | (reg << 5) | d);
+}
+
+// Returns the register that holds the environment `hops` environments above
+// the current one, loading it in `reg` if it is not the current one.
+static uint32_t arm64_environment(JitAssembler *as, int32_t hops, uint32_t reg)
+{
+    if (hops == 0)
+    {
+        return REG_ENVIRONMENT;
+    }
+    arm64_load(as, reg, REG_ENVIRONMENT, offsetof(Environment, enclosing));
+    for (int32_t i = 1; i < hops; i++)
+    {
+        arm64_load(as, reg, reg, offsetof(Environment, enclosing));
+    }
+    return reg;
+}
+
+static inline int32_t arm64_slotOffset(int32_t index)
+{
+    return (int32_t)(offsetof(Environment, values) + (size_t)index * sizeof(Value));
+}
+
+/* Emitters */
+
+void emit_prologue(JitAssembler *as)
+{
+    // NOTE: stp x29, x30, [sp, #-64]!; mov x29, sp
+    jit_emit32(as, 0xa9bc7bfd);
+    jit_emit32(as, 0x910003fd);
+    // NOTE: stp x19, x20, [sp, #16]; stp x21, x22, [sp, #32];
+    //       stp x23, x24, [sp, #48]
+    jit_emit32(as, 0xa90153f3);
+    jit_emit32(as, 0xa9025bf5);
+    jit_emit32(as, 0xa90363f7);
+
+    arm64_move(as, REG_INTERPRETER, 0);
+    arm64_move(as, REG_EXIT, 1);
+    arm64_load(as, REG_ENVIRONMENT, REG_INTERPRETER, offsetof(Interpreter, environment));
+    arm64_load(as, REG_GLOBALS, REG_INTERPRETER, offsetof(Interpreter, globals));
+    // NOTE: add x22, x22, #offsetof(Environment, values)
+    static_assert(offsetof(Environment, values) <= 0xfff, "The values of the environments are too far for an immediate.");
+    jit_emit32(as, 0x91000000 | ((uint32_t)offsetof(Environment, values) << 10) | (REG_GLOBALS << 5) | REG_GLOBALS);
+    arm64_moveImmediate(as, REG_QNAN, VAL_QNAN);
+}
+
+void emit_epilogue(JitAssembler *as)
+{
+    // NOTE: ldp x23, x24, [sp, #48]; ldp x21, x22, [sp, #32];
+    //       ldp x19, x20, [sp, #16]; ldp x29, x30, [sp], #64; ret
+    jit_emit32(as, 0xa94363f7);
+    jit_emit32(as, 0xa9425bf5);
+    jit_emit32(as, 0xa94153f3);
+    jit_emit32(as, 0xa8c47bfd);
+    jit_emit32(as, 0xd65f03c0);
+}
+
+void emit_setStatus(JitAssembler *as, JitExitStatus status)
+{
+    // NOTE: movz w0, #status
+    jit_emit32(as, 0x52800000 | ((uint32_t)status << 5) | REG_RESULT);
+}
+
+void emit_jump(JitAssembler *as, int32_t label)
+{
+    jit_addFixup(as, label, FIXUP_BRANCH26);
+    jit_emit32(as, 0x14000000);
+}
+
+void emit_loadLocal(JitAssembler *as, int32_t hops, int32_t index)
+{
+    uint32_t environment = arm64_environment(as, hops, REG_TEMP);
+    arm64_load(as, REG_VALUE, environment, arm64_slotOffset(index));
+}
+
+void emit_loadGlobal(JitAssembler *as, int32_t index)
+{
+    arm64_load(as, REG_VALUE, REG_GLOBALS, index * (int32_t)sizeof(Value));
+}
+
+// NOTE: the value the slot holds must not be an object, whose overwrite
+//       the incremental marking must see, see gcOverwrite().
+void emit_storeLocal(JitAssembler *as, int32_t hops, int32_t index, int32_t bailout)
+{
+    uint32_t environment = arm64_environment(as, hops, REG_TEMP);
+    arm64_load(as, REG_TEMP2, environment, arm64_slotOffset(index));
+    // NOTE: asr x11, x11, #50 leaves -1 for the objects only; cmn x11, #1
+    jit_emit32(as, 0x9340fc00 | (50 << 16) | (REG_TEMP2 << 5) | REG_TEMP2);
+    jit_emit32(as, 0xb100041f | (REG_TEMP2 << 5));
+    arm64_branchIf(as, COND_EQ, bailout);
+    arm64_store(as, REG_VALUE, environment, arm64_slotOffset(index));
+}
+
+void emit_storeGlobal(JitAssembler *as, int32_t index, int32_t bailout)
+{
+    int32_t offset = index * (int32_t)sizeof(Value);
+    arm64_load(as, REG_TEMP2, REG_GLOBALS, offset);
+    arm64_alu(as, ARM64_SUB, REG_TEMP2, REG_TEMP2, REG_QNAN);
+    arm64_compareImmediate(as, REG_TEMP2, VAL_TAG_UNBOUND);
+    arm64_branchIf(as, COND_EQ, bailout);
+    arm64_store(as, REG_VALUE, REG_GLOBALS, offset);
+}
+
+void emit_defineLocal(JitAssembler *as)
+{
+    uint32_t slotsUsed = offsetof(Environment, slotsUsed);
+    assert(slotsUsed % 4 == 0);
+    // NOTE: ldr w10, [x21, #slotsUsed]; add x11, x21, #values;
+    //       str x9, [x11, x10, lsl #3]; add w10, w10, #1;
+    //       str w10, [x21, #slotsUsed]
+    jit_emit32(as, 0xb9400000 | ((slotsUsed / 4) << 10) | (REG_ENVIRONMENT << 5) | REG_TEMP);
+    jit_emit32(as, 0x91000000 | ((uint32_t)offsetof(Environment, values) << 10) | (REG_ENVIRONMENT << 5) | REG_TEMP2);
+    jit_emit32(as, 0xf8207800 | (REG_TEMP << 16) | (REG_TEMP2 << 5) | REG_VALUE);
+    jit_emit32(as, 0x11000400 | (REG_TEMP << 5) | REG_TEMP);
+    jit_emit32(as, 0xb9000000 | ((slotsUsed / 4) << 10) | (REG_ENVIRONMENT << 5) | REG_TEMP);
+}
+
+void emit_unboxNumber(JitAssembler *as, int32_t number, int32_t bailout)
+{
+    arm64_alu(as, ARM64_AND, REG_TEMP, REG_VALUE, REG_QNAN);
+    arm64_compare(as, REG_TEMP, REG_QNAN);
+    arm64_branchIf(as, COND_EQ, bailout);
+    arm64_moveToNumber(as, arm64_numberRegister(number), REG_VALUE);
+}
+
+void emit_boxNumber(JitAssembler *as, int32_t number)
+{
+    // NOTE: fmov x9, d
+    jit_emit32(as, 0x9e660000 | (arm64_numberRegister(number) << 5) | REG_VALUE);
+}
+
+void emit_loadNumber(JitAssembler *as, int32_t number, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(double));
+    if (bits == 0)
+    {
+        arm64_moveToNumber(as, arm64_numberRegister(number), REG_ZERO);
+        return;
+    }
+    arm64_moveImmediate(as, REG_TEMP, bits);
+    arm64_moveToNumber(as, arm64_numberRegister(number), REG_TEMP);
+}
+
+void emit_arithmetic(JitAssembler *as, BinaryKind kind, int32_t number, int32_t right)
+{
+    uint32_t opcode = 0;
+    switch (kind)
+    {
+        case BINARY_ADD_NUMBERS: opcode = 0x1e602800; break;
+        case BINARY_SUBTRACT_NUMBERS: opcode = 0x1e603800; break;
+        case BINARY_MULTIPLY_NUMBERS: opcode = 0x1e600800; break;
+        case BINARY_DIVIDE_NUMBERS: opcode = 0x1e601800; break;
+        INVALID_DEFAULT_CASE;
+    }
+    uint32_t d = arm64_numberRegister(number);
+    jit_emit32(as, opcode | (arm64_numberRegister(right) << 16) | (d << 5) | d);
+}
+
+void emit_negate(JitAssembler *as, int32_t number)
+{
+    uint32_t d = arm64_numberRegister(number);
+    jit_emit32(as, 0x1e614000 | (d << 5) | d);
+}
+
+void emit_branchIfZero(JitAssembler *as, int32_t number, int32_t label)
+{
+    // NOTE: fcmp d, #0.0; a NaN is unordered, and is not equal to zero
+    jit_emit32(as, 0x1e602008 | (arm64_numberRegister(number) << 5));
+    arm64_branchIf(as, COND_EQ, label);
+}
+
+// NOTE: fcmp sets NZCV to 0011 when the operands are unordered, so the
+//       conditions are chosen to be false for the NaNs, e.g. MI instead of
+//       LT for `<`.
+void emit_compareBranch(JitAssembler *as, TokenType operator, int32_t left, int32_t right, bool jumpIf, int32_t label)
+{
+    uint32_t condition = COND_EQ;
+    uint32_t negation = COND_NE;
+    switch (operator)
+    {
+        case TT_GREATER: condition = COND_GT; negation = COND_LE; break;
+        case TT_GREATER_EQUAL: condition = COND_GE; negation = COND_LT; break;
+        case TT_LESS: condition = COND_MI; negation = COND_PL; break;
+        case TT_LESS_EQUAL: condition = COND_LS; negation = COND_HI; break;
+        case TT_EQUAL_EQUAL: condition = COND_EQ; negation = COND_NE; break;
+        case TT_BANG_EQUAL: condition = COND_NE; negation = COND_EQ; break;
+        INVALID_DEFAULT_CASE;
+    }
+    // NOTE: fcmp left, right
+    jit_emit32(as, 0x1e602000 | (arm64_numberRegister(right) << 16) | (arm64_numberRegister(left) << 5));
+    arm64_branchIf(as, jumpIf ? condition : negation, label);
+}
+
+// NOTE: the tag of a singleton is its difference with the quiet NaN; the
+//       numbers and the objects give larger unsigned differences.
+void emit_truthBranch(JitAssembler *as, bool jumpIf, int32_t label, int32_t bailout)
+{
+    int32_t done = jit_newLabel(as);
+    arm64_alu(as, ARM64_SUB, REG_TEMP, REG_VALUE, REG_QNAN);
+    arm64_compareImmediate(as, REG_TEMP, VAL_TAG_FALSE);
+    arm64_branchIf(as, COND_LS, jumpIf ? done : label);
+    arm64_compareImmediate(as, REG_TEMP, VAL_TAG_UNBOUND);
+    arm64_branchIf(as, COND_HI, jumpIf ? label : done);
+    arm64_compareImmediate(as, REG_TEMP, VAL_TAG_TRUE);
+    arm64_branchIf(as, COND_NE, bailout);
+    if (jumpIf)
+    {
+        emit_jump(as, label);
+    }
+    jit_bindLabel(as, done);
+}
+
+void emit_callHelper(JitAssembler *as, JitHelper helper, intptr_t argument)
+{
+    arm64_move(as, 0, REG_INTERPRETER);
+    arm64_moveImmediate(as, 1, (uint64_t)argument);
+    arm64_moveImmediate(as, REG_CALL, (uint64_t)(uintptr_t)helper);
+    // NOTE: blr x16
+    jit_emit32(as, 0xd63f0000 | (REG_CALL << 5));
+}
+
+void emit_setEnvironmentFromResult(JitAssembler *as)
+{
+    arm64_move(as, REG_ENVIRONMENT, REG_RESULT);
+}
+
+void emit_branchOnResult(JitAssembler *as, bool jumpIfNonZero, int32_t label)
+{
+    jit_addFixup(as, label, FIXUP_BRANCH19);
+    jit_emit32(as, (jumpIfNonZero ? 0xb5000000 : 0xb4000000) | REG_RESULT);
+}
+
+void emit_storeExit(JitAssembler *as, int32_t offset, bool isResult)
+{
+    arm64_store(as, isResult ? REG_RESULT : REG_VALUE, REG_EXIT, offset);
+}
+
+void emit_storeExitPointer(JitAssembler *as, int32_t offset, const void *pointer)
+{
+    arm64_moveImmediate(as, REG_TEMP, (uint64_t)(uintptr_t)pointer);
+    arm64_store(as, REG_TEMP, REG_EXIT, offset);
+}
+
+void emit_patch(JitAssembler *as, const JitFixup *fixup, int32_t target)
+{
+    int32_t distance = (target - fixup->position) / 4;
+    uint32_t instruction;
+    memcpy(&instruction, as->code + fixup->position, sizeof(uint32_t));
+    if (fixup->kind == FIXUP_BRANCH26)
+    {
+        if (distance < -(1 << 25) || distance >= (1 << 25))
+        {
+            as->failed = true;
+            return;
+        }
+        instruction |= (uint32_t)distance & 0x3ffffff;
+    }
+    else
+    {
+        assert(fixup->kind == FIXUP_BRANCH19);
+        if (distance < -(1 << 18) || distance >= (1 << 18))
+        {
+            as->failed = true;
+            return;
+        }
+        instruction |= ((uint32_t)distance & 0x7ffff) << 5;
+    }
+    memcpy(as->code + fixup->position, &instruction, sizeof(uint32_t));
+}
+
+#endif
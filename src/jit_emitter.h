@@ -0,0 +1,128 @@
+//
+//  jit_emitter.h
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#ifndef jit_emitter_h
+#define jit_emitter_h
+
+#include "jit.h"
+
+#ifdef INTERPRETER_JIT
+
+/*
+ The emitters of the native code of the JIT, implemented by a backend for
+ each architecture: jit_x86_64.c and jit_arm64.c. The native code of a loop
+ or a function is a function
+     int32_t code(Interpreter *interpreter, JitExit *exit)
+ that returns a JitExitStatus, and keeps in callee-saved registers the
+ interpreter, the exit, the current environment, the values of the globals
+ and the quiet NaN of the boxed values.
+ The code works on:
+ - a value register, that holds a boxed Value read from or written to a
+   variable;
+ - JIT_NUMBER_REGISTERS floating point registers, that hold the unboxed
+   numbers of the expressions;
+ - the result register of the calls of the helpers, which are C functions
+   called with the interpreter and one argument.
+ The jumps go to labels, that are patched when the code is complete.
+ */
+
+typedef enum
+{
+    // NOTE: the loop ended, or the function ended without a return
+    JIT_EXIT_DONE,
+    // NOTE: a statement run by the interpreter returned `exit->ret`
+    JIT_EXIT_RETURN,
+    // NOTE: a compiled return statement returned `exit->value`
+    JIT_EXIT_VALUE,
+    // NOTE: the interpreter must run the rest of the code from
+    //       `exit->bailout`
+    JIT_EXIT_BAILOUT,
+} JitExitStatus;
+
+typedef struct
+{
+    Return *ret;
+    Value value;
+    Stmt *bailout;
+} JitExit;
+
+typedef intptr_t (*JitHelper)(Interpreter *interpreter, intptr_t argument);
+
+typedef struct
+{
+    // NOTE: offset of the code to patch
+    int32_t position;
+    int32_t label;
+    // NOTE: the kind of jump of the backend
+    int32_t kind;
+} JitFixup;
+
+typedef struct
+{
+    uint8_t *code;
+    int32_t size;
+    int32_t capacity;
+
+    // NOTE: offsets of the labels in the code, -1 until they are bound
+    int32_t *labels;
+    int32_t labelsCount;
+    int32_t labelsCapacity;
+
+    JitFixup *fixups;
+    int32_t fixupsCount;
+    int32_t fixupsCapacity;
+
+    // NOTE: the epilogue, that returns the status register
+    int32_t exitLabel;
+    // NOTE: true if the code cannot be encoded, e.g. a jump is too far
+    bool failed;
+} JitAssembler;
+
+void jit_emitByte(JitAssembler *as, uint8_t byte);
+void jit_emit32(JitAssembler *as, uint32_t word);
+void jit_emit64(JitAssembler *as, uint64_t word);
+int32_t jit_newLabel(JitAssembler *as);
+void jit_bindLabel(JitAssembler *as, int32_t label);
+void jit_addFixup(JitAssembler *as, int32_t label, int32_t kind);
+
+// NOTE: xmm0-xmm14 on x86-64, and d0-d7, d16-d22 on AArch64; the registers
+//       are not saved by the helpers, and the numbers are never live across
+//       their calls.
+#define JIT_NUMBER_REGISTERS 15
+
+void emit_prologue(JitAssembler *as);
+void emit_epilogue(JitAssembler *as);
+void emit_setStatus(JitAssembler *as, JitExitStatus status);
+void emit_jump(JitAssembler *as, int32_t label);
+
+// NOTE: the local variables are `hops` environments above the current one
+void emit_loadLocal(JitAssembler *as, int32_t hops, int32_t index);
+void emit_loadGlobal(JitAssembler *as, int32_t index);
+void emit_storeLocal(JitAssembler *as, int32_t hops, int32_t index, int32_t bailout);
+void emit_storeGlobal(JitAssembler *as, int32_t index, int32_t bailout);
+void emit_defineLocal(JitAssembler *as);
+
+void emit_unboxNumber(JitAssembler *as, int32_t number, int32_t bailout);
+void emit_boxNumber(JitAssembler *as, int32_t number);
+void emit_loadNumber(JitAssembler *as, int32_t number, double value);
+void emit_arithmetic(JitAssembler *as, BinaryKind kind, int32_t number, int32_t right);
+void emit_negate(JitAssembler *as, int32_t number);
+void emit_branchIfZero(JitAssembler *as, int32_t number, int32_t label);
+void emit_compareBranch(JitAssembler *as, TokenType operator, int32_t left, int32_t right, bool jumpIf, int32_t label);
+void emit_truthBranch(JitAssembler *as, bool jumpIf, int32_t label, int32_t bailout);
+
+void emit_callHelper(JitAssembler *as, JitHelper helper, intptr_t argument);
+void emit_setEnvironmentFromResult(JitAssembler *as);
+void emit_branchOnResult(JitAssembler *as, bool jumpIfNonZero, int32_t label);
+void emit_storeExit(JitAssembler *as, int32_t offset, bool isResult);
+void emit_storeExitPointer(JitAssembler *as, int32_t offset, const void *pointer);
+
+void emit_patch(JitAssembler *as, const JitFixup *fixup, int32_t target);
+
+#endif
+
+#endif /* jit_emitter_h */
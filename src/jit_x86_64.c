@@ -0,0 +1,487 @@
+//
+//  jit_x86_64.c
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#include "jit_emitter.h"
+
+#if defined(INTERPRETER_JIT) && defined(__x86_64__)
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ The x86-64 backend of the JIT, for the System V calling convention.
+ rbx holds the interpreter, r12 the exit, r13 the current environment, r14
+ the values of the globals and r15 the quiet NaN of the boxed values. rax
+ is the value register, as well as the result of the helpers and the status;
+ rcx and rdx are scratch registers, and so is xmm15.
+ */
+
+enum
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+#define REG_INTERPRETER RBX
+#define REG_EXIT R12
+#define REG_ENVIRONMENT R13
+#define REG_GLOBALS R14
+#define REG_QNAN R15
+#define REG_VALUE RAX
+#define REG_TEMP RCX
+#define REG_TEMP2 RDX
+#define XMM_SCRATCH 15
+
+// NOTE: condition codes of the conditional jumps
+enum
+{
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+    CC_BE = 0x6, CC_A = 0x7, CC_P = 0xa, CC_NP = 0xb,
+};
+
+// NOTE: the only kind of jump: a 32-bit displacement, from its end
+#define FIXUP_REL32 0
+
+/* Encoding */
+
+static void x64_rex(JitAssembler *as, bool isWide, int32_t reg, int32_t index, int32_t base)
+{
+    uint8_t rex = (uint8_t)(0x40 | (isWide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+    if (rex != 0x40)
+    {
+        jit_emitByte(as, rex);
+    }
+}
+
+static void x64_modRegisters(JitAssembler *as, int32_t reg, int32_t rm)
+{
+    jit_emitByte(as, (uint8_t)(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// NOTE: the operand [base + displacement], always with a 32-bit displacement
+static void x64_modMemory(JitAssembler *as, int32_t reg, int32_t base, int32_t displacement)
+{
+    jit_emitByte(as, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+    if ((base & 7) == RSP)
+    {
+        jit_emitByte(as, 0x24);
+    }
+    jit_emit32(as, (uint32_t)displacement);
+}
+
+// mov reg, [base + displacement]
+static void x64_load(JitAssembler *as, int32_t reg, int32_t base, int32_t displacement)
+{
+    x64_rex(as, true, reg, 0, base);
+    jit_emitByte(as, 0x8b);
+    x64_modMemory(as, reg, base, displacement);
+}
+
+// mov [base + displacement], reg
+static void x64_store(JitAssembler *as, int32_t reg, int32_t base, int32_t displacement)
+{
+    x64_rex(as, true, reg, 0, base);
+    jit_emitByte(as, 0x89);
+    x64_modMemory(as, reg, base, displacement);
+}
+
+// mov destination, source
+static void x64_move(JitAssembler *as, int32_t destination, int32_t source)
+{
+    x64_rex(as, true, source, 0, destination);
+    jit_emitByte(as, 0x89);
+    x64_modRegisters(as, source, destination);
+}
+
+// mov reg, imm64
+static void x64_moveImmediate(JitAssembler *as, int32_t reg, uint64_t immediate)
+{
+    x64_rex(as, true, 0, 0, reg);
+    jit_emitByte(as, (uint8_t)(0xb8 + (reg & 7)));
+    jit_emit64(as, immediate);
+}
+
+// `opcode` destination, source, for add, sub, and, cmp and test
+static void x64_alu(JitAssembler *as, uint8_t opcode, int32_t destination, int32_t source)
+{
+    x64_rex(as, true, source, 0, destination);
+    jit_emitByte(as, opcode);
+    x64_modRegisters(as, source, destination);
+}
+
+#define X64_SUB 0x29
+#define X64_AND 0x21
+#define X64_CMP 0x39
+#define X64_TEST 0x85
+
+// cmp reg, imm8
+static void x64_compareImmediate(JitAssembler *as, int32_t reg, int8_t immediate)
+{
+    x64_rex(as, true, 0, 0, reg);
+    jit_emitByte(as, 0x83);
+    x64_modRegisters(as, 7, reg);
+    jit_emitByte(as, (uint8_t)immediate);
+}
+
+// An SSE2 operation on two xmm registers, with its mandatory prefix
+static void x64_sse(JitAssembler *as, uint8_t prefix, uint8_t opcode, int32_t destination, int32_t source)
+{
+    jit_emitByte(as, prefix);
+    x64_rex(as, false, destination, 0, source);
+    jit_emitByte(as, 0x0f);
+    jit_emitByte(as, opcode);
+    x64_modRegisters(as, destination, source);
+}
+
+#define SSE_ADDSD 0x58
+#define SSE_MULSD 0x59
+#define SSE_SUBSD 0x5c
+#define SSE_DIVSD 0x5e
+#define SSE_UCOMISD 0x2e
+#define SSE_XORPD 0x57
+
+// movq xmm, reg
+static void x64_moveToXmm(JitAssembler *as, int32_t xmm, int32_t reg)
+{
+    jit_emitByte(as, 0x66);
+    x64_rex(as, true, xmm, 0, reg);
+    jit_emitByte(as, 0x0f);
+    jit_emitByte(as, 0x6e);
+    x64_modRegisters(as, xmm, reg);
+}
+
+// movq reg, xmm
+static void x64_moveFromXmm(JitAssembler *as, int32_t reg, int32_t xmm)
+{
+    jit_emitByte(as, 0x66);
+    x64_rex(as, true, xmm, 0, reg);
+    jit_emitByte(as, 0x0f);
+    jit_emitByte(as, 0x7e);
+    x64_modRegisters(as, xmm, reg);
+}
+
+static void x64_jumpIf(JitAssembler *as, uint8_t condition, int32_t label)
+{
+    jit_emitByte(as, 0x0f);
+    jit_emitByte(as, (uint8_t)(0x80 | condition));
+    jit_addFixup(as, label, FIXUP_REL32);
+    jit_emit32(as, 0);
+}
+
+static void x64_push(JitAssembler *as, int32_t reg)
+{
+    x64_rex(as, false, 0, 0, reg);
+    jit_emitByte(as, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void x64_pop(JitAssembler *as, int32_t reg)
+{
+    x64_rex(as, false, 0, 0, reg);
+    jit_emitByte(as, (uint8_t)(0x58 + (reg & 7)));
+}
+
+// Returns the register that holds the environment `hops` environments above
+// the current one, loading it in `reg` if it is not the current one.
+static int32_t x64_environment(JitAssembler *as, int32_t hops, int32_t reg)
+{
+    if (hops == 0)
+    {
+        return REG_ENVIRONMENT;
+    }
+    x64_load(as, reg, REG_ENVIRONMENT, offsetof(Environment, enclosing));
+    for (int32_t i = 1; i < hops; i++)
+    {
+        x64_load(as, reg, reg, offsetof(Environment, enclosing));
+    }
+    return reg;
+}
+
+static inline int32_t x64_slotOffset(int32_t index)
+{
+    return (int32_t)(offsetof(Environment, values) + (size_t)index * sizeof(Value));
+}
+
+/* Emitters */
+
+void emit_prologue(JitAssembler *as)
+{
+    x64_push(as, RBP);
+    x64_move(as, RBP, RSP);
+    x64_push(as, RBX);
+    x64_push(as, R12);
+    x64_push(as, R13);
+    x64_push(as, R14);
+    x64_push(as, R15);
+    // NOTE: sub rsp, 8 aligns the stack on 16 bytes for the helpers
+    x64_rex(as, true, 0, 0, RSP);
+    jit_emitByte(as, 0x83);
+    x64_modRegisters(as, 5, RSP);
+    jit_emitByte(as, 8);
+
+    x64_move(as, REG_INTERPRETER, RDI);
+    x64_move(as, REG_EXIT, RSI);
+    x64_load(as, REG_ENVIRONMENT, REG_INTERPRETER, offsetof(Interpreter, environment));
+    x64_load(as, REG_GLOBALS, REG_INTERPRETER, offsetof(Interpreter, globals));
+    // NOTE: lea r14, [r14 + offsetof(Environment, values)]
+    x64_rex(as, true, REG_GLOBALS, 0, REG_GLOBALS);
+    jit_emitByte(as, 0x8d);
+    x64_modMemory(as, REG_GLOBALS, REG_GLOBALS, offsetof(Environment, values));
+    x64_moveImmediate(as, REG_QNAN, VAL_QNAN);
+}
+
+void emit_epilogue(JitAssembler *as)
+{
+    // NOTE: add rsp, 8
+    x64_rex(as, true, 0, 0, RSP);
+    jit_emitByte(as, 0x83);
+    x64_modRegisters(as, 0, RSP);
+    jit_emitByte(as, 8);
+    x64_pop(as, R15);
+    x64_pop(as, R14);
+    x64_pop(as, R13);
+    x64_pop(as, R12);
+    x64_pop(as, RBX);
+    x64_pop(as, RBP);
+    jit_emitByte(as, 0xc3);
+}
+
+void emit_setStatus(JitAssembler *as, JitExitStatus status)
+{
+    // NOTE: mov eax, imm32
+    jit_emitByte(as, 0xb8);
+    jit_emit32(as, (uint32_t)status);
+}
+
+void emit_jump(JitAssembler *as, int32_t label)
+{
+    jit_emitByte(as, 0xe9);
+    jit_addFixup(as, label, FIXUP_REL32);
+    jit_emit32(as, 0);
+}
+
+void emit_loadLocal(JitAssembler *as, int32_t hops, int32_t index)
+{
+    int32_t environment = x64_environment(as, hops, REG_TEMP);
+    x64_load(as, REG_VALUE, environment, x64_slotOffset(index));
+}
+
+void emit_loadGlobal(JitAssembler *as, int32_t index)
+{
+    x64_load(as, REG_VALUE, REG_GLOBALS, index * (int32_t)sizeof(Value));
+}
+
+// NOTE: the value the slot holds must not be an object, whose overwrite
+//       the incremental marking must see, see gcOverwrite().
+void emit_storeLocal(JitAssembler *as, int32_t hops, int32_t index, int32_t bailout)
+{
+    int32_t environment = x64_environment(as, hops, REG_TEMP);
+    x64_load(as, REG_TEMP2, environment, x64_slotOffset(index));
+    // NOTE: sar rdx, 50 leaves -1 for the objects only
+    x64_rex(as, true, 0, 0, REG_TEMP2);
+    jit_emitByte(as, 0xc1);
+    x64_modRegisters(as, 7, REG_TEMP2);
+    jit_emitByte(as, 50);
+    x64_compareImmediate(as, REG_TEMP2, -1);
+    x64_jumpIf(as, CC_E, bailout);
+    x64_store(as, REG_VALUE, environment, x64_slotOffset(index));
+}
+
+void emit_storeGlobal(JitAssembler *as, int32_t index, int32_t bailout)
+{
+    int32_t offset = index * (int32_t)sizeof(Value);
+    x64_load(as, REG_TEMP2, REG_GLOBALS, offset);
+    x64_alu(as, X64_SUB, REG_TEMP2, REG_QNAN);
+    x64_compareImmediate(as, REG_TEMP2, VAL_TAG_UNBOUND);
+    x64_jumpIf(as, CC_E, bailout);
+    x64_store(as, REG_VALUE, REG_GLOBALS, offset);
+}
+
+void emit_defineLocal(JitAssembler *as)
+{
+    int32_t slotsUsed = offsetof(Environment, slotsUsed);
+    // NOTE: mov ecx, [r13 + slotsUsed]
+    x64_rex(as, false, REG_TEMP, 0, REG_ENVIRONMENT);
+    jit_emitByte(as, 0x8b);
+    x64_modMemory(as, REG_TEMP, REG_ENVIRONMENT, slotsUsed);
+    // NOTE: mov [r13 + rcx * 8 + values], rax
+    x64_rex(as, true, REG_VALUE, REG_TEMP, REG_ENVIRONMENT);
+    jit_emitByte(as, 0x89);
+    jit_emitByte(as, (uint8_t)(0x84 | ((REG_VALUE & 7) << 3)));
+    jit_emitByte(as, (uint8_t)(0xc0 | ((REG_TEMP & 7) << 3) | (REG_ENVIRONMENT & 7)));
+    jit_emit32(as, (uint32_t)offsetof(Environment, values));
+    // NOTE: inc dword [r13 + slotsUsed]
+    x64_rex(as, false, 0, 0, REG_ENVIRONMENT);
+    jit_emitByte(as, 0xff);
+    x64_modMemory(as, 0, REG_ENVIRONMENT, slotsUsed);
+}
+
+void emit_unboxNumber(JitAssembler *as, int32_t number, int32_t bailout)
+{
+    x64_move(as, REG_TEMP, REG_VALUE);
+    x64_alu(as, X64_AND, REG_TEMP, REG_QNAN);
+    x64_alu(as, X64_CMP, REG_TEMP, REG_QNAN);
+    x64_jumpIf(as, CC_E, bailout);
+    x64_moveToXmm(as, number, REG_VALUE);
+}
+
+void emit_boxNumber(JitAssembler *as, int32_t number)
+{
+    x64_moveFromXmm(as, REG_VALUE, number);
+}
+
+void emit_loadNumber(JitAssembler *as, int32_t number, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(double));
+    if (bits == 0)
+    {
+        x64_sse(as, 0x66, SSE_XORPD, number, number);
+        return;
+    }
+    x64_moveImmediate(as, REG_TEMP, bits);
+    x64_moveToXmm(as, number, REG_TEMP);
+}
+
+void emit_arithmetic(JitAssembler *as, BinaryKind kind, int32_t number, int32_t right)
+{
+    uint8_t opcode = 0;
+    switch (kind)
+    {
+        case BINARY_ADD_NUMBERS: opcode = SSE_ADDSD; break;
+        case BINARY_SUBTRACT_NUMBERS: opcode = SSE_SUBSD; break;
+        case BINARY_MULTIPLY_NUMBERS: opcode = SSE_MULSD; break;
+        case BINARY_DIVIDE_NUMBERS: opcode = SSE_DIVSD; break;
+        INVALID_DEFAULT_CASE;
+    }
+    x64_sse(as, 0xf2, opcode, number, right);
+}
+
+void emit_negate(JitAssembler *as, int32_t number)
+{
+    x64_moveImmediate(as, REG_TEMP, VAL_SIGN_BIT);
+    x64_moveToXmm(as, XMM_SCRATCH, REG_TEMP);
+    x64_sse(as, 0x66, SSE_XORPD, number, XMM_SCRATCH);
+}
+
+void emit_branchIfZero(JitAssembler *as, int32_t number, int32_t label)
+{
+    x64_sse(as, 0x66, SSE_XORPD, XMM_SCRATCH, XMM_SCRATCH);
+    x64_sse(as, 0x66, SSE_UCOMISD, number, XMM_SCRATCH);
+    // NOTE: a NaN is unordered, and is not zero
+    int32_t notZero = jit_newLabel(as);
+    x64_jumpIf(as, CC_P, notZero);
+    x64_jumpIf(as, CC_E, label);
+    jit_bindLabel(as, notZero);
+}
+
+// NOTE: ucomisd sets ZF, PF and CF when the operands are unordered, so the
+//       comparisons are written with `above` conditions, that are false for
+//       the NaNs, and the equality also checks PF.
+void emit_compareBranch(JitAssembler *as, TokenType operator, int32_t left, int32_t right, bool jumpIf, int32_t label)
+{
+    switch (operator)
+    {
+        case TT_GREATER:
+            x64_sse(as, 0x66, SSE_UCOMISD, left, right);
+            x64_jumpIf(as, jumpIf ? CC_A : CC_BE, label);
+            break;
+        case TT_GREATER_EQUAL:
+            x64_sse(as, 0x66, SSE_UCOMISD, left, right);
+            x64_jumpIf(as, jumpIf ? CC_AE : CC_B, label);
+            break;
+        case TT_LESS:
+            x64_sse(as, 0x66, SSE_UCOMISD, right, left);
+            x64_jumpIf(as, jumpIf ? CC_A : CC_BE, label);
+            break;
+        case TT_LESS_EQUAL:
+            x64_sse(as, 0x66, SSE_UCOMISD, right, left);
+            x64_jumpIf(as, jumpIf ? CC_AE : CC_B, label);
+            break;
+        case TT_EQUAL_EQUAL:
+        case TT_BANG_EQUAL:
+        {
+            x64_sse(as, 0x66, SSE_UCOMISD, left, right);
+            // NOTE: jumps when the operands are different
+            if (jumpIf == (operator == TT_BANG_EQUAL))
+            {
+                x64_jumpIf(as, CC_P, label);
+                x64_jumpIf(as, CC_NE, label);
+            }
+            else
+            {
+                int32_t unordered = jit_newLabel(as);
+                x64_jumpIf(as, CC_P, unordered);
+                x64_jumpIf(as, CC_E, label);
+                jit_bindLabel(as, unordered);
+            }
+        } break;
+        INVALID_DEFAULT_CASE;
+    }
+}
+
+// NOTE: the tag of a singleton is its difference with the quiet NaN; the
+//       numbers and the objects give larger unsigned differences.
+void emit_truthBranch(JitAssembler *as, bool jumpIf, int32_t label, int32_t bailout)
+{
+    int32_t done = jit_newLabel(as);
+    x64_move(as, REG_TEMP, REG_VALUE);
+    x64_alu(as, X64_SUB, REG_TEMP, REG_QNAN);
+    x64_compareImmediate(as, REG_TEMP, VAL_TAG_FALSE);
+    x64_jumpIf(as, CC_BE, jumpIf ? done : label);
+    x64_compareImmediate(as, REG_TEMP, VAL_TAG_UNBOUND);
+    x64_jumpIf(as, CC_A, jumpIf ? label : done);
+    x64_compareImmediate(as, REG_TEMP, VAL_TAG_TRUE);
+    x64_jumpIf(as, CC_NE, bailout);
+    if (jumpIf)
+    {
+        emit_jump(as, label);
+    }
+    jit_bindLabel(as, done);
+}
+
+void emit_callHelper(JitAssembler *as, JitHelper helper, intptr_t argument)
+{
+    x64_move(as, RDI, REG_INTERPRETER);
+    x64_moveImmediate(as, RSI, (uint64_t)argument);
+    x64_moveImmediate(as, RAX, (uint64_t)(uintptr_t)helper);
+    // NOTE: call rax
+    jit_emitByte(as, 0xff);
+    x64_modRegisters(as, 2, RAX);
+}
+
+void emit_setEnvironmentFromResult(JitAssembler *as)
+{
+    x64_move(as, REG_ENVIRONMENT, RAX);
+}
+
+void emit_branchOnResult(JitAssembler *as, bool jumpIfNonZero, int32_t label)
+{
+    x64_alu(as, X64_TEST, RAX, RAX);
+    x64_jumpIf(as, jumpIfNonZero ? CC_NE : CC_E, label);
+}
+
+// NOTE: the result and the value share rax
+void emit_storeExit(JitAssembler *as, int32_t offset, bool isResult)
+{
+    (void)isResult;
+    x64_store(as, RAX, REG_EXIT, offset);
+}
+
+void emit_storeExitPointer(JitAssembler *as, int32_t offset, const void *pointer)
+{
+    x64_moveImmediate(as, REG_TEMP, (uint64_t)(uintptr_t)pointer);
+    x64_store(as, REG_TEMP, REG_EXIT, offset);
+}
+
+void emit_patch(JitAssembler *as, const JitFixup *fixup, int32_t target)
+{
+    assert(fixup->kind == FIXUP_REL32);
+    int32_t displacement = target - (fixup->position + 4);
+    memcpy(as->code + fixup->position, &displacement, sizeof(int32_t));
+}
+
+#endif
@@ -0,0 +1,243 @@
+//
+//  lox_array.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "lox_array.h"
+#include "garbage_collector.h"
+#include "interpreter.h"
+#include "lox_function.h"
+#include "lox_map.h"
+#include "memory_pool.h"
+
+#include <math.h>
+
+extern inline bool isLoxArray(Value array);
+
+LoxArray * arrayInit()
+{
+    LoxArray *array = slab_alloc(LoxArray);
+    array->marked = GC_CLEAR;
+#ifdef GC_GENERATIONAL
+    array->isOld = false;
+    array->isRemembered = false;
+#endif
+    array->values = NULL;
+    array->count = 0;
+    array->capacity = 0;
+    return array;
+}
+
+void arrayFree(LoxArray *array)
+{
+    // NOTE: the values are objects, and they're taken
+    //       care of by the garbage collector.
+    if (array->values != NULL)
+    {
+        slab_freen(array->values, array->capacity);
+    }
+    slab_free(array);
+}
+
+// Write barrier of the arrays, called before a value is stored in `array`.
+static inline void arrayWillStore(LoxArray *array, GarbageCollector *collector)
+{
+#ifdef GC_GENERATIONAL
+    // NOTE: an old array may now reference a young object
+    if (array->isOld && !array->isRemembered)
+    {
+        gcRememberArray(array, collector);
+    }
+#endif
+}
+
+void arrayPush(LoxArray *array, Value value, GarbageCollector *collector)
+{
+    arrayWillStore(array, collector);
+    if (array->count == array->capacity)
+    {
+        int32_t capacity = array->capacity == 0 ? LOX_ARRAY_INITIAL_CAPACITY : 2 * array->capacity;
+        Value *values = slab_allocn(Value, capacity);
+        for (int32_t index = 0; index < array->count; ++index)
+        {
+            values[index] = array->values[index];
+        }
+        if (array->values != NULL)
+        {
+            slab_freen(array->values, array->capacity);
+        }
+        array->values = values;
+        array->capacity = capacity;
+    }
+    array->values[array->count++] = value;
+}
+
+// Returns a description of the values of `array`, e.g. "[1, two, [...]]".
+// NOTE: the nested arrays and maps are not expanded, as they may contain
+//       `array`.
+char * arrayToString(const LoxArray *array)
+{
+    char *string = str_fromLiteral("[");
+    for (int32_t index = 0; index < array->count; ++index)
+    {
+        if (index > 0)
+        {
+            str_appendLiteral(string, ", ");
+        }
+        Value value = array->values[index];
+        if (isLoxArray(value))
+        {
+            str_appendLiteral(string, "[...]");
+        }
+        else if (isLoxMap(value))
+        {
+            str_appendLiteral(string, "{...}");
+        }
+        else
+        {
+            char *element = obj_stringify(value);
+            str_append(string, element);
+            str_free(element);
+        }
+    }
+    str_appendLiteral(string, "]");
+    return string;
+}
+
+/* LOX native functions */
+
+__attribute__((__noreturn__))
+static void array_throwError(const char *message, Interpreter *interpreter)
+{
+    interpreter_throwNewError(interpreter->nativeCallToken, message, interpreter);
+}
+
+static LoxArray * array_checkArray(Value value, Interpreter *interpreter)
+{
+    if (!isLoxArray(value))
+    {
+        array_throwError("Operand must be an array.", interpreter);
+    }
+    return obj_unwrapArray(value);
+}
+
+// Returns the index `value` of an element of `array`, or throws a runtime
+// error if it is not a valid one.
+static int32_t array_checkIndex(const LoxArray *array, Value value, Interpreter *interpreter)
+{
+    if (!val_isNumber(value))
+    {
+        array_throwError("Array index must be a number.", interpreter);
+    }
+    double index = val_asNumber(value);
+    if (index != floor(index))
+    {
+        array_throwError("Array index must be an integer.", interpreter);
+    }
+    if (index < 0 || index >= array->count)
+    {
+        array_throwError("Array index out of bounds.", interpreter);
+    }
+    return (int32_t)index;
+}
+
+// array() returns a new empty array
+static LOX_CALLABLE(lox_array)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    return obj_wrapArray(arrayInit(), interpreter->collector);
+}
+
+// push(array, value) appends value to array, and returns the new length
+static LOX_CALLABLE(lox_push)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    LoxArray *array = array_checkArray(args->values[0], interpreter);
+    if (array->count == LOX_ARRAY_MAX_COUNT)
+    {
+        array_throwError("Too many elements in the array.", interpreter);
+    }
+    arrayPush(array, args->values[1], interpreter->collector);
+    return val_number(array->count);
+}
+
+// pop(array) removes the last value of array, and returns it
+static LOX_CALLABLE(lox_pop)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    LoxArray *array = array_checkArray(args->values[0], interpreter);
+    if (array->count == 0)
+    {
+        array_throwError("Cannot pop an empty array.", interpreter);
+    }
+    Value value = array->values[--array->count];
+    // NOTE: the value is removed, as if it were overwritten
+    gcOverwrite(value, interpreter->collector);
+    return value;
+}
+
+// get(array, index) returns the value at index, and get(map, key) the value
+// of key, or nil if the map does not contain it
+static LOX_CALLABLE(lox_get)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    if (isLoxMap(args->values[0]))
+    {
+        mapCheckKey(args->values[1], interpreter);
+        Value value;
+        return mapGet(obj_unwrapMap(args->values[0]), args->values[1], &value) ? value : VAL_NIL;
+    }
+    LoxArray *array = array_checkArray(args->values[0], interpreter);
+    int32_t index = array_checkIndex(array, args->values[1], interpreter);
+    return array->values[index];
+}
+
+// set(array, index, value) replaces the value at index, and set(map, key,
+// value) associates value to key; both return value
+static LOX_CALLABLE(lox_set)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    if (isLoxMap(args->values[0]))
+    {
+        LoxMap *map = obj_unwrapMap(args->values[0]);
+        mapCheckKey(args->values[1], interpreter);
+        if (map->count == LOX_MAP_MAX_COUNT)
+        {
+            array_throwError("Too many keys in the map.", interpreter);
+        }
+        mapSet(map, args->values[1], args->values[2], interpreter->collector);
+        return args->values[2];
+    }
+    LoxArray *array = array_checkArray(args->values[0], interpreter);
+    int32_t index = array_checkIndex(array, args->values[1], interpreter);
+    arrayWillStore(array, interpreter->collector);
+    gcOverwrite(array->values[index], interpreter->collector);
+    array->values[index] = args->values[2];
+    return args->values[2];
+}
+
+// length(value) returns the number of values of an array, or the number of
+// characters of a string
+static LOX_CALLABLE(lox_length)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    Value value = args->values[0];
+    if (val_isString(value))
+    {
+        return val_number(str_length(obj_unwrapString(value)));
+    }
+    return val_number(array_checkArray(value, interpreter)->count);
+}
+
+static const LoxCallable lox_arrayNatives[] = {
+    LOX_NATIVE("array", lox_array, 0, "array() - returns a new empty array"),
+    LOX_NATIVE("push", lox_push, 2, "push(a, v) - appends v to the array a, and returns its length"),
+    LOX_NATIVE("pop", lox_pop, 1, "pop(a)  - removes and returns the last value of the array a"),
+    LOX_NATIVE("get", lox_get, 2, "get(a, i) - returns the value at index i of the array a, or of key i of the map a"),
+    LOX_NATIVE("set", lox_set, 3, "set(a, i, v) - replaces the value at index i of the array a, or of key i of the map a, with v"),
+    LOX_NATIVE("length", lox_length, 1, "length(a) - returns the length of the array or string a"),
+};
+
+const LoxNativeModule lox_arrayModule = LOX_MODULE(lox_arrayNatives);
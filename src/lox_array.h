@@ -0,0 +1,50 @@
+//
+//  lox_array.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef lox_array_h
+#define lox_array_h
+
+#include "common.h"
+#include "lox_callable.h"
+#include "value.h"
+
+/*
+ An array holds its values in a contiguous buffer, that doubles its capacity
+ when it is full, so that the elements are accessed in constant time and
+ pushed in amortized constant time. The arrays are only used through the
+ native functions array(), push(), pop(), get(), set() and length(); get()
+ and set() also take a map, see lox_map.h.
+ NOTE: with MEMORY_DEBUG, the buffer must fit in a 64KB allocation.
+ */
+
+typedef struct LoxArray_tag
+{
+    Value *values;
+    int32_t count;
+    int32_t capacity;
+    int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+    // NOTE: true if the array is in the remembered set of the garbage
+    //       collector
+    bool isRemembered;
+#endif
+} LoxArray;
+
+LoxArray * arrayInit(void);
+void arrayFree(LoxArray *array);
+void arrayPush(LoxArray *array, Value value, GarbageCollector *collector);
+char * arrayToString(const LoxArray *array);
+
+inline bool isLoxArray(Value array)
+{
+    return val_isObjectType(array, OT_ARRAY);
+}
+
+extern const LoxNativeModule lox_arrayModule;
+
+#endif /* lox_array_h */
@@ -8,29 +8,10 @@
 #include "lox_callable.h"
 #include "common.h"
 #include "garbage_collector.h"
+#include "memory_pool.h"
 
 extern inline int32_t callableArity(const LoxCallable *f);
-extern inline bool isLoxCallable(const Object *callee);
-
-LoxCallable * callableInit(lox_callable_function *f, int32_t arity)
-{
-    assert(arity >= 0 && arity <= LOX_MAX_ARG_COUNT);
-
-    LoxCallable* callable = lox_alloc(LoxCallable);
-    if(callable == NULL)
-    {
-        fatal_outOfMemory();
-    }
-    callable->function = f;
-    callable->arity = arity;
-    
-    return callable;
-}
-
-void callableFree(LoxCallable *callable)
-{
-        lox_free(callable);
-}
+extern inline bool isLoxCallable(Value callee);
 
 /* LOX native functions */
 
@@ -38,27 +19,34 @@ void callableFree(LoxCallable *callable)
 #include <stdio.h>
 
 // clock() returns the time elapsed in milliseconds since a reference time
-LOX_CALLABLE(lox_clock)
+static LOX_CALLABLE(lox_clock)
 {
     Interpreter *interpreter = (Interpreter *)context;
     double elapsedSec = timer_elapsedSec(&interpreter->timer);
         
-    Object *result = obj_newNumber(elapsedSec*1000, interpreter->collector);
+    Value result = val_number(elapsedSec*1000);
     return result;
 }
 
 // env() prints all objects defined in the current environment
-LOX_CALLABLE(lox_env)
+static LOX_CALLABLE(lox_env)
 {
     Interpreter *interpreter = (Interpreter *)context;
+    output_flush(&interpreter->output);
     env_printReportAll(interpreter->environment);
     
-    Object *result = obj_newNil(interpreter->collector);
-    return result;
+    return VAL_NIL;
+}
+
+// gcStats() returns a description of the garbage collector statistics
+static LOX_CALLABLE(lox_gcStats)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    return obj_wrapString(gcStatsDescription(interpreter->collector), interpreter->collector);
 }
 
 // quit() exits the interpreter
-LOX_CALLABLE(lox_quit)
+static LOX_CALLABLE(lox_quit)
 {
     Interpreter *interpreter = (Interpreter *)context;
     if (interpreter->isREPL)
@@ -67,19 +55,50 @@ LOX_CALLABLE(lox_quit)
     }
     else
     {
+        output_flush(&interpreter->output);
         exit(0);
     }
 }
 
+// flush() writes the output of the print statements that is still buffered
+static LOX_CALLABLE(lox_flush)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    output_flush(&interpreter->output);
+    return VAL_NIL;
+}
+
 // help() prints a some help in the interpreter
-LOX_CALLABLE(lox_help)
+static LOX_CALLABLE(lox_help)
 {
+    Interpreter *interpreter = (Interpreter *)context;
+    output_flush(&interpreter->output);
     printf("\nLoxi is an interpreter for the Lox language, as described on\nhttp://www.craftinginterpreters.com/the-lox-language.html\n\n");
     printf("Native functions:\n");
-    printf(" clock() - returns the time (in msec) elapsed since the start\n");
-    printf(" env()   - prints objects defined in current environment\n");
-    printf(" help()  - prints this help\n");
-    printf(" quit()  - exits the interpreter\n");
+    // NOTE: the natives are the first globals
+    for (int32_t slot = 0; slot < interpreter->nativesCount; ++slot)
+    {
+        Value value = interpreter->globals->values[slot];
+        if (isLoxCallable(value))
+        {
+            printf(" %s\n", obj_unwrapCallable(value)->help);
+        }
+    }
     printf("\n");
-    return NULL;
+    return VAL_NIL;
 }
+
+static const LoxCallable lox_coreNatives[] = {
+    LOX_NATIVE("clock", lox_clock, 0, "clock() - returns the time (in msec) elapsed since the start"),
+    LOX_NATIVE("gcStats", lox_gcStats, 0, "gcStats() - returns the garbage collector statistics"),
+    LOX_NATIVE("flush", lox_flush, 0, "flush() - writes the output of print that is still buffered"),
+};
+
+static const LoxCallable lox_replNatives[] = {
+    LOX_NATIVE("env", lox_env, 0, "env()   - prints objects defined in current environment"),
+    LOX_NATIVE("help", lox_help, 0, "help()  - prints this help"),
+    LOX_NATIVE("quit", lox_quit, 0, "quit()  - exits the interpreter"),
+};
+
+const LoxNativeModule lox_coreModule = LOX_MODULE(lox_coreNatives);
+const LoxNativeModule lox_replModule = LOX_MODULE(lox_replNatives);
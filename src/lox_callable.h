@@ -10,23 +10,42 @@
 
 #include <stdint.h>
 
+#include "value.h"
+
 struct LoxArguments_tag;
-#define LOX_CALLABLE(name) struct Object_tag *name(struct LoxArguments_tag *args, void *context)
+#define LOX_CALLABLE(name) Value name(struct LoxArguments_tag *args, void *context)
 typedef LOX_CALLABLE(lox_callable_function);
 
+/*
+ The native functions are static and immutable, so they are shared by all
+ the interpreters and threads, and the objects that wrap them own nothing.
+ They are grouped in modules, i.e. tables of natives that
+ interpreter_defineModule() defines as globals. A native receives its
+ arguments in place on the stack of locked values, and `context` is the
+ interpreter; it reports its errors with interpreter_throwNewError(), at
+ the token interpreter->nativeCallToken of the call.
+ */
+
 typedef struct LoxCallable_tag
 {
     lox_callable_function *function;
     int32_t arity;
+    // NOTE: the name of the global, and the line that help() prints
+    const char *name;
+    const char *help;
 } LoxCallable;
 
-LOX_CALLABLE(lox_clock);
-LOX_CALLABLE(lox_help);
-LOX_CALLABLE(lox_env);
-LOX_CALLABLE(lox_quit);
+typedef struct
+{
+    const LoxCallable *natives;
+    int32_t count;
+} LoxNativeModule;
+
+#define LOX_NATIVE(name, function, arity, help) { function, arity, name, help }
+#define LOX_MODULE(natives) { natives, sizeof natives / sizeof natives[0] }
 
-LoxCallable * callableInit(lox_callable_function *f, int32_t arity);
-void callableFree(LoxCallable *callable);
+extern const LoxNativeModule lox_coreModule;
+extern const LoxNativeModule lox_replModule;
 
 inline int32_t callableArity(const LoxCallable *f)
 {
@@ -35,9 +54,9 @@ inline int32_t callableArity(const LoxCallable *f)
 
 #include "objects.h"
 
-inline bool isLoxCallable(const Object *callee)
+inline bool isLoxCallable(Value callee)
 {
-    return callee->type == OT_CALLABLE;
+    return val_isObjectType(callee, OT_CALLABLE);
 }
 
 #endif /* lox_callable_h */
@@ -10,80 +10,107 @@
 #include "lox_class.h"
 #include "lox_function.h"
 #include "lox_instance.h"
+#include "memory_pool.h"
 
-extern inline bool isLoxClass(const Object *klass);
+extern inline bool isLoxClass(Value klass);
 
-LOX_CALLABLE(class_call)
+static inline uint32_t class_hashName(const char *name)
 {
-    struct LoxClassInitializerContext *initializerContext = (struct LoxClassInitializerContext *)context;
-    Interpreter *interpreter = initializerContext->interpreter;
-    LoxClass *klass = initializerContext->klass;
+    uintptr_t address = (uintptr_t)name;
+    return (uint32_t)((address >> 3) * 2654435761u);
+}
 
-    LoxInstance *instance = instanceInit(klass);
-    LoxFunction *initializer = findMethod(instance, klass, "init", &initializerContext->error, interpreter->collector);
-    if(initializerContext->error)
+// Returns the entry of the method table of `klass` for `name`: the entry of
+// the method, or the empty entry where it should be inserted.
+// NOTE: `name` must be interned, as the names of the methods.
+static inline MethodEntry * class_tableEntry(const LoxClass *klass, const char *name)
+{
+    uint32_t mask = (uint32_t)klass->methodTableCapacity - 1;
+    uint32_t slot = class_hashName(name) & mask;
+    while (klass->methodTable[slot].name != NULL && klass->methodTable[slot].name != name)
     {
-        return NULL;
+        slot = (slot + 1) & mask;
     }
-    Object *result;
-    if (initializer != NULL)
-    {
-        result = function_call(initializer, args, &initializerContext->error, interpreter);
+    return &klass->methodTable[slot];
+}
 
-        env_release(initializer->closure);
-        lox_free(initializer);
-        
-        if(initializerContext->error)
-        {
-            return NULL;
-        }
-    }
-    else
+static void class_tableInsert(LoxClass *klass, const char *name, LoxFunction *function)
+{
+    MethodEntry *entry = class_tableEntry(klass, name);
+    // NOTE: the methods of the class are inserted first, so that they
+    //       override the inherited ones.
+    if (entry->name == NULL)
     {
-        result = obj_wrapInstance(instance, interpreter->collector);
+        entry->name = name;
+        entry->function = function;
     }
-    return result;
 }
 
-const LoxFunction * findClassMethod(const LoxClass *klass, const char *name)
+// Builds the method table of `klass`, that holds its methods and the ones
+// that it inherits from its superclasses, so that a method of any class of
+// the hierarchy is found with one lookup.
+static void class_buildMethodTable(LoxClass *klass)
 {
+    int32_t count = klass->methodsCount;
+    if (klass->superClass != NULL)
+    {
+        count += klass->superClass->methodTableCount;
+    }
+    int32_t capacity = LOX_CLASS_MIN_METHOD_TABLE;
+    while (capacity < 2 * count)
+    {
+        capacity *= 2;
+    }
+    klass->methodTable = slab_allocn(MethodEntry, capacity);
+    klass->methodTableCapacity = capacity;
+    for (int32_t index = 0; index < capacity; ++index)
+    {
+        klass->methodTable[index].name = NULL;
+        klass->methodTable[index].function = NULL;
+    }
+
     for (int32_t index = 0; index < klass->methodsCount; ++index)
     {
-        if(str_isEqual(name, klass->methods[index].name))
+        class_tableInsert(klass, klass->methods[index].name, klass->methods[index].function);
+    }
+    const LoxClass *superClass = klass->superClass;
+    if (superClass != NULL)
+    {
+        for (int32_t index = 0; index < superClass->methodTableCapacity; ++index)
         {
-            const LoxFunction *method = klass->methods[index].function;
-            return method;
+            const MethodEntry *entry = &superClass->methodTable[index];
+            if (entry->name != NULL)
+            {
+                class_tableInsert(klass, entry->name, entry->function);
+            }
         }
     }
-    return NULL;
-}
 
-int32_t class_arity(const LoxClass *klass)
-{
-    const LoxFunction *initializer = findClassMethod(klass, "init");
-    if (initializer == NULL)
+    klass->methodTableCount = 0;
+    for (int32_t index = 0; index < capacity; ++index)
     {
-        return 0;
+        if (klass->methodTable[index].name != NULL)
+        {
+            ++klass->methodTableCount;
+        }
     }
-    int32_t arity = initializer->declaration->arity;
-    return arity;
 }
 
 LoxClass * classInit(const char *name, LoxClass *superClass, MethodEntry *methods, int32_t methodsCount)
 {
-    LoxClass* klass = lox_alloc(LoxClass);
-    if(klass == NULL)
-    {
-        fatal_outOfMemory();
-    }
-    assert(klass != NULL);
+    LoxClass* klass = slab_alloc(LoxClass);
     klass->marked = GC_CLEAR;
+#ifdef GC_GENERATIONAL
+    klass->isOld = false;
+#endif
     klass->name = name;
     klass->superClass = superClass;
     klass->methods = methods;
     klass->methodsCount = methodsCount;
-    int32_t arity = class_arity(klass);
-    klass->callable = callableInit(class_call, arity);
+    class_buildMethodTable(klass);
+    klass->shape = shape_init();
+    klass->initializer = classFindMethod(klass, str_internedInit);
+    klass->arity = klass->initializer != NULL ? klass->initializer->declaration->arity : 0;
     return klass;
 }
 
@@ -93,14 +120,18 @@ static void classFreeMethods(LoxClass *klass)
     {
         function_free(klass->methods[index].function);
     }
-    lox_free(klass->methods);
+    if (klass->methods != NULL)
+    {
+        slab_freen(klass->methods, klass->methodsCount);
+    }
 }
 
 void classFree(LoxClass *klass)
 {
     classFreeMethods(klass);
-    callableFree(klass->callable);
-    lox_free(klass);
+    slab_freen(klass->methodTable, klass->methodTableCapacity);
+    shape_free(klass->shape);
+    slab_free(klass);
 }
 
 char * classToString(const LoxClass *klass)
@@ -110,26 +141,9 @@ char * classToString(const LoxClass *klass)
     return str;
 }
 
-LoxFunction * findMethod(LoxInstance *instance, LoxClass *klass, const char *name, Error **error, GarbageCollector *collector)
+// Returns the method `name` of `klass` or of its superclasses, or NULL if
+// there is none.
+const LoxFunction * classFindMethod(const LoxClass *klass, const char *name)
 {
-    for (int32_t index = 0; index < klass->methodsCount; ++index)
-    {
-        if(str_isEqual(name, klass->methods[index].name))
-        {
-            const LoxFunction *function = klass->methods[index].function;
-            LoxFunction *result = function_bind(function, instance, error, collector);
-            return result;
-        }
-    }
-    
-    if (klass->superClass != NULL)
-    {
-        return findMethod(instance, klass->superClass, name, error, collector);
-    }
-    
-    return NULL;
+    return class_tableEntry(klass, name)->function;
 }
-
-
-
-
@@ -11,6 +11,7 @@
 #include "lox_callable.h"
 #include "memory.h"
 #include "objects.h"
+#include "shape.h"
 #include "string.h"
 
 struct Interpreter_tag;
@@ -24,30 +25,37 @@ typedef struct
 
 typedef struct LoxClass_tag
 {
-    LoxCallable *callable;
     const char *name;
     LoxClass *superClass;
-    // TODO: Use a hash table instead of a simple array to store the methods?
+    // NOTE: the methods defined by the class, that it owns
     MethodEntry *methods;
     int32_t methodsCount;
+    // NOTE: hash table of the methods of the class and of the ones it
+    //       inherits, with linear probing on the interned names; the empty
+    //       entries have a NULL name. The capacity is a power of 2.
+    MethodEntry *methodTable;
+    int32_t methodTableCapacity;
+    int32_t methodTableCount;
+    // NOTE: the initializer, that may be inherited, or NULL if there is none
+    const LoxFunction *initializer;
+    // NOTE: root of the tree of shapes of the instances of the class
+    Shape *shape;
+    // NOTE: number of arguments of the initializer, 0 if there is none
+    int32_t arity;
     int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+#endif
 } LoxClass;
 
-struct LoxClassInitializerContext
-{
-    Interpreter *interpreter;
-    LoxClass *klass;
-    Error *error;
-};
-
 LoxClass * classInit(const char *name, LoxClass *superClass, MethodEntry *methods, int32_t methodsCount);
 void classFree(LoxClass *klass);
 char * classToString(const LoxClass *klass);
-LoxFunction * findMethod(LoxInstance *instance, LoxClass *klass, const char *name, Error **error, GarbageCollector *collector);
+const LoxFunction * classFindMethod(const LoxClass *klass, const char *name);
 
-inline bool isLoxClass(const Object* klass)
+inline bool isLoxClass(Value klass)
 {
-    return klass->type == OT_CLASS;
+    return val_isObjectType(klass, OT_CLASS);
 }
 
 #endif /* lox_class_h */
@@ -9,62 +9,253 @@
 
 #include "garbage_collector.h"
 #include "lox_instance.h"
+#include "memory_pool.h"
 #include "interpreter.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "profiler.h"
+#include "resolver.h"
 #include "return.h"
+#include "tracer.h"
+#include "utility.h"
 
-extern inline bool isLoxFunction(const Object *function);
+extern inline bool isLoxFunction(Value function);
+extern inline Value function_call(const LoxFunction *function, LoxArguments *args, Error **error, Interpreter *interpreter);
 
 LoxFunction * function_init(FunctionStmt *declaration, Environment *closure, bool isInitializer)
 {
-    LoxFunction *function = lox_alloc(LoxFunction);
-    if(function == NULL)
-    {
-        fatal_outOfMemory();
-    }
+    LoxFunction *function = slab_alloc(LoxFunction);
     function->declaration = declaration;
     function->closure = closure;
+    function->receiver = VAL_NIL;
     function->isInitializer = isInitializer;
     function->marked = GC_CLEAR;
+#ifdef GC_GENERATIONAL
+    function->isOld = false;
+#endif
     return function;
 }
 
 void function_free(LoxFunction *function)
 {
-    lox_free(function);
+    slab_free(function);
 }
 
-Object * function_call(const LoxFunction *function, LoxArguments *args, Error **error, Interpreter *interpreter)
+// Parses, resolves and optimizes the body of `declaration`, that was
+// declared lazily, see parseLazily(). If the body has a syntax or resolution
+// error, it is reported as by an eager parse, and the program stops with
+// the same exit code. Returns false if the body had an error in an earlier
+// call, e.g. of a previous source of the REPL, so that the call fails.
+bool function_parseBody(FunctionStmt *declaration, Interpreter *interpreter)
 {
-    assert(args->count == function->declaration->arity);
-    
-    // NOTE: we dynamically create a new local environment for
-    //       the function to allow for recursion.
-    Environment *environment = env_init(function->closure, error, interpreter->collector);
-    if (*error)
+    LazyBody *lazyBody = declaration->lazyBody;
+    assert(lazyBody != NULL);
+    if (lazyBody->hadError)
     {
+        return false;
+    }
+    // NOTE: the errors are reported in the source of the function, which
+    //       may not be the one running, e.g. for the prelude.
+    // NOTE: the errors follow the output of the calls that preceded this one
+    output_flush(&interpreter->output);
+    const char *source = interpreter->source;
+    interpreter->source = lazyBody->source;
+    bool hadError = lox_hadError_;
+    lox_hadError_ = false;
+
+    Stmt *body = parse_lazyBody(lazyBody);
+    if (!lox_hadError_)
+    {
+        declaration->lazyBody = NULL;
+        declaration->body = body;
+        resolveLazyBody(declaration, lazyBody, interpreter);
+    }
+    if (!lox_hadError_ && lazyBody->optimize)
+    {
+        declaration->body = optimize(declaration->body, lazyBody->arena);
+    }
+    if (lox_hadError_)
+    {
+        lazyBody->hadError = true;
+        declaration->lazyBody = lazyBody;
+        declaration->body = NULL;
+    }
+
+    bool success = !lox_hadError_;
+    lox_hadError_ = hadError || lox_hadError_;
+    interpreter->source = source;
+    if (!success)
+    {
+        interpreter_throwCompileError(interpreter);
+    }
+    return true;
+}
+
+// Returns the environment of a call of `function`, with "this" and the
+// arguments defined, or NULL if it could not be created.
+// NOTE: we dynamically create a new local environment for
+//       the function to allow for recursion. It is pushed on the frame
+//       stack if no closure declared in the function can capture it.
+// NOTE: "this" is stored in the first slot of the environment of the call,
+//       before the parameters.
+static inline Environment * function_initEnvironment(const LoxFunction *function, Value receiver, const LoxArguments *args, Error **error, Interpreter *interpreter)
+{
+    if (function->declaration->lazyBody != NULL && !function_parseBody(function->declaration, interpreter))
+    {
+        *error = initError(NULL, "Could not compile the body of the function.");
         return NULL;
     }
+    Environment *environment;
+    if (function->declaration->isCaptured)
+    {
+        environment = env_init(function->closure, function->declaration->slotsCount, error, interpreter->collector);
+        if (*error)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        environment = env_pushFrame(function->closure, function->declaration->slotsCount, &interpreter->frames);
+    }
     assert(environment != NULL);
-    
+
+    if (!val_isNil(receiver))
+    {
+        env_defineThis(receiver, environment);
+    }
     for(int32_t i = 0; i < function->declaration->arity; i++)
     {
         Token *parameter = function->declaration->parameters[i];
         *error = env_defineLocal(parameter, args->values[i], environment);
         assert(*error == NULL);
     }
-    
-    Return *ret = interpreter_executeBlock(function->declaration->body, environment, interpreter);
+    return environment;
+}
 
-    env_release(environment);
-    
-    Object *result;
-    if (function->isInitializer)
+// Runs the body of `declaration` in `environment`, as native code once the
+// function is hot.
+static inline Return * function_executeBody(FunctionStmt *declaration, Environment *environment, Interpreter *interpreter)
+{
+#ifdef INTERPRETER_JIT
+    if (interpreter->jit != NULL && jit_isHotFunction(declaration))
+    {
+        return jit_runFunction(declaration, environment, interpreter);
+    }
+#endif
+    return interpreter_executeBlock(declaration->body, environment, interpreter);
+}
+
+// Runs the tail calls that end the call of `function` in `environment`,
+// until one returns without a tail call, and returns its result. The called
+// function replaces the calling one: `function`, `receiver` and
+// `environment` are updated to the last function called, and its callee
+// takes the place of the one of the first function on the stack of locked
+// values, just before `args`. Returns NULL if an error occurred, with the
+// environment already released.
+__attribute__((__noinline__))
+static Return * function_runTailCalls(const LoxFunction **function, Value *receiver, Environment **environment, const LoxArguments *args, Error **error, Interpreter *interpreter)
+{
+    GarbageCollector *collector = interpreter->collector;
+    Profiler *profiler = interpreter->profiler;
+    int32_t calleeIndex = (int32_t)(args->values - collector->locked) - 1;
+    assert(calleeIndex >= 0 && calleeIndex < collector->lockedCount);
+
+    Return *ret;
+    do
     {
-        result = env_getAt(/*"this"*/NULL, 0, 0, function->closure, error, interpreter->collector);
-        if(*error)
+        env_release(*environment, &interpreter->frames);
+        if (profiler != NULL)
+        {
+            profiler_exit(profiler);
+        }
+        *function = interpreter->tailCall.function;
+        *receiver = interpreter->tailCall.receiver;
+        interpreter->tailCall.function = NULL;
+
+        int32_t argumentsCount = (*function)->declaration->arity;
+        LoxArguments arguments = {collector->locked + collector->lockedCount - argumentsCount, argumentsCount};
+        *environment = function_initEnvironment(*function, *receiver, &arguments, error, interpreter);
+        // NOTE: the environment retains the arguments, and the callee takes
+        //       the place of the one of the calling function.
+        collector->locked[calleeIndex] = collector->locked[collector->lockedCount - argumentsCount - 1];
+        gcPopLockn(argumentsCount + 1, collector);
+        if (*error)
         {
             return NULL;
         }
+        if (profiler != NULL)
+        {
+            profiler_enter((*function)->declaration, profiler);
+        }
+        interpreter->currentFunction = (*function)->declaration;
+        ret = function_executeBody((*function)->declaration, *environment, interpreter);
+    } while (ret != NULL && interpreter->tailCall.function != NULL);
+    return ret;
+}
+
+// Calls `function` with `receiver` as "this". `receiver` is an instance if
+// `function` is a method, and VAL_NIL otherwise.
+// NOTE: the arguments must be on the stack of locked values, right above the
+//       callee. When the function ends with a tail call, the called function
+//       replaces it and runs in this same C frame, so that tail calls use
+//       constant C stack and environments.
+Value function_invoke(const LoxFunction *function, Value receiver, LoxArguments *args, Error **error, Interpreter *interpreter)
+{
+    assert(args->count == function->declaration->arity);
+    if (interpreter->callDepth == LOX_MAX_CALL_DEPTH || stack_isExhausted())
+    {
+        *error = initError(NULL, "Stack overflow.");
+        return VAL_NIL;
+    }
+
+    Environment *environment = function_initEnvironment(function, receiver, args, error, interpreter);
+    if (*error)
+    {
+        return VAL_NIL;
+    }
+    
+    Profiler *profiler = interpreter->profiler;
+    if (profiler != NULL)
+    {
+        profiler_enter(function->declaration, profiler);
+    }
+    if (tracer_tracesCalls && interpreter->callDepth == 0)
+    {
+        tracer_beginCall(function->declaration->name);
+    }
+    ++interpreter->callDepth;
+    const FunctionStmt *caller = interpreter->currentFunction;
+    interpreter->currentFunction = function->declaration;
+    Return *ret = function_executeBody(function->declaration, environment, interpreter);
+    if (ret != NULL && interpreter->tailCall.function != NULL)
+    {
+        ret = function_runTailCalls(&function, &receiver, &environment, args, error, interpreter);
+        if (*error)
+        {
+            --interpreter->callDepth;
+            interpreter->currentFunction = caller;
+            return VAL_NIL;
+        }
+    }
+    --interpreter->callDepth;
+    interpreter->currentFunction = caller;
+    if (tracer_tracesCalls && interpreter->callDepth == 0)
+    {
+        tracer_endCall();
+    }
+    if (profiler != NULL)
+    {
+        profiler_exit(profiler);
+    }
+
+    env_release(environment, &interpreter->frames);
+    
+    Value result;
+    if (function->isInitializer)
+    {
+        result = receiver;
     }
     else if(ret != NULL)
     {
@@ -72,9 +263,8 @@ Object * function_call(const LoxFunction *function, LoxArguments *args, Error **
     }
     else
     {
-        result = obj_newNil(interpreter->collector);
+        result = VAL_NIL;
     }
-    assert(result != NULL);
     
     return result;
 }
@@ -97,19 +287,12 @@ char * function_toString(LoxFunction *function, Interpreter *interpreter)
     return str;
 }
 
-LoxFunction * function_bind(const LoxFunction *function, LoxInstance *instance, Error **error, GarbageCollector *collector)
+// Returns a copy of the method `function` bound to the instance
+// `receiver`, for when the method is taken as a value.
+LoxFunction * function_bind(const LoxFunction *function, Value receiver)
 {
-    Environment *environment = env_init(function->closure, error, collector);
-    if (*error)
-    {
-        return NULL;
-    }
-    assert(environment != NULL);
-
-    env_defineThis(obj_wrapInstance(instance, collector), environment);
-
-    LoxFunction *result = function_init(function->declaration, environment, function->isInitializer);
+    assert(val_isObjectType(receiver, OT_INSTANCE));
+    LoxFunction *result = function_init(function->declaration, function->closure, function->isInitializer);
+    result->receiver = receiver;
     return result;
 }
-
-
@@ -22,38 +22,42 @@ typedef struct LoxFunction_tag
 {
     FunctionStmt *declaration;
     Environment *closure;
+    // NOTE: instance bound to "this" when a method is taken as a value,
+    //       VAL_NIL otherwise. The methods called directly on an instance
+    //       are not bound, and receive "this" from the caller.
+    Value receiver;
     bool isInitializer;
     int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+#endif
 } LoxFunction;
 
+// NOTE: the arguments of a call are not copied: `values` points to the
+//       stack of locked values, where the caller pushed them, and is only
+//       valid until the next value is locked, which may move the stack.
 typedef struct LoxArguments_tag
 {
-    Object * values[LOX_MAX_ARG_COUNT];
+    const Value *values;
     int32_t count;
 } LoxArguments;
 
-static inline LoxArguments *argumentsInit()
-{
-    LoxArguments *arguments = lox_alloc(LoxArguments);
-    return arguments;
-}
-
-
-static inline void argumentsFree(LoxArguments *arguments)
-{
-    lox_free(arguments);
-}
-
 LoxFunction * function_init(FunctionStmt *declaration, Environment *closure, bool isInitializer);
 void function_free(LoxFunction *function);
-Object * function_call(const LoxFunction *function, LoxArguments *args, Error **error, Interpreter *interpreter);
+bool function_parseBody(FunctionStmt *declaration, Interpreter *interpreter);
+Value function_invoke(const LoxFunction *function, Value receiver, LoxArguments *args, Error **error, Interpreter *interpreter);
 int32_t function_arity(LoxFunction *function);
 char * function_toString(LoxFunction *function, Interpreter *interpreter);
-LoxFunction * function_bind(const LoxFunction *function, LoxInstance *instance, Error **error, GarbageCollector *collector);
+LoxFunction * function_bind(const LoxFunction *function, Value receiver);
+
+inline Value function_call(const LoxFunction *function, LoxArguments *args, Error **error, Interpreter *interpreter)
+{
+    return function_invoke(function, function->receiver, args, error, interpreter);
+}
 
-inline bool isLoxFunction(const Object *function)
+inline bool isLoxFunction(Value function)
 {
-    return function->type == OT_FUNCTION;
+    return val_isObjectType(function, OT_FUNCTION);
 }
 
 #endif /* lox_function_h */
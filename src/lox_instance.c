@@ -9,20 +9,24 @@
 #include "lox_function.h"
 #include "lox_instance.h"
 #include "memory.h"
+#include "memory_pool.h"
 #include "string.h"
 
-extern inline bool isLoxInstance(const Object *function);
+extern inline bool isLoxInstance(Value function);
+extern inline int32_t instanceFieldsCount(const LoxInstance *instance);
 
 LoxInstance * instanceInit(LoxClass *klass)
 {
-    LoxInstance *instance = lox_alloc(LoxInstance);
-    if(instance == NULL)
-    {
-        fatal_outOfMemory();
-    }
+    LoxInstance *instance = slab_alloc(LoxInstance);
     instance->marked = GC_CLEAR;
+#ifdef GC_GENERATIONAL
+    instance->isOld = false;
+    instance->isRemembered = false;
+#endif
     instance->klass = klass;
-    instance->fieldsCount = 0;
+    instance->shape = klass->shape;
+    instance->fields = NULL;
+    instance->fieldsCapacity = 0;
     return instance;
 }
 
@@ -30,7 +34,11 @@ void instanceFree(LoxInstance *instance)
 {
     // NOTE: the fields are objects, and they're taken
     //       care of by the garbage collector.
-    lox_free(instance);
+    if (instance->fields != NULL)
+    {
+        slab_freen(instance->fields, instance->fieldsCapacity);
+    }
+    slab_free(instance);
 }
 
 char * instanceToString(const LoxInstance *instance)
@@ -40,66 +48,119 @@ char * instanceToString(const LoxInstance *instance)
     return str;
 }
 
-// Returns the index of the field named `name`.
-// If such a field does not exist, returns -1.
-static int32_t indexOf(const char *name, const FieldEntry *fields, int32_t fieldsCount)
+// Grows the storage of the fields so that it can hold `count` values.
+static void instanceReserve(LoxInstance *instance, int32_t count)
 {
-    for (int32_t index = 0; index < fieldsCount; ++index)
+    if (count <= instance->fieldsCapacity)
     {
-        if (str_isEqual(name, fields[index].name))
-        {
-            return index;
-        }
+        return;
     }
-    return -1;
+    int32_t capacity = instance->fieldsCapacity == 0 ? LOX_INSTANCE_INITIAL_FIELDS : 2 * instance->fieldsCapacity;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    Value *fields = slab_allocn(Value, capacity);
+    for (int32_t index = 0; index < instanceFieldsCount(instance); ++index)
+    {
+        fields[index] = instance->fields[index];
+    }
+    if (instance->fields != NULL)
+    {
+        slab_freen(instance->fields, instance->fieldsCapacity);
+    }
+    instance->fields = fields;
+    instance->fieldsCapacity = capacity;
 }
 
+// Looks up the property `property` of `instance`. If it is a field, its
+// value is stored in `field` and NULL is returned; otherwise returns the
+// method, that is not bound to the instance.
 // NOTE: We first look for a field, and if not found for a method.
 //       This implies that fields shadow methods.
-Object * instanceGet(LoxInstance *instance, const Token *property, Error **error, GarbageCollector *collector)
+//       The result of the lookup is stored in `cache` for the shape of
+//       the instance.
+const LoxFunction * instanceLookup(LoxInstance *instance, const Token *property, InlineCache *cache, Value *field, Error **error)
 {
-    const char *name = get_identifier_name(property);
-    
-    int32_t index = indexOf(name, instance->fields, instance->fieldsCount);
-    if (index != -1)
+    InlineCacheEntry *entry = ic_lookup(cache, instance->shape->id);
+    if (entry == NULL)
     {
-        Object *result = obj_dup(instance->fields[index].value, collector);
-        return result;
+        const char *name = get_identifier_name(property);
+        int32_t index = shape_indexOf(instance->shape, name);
+        const LoxFunction *method = NULL;
+        if (index == -1)
+        {
+            method = classFindMethod(instance->klass, name);
+            if (method == NULL)
+            {
+                *error = initErrorIdentifier("Undefined property '", property, "'.");
+                return NULL;
+            }
+        }
+        entry = ic_insert(cache, instance->shape->id);
+        entry->index = index;
+        entry->method = method;
     }
-    
-    LoxFunction *method = findMethod(instance, instance->klass, name, error, collector);
-    if (*error)
+
+    if (entry->index != -1)
     {
+        *field = instance->fields[entry->index];
         return NULL;
     }
-    if (method != NULL)
-    {
-        Object *result = obj_wrapFunction(method, collector);
-        env_release(method->closure);
-        return result;
-    }
-    
-    *error = initErrorIdentifier("Undefined property '", property, "'.");
-    return NULL;
+    return entry->method;
 }
 
-// Stores a duplicate of value in the field `property` of instance.
-// NOTE: the value is duplicated since the interpreter uses it as return value too.
-void instanceSet(LoxInstance *instance, const Token *property, Object *value)
+// Stores value in the field `property` of instance. If the instance does
+// not have such a field, it transitions to the shape that has it. The slot
+// and the shape after the assignment are stored in `cache`.
+void instanceSet(LoxInstance *instance, const Token *property, InlineCache *cache, Value value, GarbageCollector *collector)
 {
-    const char *name = get_identifier_name(property);
-    int32_t index = indexOf(name, instance->fields, instance->fieldsCount);
-    if (index == -1)
+#ifdef GC_GENERATIONAL
+    // NOTE: write barrier: an old instance may now reference a young object
+    if (instance->isOld && !instance->isRemembered)
     {
-        assert(instance->fieldsCount < LOX_INSTANCE_MAX_FIELDS);
-        index = instance->fieldsCount;
-        instance->fields[index].name = name;
-        instance->fieldsCount++;
+        gcRememberInstance(instance, collector);
+    }
+#endif
+    InlineCacheEntry *entry = ic_lookup(cache, instance->shape->id);
+    if (entry == NULL)
+    {
+        const char *name = get_identifier_name(property);
+        int32_t index = shape_indexOf(instance->shape, name);
+        Shape *shape = instance->shape;
+        if (index == -1)
+        {
+            index = instanceFieldsCount(instance);
+            assert(index < LOX_INSTANCE_MAX_FIELDS);
+            shape = shape_addField(instance->shape, name);
+        }
+        entry = ic_insert(cache, instance->shape->id);
+        entry->index = index;
+        entry->shape = shape;
+    }
+
+    if (entry->shape != instance->shape)
+    {
+        instanceReserve(instance, entry->index + 1);
+        instance->shape = entry->shape;
     }
     else
     {
-        assert(instance->fields[index].value != NULL);
+        assert(!val_isUndefined(instance->fields[entry->index]));
+        gcOverwrite(instance->fields[entry->index], collector);
     }
-    instance->fields[index].value = value;
+    instance->fields[entry->index] = value;
 }
 
+// Adds to `instance` the field `name`, that it does not have, with `value`.
+// NOTE: there is no write barrier, this is only used to build instances
+//       while the garbage collector is paused.
+void instanceAddField(LoxInstance *instance, const char *name, Value value)
+{
+    assert(shape_indexOf(instance->shape, name) == -1);
+    int32_t index = instanceFieldsCount(instance);
+    assert(index < LOX_INSTANCE_MAX_FIELDS);
+    instanceReserve(instance, index + 1);
+    instance->shape = shape_addField(instance->shape, name);
+    instance->fields[index] = value;
+}
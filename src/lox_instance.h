@@ -9,34 +9,44 @@
 #define lox_instance_h
 
 #include "error.h"
+#include "inline_cache.h"
 #include "lox_class.h"
 #include "token.h"
 #include "common.h"
 
-typedef struct
-{
-    const char *name;
-    Object *value;
-} FieldEntry;
-
 typedef struct LoxInstance_tag
 {
     LoxClass *klass;
-    // TODO: Use a hash table instead of a simple array to store the fields?
-    FieldEntry fields[LOX_INSTANCE_MAX_FIELDS];
-    int32_t fieldsCount;
+    // NOTE: the shape maps the names of the fields to their index in
+    //       `fields`, and it is shared by all the instances of the class
+    //       with the same fields.
+    Shape *shape;
+    Value *fields;
+    int32_t fieldsCapacity;
     int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+    // NOTE: true if the instance is in the remembered set of the garbage
+    //       collector
+    bool isRemembered;
+#endif
 } LoxInstance;
 
 LoxInstance * instanceInit(LoxClass *klass);
 void instanceFree(LoxInstance *instance);
 char * instanceToString(const LoxInstance *instance);
-Object * instanceGet(LoxInstance *instance, const Token *property, Error **error, GarbageCollector *collector);
-void instanceSet(LoxInstance *instance, const Token *property, Object *value);
+void instanceAddField(LoxInstance *instance, const char *name, Value value);
+const LoxFunction * instanceLookup(LoxInstance *instance, const Token *property, InlineCache *cache, Value *field, Error **error);
+void instanceSet(LoxInstance *instance, const Token *property, InlineCache *cache, Value value, GarbageCollector *collector);
+
+inline int32_t instanceFieldsCount(const LoxInstance *instance)
+{
+    return instance->shape->fieldsCount;
+}
 
-inline bool isLoxInstance(const Object *function)
+inline bool isLoxInstance(Value function)
 {
-    return function->type == OT_INSTANCE;
+    return val_isObjectType(function, OT_INSTANCE);
 }
 
 #endif /* lox_instance_h */
@@ -0,0 +1,322 @@
+//
+//  lox_map.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "lox_map.h"
+#include "garbage_collector.h"
+#include "interpreter.h"
+#include "lox_array.h"
+#include "lox_function.h"
+#include "memory_pool.h"
+
+#include <string.h>
+
+extern inline bool isLoxMap(Value map);
+
+#define MAP_EMPTY_KEY VAL_NIL
+#define MAP_DELETED_KEY VAL_UNDEFINED
+
+LoxMap * mapInit()
+{
+    LoxMap *map = slab_alloc(LoxMap);
+    map->marked = GC_CLEAR;
+#ifdef GC_GENERATIONAL
+    map->isOld = false;
+    map->isRemembered = false;
+#endif
+    map->entries = NULL;
+    map->count = 0;
+    map->usedCount = 0;
+    map->capacity = 0;
+    return map;
+}
+
+void mapFree(LoxMap *map)
+{
+    // NOTE: the keys and values are objects, and they're taken
+    //       care of by the garbage collector.
+    if (map->entries != NULL)
+    {
+        slab_freen(map->entries, map->capacity);
+    }
+    slab_free(map);
+}
+
+// Returns true if `key` can be a key of a map, i.e. if it is a string or a
+// number that is not NaN.
+bool mapIsValidKey(Value key)
+{
+    if (val_isNumber(key))
+    {
+        double number = val_asNumber(key);
+        return number == number;
+    }
+    return val_isString(key);
+}
+
+// NOTE: the keys are checked with mapIsValidKey() by the callers
+static uint32_t map_hash(Value key)
+{
+    if (val_isNumber(key))
+    {
+        // NOTE: 0 and -0 are the same key
+        double number = val_asNumber(key);
+        uint64_t bits = 0;
+        if (number != 0)
+        {
+            memcpy(&bits, &number, sizeof(bits));
+        }
+        bits ^= bits >> 33;
+        bits *= 0xff51afd7ed558ccdULL;
+        bits ^= bits >> 33;
+        return (uint32_t)bits;
+    }
+    return (uint32_t)str_hash(obj_unwrapString(key));
+}
+
+static bool map_isSameKey(Value key, uint32_t hash, const MapEntry *entry)
+{
+    if (entry->hash != hash)
+    {
+        return false;
+    }
+    if (val_isNumber(key))
+    {
+        return val_isNumber(entry->key) && val_asNumber(key) == val_asNumber(entry->key);
+    }
+    return (val_isString(entry->key) &&
+            str_isEqual(obj_unwrapString(key), obj_unwrapString(entry->key)));
+}
+
+// Returns the entry of `key`, or NULL if the map has none.
+static MapEntry * map_find(const LoxMap *map, Value key, uint32_t hash)
+{
+    if (map->capacity == 0)
+    {
+        return NULL;
+    }
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    for (uint32_t index = hash & mask; ; index = (index + 1) & mask)
+    {
+        MapEntry *entry = &map->entries[index];
+        if (entry->key == MAP_EMPTY_KEY)
+        {
+            return NULL;
+        }
+        if (entry->key != MAP_DELETED_KEY && map_isSameKey(key, hash, entry))
+        {
+            return entry;
+        }
+    }
+}
+
+// Moves the keys to a table of `capacity` entries, without the deleted ones.
+static void map_resize(LoxMap *map, int32_t capacity)
+{
+    MapEntry *entries = slab_allocn(MapEntry, capacity);
+    for (int32_t index = 0; index < capacity; ++index)
+    {
+        entries[index].key = MAP_EMPTY_KEY;
+        entries[index].value = VAL_NIL;
+    }
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (int32_t index = 0; index < map->capacity; ++index)
+    {
+        const MapEntry *entry = &map->entries[index];
+        if (entry->key == MAP_EMPTY_KEY || entry->key == MAP_DELETED_KEY)
+        {
+            continue;
+        }
+        uint32_t slot = entry->hash & mask;
+        while (entries[slot].key != MAP_EMPTY_KEY)
+        {
+            slot = (slot + 1) & mask;
+        }
+        entries[slot] = *entry;
+    }
+    if (map->entries != NULL)
+    {
+        slab_freen(map->entries, map->capacity);
+    }
+    map->entries = entries;
+    map->capacity = capacity;
+    map->usedCount = map->count;
+}
+
+// Returns true if `key` is in `map`, and stores its value in `value`.
+bool mapGet(const LoxMap *map, Value key, Value *value)
+{
+    const MapEntry *entry = map_find(map, key, map_hash(key));
+    if (entry == NULL)
+    {
+        return false;
+    }
+    *value = entry->value;
+    return true;
+}
+
+void mapSet(LoxMap *map, Value key, Value value, GarbageCollector *collector)
+{
+#ifdef GC_GENERATIONAL
+    // NOTE: an old map may now reference young objects
+    if (map->isOld && !map->isRemembered)
+    {
+        gcRememberMap(map, collector);
+    }
+#endif
+    uint32_t hash = map_hash(key);
+    MapEntry *entry = map_find(map, key, hash);
+    if (entry != NULL)
+    {
+        gcOverwrite(entry->value, collector);
+        entry->value = value;
+        return;
+    }
+    if (4 * (map->usedCount + 1) > 3 * map->capacity)
+    {
+        // NOTE: the table only grows if the keys, and not the deleted
+        //       entries, fill half of it
+        int32_t capacity = map->capacity == 0 ? LOX_MAP_INITIAL_CAPACITY : map->capacity;
+        if (2 * (map->count + 1) > capacity)
+        {
+            capacity *= 2;
+        }
+        map_resize(map, capacity);
+    }
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    uint32_t index = hash & mask;
+    while (map->entries[index].key != MAP_EMPTY_KEY && map->entries[index].key != MAP_DELETED_KEY)
+    {
+        index = (index + 1) & mask;
+    }
+    if (map->entries[index].key == MAP_EMPTY_KEY)
+    {
+        ++map->usedCount;
+    }
+    map->entries[index] = (MapEntry){key, value, hash};
+    ++map->count;
+}
+
+// Removes `key` from `map`. Returns false if the map did not contain it.
+bool mapDelete(LoxMap *map, Value key, GarbageCollector *collector)
+{
+    MapEntry *entry = map_find(map, key, map_hash(key));
+    if (entry == NULL)
+    {
+        return false;
+    }
+    // NOTE: the key and the value are removed, as if they were overwritten
+    gcOverwrite(entry->key, collector);
+    gcOverwrite(entry->value, collector);
+    entry->key = MAP_DELETED_KEY;
+    entry->value = VAL_NIL;
+    --map->count;
+    return true;
+}
+
+// Returns a description of the entries of `map`, e.g. "{one: 1, 2: [...]}".
+// NOTE: the nested arrays and maps are not expanded, as they may contain
+//       `map`.
+char * mapToString(const LoxMap *map)
+{
+    char *string = str_fromLiteral("{");
+    bool isFirst = true;
+    for (int32_t index = 0; index < map->capacity; ++index)
+    {
+        const MapEntry *entry = &map->entries[index];
+        if (entry->key == MAP_EMPTY_KEY || entry->key == MAP_DELETED_KEY)
+        {
+            continue;
+        }
+        if (!isFirst)
+        {
+            str_appendLiteral(string, ", ");
+        }
+        isFirst = false;
+        char *key = obj_stringify(entry->key);
+        str_append(string, key);
+        str_free(key);
+        str_appendLiteral(string, ": ");
+        if (isLoxArray(entry->value))
+        {
+            str_appendLiteral(string, "[...]");
+        }
+        else if (isLoxMap(entry->value))
+        {
+            str_appendLiteral(string, "{...}");
+        }
+        else
+        {
+            char *value = obj_stringify(entry->value);
+            str_append(string, value);
+            str_free(value);
+        }
+    }
+    str_appendLiteral(string, "}");
+    return string;
+}
+
+/* LOX native functions */
+
+// Throws a runtime error if `key` cannot be a key of a map.
+void mapCheckKey(Value key, Interpreter *interpreter)
+{
+    if (!mapIsValidKey(key))
+    {
+        interpreter_throwNewError(interpreter->nativeCallToken, "Map key must be a string or a number.", interpreter);
+    }
+}
+
+static LoxMap * map_checkMap(Value value, Interpreter *interpreter)
+{
+    if (!isLoxMap(value))
+    {
+        interpreter_throwNewError(interpreter->nativeCallToken, "Operand must be a map.", interpreter);
+    }
+    return obj_unwrapMap(value);
+}
+
+// map() returns a new empty map
+static LOX_CALLABLE(lox_map)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    return obj_wrapMap(mapInit(), interpreter->collector);
+}
+
+// has(map, key) returns true if map contains key
+static LOX_CALLABLE(lox_has)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    LoxMap *map = map_checkMap(args->values[0], interpreter);
+    mapCheckKey(args->values[1], interpreter);
+    Value value;
+    return val_boolean(mapGet(map, args->values[1], &value));
+}
+
+// delete(map, key) removes key from map, and returns true if it was in it
+static LOX_CALLABLE(lox_delete)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    LoxMap *map = map_checkMap(args->values[0], interpreter);
+    mapCheckKey(args->values[1], interpreter);
+    return val_boolean(mapDelete(map, args->values[1], interpreter->collector));
+}
+
+// size(map) returns the number of keys of map
+static LOX_CALLABLE(lox_size)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    return val_number(map_checkMap(args->values[0], interpreter)->count);
+}
+
+static const LoxCallable lox_mapNatives[] = {
+    LOX_NATIVE("map", lox_map, 0, "map()   - returns a new empty map"),
+    LOX_NATIVE("has", lox_has, 2, "has(m, k) - returns true if the map m contains the key k"),
+    LOX_NATIVE("delete", lox_delete, 2, "delete(m, k) - removes the key k from the map m"),
+    LOX_NATIVE("size", lox_size, 1, "size(m) - returns the number of keys of the map m"),
+};
+
+const LoxNativeModule lox_mapModule = LOX_MODULE(lox_mapNatives);
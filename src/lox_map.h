@@ -0,0 +1,72 @@
+//
+//  lox_map.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef lox_map_h
+#define lox_map_h
+
+#include "common.h"
+#include "lox_callable.h"
+#include "value.h"
+
+struct Interpreter_tag;
+typedef struct Interpreter_tag Interpreter;
+
+/*
+ A map associates values to keys, that are numbers or strings. The entries
+ are stored in a hash table with open addressing and linear probing, whose
+ capacity doubles when it is three quarters full, counting the entries
+ that were deleted. The strings are hashed with str_hash(), that stores
+ their hash, and two strings with the same characters are the same key.
+ The maps are used through the native functions map(), has(), delete() and
+ size(), and through get() and set(), that take an array or a map.
+ NOTE: with MEMORY_DEBUG, the entries must fit in a 64KB allocation.
+ */
+
+typedef struct
+{
+    // NOTE: VAL_NIL for the empty entries, and VAL_UNDEFINED for the
+    //       deleted ones
+    Value key;
+    Value value;
+    uint32_t hash;
+} MapEntry;
+
+typedef struct LoxMap_tag
+{
+    MapEntry *entries;
+    // NOTE: number of keys, and of entries that are not empty, i.e. of the
+    //       keys and of the deleted entries
+    int32_t count;
+    int32_t usedCount;
+    // NOTE: a power of 2, or 0
+    int32_t capacity;
+    int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+    // NOTE: true if the map is in the remembered set of the garbage
+    //       collector
+    bool isRemembered;
+#endif
+} LoxMap;
+
+LoxMap * mapInit(void);
+void mapFree(LoxMap *map);
+bool mapIsValidKey(Value key);
+void mapCheckKey(Value key, Interpreter *interpreter);
+bool mapGet(const LoxMap *map, Value key, Value *value);
+void mapSet(LoxMap *map, Value key, Value value, GarbageCollector *collector);
+bool mapDelete(LoxMap *map, Value key, GarbageCollector *collector);
+char * mapToString(const LoxMap *map);
+
+inline bool isLoxMap(Value map)
+{
+    return val_isObjectType(map, OT_MAP);
+}
+
+extern const LoxNativeModule lox_mapModule;
+
+#endif /* lox_map_h */
@@ -0,0 +1,72 @@
+//
+//  lox_math.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "lox_math.h"
+#include "interpreter.h"
+#include "lox_function.h"
+
+#include <math.h>
+
+static double math_checkNumber(Value value, Interpreter *interpreter)
+{
+    if (!val_isNumber(value))
+    {
+        interpreter_throwNewError(interpreter->nativeCallToken, "Operand must be a number.", interpreter);
+    }
+    return val_asNumber(value);
+}
+
+// NOTE: defines the native `name` that returns function(x)
+#define MATH_UNARY_NATIVE(name, function)                                   \
+static LOX_CALLABLE(name)                                                   \
+{                                                                           \
+    Interpreter *interpreter = (Interpreter *)context;                      \
+    return val_number(function(math_checkNumber(args->values[0], interpreter))); \
+}
+
+// NOTE: defines the native `name` that returns function(x, y)
+#define MATH_BINARY_NATIVE(name, function)                                  \
+static LOX_CALLABLE(name)                                                   \
+{                                                                           \
+    Interpreter *interpreter = (Interpreter *)context;                      \
+    double x = math_checkNumber(args->values[0], interpreter);              \
+    double y = math_checkNumber(args->values[1], interpreter);              \
+    return val_number(function(x, y));                                      \
+}
+
+MATH_UNARY_NATIVE(lox_abs, fabs)
+MATH_UNARY_NATIVE(lox_ceil, ceil)
+MATH_UNARY_NATIVE(lox_cos, cos)
+MATH_UNARY_NATIVE(lox_exp, exp)
+MATH_UNARY_NATIVE(lox_floor, floor)
+MATH_UNARY_NATIVE(lox_log, log)
+MATH_UNARY_NATIVE(lox_round, round)
+MATH_UNARY_NATIVE(lox_sin, sin)
+MATH_UNARY_NATIVE(lox_sqrt, sqrt)
+MATH_BINARY_NATIVE(lox_max, fmax)
+MATH_BINARY_NATIVE(lox_min, fmin)
+MATH_BINARY_NATIVE(lox_pow, pow)
+
+#undef MATH_UNARY_NATIVE
+#undef MATH_BINARY_NATIVE
+
+static const LoxCallable lox_mathNatives[] = {
+    LOX_NATIVE("abs", lox_abs, 1, "abs(x)  - returns the absolute value of x"),
+    LOX_NATIVE("ceil", lox_ceil, 1, "ceil(x) - returns the smallest integer not less than x"),
+    LOX_NATIVE("cos", lox_cos, 1, "cos(x)  - returns the cosine of x"),
+    LOX_NATIVE("exp", lox_exp, 1, "exp(x)  - returns e raised to the power x"),
+    LOX_NATIVE("floor", lox_floor, 1, "floor(x) - returns the largest integer not greater than x"),
+    LOX_NATIVE("log", lox_log, 1, "log(x)  - returns the natural logarithm of x"),
+    LOX_NATIVE("max", lox_max, 2, "max(x, y) - returns the larger of x and y"),
+    LOX_NATIVE("min", lox_min, 2, "min(x, y) - returns the smaller of x and y"),
+    LOX_NATIVE("pow", lox_pow, 2, "pow(x, y) - returns x raised to the power y"),
+    LOX_NATIVE("round", lox_round, 1, "round(x) - returns x rounded to the nearest integer"),
+    LOX_NATIVE("sin", lox_sin, 1, "sin(x)  - returns the sine of x"),
+    LOX_NATIVE("sqrt", lox_sqrt, 1, "sqrt(x) - returns the square root of x"),
+};
+
+const LoxNativeModule lox_mathModule = LOX_MODULE(lox_mathNatives);
@@ -0,0 +1,17 @@
+//
+//  lox_math.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef lox_math_h
+#define lox_math_h
+
+#include "lox_callable.h"
+
+// NOTE: the functions of the C math library, e.g. sqrt(x) and pow(x, y),
+//       as natives that take and return numbers.
+extern const LoxNativeModule lox_mathModule;
+
+#endif /* lox_math_h */
@@ -0,0 +1,113 @@
+//
+//  lox_string.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "lox_string.h"
+#include "interpreter.h"
+#include "lox_function.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+__attribute__((__noreturn__))
+static void string_throwError(const char *message, Interpreter *interpreter)
+{
+    interpreter_throwNewError(interpreter->nativeCallToken, message, interpreter);
+}
+
+static const char * string_checkString(Value value, Interpreter *interpreter)
+{
+    if (!val_isString(value))
+    {
+        string_throwError("Operand must be a string.", interpreter);
+    }
+    return obj_unwrapString(value);
+}
+
+// Returns the index `value` of a character of `string`, or of its end, or
+// throws a runtime error if it is not a valid one.
+static str_size string_checkIndex(const char *string, Value value, Interpreter *interpreter)
+{
+    if (!val_isNumber(value))
+    {
+        string_throwError("String index must be a number.", interpreter);
+    }
+    double index = val_asNumber(value);
+    if (index != floor(index))
+    {
+        string_throwError("String index must be an integer.", interpreter);
+    }
+    if (index < 0 || index > str_length(string))
+    {
+        string_throwError("String index out of bounds.", interpreter);
+    }
+    return (str_size)index;
+}
+
+// indexOf(string, substring) returns the index of the first occurrence of
+// substring in string, or -1 if there is none
+static LOX_CALLABLE(lox_indexOf)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    const char *string = string_checkString(args->values[0], interpreter);
+    const char *substring = string_checkString(args->values[1], interpreter);
+    const char *found = strstr(string, substring);
+    return val_number(found != NULL ? (double)(found - string) : -1);
+}
+
+// substring(string, start, end) returns the characters of string from the
+// index start to the index end excluded
+static LOX_CALLABLE(lox_substring)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    const char *string = string_checkString(args->values[0], interpreter);
+    str_size start = string_checkIndex(string, args->values[1], interpreter);
+    str_size end = string_checkIndex(string, args->values[2], interpreter);
+    if (end < start)
+    {
+        string_throwError("String index out of bounds.", interpreter);
+    }
+    return obj_wrapString(str_substring(string, substringStartEnd(start, end)), interpreter->collector);
+}
+
+// toString(value) returns the string that print would write for value
+static LOX_CALLABLE(lox_toString)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    if (val_isString(args->values[0]))
+    {
+        return args->values[0];
+    }
+    return obj_wrapString(obj_stringify(args->values[0]), interpreter->collector);
+}
+
+// parseNumber(string) returns the number written in string, in the syntax
+// of the number literals with an optional sign and exponent, or nil if
+// string is not a number
+static LOX_CALLABLE(lox_parseNumber)
+{
+    Interpreter *interpreter = (Interpreter *)context;
+    const char *string = string_checkString(args->values[0], interpreter);
+    const char *digits = (string[0] == '-') ? string + 1 : string;
+    // NOTE: strtod also parses e.g. hexadecimal numbers and "inf"
+    if (digits[0] < '0' || digits[0] > '9' || digits[strspn(digits, "0123456789.eE+-")] != '\0')
+    {
+        return VAL_NIL;
+    }
+    char *end;
+    double value = strtod(string, &end);
+    return *end == '\0' ? val_number(value) : VAL_NIL;
+}
+
+static const LoxCallable lox_stringNatives[] = {
+    LOX_NATIVE("indexOf", lox_indexOf, 2, "indexOf(s, t) - returns the index of the first t in the string s, or -1"),
+    LOX_NATIVE("substring", lox_substring, 3, "substring(s, i, j) - returns the characters of the string s from i to j excluded"),
+    LOX_NATIVE("toString", lox_toString, 1, "toString(v) - returns the string that print writes for v"),
+    LOX_NATIVE("parseNumber", lox_parseNumber, 1, "parseNumber(s) - returns the number written in the string s, or nil"),
+};
+
+const LoxNativeModule lox_stringModule = LOX_MODULE(lox_stringNatives);
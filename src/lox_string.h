@@ -0,0 +1,18 @@
+//
+//  lox_string.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef lox_string_h
+#define lox_string_h
+
+#include "lox_callable.h"
+
+// NOTE: natives that search, slice, format and parse strings, so that the
+//       loops over their characters run in C. The indices are the ones of
+//       the bytes of the strings.
+extern const LoxNativeModule lox_stringModule;
+
+#endif /* lox_string_h */
@@ -0,0 +1,191 @@
+//
+//  loxi.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "loxi.h"
+#include "interpreter.h"
+#include "memory_pool.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "utility.h"
+#include "vm.h"
+
+// NOTE: a source that has been run, with the syntax tree that the functions
+//       and classes it defined refer to.
+typedef struct LoxiProgram_tag
+{
+    char *source;
+    Token *tokens;
+    Arena *arena;
+    struct LoxiProgram_tag *next;
+} LoxiProgram;
+
+struct Loxi_tag
+{
+    Interpreter *interpreter;
+    LoxiOptions options;
+    LoxiProgram *programs;
+};
+
+// NOTE: number of calls of loxi_initThread() not matched by loxi_freeThread()
+static thread_global int32_t loxi_threadUsers = 0;
+
+LoxiOptions loxi_defaultOptions()
+{
+    return (LoxiOptions){
+        .useVM = false,
+        .optimize = true,
+        .lazyParse = false,
+        .useTailCalls = true,
+        .isIncrementalGC = false,
+        .gcThreadsCount = 1,
+    };
+}
+
+void loxi_initThread()
+{
+    if (loxi_threadUsers++ == 0)
+    {
+        slabInit();
+        str_initPools();
+        str_initInternTable();
+        lox_hadError_ = false;
+        lox_hadRuntimeError_ = false;
+        stack_initLimit();
+    }
+}
+
+void loxi_freeThread()
+{
+    assert(loxi_threadUsers > 0);
+    if (--loxi_threadUsers == 0)
+    {
+        str_freeInternTable();
+        str_freePools();
+        slabFree();
+    }
+}
+
+// Returns a new interpreter, or NULL if it could not be started.
+Loxi * loxi_new(const LoxiOptions *options)
+{
+    loxi_initThread();
+    Interpreter *interpreter = interpreter_init(false);
+    if (interpreter == NULL)
+    {
+        loxi_freeThread();
+        return NULL;
+    }
+    interpreter->useTailCalls = options->useTailCalls;
+    gcSetMarking(options->isIncrementalGC, options->gcThreadsCount, interpreter->collector);
+
+    Loxi *loxi = lox_alloc(Loxi);
+    if (loxi == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    loxi->interpreter = interpreter;
+    loxi->options = *options;
+    loxi->programs = NULL;
+    return loxi;
+}
+
+static void loxi_freePrograms(Loxi *loxi)
+{
+    LoxiProgram *program = loxi->programs;
+    while (program != NULL)
+    {
+        LoxiProgram *next = program->next;
+        tokens_free(program->tokens);
+        arena_free(program->arena);
+        str_free(program->source);
+        lox_free(program);
+        program = next;
+    }
+    loxi->programs = NULL;
+}
+
+void loxi_free(Loxi *loxi)
+{
+    interpreter_free(loxi->interpreter);
+    loxi_freePrograms(loxi);
+    lox_free(loxi);
+    loxi_freeThread();
+}
+
+// Forgets the globals defined by the sources that have been run, so that
+// the next source runs as in a new interpreter. The memory of the
+// interpreter is kept for the next runs.
+void loxi_reset(Loxi *loxi)
+{
+    interpreter_reset(loxi->interpreter);
+    loxi_freePrograms(loxi);
+}
+
+// Compiles and executes `source` in the globals of the interpreter, and
+// returns one of the exit codes of the command line, e.g.
+// LOX_EXIT_CODE_HAD_RUNTIME_ERROR. The errors are reported on the standard
+// error, and do not prevent the following runs.
+int32_t loxi_run(const char *source, Loxi *loxi)
+{
+    Interpreter *interpreter = loxi->interpreter;
+    lox_hadError_ = false;
+    lox_hadRuntimeError_ = false;
+
+    LoxiProgram *program = lox_alloc(LoxiProgram);
+    if (program == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    program->source = str_fromLiteral(source);
+    program->tokens = scan(program->source);
+    program->arena = arena_init();
+    program->next = loxi->programs;
+    loxi->programs = program;
+
+    interpreter->source = program->source;
+    Stmt *statements;
+    if (loxi->options.lazyParse)
+    {
+        statements = parseLazily(program->tokens, program->source, loxi->options.optimize, program->arena);
+    }
+    else
+    {
+        statements = parse(program->tokens, program->source, program->arena);
+    }
+    if (!lox_hadError_)
+    {
+        resolve(statements, interpreter);
+    }
+    if (!lox_hadError_)
+    {
+        if (loxi->options.optimize)
+        {
+            statements = optimize(statements, program->arena);
+        }
+        if (loxi->options.useVM)
+        {
+            vm_interpret(statements, interpreter);
+        }
+        else
+        {
+            interpret(statements, interpreter);
+        }
+    }
+    interpreter_clearRuntimeError(interpreter);
+
+    if (lox_hadError_)
+    {
+        return LOX_EXIT_CODE_HAD_ERROR;
+    }
+    if (lox_hadRuntimeError_)
+    {
+        return LOX_EXIT_CODE_HAD_RUNTIME_ERROR;
+    }
+    return LOX_EXIT_CODE_OK;
+}
@@ -0,0 +1,55 @@
+//
+//  loxi.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef loxi_h
+#define loxi_h
+
+#include "common.h"
+
+#include <stdint.h>
+
+/*
+ The interface to embed loxi in a program. An interpreter keeps its globals
+ across the sources it runs, as in the REPL.
+ The interpreters share no mutable state: the state that is not kept by an
+ interpreter, i.e. the memory pools, the interned strings and the error
+ flags, is local to the thread, and initialized with the first interpreter
+ of the thread. So each thread can create and run its own interpreters
+ without locks, but an interpreter must only be used by the thread that
+ created it.
+ The tree-walking interpreter recurses on the C stack: a thread that runs it
+ needs about 4 MB of stack for LOX_MAX_CALL_DEPTH nested calls, e.g. a
+ thread created with a stack of LOX_THREAD_STACK_SIZE bytes. On a smaller
+ stack the calls report a stack overflow at a lower depth.
+ */
+
+typedef struct
+{
+    // NOTE: see the options of the same names of the command line.
+    bool useVM;
+    bool optimize;
+    bool lazyParse;
+    bool useTailCalls;
+    bool isIncrementalGC;
+    int32_t gcThreadsCount;
+} LoxiOptions;
+
+typedef struct Loxi_tag Loxi;
+
+LoxiOptions loxi_defaultOptions(void);
+
+// NOTE: the calls can nest; the state of the thread is freed by the last
+//       call of loxi_freeThread().
+void loxi_initThread(void);
+void loxi_freeThread(void);
+
+Loxi * loxi_new(const LoxiOptions *options);
+void loxi_free(Loxi *loxi);
+void loxi_reset(Loxi *loxi);
+int32_t loxi_run(const char *source, Loxi *loxi);
+
+#endif /* loxi_h */
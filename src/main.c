@@ -5,57 +5,368 @@
 //  Created by Marco Caldarelli on 12/10/2017.
 //
 
+#include <limits.h>
+#include <pthread.h>
 #include <string.h>
 
 #include "common.h"
 #include "interpreter.h"
+#include "jit.h"
+#include "lox_class.h"
+#include "lox_function.h"
+#include "loxi.h"
+#include "memory_sampler.h"
+#include "memory_pool.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "profiler.h"
+#include "program_cache.h"
 #include "resolver.h"
 #include "scanner.h"
+#include "tracer.h"
 #include "utility.h"
+#include "vm.h"
 
-global bool lox_hadError_ = false;
-global bool lox_hadRuntimeError_ = false;
+// NOTE: if true, the code is compiled to bytecode and executed by the
+//       virtual machine instead of the tree-walking interpreter.
+static bool lox_useVM_ = false;
+
+// NOTE: if true, the resolved syntax tree is optimized before it is
+//       executed, see optimize().
+static bool lox_optimize_ = true;
+
+// NOTE: if true, the bodies of the functions and methods declared at the top
+//       level are only parsed and resolved by their first call, see
+//       parseLazily(). Their syntax errors are then reported by that call, and
+//       the cache is not used, as it stores the whole tree.
+static bool lox_lazyParse_ = false;
+
+// NOTE: if true, the syntax tree of a script is stored in a cache file, and
+//       loaded from it by the following runs, see program_cache.h. The cache
+//       is off by default, so that running a script writes no file next to
+//       it.
+static bool lox_useCache_ = false;
+
+// NOTE: if greater than 0, the script is run this many times and the
+//       statistics of the runs are printed, see benchFile().
+static int32_t lox_benchRuns_ = 0;
+
+// NOTE: if true, the runs of --bench only scan the script, see
+//       benchScanFile().
+static bool lox_benchScan_ = false;
+
+// NOTE: if true, the calls of the script are profiled and a report is
+//       printed when it ends. If not NULL, the call stacks are also written
+//       to this file, see profiler_writeCollapsedStacks().
+static bool lox_profile_ = false;
+static const char *lox_profileStacksPath_ = NULL;
+
+// NOTE: if true, the statistics of the garbage collector are printed when the
+//       script ends. If not NULL, each collection is logged to this file, see
+//       gcSetLog().
+static bool lox_gcStats_ = false;
+static const char *lox_gcLogPath_ = NULL;
+
+// NOTE: if greater than 0, about one allocation every this many bytes is
+//       sampled, and the sites of the samples are printed when the script
+//       ends, see memory_sampler.h.
+static int64_t lox_allocSamples_ = 0;
+
+// NOTE: if not NULL, a timeline of the phases of the run and of the pauses
+//       of the garbage collector is written to this file, with the calls
+//       from the top-level code if true, see tracer.h.
+static const char *lox_traceEventsPath_ = NULL;
+static bool lox_traceCalls_ = false;
+
+// NOTE: if true, the tree-walking interpreter compiles the hot loops and
+//       functions to native code, see jit.h.
+static bool lox_useJIT_ = false;
+
+// NOTE: if false, the calls in return statements nest in the calling
+//       function instead of replacing it, e.g. to keep all the calls in
+//       the profiles.
+static bool lox_useTailCalls_ = true;
+
+// NOTE: if true, the major collections are marked incrementally; otherwise
+//       the large heaps are marked by this many threads, see gcSetMarking().
+static bool lox_gcIncremental_ = false;
+static int32_t lox_gcThreads_ = 1;
+
+// NOTE: if greater than 0, the paths of the scripts are read from the
+//       standard input and the scripts are run by this many threads, see
+//       batchFiles().
+static int32_t lox_batchWorkers_ = 0;
+
+// NOTE: if not NULL, this script is run before the main script, in the same
+//       globals. With the cache, its globals are restored from a heap
+//       snapshot instead, see loadPrelude().
+static const char *lox_preludePath_ = NULL;
+
+static inline void execute(Stmt *statements, Interpreter *interpreter)
+{
+    uint64_t startTime = tracer_begin();
+    if (lox_useVM_)
+    {
+        vm_interpret(statements, interpreter);
+    }
+    else
+    {
+        interpret(statements, interpreter);
+    }
+    if (tracer_tracesCalls)
+    {
+        // NOTE: a runtime error ends the call in progress
+        tracer_endCall();
+    }
+    tracer_end("interpret", startTime);
+}
 
 static void lox_clearError()
 {
     lox_hadError_ = false;
 }
 
-static void run(const char *source, Interpreter *interpreter)
+// Gives `interpreter` a JIT if --jit was passed.
+static void startJIT(Interpreter *interpreter)
 {
-    Token *tokens = scan(source);
-    Stmt *statements = parse(tokens, source);
+#ifdef INTERPRETER_JIT
+    if (lox_useJIT_)
+    {
+        interpreter->jit = jit_init();
+    }
+#else
+    (void)interpreter;
+#endif
+}
+
+// Frees the JIT of `interpreter`, and the native code it compiled.
+static void stopJIT(Interpreter *interpreter)
+{
+#ifdef INTERPRETER_JIT
+    if (interpreter->jit != NULL)
+    {
+        jit_free(interpreter->jit);
+        interpreter->jit = NULL;
+    }
+#else
+    (void)interpreter;
+#endif
+}
+
+// Prints the report of the profiler of `interpreter`, if any, and frees it.
+// NOTE: the report refers to the syntax tree, so it must be printed before
+//       the tree is freed.
+static void printProfile(Interpreter *interpreter)
+{
+    Profiler *profiler = interpreter->profiler;
+    if (profiler == NULL)
+    {
+        return;
+    }
+    profiler_finish(profiler);
+    profiler_printReport(stderr, profiler);
+    if (lox_profileStacksPath_ != NULL && !profiler_writeCollapsedStacks(lox_profileStacksPath_, profiler))
+    {
+        fprintf(stderr, "Could not write the call stacks to %s.\n", lox_profileStacksPath_);
+    }
+    profiler_free(profiler);
+    interpreter->profiler = NULL;
+}
+
+// Scans, parses and resolves `source`, and returns its syntax tree or NULL
+// if there was an error.
+static Stmt * compile(const char *source, Token **tokens, Interpreter *interpreter, Arena *arena)
+{
+    uint64_t startTime = tracer_begin();
+    *tokens = scan(source);
+    tracer_end("scan", startTime);
+
+    startTime = tracer_begin();
+    Stmt *statements;
+    if (lox_lazyParse_)
+    {
+        statements = parseLazily(*tokens, source, lox_optimize_, arena);
+    }
+    else
+    {
+        statements = parse(*tokens, source, arena);
+    }
+    tracer_end("parse", startTime);
     
     // NOTE: Stop if there was a syntax error.
     if (lox_hadError_)
     {
-        return;
+        return NULL;
     }
     
-    interpreter->source = source;
+    startTime = tracer_begin();
     resolve(statements, interpreter);
+    tracer_end("resolve", startTime);
 
     // NOTE: Stop if there was a resolution error.
     if (lox_hadError_)
     {
-        return;
+        return NULL;
+    }
+
+    if (lox_optimize_)
+    {
+        startTime = tracer_begin();
+        statements = optimize(statements, arena);
+        tracer_end("optimize", startTime);
+    }
+    return statements;
+}
+
+// Runs `source`. If `cachePath` is not NULL, the syntax tree is loaded from
+// the cache file, or stored in it when the source is compiled.
+static void run(const char *source, const char *cachePath, Interpreter *interpreter)
+{
+    interpreter->source = source;
+    Token *tokens = NULL;
+    Arena *arena = arena_init();
+    Stmt *statements = NULL;
+
+    bool isCached = false;
+    if (cachePath != NULL)
+    {
+        uint64_t startTime = tracer_begin();
+        isCached = cache_load(cachePath, source, lox_optimize_, &statements, interpreter, arena);
+        tracer_end("load cache", startTime);
+        if (!isCached)
+        {
+            // NOTE: discard the part of the tree that may have been loaded
+            arena_free(arena);
+            arena = arena_init();
+        }
+    }
+    if (!isCached)
+    {
+        statements = compile(source, &tokens, interpreter, arena);
+        if (lox_hadError_)
+        {
+            return;
+        }
+        if (cachePath != NULL)
+        {
+            uint64_t startTime = tracer_begin();
+            cache_store(cachePath, source, lox_optimize_, statements);
+            tracer_end("store cache", startTime);
+        }
     }
     
-    interpret(statements, interpreter);
+    execute(statements, interpreter);
+    ic_printStats();
+    printProfile(interpreter);
+    sampler_printReport(stderr);
 
-    while(tokens)
+    if (tokens != NULL)
     {
-        Token *next = tokens->nextInScan;
-        token_free(tokens);
-        tokens = next;
+        tokens_free(tokens);
+    }
+    arena_free(arena);
+}
+
+// NOTE: the syntax tree of the prelude, that the functions and classes it
+//       defined refer to, must outlive the interpreter.
+typedef struct
+{
+    char *source;
+    size_t mappedSize;
+    Token *tokens;
+    Arena *arena;
+} Prelude;
+
+// Defines in `interpreter` the globals of the prelude, restoring them from
+// its snapshot if there is a valid one, or running the prelude and storing
+// its snapshot otherwise. Returns false if the prelude had an error.
+static bool loadPrelude(Prelude *prelude, Interpreter *interpreter)
+{
+    *prelude = (Prelude){NULL, 0, NULL, NULL};
+    if (lox_preludePath_ == NULL)
+    {
+        return true;
+    }
+    prelude->source = mapFile(lox_preludePath_, &prelude->mappedSize);
+    if (prelude->source == NULL)
+    {
+        exit(LOX_EXIT_CODE_FATAL_ERROR);
+    }
+    uint64_t startTime = tracer_begin();
+    prelude->arena = arena_init();
+    interpreter->source = prelude->source;
+
+    char *snapshotPath = (lox_useCache_ && !lox_lazyParse_) ? cache_pathForSnapshot(lox_preludePath_) : NULL;
+    bool isRestored = false;
+    if (snapshotPath != NULL)
+    {
+        Stmt *statements = NULL;
+        isRestored = cache_loadSnapshot(snapshotPath, prelude->source, lox_optimize_, &statements, interpreter, prelude->arena);
+        if (!isRestored)
+        {
+            // NOTE: discard the part of the tree that may have been loaded
+            arena_free(prelude->arena);
+            prelude->arena = arena_init();
+        }
+        else if (lox_useVM_)
+        {
+            // NOTE: the virtual machine calls the functions in the chunks
+            //       compiled with their declarations.
+            vm_compileFunctions(statements, interpreter);
+        }
+    }
+    if (!isRestored)
+    {
+        Stmt *statements = compile(prelude->source, &prelude->tokens, interpreter, prelude->arena);
+        if (!lox_hadError_)
+        {
+            execute(statements, interpreter);
+        }
+        if (!lox_hadError_ && !lox_hadRuntimeError_ && snapshotPath != NULL &&
+            !cache_storeSnapshot(snapshotPath, prelude->source, lox_optimize_, statements, interpreter))
+        {
+            fprintf(stderr, "The globals of the prelude '%s' could not be stored in a snapshot.\n", lox_preludePath_);
+        }
+    }
+
+    if (snapshotPath != NULL)
+    {
+        str_free(snapshotPath);
+    }
+    tracer_end("prelude", startTime);
+    return !lox_hadError_ && !lox_hadRuntimeError_;
+}
+
+static void freePrelude(Prelude *prelude)
+{
+    if (prelude->source == NULL)
+    {
+        return;
+    }
+    if (prelude->tokens != NULL)
+    {
+        tokens_free(prelude->tokens);
+    }
+    arena_free(prelude->arena);
+    unmapFile(prelude->source, prelude->mappedSize);
+}
+
+static void exitOnError()
+{
+    if (lox_hadError_)
+    {
+        exit(LOX_EXIT_CODE_HAD_ERROR);
+    }
+    if (lox_hadRuntimeError_)
+    {
+        exit(LOX_EXIT_CODE_HAD_RUNTIME_ERROR);
     }
-    freeStmt(statements);
 }
 
 void runFile(const char *filename)
 {
-    char *source = readFile(filename);
+    size_t mappedSize;
+    char *source = mapFile(filename, &mappedSize);
     if(source == NULL)
     {
         exit(LOX_EXIT_CODE_OK);
@@ -67,29 +378,311 @@ void runFile(const char *filename)
         fprintf(stderr, "Fatal error: could not start the interpreter.");
         exit(LOX_EXIT_CODE_FATAL_ERROR);
     }
+    interpreter->useTailCalls = lox_useTailCalls_;
+    gcSetMarking(lox_gcIncremental_, lox_gcThreads_, interpreter->collector);
+    startJIT(interpreter);
 
-    run(source, interpreter);
+    if (lox_profile_)
+    {
+        interpreter->profiler = profiler_init(interpreter->collector);
+    }
+    if (lox_gcLogPath_ != NULL && !gcSetLog(lox_gcLogPath_, interpreter->collector))
+    {
+        fprintf(stderr, "Could not open the garbage collector log '%s'.\n", lox_gcLogPath_);
+    }
+    if (lox_traceEventsPath_ != NULL && !tracer_start(lox_traceEventsPath_, lox_traceCalls_))
+    {
+        fprintf(stderr, "Could not open the trace file '%s'.\n", lox_traceEventsPath_);
+    }
+    if (lox_allocSamples_ > 0)
+    {
+        if (!sampler_start(lox_allocSamples_))
+        {
+            fprintf(stderr, "The allocation sampler is not compiled, see MEMORY_SAMPLING.\n");
+            exit(LOX_EXIT_CODE_FATAL_ERROR);
+        }
+        sampler_setInterpreter(interpreter);
+    }
 
-    if (lox_hadError_)
+    Prelude prelude;
+    if (!loadPrelude(&prelude, interpreter))
     {
-        exit(LOX_EXIT_CODE_HAD_ERROR);
+        tracer_stop();
+        exitOnError();
     }
-    if (lox_hadRuntimeError_)
+    char *cachePath = (lox_useCache_ && !lox_lazyParse_) ? cache_pathForScript(filename) : NULL;
+    run(source, cachePath, interpreter);
+    tracer_stop();
+    sampler_stop();
+    stopJIT(interpreter);
+
+    if (lox_gcStats_)
     {
-        exit(LOX_EXIT_CODE_HAD_RUNTIME_ERROR);
+        char *description = gcStatsDescription(interpreter->collector);
+        fprintf(stderr, "%s\n", description);
+        str_free(description);
+        slabPrintStats(stderr);
     }
+
+    exitOnError();
     
 #ifdef MEMORY_FREE_ON_EXIT
+    if (cachePath != NULL)
+    {
+        str_free(cachePath);
+    }
     interpreter_free(interpreter);
-    str_free(source);
+    freePrelude(&prelude);
+    unmapFile(source, mappedSize);
+#endif
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+    double timeA = *(const double *)a;
+    double timeB = *(const double *)b;
+    return (timeA > timeB) - (timeA < timeB);
+}
+
+// Runs the script `filename` `runs` times, each time with a new interpreter,
+// and prints on the standard error a line with the comma separated values:
+//   benchmark,runs,median_sec,min_sec,max_sec,collections,minor_collections,peak_objects
+// The garbage collector statistics are the ones of the last run.
+void benchFile(const char *filename, int32_t runs)
+{
+    size_t mappedSize;
+    char *source = mapFile(filename, &mappedSize);
+    if(source == NULL)
+    {
+        exit(LOX_EXIT_CODE_FATAL_ERROR);
+    }
+    char *cachePath = (lox_useCache_ && !lox_lazyParse_) ? cache_pathForScript(filename) : NULL;
+
+    double *times = lox_allocn(double, runs);
+    if (times == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    int32_t collections = 0;
+    int32_t minorCollections = 0;
+    int32_t peakObjects = 0;
+    for (int32_t index = 0; index < runs; index++)
+    {
+        Interpreter *interpreter = interpreter_init(false);
+        if (interpreter == NULL)
+        {
+            fprintf(stderr, "Fatal error: could not start the interpreter.");
+            exit(LOX_EXIT_CODE_FATAL_ERROR);
+        }
+        interpreter->useTailCalls = lox_useTailCalls_;
+        gcSetMarking(lox_gcIncremental_, lox_gcThreads_, interpreter->collector);
+        startJIT(interpreter);
+
+        // NOTE: the prelude is part of the startup that is measured.
+        Timer timer = timer_init();
+        Prelude prelude;
+        if (loadPrelude(&prelude, interpreter))
+        {
+            run(source, cachePath, interpreter);
+        }
+        times[index] = timer_elapsedSec(&timer);
+        stopJIT(interpreter);
+
+        exitOnError();
+        GarbageCollector *collector = interpreter->collector;
+        collections = collector->stats.collectionsCount;
+        minorCollections = collector->stats.minorCollectionsCount;
+        peakObjects = collector->stats.peakObjectsCount;
+        interpreter_free(interpreter);
+        freePrelude(&prelude);
+    }
+
+    qsort(times, (size_t)runs, sizeof(double), compareTimes);
+    double median = (runs % 2 == 1) ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.0;
+    fprintf(stderr, "%s,%d,%.6f,%.6f,%.6f,%d,%d,%d\n", filename, runs, median, times[0], times[runs - 1],
+            collections, minorCollections, peakObjects);
+
+    lox_free(times);
+#ifdef MEMORY_FREE_ON_EXIT
+    if (cachePath != NULL)
+    {
+        str_free(cachePath);
+    }
+    unmapFile(source, mappedSize);
+#endif
+}
+
+// Scans the script `filename` `runs` times, and prints on the standard error
+// a line with the comma separated values:
+//   source,runs,median_sec,min_sec,max_sec,mb_per_sec,tokens
+// where mb_per_sec is the scan throughput of the median run.
+void benchScanFile(const char *filename, int32_t runs)
+{
+    size_t mappedSize;
+    char *source = mapFile(filename, &mappedSize);
+    if(source == NULL)
+    {
+        exit(LOX_EXIT_CODE_FATAL_ERROR);
+    }
+
+    double *times = lox_allocn(double, runs);
+    if (times == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    int32_t tokensCount = 0;
+    for (int32_t index = 0; index < runs; index++)
+    {
+        Timer timer = timer_init();
+        Token *tokens = scan(source);
+        times[index] = timer_elapsedSec(&timer);
+
+        tokensCount = 0;
+        while (tokens[tokensCount].type != TT_EOF)
+        {
+            tokensCount++;
+        }
+        tokens_free(tokens);
+    }
+
+    qsort(times, (size_t)runs, sizeof(double), compareTimes);
+    double median = (runs % 2 == 1) ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.0;
+    double megabytes = (double)str_length(source) / (1024.0 * 1024.0);
+    fprintf(stderr, "%s,%d,%.6f,%.6f,%.6f,%.1f,%d\n", filename, runs, median, times[0], times[runs - 1],
+            median > 0.0 ? megabytes / median : 0.0, tokensCount);
+
+    lox_free(times);
+#ifdef MEMORY_FREE_ON_EXIT
+    unmapFile(source, mappedSize);
 #endif
 }
 
+// NOTE: the scripts of --batch still to run, whose paths are read from `input`
+typedef struct
+{
+    pthread_mutex_t mutex;
+    FILE *input;
+} BatchQueue;
+
+// Reads the path of the next script in `path`, which has PATH_MAX bytes.
+// Returns false if there are no more scripts.
+static bool batchNextPath(char *path, BatchQueue *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    bool hasPath = false;
+    while (!hasPath && fgets(path, PATH_MAX, queue->input) != NULL)
+    {
+        path[strcspn(path, "\r\n")] = '\0';
+        hasPath = path[0] != '\0';
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return hasPath;
+}
+
+// Runs the scripts of the queue until it is empty, each in the same
+// interpreter, that is reset between two scripts.
+static void * batchWorker(void *data)
+{
+    BatchQueue *queue = (BatchQueue *)data;
+    LoxiOptions options = {
+        .useVM = lox_useVM_,
+        .optimize = lox_optimize_,
+        .lazyParse = lox_lazyParse_,
+        .useTailCalls = lox_useTailCalls_,
+        .isIncrementalGC = lox_gcIncremental_,
+        .gcThreadsCount = lox_gcThreads_,
+    };
+    Loxi *loxi = loxi_new(&options);
+    if (loxi == NULL)
+    {
+        fprintf(stderr, "Fatal error: could not start the interpreter.");
+        exit(LOX_EXIT_CODE_FATAL_ERROR);
+    }
+
+    char path[PATH_MAX];
+    while (batchNextPath(path, queue))
+    {
+        int32_t exitCode = LOX_EXIT_CODE_FATAL_ERROR;
+        Timer timer = timer_init();
+        size_t mappedSize;
+        char *source = mapFile(path, &mappedSize);
+        if (source != NULL)
+        {
+            exitCode = loxi_run(source, loxi);
+            unmapFile(source, mappedSize);
+            loxi_reset(loxi);
+        }
+        fprintf(stderr, "%s,%d,%.6f\n", path, exitCode, timer_elapsedSec(&timer));
+    }
+
+    loxi_free(loxi);
+    return NULL;
+}
+
+// Runs the scripts whose paths are read from the standard input, one per
+// line, on `workersCount` threads, each with its own interpreter. When each
+// script ends, prints on the standard error a line with the comma separated
+// values:
+//   script,exit_code,time_sec
+void batchFiles(int32_t workersCount)
+{
+#ifdef MEMORY_DEBUG
+    // NOTE: the tracking of the allocations is not thread safe.
+    workersCount = 1;
+#endif
+    BatchQueue queue;
+    pthread_mutex_init(&queue.mutex, NULL);
+    queue.input = stdin;
+
+    pthread_t *workers = lox_allocn(pthread_t, workersCount);
+    if (workers == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    // NOTE: the default stack of a thread, e.g. 512KB on macOS, is too small
+    //       for the calls of the tree-walking interpreter.
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, LOX_THREAD_STACK_SIZE);
+    int32_t startedCount = 0;
+    while (startedCount < workersCount && pthread_create(&workers[startedCount], &attributes, batchWorker, &queue) == 0)
+    {
+        ++startedCount;
+    }
+    pthread_attr_destroy(&attributes);
+    if (startedCount == 0)
+    {
+        fprintf(stderr, "Fatal error: could not start the workers.");
+        exit(LOX_EXIT_CODE_FATAL_ERROR);
+    }
+    for (int32_t index = 0; index < startedCount; ++index)
+    {
+        pthread_join(workers[index], NULL);
+    }
+
+    lox_free(workers);
+    pthread_mutex_destroy(&queue.mutex);
+}
+
+/*
+ The functions and the classes declared in a line of the REPL refer to its
+ syntax tree, so the line is kept as long as they may be called. A line that
+ declares no function is freed as soon as it has been executed. The others
+ are kept until a collection of the heap leaves no function or class object
+ whose declaration is in the line: the objects in use are visited after
+ each collection, and their declarations are looked up in the retained
+ lines. When the retained lines reach a threshold, a collection is needed to
+ find the ones that can be freed; the threshold then grows with the lines
+ that are still referenced.
+ */
+
 typedef struct Line_tag
 {
     char *source;
     Token *tokens;
     Stmt *statements;
+    // NOTE: arena the syntax tree of the line is allocated in
+    Arena *arena;
     int32_t line;
     struct Line_tag *next;
 } Line;
@@ -102,9 +695,149 @@ Line *lineInit(char *source)
         fatal_outOfMemory();
     }
     input->source = str_fromLiteral(source);
+    input->tokens = NULL;
+    input->statements = NULL;
+    input->arena = NULL;
     return input;
 }
 
+static void lineFree(Line *line)
+{
+    if (line->tokens != NULL)
+    {
+        tokens_free(line->tokens);
+    }
+    if (line->arena != NULL)
+    {
+        arena_free(line->arena);
+    }
+    str_free(line->source);
+    lox_free(line);
+}
+
+static void lineCountFunction(FunctionStmt *function, void *context)
+{
+    ++*(int32_t *)context;
+}
+
+typedef struct
+{
+    const FunctionStmt **declarations;
+    int32_t count;
+    int32_t capacity;
+} Declarations;
+
+static void addDeclaration(const FunctionStmt *declaration, Declarations *declarations)
+{
+    if (declarations->count == declarations->capacity)
+    {
+        int32_t capacity = declarations->capacity == 0 ? 64 : 2 * declarations->capacity;
+        const FunctionStmt **grown = lox_allocn(const FunctionStmt *, capacity);
+        if (grown == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        if (declarations->declarations != NULL)
+        {
+            memcpy(grown, declarations->declarations, (size_t)declarations->count * sizeof(FunctionStmt *));
+            lox_free(declarations->declarations);
+        }
+        declarations->declarations = grown;
+        declarations->capacity = capacity;
+    }
+    declarations->declarations[declarations->count++] = declaration;
+}
+
+// Adds the declarations of the functions that can be called through
+// `object` to the declarations in the context.
+// NOTE: the superclasses are visited as their objects may have been
+//       collected, while they are still retained by their subclasses.
+static void addObjectDeclarations(Object *object, void *context)
+{
+    Declarations *declarations = (Declarations *)context;
+    if (object->type == OT_FUNCTION)
+    {
+        addDeclaration(object->function->declaration, declarations);
+    }
+    else if (object->type == OT_CLASS)
+    {
+        for (const LoxClass *klass = object->klass; klass != NULL; klass = klass->superClass)
+        {
+            for (int32_t index = 0; index < klass->methodsCount; ++index)
+            {
+                addDeclaration(klass->methods[index].function->declaration, declarations);
+            }
+        }
+    }
+}
+
+static int compareDeclarations(const void *a, const void *b)
+{
+    uintptr_t declarationA = (uintptr_t)*(const FunctionStmt * const *)a;
+    uintptr_t declarationB = (uintptr_t)*(const FunctionStmt * const *)b;
+    return (declarationA > declarationB) - (declarationA < declarationB);
+}
+
+typedef struct
+{
+    const Declarations *used;
+    bool isUsed;
+} LineUse;
+
+static void lineCheckFunction(FunctionStmt *function, void *context)
+{
+    LineUse *use = (LineUse *)context;
+    const FunctionStmt *declaration = function;
+    if (!use->isUsed && bsearch(&declaration, use->used->declarations, (size_t)use->used->count,
+                                sizeof(FunctionStmt *), compareDeclarations) != NULL)
+    {
+        use->isUsed = true;
+    }
+}
+
+// Frees the lines whose functions and classes are not referenced by the
+// objects in use, and returns the ones that are kept.
+static Line * reclaimLines(Line *lines, const GarbageCollector *collector)
+{
+    Declarations used = {NULL, 0, 0};
+    gcForEachObject(addObjectDeclarations, &used, collector);
+    if (used.count > 0)
+    {
+        qsort(used.declarations, (size_t)used.count, sizeof(FunctionStmt *), compareDeclarations);
+    }
+
+    Line **link = &lines;
+    while (*link != NULL)
+    {
+        Line *line = *link;
+        LineUse use = {&used, false};
+        if (used.count > 0)
+        {
+            stmt_forEachFunction(line->statements, lineCheckFunction, &use);
+        }
+        if (use.isUsed)
+        {
+            link = &line->next;
+        }
+        else
+        {
+            *link = line->next;
+            lineFree(line);
+        }
+    }
+
+    if (used.declarations != NULL)
+    {
+        lox_free(used.declarations);
+    }
+    return lines;
+}
+
+static inline int32_t collectionsCount(const GarbageCollector *collector)
+{
+    return collector->stats.collectionsCount + collector->stats.minorCollectionsCount;
+}
+
 static void repl()
 {
     printf("Welcome to LOXI, the Lox Interpreter\n");
@@ -119,8 +852,14 @@ static void repl()
         fprintf(stderr, "Fatal error: could not start the interpreter.");
         exit(LOX_EXIT_CODE_FATAL_ERROR);
     }
+    interpreter->useTailCalls = lox_useTailCalls_;
+    gcSetMarking(lox_gcIncremental_, lox_gcThreads_, interpreter->collector);
     
     int32_t lineNumber = 1;
+    GarbageCollector *collector = interpreter->collector;
+    int32_t linesCount = 0;
+    int32_t maxLines = REPL_COLLECT_LINES;
+    int32_t reclaimedCollections = collectionsCount(collector);
     
     do {
         printf("%d> ", lineNumber);
@@ -132,11 +871,10 @@ static void repl()
         input[strlen(input) - 1] = '\0';
         Line *currentLine = lineInit(input);
         currentLine->line = lineNumber++;
-        currentLine->next = lines;
-        lines = currentLine;
         
         currentLine->tokens = scanLine(currentLine->source, currentLine->line);
-        currentLine->statements = parse(currentLine->tokens, currentLine->source);
+        currentLine->arena = arena_initSized(REPL_ARENA_BLOCK_SIZE);
+        currentLine->statements = parse(currentLine->tokens, currentLine->source, currentLine->arena);
         
         // NOTE: Stop if there was a syntax error.
         if (!lox_hadError_)
@@ -147,34 +885,60 @@ static void repl()
 
             if (!lox_hadError_)
             {
-                interpret(currentLine->statements, interpreter);
+                if (lox_optimize_)
+                {
+                    currentLine->statements = optimize(currentLine->statements, currentLine->arena);
+                }
+                execute(currentLine->statements, interpreter);
             }
         }
 
         // NOTE: We don't interrupt interactive session if an error happened
         lox_clearError();
         interpreter_clearRuntimeError(interpreter);
-        
-        gcCollect(interpreter->collector);
+        // NOTE: the inline caches of the lines that are freed must be
+        //       forgotten first.
+        ic_printStats();
+
+        int32_t functionsCount = 0;
+        stmt_forEachFunction(currentLine->statements, lineCountFunction, &functionsCount);
+        if (functionsCount == 0)
+        {
+            lineFree(currentLine);
+        }
+        else
+        {
+            currentLine->next = lines;
+            lines = currentLine;
+            ++linesCount;
+        }
+
+        if (linesCount >= maxLines)
+        {
+            gcCollect(collector);
+        }
+        if (collectionsCount(collector) != reclaimedCollections)
+        {
+            lines = reclaimLines(lines, collector);
+            reclaimedCollections = collectionsCount(collector);
+            linesCount = 0;
+            for (Line *line = lines; line != NULL; line = line->next)
+            {
+                ++linesCount;
+            }
+            maxLines = max(REPL_COLLECT_LINES, 2 * linesCount);
+        }
     } while (interpreter->exitREPL != true);
 
+    ic_printStats();
+
 #ifdef MEMORY_FREE_ON_EXIT
     // NOTE: Free all lines
     Line *line = lines;
     while(line)
     {
-        Token *token = line->tokens;
-        while(token)
-        {
-            Token *next = token->nextInScan;
-            token_free(token);
-            token = next;
-        }
-        freeStmt(line->statements);
-        str_free(line->source);
-        
         Line *next = line->next;
-        lox_free(line);
+        lineFree(line);
         line = next;
     }
     
@@ -185,20 +949,145 @@ static void repl()
 int main(int argc, const char * argv[])
 {
     lox_alloc_init();
-    str_initPools();
-    lox_clearError();
+    loxi_initThread();
     
-    if(argc == 1) {
+    int32_t argIndex = 1;
+    while (argIndex < argc && strncmp(argv[argIndex], "--", 2) == 0)
+    {
+        if (strcmp(argv[argIndex], "--vm") == 0)
+        {
+            lox_useVM_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--no-optimize") == 0)
+        {
+            lox_optimize_ = false;
+        }
+        else if (strcmp(argv[argIndex], "--lazy") == 0)
+        {
+            lox_lazyParse_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--cache") == 0)
+        {
+            lox_useCache_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--no-cache") == 0)
+        {
+            lox_useCache_ = false;
+        }
+        else if (strcmp(argv[argIndex], "--profile") == 0)
+        {
+            lox_profile_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--profile-stacks") == 0 && argIndex + 1 < argc)
+        {
+            lox_profile_ = true;
+            lox_profileStacksPath_ = argv[++argIndex];
+        }
+        else if (strcmp(argv[argIndex], "--jit") == 0)
+        {
+#ifndef INTERPRETER_JIT
+            fprintf(stderr, "The JIT is not compiled for this platform, see INTERPRETER_JIT.\n");
+            exit(LOX_EXIT_CODE_FATAL_ERROR);
+#endif
+            lox_useJIT_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--no-tail-calls") == 0)
+        {
+            lox_useTailCalls_ = false;
+        }
+        else if (strcmp(argv[argIndex], "--gc-stats") == 0)
+        {
+            lox_gcStats_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--gc-log") == 0 && argIndex + 1 < argc)
+        {
+            lox_gcLogPath_ = argv[++argIndex];
+        }
+        else if (strcmp(argv[argIndex], "--alloc-samples") == 0 && argIndex + 1 < argc)
+        {
+            lox_allocSamples_ = atoll(argv[++argIndex]);
+            if (lox_allocSamples_ <= 0)
+            {
+                fprintf(stderr, "The number of bytes of --alloc-samples must be positive.\n");
+                exit(LOX_EXIT_CODE_FATAL_ERROR);
+            }
+        }
+        else if (strncmp(argv[argIndex], "--trace-events=", strlen("--trace-events=")) == 0)
+        {
+            lox_traceEventsPath_ = argv[argIndex] + strlen("--trace-events=");
+            if (*lox_traceEventsPath_ == '\0')
+            {
+                fprintf(stderr, "The file of --trace-events is missing.\n");
+                exit(LOX_EXIT_CODE_FATAL_ERROR);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--trace-calls") == 0)
+        {
+            lox_traceCalls_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--gc-incremental") == 0)
+        {
+            lox_gcIncremental_ = true;
+        }
+        else if (strcmp(argv[argIndex], "--gc-threads") == 0 && argIndex + 1 < argc)
+        {
+            lox_gcThreads_ = atoi(argv[++argIndex]);
+            if (lox_gcThreads_ <= 0)
+            {
+                fprintf(stderr, "The number of threads of --gc-threads must be positive.\n");
+                exit(LOX_EXIT_CODE_FATAL_ERROR);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--batch") == 0 && argIndex + 1 < argc)
+        {
+            lox_batchWorkers_ = atoi(argv[++argIndex]);
+            if (lox_batchWorkers_ <= 0)
+            {
+                fprintf(stderr, "The number of workers of --batch must be positive.\n");
+                exit(LOX_EXIT_CODE_FATAL_ERROR);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--prelude") == 0 && argIndex + 1 < argc)
+        {
+            lox_preludePath_ = argv[++argIndex];
+        }
+        else if (strcmp(argv[argIndex], "--bench") == 0 && argIndex + 1 < argc)
+        {
+            lox_benchRuns_ = atoi(argv[++argIndex]);
+            if (lox_benchRuns_ <= 0)
+            {
+                fprintf(stderr, "The number of runs of --bench must be positive.\n");
+                exit(LOX_EXIT_CODE_FATAL_ERROR);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--bench-scan") == 0)
+        {
+            lox_benchScan_ = true;
+        }
+        else
+        {
+            break;
+        }
+        ++argIndex;
+    }
+
+    if (argIndex == argc && lox_batchWorkers_ > 0) {
+        batchFiles(lox_batchWorkers_);
+    } else if(argIndex == argc && lox_benchRuns_ == 0) {
         repl();
-    } else if (argc == 2) {
-        runFile(argv[1]);
+    } else if (argIndex + 1 == argc && lox_benchRuns_ > 0 && lox_benchScan_) {
+        benchScanFile(argv[argIndex], lox_benchRuns_);
+    } else if (argIndex + 1 == argc && lox_benchRuns_ > 0) {
+        benchFile(argv[argIndex], lox_benchRuns_);
+    } else if (argIndex + 1 == argc) {
+        runFile(argv[argIndex]);
     } else {
-        fprintf(stderr, "Usage: clox [path]\n");
+        fprintf(stderr, "Usage: clox [--vm] [--no-optimize] [--lazy] [--cache] [--jit] [--no-tail-calls] [--prelude file] [--bench runs] [--bench-scan] [--batch workers] [--profile] [--profile-stacks file] [--gc-stats] [--gc-log file] [--gc-incremental] [--gc-threads count] [--alloc-samples bytes] [--trace-events=file] [--trace-calls] [path]\n");
         exit(LOX_EXIT_CODE_FATAL_ERROR);
     }
 
 #ifdef MEMORY_FREE_ON_EXIT
-    str_freePools();
+    loxi_freeThread();
 #endif
     
 #ifdef MEMORY_DEBUG
@@ -256,7 +256,7 @@ static const char * filenameFromPath(const char *path)
 void * lox_alloc_(size_t capacity, int32_t count, const char *file, int line, const char *type)
 {
     assert(count < MEMORY_MAX_SIZE);
-    assert(capacity < MEMORY_MAX_SIZE / count);
+    assert(capacity <= (size_t)(MEMORY_MAX_SIZE / count));
     size_t totalCapacity = capacity*count;
     assert(totalCapacity < MEMORY_MAX_SIZE - ALLOC_OFFSET - ALLOC_ENDMARKER_SIZE - MARKER_ALIGNMENT );
 
@@ -27,17 +27,92 @@ void lox_free_(void *ptr, const char *file, int line);
 #define ALLOC_STR(x)  #x
 #define lox_alloc(type) lox_allocn(type, 1)
 #define lox_allocn(type, count) (type *)lox_alloc_(sizeof(type), count, __FILE__, __LINE__, ALLOC_STR(type))
+#define lox_allocnAt(type, count, file, line) (type *)lox_alloc_(sizeof(type), count, file, line, ALLOC_STR(type))
 #define lox_realloc(ptr, count) lox_realloc_(ptr, count, __FILE__, __LINE__)
+#define lox_reallocAt(ptr, count, file, line) lox_realloc_(ptr, count, file, line)
+#define lox_allocnUnsampled(type, count) lox_allocn(type, count)
 #define lox_free(ptr) lox_free_(ptr, __FILE__, __LINE__)
 
+#elif defined(MEMORY_SAMPLING)
+
+#include <stdlib.h>
+
+// NOTE: the allocations count toward the next sample of the allocation
+//       sampler of the thread, and the sampled ones are recorded with their
+//       call site, see memory_sampler.h. The counter stays positive while
+//       the sampler is stopped, so that the cost is a subtraction and a
+//       branch per allocation, and a branch per free.
+extern thread_global int64_t sampler_bytesBeforeSample;
+extern thread_global int32_t sampler_liveSamplesCount;
+void sampler_recordSample(void *pointer, size_t size, const char *file, int line, const char *type);
+void sampler_releaseSample(void *pointer);
+
+inline void sampler_countAllocation(void *pointer, size_t size, const char *file, int line, const char *type)
+{
+    sampler_bytesBeforeSample -= (int64_t)size;
+    if (sampler_bytesBeforeSample < 0)
+    {
+        sampler_recordSample(pointer, size, file, line, type);
+    }
+}
+
+inline void sampler_countRelease(void *pointer)
+{
+    if (sampler_liveSamplesCount > 0)
+    {
+        sampler_releaseSample(pointer);
+    }
+}
+
+inline void * lox_sampledMalloc(size_t size, const char *file, int line, const char *type)
+{
+    void *pointer = malloc(size);
+    sampler_countAllocation(pointer, size, file, line, type);
+    return pointer;
+}
+
+inline void * lox_sampledRealloc(void *pointer, size_t size, const char *file, int line)
+{
+    sampler_countRelease(pointer);
+    pointer = realloc(pointer, size);
+    sampler_countAllocation(pointer, size, file, line, "char");
+    return pointer;
+}
+
+inline void lox_sampledFree(void *pointer)
+{
+    sampler_countRelease(pointer);
+    free(pointer);
+}
+
+#define ALLOC_STR(x)  #x
+#define lox_alloc(type) lox_allocn(type, 1)
+#define lox_allocn(type, count) (type *)lox_sampledMalloc((count)*sizeof(type), __FILE__, __LINE__, ALLOC_STR(type))
+#define lox_allocnAt(type, count, file, line) (type *)lox_sampledMalloc((count)*sizeof(type), file, line, ALLOC_STR(type))
+// NOTE: -IMPORTANT- This realloc does not keep track of the size
+//       of the type, and thus works for chars only at the moment
+#define lox_realloc(ptr, count) lox_sampledRealloc(ptr, count, __FILE__, __LINE__)
+#define lox_reallocAt(ptr, count, file, line) lox_sampledRealloc(ptr, count, file, line)
+// NOTE: for the memory that is sampled piecewise when it is handed out,
+//       like the pages of the objects of the garbage collector.
+#define lox_allocnUnsampled(type, count) (type *)malloc((count)*sizeof(type))
+#define lox_free(ptr) lox_sampledFree(ptr)
+
+#define lox_alloc_init(void)
+#define alloc_printDB(void)
+#define alloc_printActiveDB(void)
+
 #else
 
 #include <stdlib.h>
 #define lox_alloc(type) lox_allocn(type, 1)
 #define lox_allocn(type, count) (type *)malloc(count*sizeof(type))
+#define lox_allocnAt(type, count, file, line) lox_allocn(type, count)
 // NOTE: -IMPORTANT- This realloc does not keep track of the size
 //       of the type, and thus works for chars only at the moment
 #define lox_realloc(ptr, count) realloc(ptr, count)
+#define lox_reallocAt(ptr, count, file, line) lox_realloc(ptr, count)
+#define lox_allocnUnsampled(type, count) lox_allocn(type, count)
 #define lox_free(ptr) free(ptr)
 
 #define lox_alloc_init(void)
@@ -9,35 +9,87 @@
 #include "common.h"
 #include "error.h"
 
+extern inline void * poolGetObject(struct MemoryPool *pool);
 extern inline void poolReleaseObject(void *object, struct MemoryPool *pool);
+extern inline void * slabAlloc_(size_t size, const char *file, int line);
+extern inline void slabRelease(void *object, size_t size);
 
-static void poolAlloc(int32_t numPages, struct MemoryPool *pool)
+// Allocates a new chunk, twice as large as the last one, up to
+// POOL_MAX_CHUNK_PAGES pages, and makes it the current chunk.
+static void poolAlloc(struct MemoryPool *pool)
 {
-    ChunkSize totalSize = PAGE_SIZE*numPages;
-    PoolChunk *chunk = (PoolChunk *)lox_allocn(uint8_t, totalSize);
+    int32_t pagesCount = pool->chunksCount < 31 ? min(1 << pool->chunksCount, POOL_MAX_CHUNK_PAGES) : POOL_MAX_CHUNK_PAGES;
+    size_t size = (size_t)pagesCount * PAGE_SIZE;
+    // NOTE: the chunks must be aligned to the pages, that lox_alloc does
+    //       not guarantee.
+    PoolChunk *chunk = (PoolChunk *)aligned_alloc(PAGE_SIZE, size);
     if(chunk == NULL)
     {
         fatal_outOfMemory();
     }
-    chunk->memory = (void *)(chunk + 1);
-    chunk->memorySize = totalSize - sizeof(PoolChunk);
-    chunk->used = 0;
-    chunk->nextChunk = pool->firstChunk;
+    chunk->chunk = chunk;
+    chunk->pool = pool;
+    chunk->firstUnused = NULL;
+    chunk->bump = (uint8_t *)chunk + POOL_CHUNK_HEADER_SIZE;
+    chunk->bumpEnd = (uint8_t *)chunk + PAGE_SIZE;
+    chunk->pagesCount = pagesCount;
+    chunk->liveCount = 0;
+    chunk->isAvailable = false;
+    chunk->nextAvailable = NULL;
+
+    chunk->previous = NULL;
+    chunk->next = pool->firstChunk;
+    if (pool->firstChunk != NULL)
+    {
+        pool->firstChunk->previous = chunk;
+    }
     pool->firstChunk = chunk;
+    ++pool->chunksCount;
+    pool->memorySize += size;
+    pool->currentChunk = chunk;
+}
+
+static void poolRelease(PoolChunk *chunk, struct MemoryPool *pool)
+{
+    if (chunk->previous != NULL)
+    {
+        chunk->previous->next = chunk->next;
+    }
+    else
+    {
+        pool->firstChunk = chunk->next;
+    }
+    if (chunk->next != NULL)
+    {
+        chunk->next->previous = chunk->previous;
+    }
+    --pool->chunksCount;
+    ++pool->releasedChunksCount;
+    pool->memorySize -= (size_t)chunk->pagesCount * PAGE_SIZE;
+    free(chunk);
 }
 
 struct MemoryPool * poolInit(ChunkSize objectSize)
 {
+    assert(objectSize >= sizeof(PoolUnusedObject) && objectSize % POOL_ALIGNMENT == 0);
+    assert(objectSize <= PAGE_SIZE - POOL_CHUNK_HEADER_SIZE);
+
     struct MemoryPool *pool = lox_alloc(struct MemoryPool);
     if(pool == NULL)
     {
         fatal_outOfMemory();
     }
     pool->firstChunk = NULL;
-    pool->firstUnused = NULL;
+    pool->currentChunk = NULL;
+    pool->firstAvailable = NULL;
     pool->chunksCount = 0;
     pool->objectSize = objectSize;
-    poolAlloc(1, pool);
+    pool->liveCount = 0;
+    pool->peakLiveCount = 0;
+    pool->allocationsCount = 0;
+    pool->releasedChunksCount = 0;
+    pool->memorySize = 0;
+    poolAlloc(pool);
     return pool;
 }
 
@@ -46,31 +98,166 @@ void poolFree(struct MemoryPool *pool)
     while(pool->firstChunk)
     {
         PoolChunk *chunk = pool->firstChunk;
-        pool->firstChunk = chunk->nextChunk;
-        lox_free(chunk);
+        pool->firstChunk = chunk->next;
+        free(chunk);
     }
     lox_free(pool);
 }
 
-void * poolGetObject(struct MemoryPool *pool)
+// Adds `chunk`, that was full, to the list of the available chunks.
+void poolMakeAvailable(PoolChunk *chunk)
 {
-    PoolChunk *chunk = pool->firstChunk;
-    
-    if (pool->firstUnused)
+    struct MemoryPool *pool = chunk->pool;
+    chunk->isAvailable = true;
+    chunk->nextAvailable = pool->firstAvailable;
+    pool->firstAvailable = chunk;
+}
+
+// Called by poolGetObject() when the current page is full: moves to
+// the next page of the current chunk, or else to an available chunk, or
+// else to a new chunk.
+void * poolGetObjectSlow(struct MemoryPool *pool)
+{
+    PoolChunk *chunk = pool->currentChunk;
+    assert(chunk->firstUnused == NULL);
+
+    uint8_t *chunkEnd = (uint8_t *)chunk + (size_t)chunk->pagesCount * PAGE_SIZE;
+    if (chunk->bumpEnd < chunkEnd)
     {
-        PoolUnusedObject *object = pool->firstUnused;
-        pool->firstUnused = object->next;
-        return (void *)object;
+        uint8_t *page = chunk->bumpEnd;
+        *(PoolChunk **)page = chunk;
+        chunk->bump = page + POOL_PAGE_HEADER_SIZE;
+        chunk->bumpEnd = page + PAGE_SIZE;
     }
-    
-    if (chunk->used + pool->objectSize > chunk->memorySize)
+    else if (pool->firstAvailable != NULL)
     {
-        poolAlloc(1, pool);
-        chunk = pool->firstChunk;
+        chunk = pool->firstAvailable;
+        pool->firstAvailable = chunk->nextAvailable;
+        chunk->isAvailable = false;
+        chunk->nextAvailable = NULL;
+        pool->currentChunk = chunk;
     }
-    void *object = (uint8_t *)chunk->memory + chunk->used;
-    chunk->used += pool->objectSize;
-    
-    return object;
+    else
+    {
+        poolAlloc(pool);
+    }
+    return poolGetObject(pool);
 }
 
+// Releases the available chunks that have no live objects.
+// NOTE: the current chunk is kept, even if it is empty.
+void poolTrim(struct MemoryPool *pool)
+{
+    PoolChunk **available = &pool->firstAvailable;
+    while (*available != NULL)
+    {
+        PoolChunk *chunk = *available;
+        if (chunk->liveCount == 0)
+        {
+            *available = chunk->nextAvailable;
+            poolRelease(chunk, pool);
+        }
+        else
+        {
+            available = &chunk->nextAvailable;
+        }
+    }
+}
+
+/* Slab allocator */
+
+#ifdef MEMORY_USE_SLABS
+// NOTE: the size classes are spaced by POOL_ALIGNMENT up to 128 bytes, then
+//       by a quarter of the closest lower power of 2.
+static const ChunkSize slab_classSizes[SLAB_CLASSES_COUNT] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512,
+    640, 768, 896, 1024,
+};
+static_assert(SLAB_MAX_SIZE == 1024, "The size classes of the slab allocator must end with SLAB_MAX_SIZE.");
+#endif
+
+thread_global struct MemoryPool *slab_pools[SLAB_CLASSES_COUNT];
+// NOTE: size class of the objects of each size, in units of POOL_ALIGNMENT.
+//       The table is constant so that it is shared by all the threads.
+const uint8_t slab_classOfSize[SLAB_MAX_SIZE / POOL_ALIGNMENT + 1] = {
+    0, 0, 1, 2, 3, 4, 5, 6, 7,
+    8, 8, 9, 9, 10, 10, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+    16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17,
+    18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+};
+
+void slabInit()
+{
+#ifdef MEMORY_USE_SLABS
+#ifndef NDEBUG
+    for (int32_t index = 0; index <= SLAB_MAX_SIZE / POOL_ALIGNMENT; ++index)
+    {
+        uint8_t sizeClass = slab_classOfSize[index];
+        assert(slab_classSizes[sizeClass] >= (ChunkSize)index * POOL_ALIGNMENT);
+        assert(sizeClass == 0 || slab_classSizes[sizeClass - 1] < (ChunkSize)index * POOL_ALIGNMENT);
+    }
+#endif
+    for (int32_t index = 0; index < SLAB_CLASSES_COUNT; ++index)
+    {
+        slab_pools[index] = poolInit(slab_classSizes[index]);
+    }
+#endif
+}
+
+void slabFree()
+{
+#ifdef MEMORY_USE_SLABS
+    for (int32_t index = 0; index < SLAB_CLASSES_COUNT; ++index)
+    {
+        poolFree(slab_pools[index]);
+        slab_pools[index] = NULL;
+    }
+#endif
+}
+
+// Returns the pool of the size class of the objects of `size` bytes, or
+// NULL if they are not allocated by the slab allocator.
+struct MemoryPool * slabPool(size_t size)
+{
+#ifdef MEMORY_USE_SLABS
+    if (size <= SLAB_MAX_SIZE)
+    {
+        return slab_pools[slab_classOfSize[(size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT]];
+    }
+#endif
+    return NULL;
+}
+
+// Releases the empty chunks of all the size classes.
+void slabTrim()
+{
+#ifdef MEMORY_USE_SLABS
+    for (int32_t index = 0; index < SLAB_CLASSES_COUNT; ++index)
+    {
+        poolTrim(slab_pools[index]);
+    }
+#endif
+}
+
+// Prints a line of statistics for each size class that has been used.
+void slabPrintStats(FILE *file)
+{
+#ifdef MEMORY_USE_SLABS
+    fprintf(file, "slab size classes:\n");
+    fprintf(file, "%6s %12s %10s %10s %8s %10s %10s\n", "size", "allocations", "live", "peak", "chunks", "released", "KB");
+    for (int32_t index = 0; index < SLAB_CLASSES_COUNT; ++index)
+    {
+        const struct MemoryPool *pool = slab_pools[index];
+        if (pool->allocationsCount == 0)
+        {
+            continue;
+        }
+        fprintf(file, "%6u %12lld %10d %10d %8d %10d %10zu\n", pool->objectSize, (long long)pool->allocationsCount,
+                pool->liveCount, pool->peakLiveCount, pool->chunksCount, pool->releasedChunksCount,
+                pool->memorySize / 1024);
+    }
+#endif
+}
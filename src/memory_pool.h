@@ -8,39 +8,205 @@
 #ifndef memory_pool_h
 #define memory_pool_h
 
+#include "common.h"
+#include "error.h"
+
 #include <stdint.h>
+#include <stdio.h>
+
+/*
+ A memory pool allocates objects of one size from chunks of memory pages.
+ The chunks grow geometrically, from one page up to POOL_MAX_CHUNK_PAGES
+ pages, and each chunk keeps its own list of unused objects and counts its
+ live objects, so that the empty chunks can be released by poolTrim().
+ The chunks are aligned to the page size, and each page starts with a
+ pointer to its chunk: the objects never straddle two pages, and the chunk
+ of an object is found in constant time.
+ New objects are taken from the current chunk; when it is full, from a
+ chunk in the list of the available chunks, i.e. the ones where objects
+ have been released since they were full.
+
+ The slab allocator has a pool for each size class up to SLAB_MAX_SIZE
+ bytes, that is shared by all the runtime structures of that size; larger
+ allocations use malloc. The pools are trimmed after each major collection
+ of the garbage collector. Each thread has its own pools, so that they are
+ used without locks.
+ */
 
 typedef uint32_t ChunkSize;
 
-typedef struct PoolChunk_tag
-{
-    struct PoolChunk_tag *nextChunk;
-    void *memory;
-    ChunkSize used;
-    ChunkSize memorySize;
-} PoolChunk;
+struct MemoryPool;
 
 typedef struct PoolUnusedObject_tag
 {
     struct PoolUnusedObject_tag *next;
 } PoolUnusedObject;
 
+typedef struct PoolChunk_tag
+{
+    // NOTE: the first page of the chunk starts with the chunk itself, the
+    //       following pages with a pointer to it.
+    struct PoolChunk_tag *chunk;
+
+    struct PoolChunk_tag *next;
+    struct PoolChunk_tag *previous;
+    struct PoolChunk_tag *nextAvailable;
+    struct MemoryPool *pool;
+
+    PoolUnusedObject *firstUnused;
+    // NOTE: the objects between `bump` and `bumpEnd` were never used; the
+    //       pages after `bump` are only initialized when needed.
+    uint8_t *bump;
+    uint8_t *bumpEnd;
+    int32_t pagesCount;
+    int32_t liveCount;
+    bool isAvailable;
+} PoolChunk;
+
+// NOTE: the pointer to the chunk at the start of each page takes the room
+//       of one object of the smallest size class, and keeps the objects of
+//       the page aligned.
+#define POOL_ALIGNMENT 16
+#define POOL_CHUNK_HEADER_SIZE ((sizeof(PoolChunk) + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT)
+#define POOL_PAGE_HEADER_SIZE POOL_ALIGNMENT
+#define POOL_CHUNK_OF(object) (*(PoolChunk **)((uintptr_t)(object) & ~(uintptr_t)(PAGE_SIZE - 1)))
+
+static_assert((PAGE_SIZE & (PAGE_SIZE - 1)) == 0, "The page size must be a power of 2.");
+static_assert(SLAB_MAX_SIZE <= PAGE_SIZE - POOL_CHUNK_HEADER_SIZE, "The objects of the largest size class must fit in a page.");
+
 struct MemoryPool
 {
+    // NOTE: list of all the chunks
     PoolChunk *firstChunk;
-    PoolUnusedObject *firstUnused;
+    PoolChunk *currentChunk;
+    PoolChunk *firstAvailable;
     int32_t chunksCount;
     ChunkSize objectSize;
+
+    int32_t liveCount;
+    int32_t peakLiveCount;
+    int64_t allocationsCount;
+    int32_t releasedChunksCount;
+    size_t memorySize;
 };
 
 struct MemoryPool* poolInit(ChunkSize objectSize);
 void poolFree(struct MemoryPool *pool);
-void * poolGetObject(struct MemoryPool *pool);
+void * poolGetObjectSlow(struct MemoryPool *pool);
+void poolMakeAvailable(PoolChunk *chunk);
+void poolTrim(struct MemoryPool *pool);
+
+inline void * poolGetObject(struct MemoryPool *pool)
+{
+    PoolChunk *chunk = pool->currentChunk;
+    void *object;
+    if (chunk->firstUnused != NULL)
+    {
+        object = chunk->firstUnused;
+        chunk->firstUnused = chunk->firstUnused->next;
+    }
+    else if (chunk->bump + pool->objectSize <= chunk->bumpEnd)
+    {
+        object = chunk->bump;
+        chunk->bump += pool->objectSize;
+    }
+    else
+    {
+        return poolGetObjectSlow(pool);
+    }
+    ++chunk->liveCount;
+    ++pool->allocationsCount;
+    if (++pool->liveCount > pool->peakLiveCount)
+    {
+        pool->peakLiveCount = pool->liveCount;
+    }
+    return object;
+}
 
 inline void poolReleaseObject(void* object, struct MemoryPool *pool)
 {
-    ((PoolUnusedObject *)object)->next = pool->firstUnused;
-    pool->firstUnused = object;
+    PoolChunk *chunk = POOL_CHUNK_OF(object);
+    assert(chunk->pool == pool);
+    ((PoolUnusedObject *)object)->next = chunk->firstUnused;
+    chunk->firstUnused = object;
+    --chunk->liveCount;
+    --pool->liveCount;
+    if (!chunk->isAvailable && chunk != pool->currentChunk)
+    {
+        poolMakeAvailable(chunk);
+    }
 }
 
+/* Slab allocator */
+
+#define SLAB_CLASSES_COUNT 20
+
+void slabInit(void);
+void slabFree(void);
+struct MemoryPool * slabPool(size_t size);
+void slabTrim(void);
+void slabPrintStats(FILE *file);
+
+#ifdef MEMORY_USE_SLABS
+
+extern thread_global struct MemoryPool *slab_pools[SLAB_CLASSES_COUNT];
+extern const uint8_t slab_classOfSize[SLAB_MAX_SIZE / POOL_ALIGNMENT + 1];
+
+inline void * slabAlloc_(size_t size, const char *file, int line)
+{
+    void *object;
+    if (size <= SLAB_MAX_SIZE)
+    {
+        object = poolGetObject(slab_pools[slab_classOfSize[(size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT]]);
+    }
+    else
+    {
+        object = lox_allocnAt(uint8_t, size, file, line);
+    }
+    if (object == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    return object;
+}
+
+// NOTE: `size` must be the size given to slabAlloc() for `object`.
+inline void slabRelease(void *object, size_t size)
+{
+    if (size <= SLAB_MAX_SIZE)
+    {
+        poolReleaseObject(object, slab_pools[slab_classOfSize[(size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT]]);
+    }
+    else
+    {
+        lox_free(object);
+    }
+}
+
+#else
+
+inline void * slabAlloc_(size_t size, const char *file, int line)
+{
+    void *object = lox_allocnAt(uint8_t, size, file, line);
+    if (object == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    return object;
+}
+
+inline void slabRelease(void *object, size_t size)
+{
+    lox_free(object);
+}
+
+#endif
+
+// NOTE: the call site is recorded by the allocation sampler, see
+//       memory_sampler.h.
+#define slab_alloc(type) ((type *)slabAlloc_(sizeof(type), __FILE__, __LINE__))
+#define slab_allocn(type, count) ((type *)slabAlloc_((size_t)(count) * sizeof(type), __FILE__, __LINE__))
+#define slab_free(ptr) slabRelease(ptr, sizeof(*(ptr)))
+#define slab_freen(ptr, count) slabRelease(ptr, (size_t)(count) * sizeof(*(ptr)))
+
 #endif /* memory_pool_h */
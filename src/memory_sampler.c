@@ -0,0 +1,455 @@
+//
+//  memory_sampler.c
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#include "memory_sampler.h"
+
+#include "interpreter.h"
+
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef MEMORY_SAMPLING
+
+extern inline void sampler_countAllocation(void *pointer, size_t size, const char *file, int line, const char *type);
+extern inline void sampler_countRelease(void *pointer);
+extern inline void * lox_sampledMalloc(size_t size, const char *file, int line, const char *type);
+extern inline void * lox_sampledRealloc(void *pointer, size_t size, const char *file, int line);
+extern inline void lox_sampledFree(void *pointer);
+
+// NOTE: the tables of the sampler are allocated with malloc and free, and
+//       not with lox_alloc(), so that they are not sampled themselves.
+
+// NOTE: the allocations of a C call site made by a Lox function. The bytes
+//       are estimates: each sample stands for the bytes allocated around it.
+typedef struct
+{
+    // NOTE: NULL for the empty entries of the table
+    const char *file;
+    int32_t line;
+    const char *type;
+    // NOTE: NULL for the top-level code
+    const FunctionStmt *function;
+    int64_t samplesCount;
+    double totalBytes;
+    double liveBytes;
+} SampleSite;
+
+// NOTE: a sampled allocation that has not been released yet
+typedef struct
+{
+    // NOTE: NULL for the empty entries of the table
+    void *pointer;
+    int32_t site;
+    double bytes;
+} LiveSample;
+
+typedef struct
+{
+    int64_t interval;
+    uint64_t random;
+    const Interpreter *interpreter;
+
+    // NOTE: hash tables with linear probing, whose capacities are powers of
+    //       two; they grow when they are half full.
+    SampleSite *sites;
+    int32_t sitesCount;
+    int32_t sitesCapacity;
+
+    LiveSample *live;
+    int32_t liveCapacity;
+} Sampler;
+
+#define SAMPLER_INITIAL_CAPACITY 256
+
+thread_global int64_t sampler_bytesBeforeSample = INT64_MAX;
+thread_global int32_t sampler_liveSamplesCount = 0;
+
+static thread_global Sampler *sampler_ = NULL;
+
+// NOTE: set by SIGUSR1, and shared by the threads
+static volatile sig_atomic_t sampler_isReportRequested = 0;
+
+static void sampler_requestReport(int signal)
+{
+    sampler_isReportRequested = 1;
+}
+
+static void * sampler_allocZeroed(size_t count, size_t size)
+{
+    void *memory = calloc(count, size);
+    if (memory == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    return memory;
+}
+
+// Returns the number of bytes before the next sample, drawn from an
+// exponential distribution whose mean is the interval of the sampler.
+static int64_t sampler_nextDistance(Sampler *sampler)
+{
+    // NOTE: xorshift64*
+    uint64_t x = sampler->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sampler->random = x;
+    double uniform = (double)((x * 2685821657736338717ull) >> 11) / 9007199254740992.0;
+    double distance = -log(1.0 - uniform) * (double)sampler->interval;
+    if (distance < 1.0)
+    {
+        return 1;
+    }
+    return (distance < 1e18) ? (int64_t)distance : (int64_t)1e18;
+}
+
+static inline uint32_t sampler_hashPointer(const void *pointer)
+{
+    uintptr_t address = (uintptr_t)pointer;
+    return (uint32_t)((address >> 3) * 2654435761u);
+}
+
+static inline uint32_t sampler_hashSite(const char *file, int32_t line, const char *type, const FunctionStmt *function)
+{
+    uint32_t hash = sampler_hashPointer(file) ^ sampler_hashPointer(type);
+    hash = hash * 31 + (uint32_t)line;
+    return hash ^ sampler_hashPointer(function);
+}
+
+static void sampler_growSites(Sampler *sampler)
+{
+    SampleSite *sites = sampler->sites;
+    int32_t capacity = sampler->sitesCapacity;
+    sampler->sitesCapacity = 2 * capacity;
+    sampler->sites = sampler_allocZeroed((size_t)sampler->sitesCapacity, sizeof(SampleSite));
+    // NOTE: the live samples refer to the sites by index, so they are
+    //       updated with the new indices.
+    int32_t *indices = sampler_allocZeroed((size_t)capacity, sizeof(int32_t));
+    uint32_t mask = (uint32_t)sampler->sitesCapacity - 1;
+    for (int32_t i = 0; i < capacity; i++)
+    {
+        SampleSite *site = &sites[i];
+        if (site->file == NULL)
+        {
+            continue;
+        }
+        uint32_t index = sampler_hashSite(site->file, site->line, site->type, site->function) & mask;
+        while (sampler->sites[index].file != NULL)
+        {
+            index = (index + 1) & mask;
+        }
+        sampler->sites[index] = *site;
+        indices[i] = (int32_t)index;
+    }
+    for (int32_t i = 0; i < sampler->liveCapacity; i++)
+    {
+        LiveSample *sample = &sampler->live[i];
+        if (sample->pointer != NULL)
+        {
+            sample->site = indices[sample->site];
+        }
+    }
+    free(indices);
+    free(sites);
+}
+
+// Returns the index of the site of the allocation, that is added if it is
+// not in the table.
+static int32_t sampler_site(const char *file, int32_t line, const char *type, const FunctionStmt *function, Sampler *sampler)
+{
+    if (2 * (sampler->sitesCount + 1) > sampler->sitesCapacity)
+    {
+        sampler_growSites(sampler);
+    }
+    uint32_t mask = (uint32_t)sampler->sitesCapacity - 1;
+    uint32_t index = sampler_hashSite(file, line, type, function) & mask;
+    while (sampler->sites[index].file != NULL)
+    {
+        SampleSite *site = &sampler->sites[index];
+        if (site->file == file && site->line == line && site->type == type && site->function == function)
+        {
+            return (int32_t)index;
+        }
+        index = (index + 1) & mask;
+    }
+    SampleSite *site = &sampler->sites[index];
+    *site = (SampleSite){file, line, type, function, 0, 0.0, 0.0};
+    sampler->sitesCount++;
+    return (int32_t)index;
+}
+
+static void sampler_insertLive(LiveSample sample, Sampler *sampler);
+
+static void sampler_growLive(Sampler *sampler)
+{
+    LiveSample *live = sampler->live;
+    int32_t capacity = sampler->liveCapacity;
+    sampler->liveCapacity = 2 * capacity;
+    sampler->live = sampler_allocZeroed((size_t)sampler->liveCapacity, sizeof(LiveSample));
+    for (int32_t i = 0; i < capacity; i++)
+    {
+        if (live[i].pointer != NULL)
+        {
+            sampler_insertLive(live[i], sampler);
+        }
+    }
+    free(live);
+}
+
+static void sampler_insertLive(LiveSample sample, Sampler *sampler)
+{
+    uint32_t mask = (uint32_t)sampler->liveCapacity - 1;
+    uint32_t index = sampler_hashPointer(sample.pointer) & mask;
+    while (sampler->live[index].pointer != NULL)
+    {
+        index = (index + 1) & mask;
+    }
+    sampler->live[index] = sample;
+}
+
+// Removes the live sample at `index`, and moves back the following samples
+// of its cluster that would not be found otherwise.
+static void sampler_removeLive(uint32_t index, Sampler *sampler)
+{
+    uint32_t mask = (uint32_t)sampler->liveCapacity - 1;
+    uint32_t hole = index;
+    uint32_t next = (index + 1) & mask;
+    while (sampler->live[next].pointer != NULL)
+    {
+        uint32_t home = sampler_hashPointer(sampler->live[next].pointer) & mask;
+        // NOTE: the sample can fill the hole if its home is not in the
+        //       cyclic range (hole, next].
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            sampler->live[hole] = sampler->live[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    sampler->live[hole].pointer = NULL;
+    sampler_liveSamplesCount--;
+}
+
+// Returns the index of the live sample of `pointer`, or -1 if it is not
+// sampled.
+static int64_t sampler_findLive(const void *pointer, const Sampler *sampler)
+{
+    uint32_t mask = (uint32_t)sampler->liveCapacity - 1;
+    uint32_t index = sampler_hashPointer(pointer) & mask;
+    while (sampler->live[index].pointer != NULL)
+    {
+        if (sampler->live[index].pointer == pointer)
+        {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+// Records the allocation of `size` bytes at `pointer`, whose allocation
+// made the counter of the bytes before the next sample negative, and draws
+// the distance to the next sample.
+void sampler_recordSample(void *pointer, size_t size, const char *file, int line, const char *type)
+{
+    Sampler *sampler = sampler_;
+    if (sampler == NULL)
+    {
+        sampler_bytesBeforeSample = INT64_MAX;
+        return;
+    }
+    sampler_bytesBeforeSample = sampler_nextDistance(sampler);
+    if (sampler_isReportRequested)
+    {
+        sampler_isReportRequested = 0;
+        sampler_printReport(stderr);
+    }
+    if (pointer == NULL)
+    {
+        return;
+    }
+
+    const FunctionStmt *function = (sampler->interpreter != NULL) ? sampler->interpreter->currentFunction : NULL;
+    int32_t siteIndex = sampler_site(file, line, type, function, sampler);
+    SampleSite *site = &sampler->sites[siteIndex];
+    // NOTE: an allocation of `size` bytes is sampled with probability
+    //       1 - exp(-size / interval), so it stands for `size` divided by
+    //       this probability.
+    double probability = -expm1(-(double)size / (double)sampler->interval);
+    double bytes = (probability > 0.0) ? (double)size / probability : (double)sampler->interval;
+    site->samplesCount++;
+    site->totalBytes += bytes;
+    site->liveBytes += bytes;
+
+    // NOTE: a pointer that is still sampled was released without being
+    //       reported, e.g. with the pool it belonged to.
+    int64_t index = sampler_findLive(pointer, sampler);
+    if (index != -1)
+    {
+        LiveSample *previous = &sampler->live[index];
+        sampler->sites[previous->site].liveBytes -= previous->bytes;
+        sampler_removeLive((uint32_t)index, sampler);
+    }
+    if (2 * (sampler_liveSamplesCount + 1) > sampler->liveCapacity)
+    {
+        sampler_growLive(sampler);
+    }
+    sampler_insertLive((LiveSample){pointer, siteIndex, bytes}, sampler);
+    sampler_liveSamplesCount++;
+}
+
+// Removes the sample of `pointer`, that is released, if it was sampled.
+void sampler_releaseSample(void *pointer)
+{
+    Sampler *sampler = sampler_;
+    if (sampler == NULL)
+    {
+        return;
+    }
+    int64_t index = sampler_findLive(pointer, sampler);
+    if (index != -1)
+    {
+        LiveSample *sample = &sampler->live[index];
+        sampler->sites[sample->site].liveBytes -= sample->bytes;
+        sampler_removeLive((uint32_t)index, sampler);
+    }
+}
+
+// Starts sampling the allocations of the thread, about one every `interval`
+// bytes. Returns false if the sampler is not compiled.
+bool sampler_start(int64_t interval)
+{
+    assert(interval > 0);
+    sampler_stop();
+    Sampler *sampler = sampler_allocZeroed(1, sizeof(Sampler));
+    sampler->interval = interval;
+    sampler->random = 0x9e3779b97f4a7c15ull ^ (uint64_t)(uintptr_t)sampler;
+    sampler->interpreter = NULL;
+    sampler->sitesCapacity = SAMPLER_INITIAL_CAPACITY;
+    sampler->sites = sampler_allocZeroed((size_t)sampler->sitesCapacity, sizeof(SampleSite));
+    sampler->liveCapacity = SAMPLER_INITIAL_CAPACITY;
+    sampler->live = sampler_allocZeroed((size_t)sampler->liveCapacity, sizeof(LiveSample));
+    sampler_ = sampler;
+    sampler_liveSamplesCount = 0;
+    sampler_bytesBeforeSample = sampler_nextDistance(sampler);
+#ifdef SIGUSR1
+    signal(SIGUSR1, sampler_requestReport);
+#endif
+    return true;
+}
+
+void sampler_stop()
+{
+    Sampler *sampler = sampler_;
+    if (sampler == NULL)
+    {
+        return;
+    }
+    sampler_bytesBeforeSample = INT64_MAX;
+    sampler_liveSamplesCount = 0;
+    sampler_ = NULL;
+    free(sampler->sites);
+    free(sampler->live);
+    free(sampler);
+}
+
+// Sets the interpreter whose running function is recorded with the samples.
+void sampler_setInterpreter(const Interpreter *interpreter)
+{
+    if (sampler_ != NULL)
+    {
+        sampler_->interpreter = interpreter;
+    }
+}
+
+static thread_global const SampleSite *sampler_sortedSites;
+
+static int sampler_compareTotalBytes(const void *a, const void *b)
+{
+    const SampleSite *siteA = &sampler_sortedSites[*(const int32_t *)a];
+    const SampleSite *siteB = &sampler_sortedSites[*(const int32_t *)b];
+    return (siteA->totalBytes < siteB->totalBytes) - (siteA->totalBytes > siteB->totalBytes);
+}
+
+// Prints on `file` the sites of the samples, sorted by the estimated bytes
+// they allocated.
+// NOTE: the names of the Lox functions refer to their syntax tree, so the
+//       report must be printed before the tree is freed.
+void sampler_printReport(FILE *file)
+{
+    Sampler *sampler = sampler_;
+    if (sampler == NULL)
+    {
+        return;
+    }
+    int32_t *order = malloc((size_t)max(sampler->sitesCount, 1) * sizeof(int32_t));
+    if (order == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    int32_t count = 0;
+    double totalBytes = 0.0;
+    double liveBytes = 0.0;
+    for (int32_t i = 0; i < sampler->sitesCapacity; i++)
+    {
+        if (sampler->sites[i].file != NULL)
+        {
+            order[count++] = i;
+            totalBytes += sampler->sites[i].totalBytes;
+            liveBytes += sampler->sites[i].liveBytes;
+        }
+    }
+    sampler_sortedSites = sampler->sites;
+    qsort(order, (size_t)count, sizeof(int32_t), sampler_compareTotalBytes);
+
+    fprintf(file, "Allocations sampled every %lld bytes: %.0f KB allocated, %.0f KB live\n",
+            (long long)sampler->interval, totalBytes / 1024.0, fmax(liveBytes, 0.0) / 1024.0);
+    fprintf(file, "%10s %12s %12s  %-32s %s\n", "samples", "total (KB)", "live (KB)", "site", "function");
+    for (int32_t i = 0; i < count; i++)
+    {
+        const SampleSite *site = &sampler->sites[order[i]];
+        char location[256];
+        const char *name = strrchr(site->file, '/');
+        snprintf(location, sizeof(location), "%s:%d %s", name != NULL ? name + 1 : site->file, site->line, site->type);
+        char function[256];
+        if (site->function == NULL)
+        {
+            snprintf(function, sizeof(function), "<script>");
+        }
+        else
+        {
+            const Token *token = site->function->name;
+            snprintf(function, sizeof(function), "%s:%d", get_identifier_name(token), token->lexeme.line + 1);
+        }
+        fprintf(file, "%10lld %12.1f %12.1f  %-32s %s\n", (long long)site->samplesCount,
+                site->totalBytes / 1024.0, fmax(site->liveBytes, 0.0) / 1024.0, location, function);
+    }
+    free(order);
+}
+
+#else
+
+bool sampler_start(int64_t interval)
+{
+    return false;
+}
+
+void sampler_stop()
+{
+}
+
+void sampler_setInterpreter(const Interpreter *interpreter)
+{
+}
+
+void sampler_printReport(FILE *file)
+{
+}
+
+#endif
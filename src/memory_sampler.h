@@ -0,0 +1,39 @@
+//
+//  memory_sampler.h
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#ifndef memory_sampler_h
+#define memory_sampler_h
+
+#include "common.h"
+
+#include <stdio.h>
+
+/*
+ The allocation sampler records about one allocation every `interval` bytes
+ allocated by lox_alloc(), str_alloc() and the objects of the garbage
+ collector. The distance between two samples is drawn at random, with
+ `interval` as mean, so that each byte has the same chance of being sampled
+ whatever the size of its allocation. Each sample carries the C call site
+ of the allocation, i.e. its file, line and type (the type of object for
+ the objects), and the Lox function that was running, and stands for the
+ bytes allocated around it: the report aggregates by site the estimated
+ bytes allocated, and the bytes of the samples that are still live.
+ While the sampler runs, the signal SIGUSR1 prints the report on the
+ standard error at the next sample.
+ The sampler is local to the thread, like the memory pools, and is compiled
+ with MEMORY_SAMPLING, see memory.h for the cost of the allocations while
+ it is stopped.
+ */
+
+struct Interpreter_tag;
+
+bool sampler_start(int64_t interval);
+void sampler_stop(void);
+void sampler_setInterpreter(const struct Interpreter_tag *interpreter);
+void sampler_printReport(FILE *file);
+
+#endif /* memory_sampler_h */
@@ -6,42 +6,59 @@
 //
 
 #include "garbage_collector.h"
+#include "lox_array.h"
 #include "lox_callable.h"
 #include "lox_class.h"
 #include "lox_function.h"
 #include "lox_instance.h"
+#include "lox_map.h"
 #include "memory.h"
 #include "objects.h"
 #include "string.h"
 
+#include <float.h>
+#include <limits.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 
-extern inline Object * objNew(ObjectType type, GarbageCollector *collector);
-extern inline Object * obj_newBoolean(bool value, GarbageCollector *collector);
-extern inline Object * obj_wrapCallable(LoxCallable *callable, GarbageCollector *collector);
-extern inline Object * obj_newCallable(LoxCallable *callable, GarbageCollector *collector);
-extern inline Object * obj_wrapClass(LoxClass *klass, GarbageCollector *collector);
-extern inline Object * obj_wrapFunction(LoxFunction *function, GarbageCollector *collector);
-extern inline Object * obj_wrapInstance(LoxInstance *instance, GarbageCollector *collector);
-extern inline Object * obj_newNil(GarbageCollector *collector);
-extern inline Object * obj_newNumber(double value, GarbageCollector *collector);
-extern inline Object * obj_newString(const char *str, GarbageCollector *collector);
-extern inline Object * obj_wrapString(char *str, GarbageCollector *collector);
-extern inline Object * obj_wrapArguments(LoxArguments *arguments, GarbageCollector *collector);
+extern inline Value val_number(double number);
+extern inline Value val_boolean(bool boolean);
+extern inline Value val_object(const struct Object_tag *object);
+extern inline bool val_isNumber(Value value);
+extern inline bool val_isNil(Value value);
+extern inline bool val_isBoolean(Value value);
+extern inline bool val_isUndefined(Value value);
+extern inline bool val_isUnbound(Value value);
+extern inline bool val_isObject(Value value);
+extern inline double val_asNumber(Value value);
+extern inline bool val_asBoolean(Value value);
+extern inline struct Object_tag * val_asObject(Value value);
+extern inline ObjectType val_type(Value value);
+extern inline bool val_isObjectType(Value value, ObjectType type);
 
-extern inline bool obj_unwrapBoolean(const Object *obj);
-extern inline const LoxCallable * obj_unwrapCallable(const Object *obj);
-extern inline LoxClass * obj_unwrapClass(const Object *obj);
-extern inline LoxFunction * obj_unwrapFunction(const Object *obj);
-extern inline LoxInstance * obj_unwrapInstance(const Object *obj);
-extern inline void * obj_unwrapNil(const Object *obj);
-extern inline double obj_unwrapNumber(const Object *obj);
-extern inline const char * obj_unwrapString(const Object *obj);
-extern inline LoxArguments * obj_unwrapArguments(const Object *obj);
+extern inline Object * objNew_(ObjectType type, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapCallable_(const LoxCallable *callable, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapClass_(LoxClass *klass, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapFunction_(LoxFunction *function, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapInstance_(LoxInstance *instance, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapArray_(LoxArray *array, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapMap_(LoxMap *map, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_newString_(const char *str, GarbageCollector *collector, const char *file, int line);
+extern inline Value obj_wrapString_(char *str, GarbageCollector *collector, const char *file, int line);
+extern inline bool val_isString(Value value);
+
+extern inline const LoxCallable * obj_unwrapCallable(Value value);
+extern inline LoxClass * obj_unwrapClass(Value value);
+extern inline LoxFunction * obj_unwrapFunction(Value value);
+extern inline LoxInstance * obj_unwrapInstance(Value value);
+extern inline LoxArray * obj_unwrapArray(Value value);
+extern inline LoxMap * obj_unwrapMap(Value value);
+extern inline const char * obj_unwrapString(Value value);
 
 #if DEBUG
 // NOTE: Here we store the last debug ID that was assigned
-int32_t obj_debugID = 0;
+thread_global int32_t obj_debugID = 0;
 #endif
 
 // Array of the object type names
@@ -58,107 +75,138 @@ const char * obj_typeLiteral(ObjectType type)
     return object_type_string[type];
 }
 
-Object * obj_dup(const Object *obj, GarbageCollector *collector)
+bool isTruthy(Value value)
 {
-    switch (obj->type) {
-        case OT_BOOLEAN:
-            return obj_newBoolean(obj->boolean, collector);
-        case OT_CALLABLE:
-            return obj_newCallable(obj->callable, collector);
-        case OT_CLASS:
-            return obj_wrapClass(obj->klass, collector);
-        case OT_INSTANCE:
-            return obj_wrapInstance(obj->instance, collector);
-        case OT_FUNCTION:
-            return obj_wrapFunction(obj->function, collector);
-        case OT_NIL:
-            return obj_newNil(collector);
-        case OT_NUMBER:
-            return obj_newNumber(obj->number, collector);
-        case OT_STRING:
-            return obj_newString(obj->string, collector);
-        case OT_ARGUMENTS:
-            // NOTE: we never duplicate an Arguments object.
-            INVALID_CASE;
-        case OT_UNUSED:
-            INVALID_CASE;
-    }
-}
-
-bool isTruthy(Object *object)
-{
-    if (object->type == OT_NIL)
+    if (val_isNil(value))
     {
         return false;
     }
-    if (object->type == OT_BOOLEAN)
+    if (val_isBoolean(value))
     {
-        return obj_unwrapBoolean(object);
+        return val_asBoolean(value);
     }
     return true;
 }
 
-bool isEqual(Object *a, Object *b)
+bool isEqual(Value a, Value b)
 {
-    if (a->type == OT_NIL && b->type == OT_NIL)
+    if (val_isNumber(a) && val_isNumber(b))
     {
-        return true;
+        return val_asNumber(a) == val_asNumber(b);
     }
-    if (a->type == OT_BOOLEAN && b->type == OT_BOOLEAN)
+    if (!val_isObject(a) || !val_isObject(b))
     {
-        return obj_unwrapBoolean(a) == obj_unwrapBoolean(b);
+        // NOTE: nil and booleans are singletons
+        return a == b;
     }
-    if (a->type == OT_CALLABLE && b->type == OT_CALLABLE)
+    if (isLoxCallable(a) && isLoxCallable(b))
     {
         const LoxCallable *callableA = obj_unwrapCallable(a);
         const LoxCallable *callableB = obj_unwrapCallable(b);
         return callableA->function == callableB->function;
     }
-    if (a->type == OT_FUNCTION && b->type == OT_FUNCTION)
+    if (isLoxFunction(a) && isLoxFunction(b))
     {
         const LoxFunction *funcA = obj_unwrapFunction(a);
         const LoxFunction *funcB = obj_unwrapFunction(b);
+        // NOTE: each access to a method creates a new bound method, that
+        //       is only equal to itself.
+        if (!val_isNil(funcA->receiver) || !val_isNil(funcB->receiver))
+        {
+            return funcA == funcB;
+        }
         return ((funcA->declaration == funcB->declaration) && (funcA->closure == funcB->closure));
     }
-    if (a->type == OT_NUMBER && b->type == OT_NUMBER)
+    if (isLoxArray(a) && isLoxArray(b))
+    {
+        // NOTE: the arrays are mutable, so they are only equal to themselves
+        return obj_unwrapArray(a) == obj_unwrapArray(b);
+    }
+    if (isLoxMap(a) && isLoxMap(b))
     {
-        return obj_unwrapNumber(a) == obj_unwrapNumber(b);
+        return obj_unwrapMap(a) == obj_unwrapMap(b);
     }
-    if (a->type == OT_STRING && b->type == OT_STRING)
+    if (val_isString(a) && val_isString(b))
     {
         return str_isEqual(obj_unwrapString(a), obj_unwrapString(b));
     }
     return false;
 }
 
+// Returns the concatenation of the string `left` and `suffix`. Long results
+// are views of a string builder, so that appending to the longest view of a
+// builder extends it in place, instead of copying the whole string.
+// NOTE: the operands are read and the builder is retained before the
+//       result is allocated, so they do not need to be protected from the
+//       garbage collector.
+Value obj_concatStrings_(Value left, const char *suffix, GarbageCollector *collector, const char *file, int line)
+{
+    assert(val_isString(left));
+    Object *leftObject = val_asObject(left);
+    StringBuilder *builder = NULL;
+    if (leftObject->type == OT_STRING_VIEW &&
+        leftObject->length == STR_LENGTH(leftObject->builder->string))
+    {
+        builder = leftObject->builder;
+        str_builderAppend_(builder, suffix, file, line);
+    }
+    else
+    {
+        const char *prefix = obj_unwrapString(left);
+        if (str_length(prefix) + str_length(suffix) < STR_BUILDER_MIN_LENGTH)
+        {
+            return obj_wrapString_(str_concat_(prefix, suffix, file, line), collector, file, line);
+        }
+        builder = str_builderInit_(prefix, suffix, file, line);
+    }
+    str_builderRetain(builder);
+    str_size length = STR_LENGTH(builder->string);
+    Object *object = objNew_(OT_STRING_VIEW, collector, file, line);
+    object->builder = builder;
+    object->length = length;
+    return val_object(object);
+}
+
+// Converts the string view `object` to a flat string, that owns a copy of
+// its prefix of the builder.
+void obj_flattenString(Object *object)
+{
+    assert(object->type == OT_STRING_VIEW);
+    StringBuilder *builder = object->builder;
+    char *string = str_substring(builder->string, substring(0, object->length));
+    str_builderRelease(builder);
+    object->type = OT_STRING;
+    object->string = string;
+}
+
 // Returns a string that represents the object `obj`.
-char * obj_stringify(const Object *object)
+char * obj_stringify_(Value object, const char *file, int line)
 {
     char *string;
-    if (object == NULL)
+    if (val_isUndefined(object))
     {
-        return str_fromLiteral("nil");
+        return str_fromLiteral_("nil", file, line);
     }
     
-    switch(object->type)
+    switch(val_type(object))
     {
         case OT_BOOLEAN:
         {
-            bool value = obj_unwrapBoolean(object);
-            string = str_fromLiteral(value ? "true" : "false");
+            bool value = val_asBoolean(object);
+            string = str_fromLiteral_(value ? "true" : "false", file, line);
         } break;
             
         case OT_CALLABLE:
         {
             // TODO: include the name of the native function.
-            string = str_fromLiteral("<fn ");
-            str_appendLiteral(string, ">");
+            string = str_fromLiteral_("<fn ", file, line);
+            string = str_appendLiteral_(string, ">", file, line);
         } break;
 
         case OT_CLASS:
         {
             const LoxClass *klass = obj_unwrapClass(object);
-            string = str_dup(klass->name);
+            string = str_dup_(klass->name, file, line);
         } break;
 
         case OT_INSTANCE:
@@ -167,52 +215,40 @@ char * obj_stringify(const Object *object)
             string = instanceToString(instance);
         } break;
 
+        case OT_ARRAY:
+        {
+            string = arrayToString(obj_unwrapArray(object));
+        } break;
+
+        case OT_MAP:
+        {
+            string = mapToString(obj_unwrapMap(object));
+        } break;
+
         case OT_FUNCTION:
         {
             const LoxFunction *function = obj_unwrapFunction(object);
-            string = str_fromLiteral("<fn ");
-            str_append(string, get_identifier_name(function->declaration->name));
-            str_appendLiteral(string, ">");
+            string = str_fromLiteral_("<fn ", file, line);
+            string = str_append_(string, get_identifier_name(function->declaration->name), file, line);
+            string = str_appendLiteral_(string, ">", file, line);
         } break;
             
         case OT_NIL:
         {
-            string = str_fromLiteral("nil");
+            string = str_fromLiteral_("nil", file, line);
         } break;
             
         case OT_NUMBER:
         {
-            double value = obj_unwrapNumber(object);
-            if (value == 0)
-            {
-                if (signbit(value))
-                {
-                    string = str_fromLiteral("-0");
-                }
-                else
-                {
-                    string = str_fromLiteral("0");
-                }
-            }
-            else if(value == (double)(int)value)
-            {
-                // Note: The number is an integer!
-                string = str_fromInt64((int64_t)value);
-            }
-            else
-            {
-                string = str_fromDouble(value);
-            }
+            char buffer[OBJ_NUMBER_BUFFER_SIZE];
+            obj_formatNumber(val_asNumber(object), buffer);
+            string = str_fromLiteral_(buffer, file, line);
         } break;
             
         case OT_STRING:
+        case OT_STRING_VIEW:
         {
-            string = str_dup(obj_unwrapString(object));
-        } break;
-            
-        case OT_ARGUMENTS:
-        {
-            string = str_fromLiteral("[args]");
+            string = str_dup_(obj_unwrapString(object), file, line);
         } break;
             
         case OT_UNUSED:
@@ -221,20 +257,58 @@ char * obj_stringify(const Object *object)
     return string;
 }
 
+// Writes `value` in `buffer`, that must hold OBJ_NUMBER_BUFFER_SIZE chars,
+// as print writes it, and returns its length. The integers are written
+// without a decimal point, and the other numbers with DBL_DIG significant
+// digits.
+int32_t obj_formatNumber(double value, char *buffer)
+{
+    if (value == 0)
+    {
+        // NOTE: -0 keeps its sign
+        const char *zero = signbit(value) ? "-0" : "0";
+        strcpy(buffer, zero);
+        return (int32_t)strlen(zero);
+    }
+    if (value >= INT_MIN && value <= INT_MAX && value == (double)(int)value)
+    {
+        // NOTE: the digits are written from the last one, and moved to the
+        //       start of the buffer.
+        char digits[OBJ_NUMBER_BUFFER_SIZE];
+        char *digit = digits + sizeof(digits);
+        int64_t integer = (int64_t)value;
+        uint64_t magnitude = integer < 0 ? (uint64_t)(-integer) : (uint64_t)integer;
+        do
+        {
+            *--digit = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (integer < 0)
+        {
+            *--digit = '-';
+        }
+        int32_t length = (int32_t)(digits + sizeof(digits) - digit);
+        memcpy(buffer, digit, (size_t)length);
+        buffer[length] = '\0';
+        return length;
+    }
+    return snprintf(buffer, OBJ_NUMBER_BUFFER_SIZE, "%.*g", DBL_DIG, value);
+}
+
 // Returns a description of the object.
-char * obj_description(const Object *object)
+char * obj_description(Value object)
 {
     char *string;
-    if (object == NULL)
+    if (val_isUndefined(object))
     {
         return str_fromLiteral("nil");
     }
     
-    switch(object->type)
+    switch(val_type(object))
     {
         case OT_BOOLEAN:
         {
-            bool value = obj_unwrapBoolean(object);
+            bool value = val_asBoolean(object);
             string = str_fromLiteral(value ? "true" : "false");
         } break;
             
@@ -258,6 +332,32 @@ char * obj_description(const Object *object)
             string = instanceToString(instance);
         } break;
             
+        case OT_ARRAY:
+        {
+            const LoxArray *array = obj_unwrapArray(object);
+            char *count = str_fromInt64(array->count);
+            string = str_fromLiteral("array (");
+            str_append(string, count);
+            str_appendLiteral(string, " values) ");
+            str_free(count);
+            char *values = arrayToString(array);
+            str_append(string, values);
+            str_free(values);
+        } break;
+            
+        case OT_MAP:
+        {
+            const LoxMap *map = obj_unwrapMap(object);
+            char *count = str_fromInt64(map->count);
+            string = str_fromLiteral("map (");
+            str_append(string, count);
+            str_appendLiteral(string, " keys) ");
+            str_free(count);
+            char *entries = mapToString(map);
+            str_append(string, entries);
+            str_free(entries);
+        } break;
+            
         case OT_FUNCTION:
         {
             const LoxFunction *function = obj_unwrapFunction(object);
@@ -277,50 +377,27 @@ char * obj_description(const Object *object)
             
         case OT_NUMBER:
         {
-            double value = obj_unwrapNumber(object);
-            if (value == 0)
-            {
-                if (signbit(value))
-                {
-                    string = str_fromLiteral("-0");
-                }
-                else
-                {
-                    string = str_fromLiteral("0");
-                }
-            }
-            else if(value == (double)(int)value)
-            {
-                // Note: The number is an integer!
-                string = str_fromInt64((int64_t)value);
-            }
-            else
-            {
-                string = str_fromDouble(value);
-            }
+            char buffer[OBJ_NUMBER_BUFFER_SIZE];
+            obj_formatNumber(val_asNumber(object), buffer);
+            string = str_fromLiteral(buffer);
         } break;
             
         case OT_STRING:
+        case OT_STRING_VIEW:
         {
             string = str_fromLiteral("\"");
             str_append(string, obj_unwrapString(object));
             str_appendLiteral(string, "\"");
         } break;
-
-        case OT_ARGUMENTS:
-        {
-            string = str_fromLiteral("[args]");
-        } break;
-
         case OT_UNUSED:
             INVALID_CASE;
     }
     return string;
 }
 
-void obj_print(Object *obj)
+void obj_print(Value value)
 {
-    char *str = obj_stringify(obj);
+    char *str = obj_stringify(value);
     printf("%s\n", str);
     str_free(str);
 }
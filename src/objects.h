@@ -9,15 +9,19 @@
 #define objects_h
 
 #include "common.h"
+#include "string.h"
+#include "value.h"
 
 #include <inttypes.h>
 
-// NOTE: definition of the object types
+// NOTE: definition of the object types. NIL, BOOLEAN and NUMBER are the
+//       types of the immediate values, that are never allocated.
 
 #define FOREACH_OBJECT(obj)                              \
   obj(NIL)       obj(BOOLEAN)  obj(CALLABLE) obj(CLASS)  \
   obj(FUNCTION)  obj(INSTANCE) obj(NUMBER)   obj(STRING) \
-  obj(ARGUMENTS) obj(UNUSED)
+  obj(STRING_VIEW) obj(ARRAY)  obj(MAP)      \
+  obj(UNUSED)
 
 typedef enum ObjectType
 {
@@ -31,6 +35,12 @@ typedef enum ObjectType
 struct LoxArguments_tag;
 typedef struct LoxArguments_tag LoxArguments;
 
+struct LoxArray_tag;
+typedef struct LoxArray_tag LoxArray;
+
+struct LoxMap_tag;
+typedef struct LoxMap_tag LoxMap;
+
 struct LoxCallable_tag;
 typedef struct LoxCallable_tag LoxCallable;
 
@@ -49,187 +59,226 @@ typedef struct GarbageCollector_tag GarbageCollector;
 typedef struct Object_tag
 {
     union {
-        double number;
-        bool boolean;
         char *string;
-        LoxArguments *arguments;
-        LoxCallable *callable;
+        StringBuilder *builder;
+        const LoxCallable *callable;
         LoxClass *klass;
         LoxFunction *function;
         LoxInstance *instance;
+        LoxArray *array;
+        LoxMap *map;
         void *value;
     };
     struct Object_tag *next;
     ObjectType type;
     int32_t marked;
+#ifdef GC_GENERATIONAL
+    bool isOld;
+#endif
+    // NOTE: length of the prefix of the builder that is the value of a
+    //       string view
+    str_size length;
 #ifdef DEBUG
     int32_t debugID;
 #endif
 } Object;
 
+// Returns the type of `value`.
+inline ObjectType val_type(Value value)
+{
+    if (val_isNumber(value))
+    {
+        return OT_NUMBER;
+    }
+    if (val_isObject(value))
+    {
+        return val_asObject(value)->type;
+    }
+    if (val_isBoolean(value))
+    {
+        return OT_BOOLEAN;
+    }
+    return OT_NIL;
+}
+
+// Returns true iff `value` is a heap object of type `type`.
+inline bool val_isObjectType(Value value, ObjectType type)
+{
+    return val_isObject(value) && val_asObject(value)->type == type;
+}
+
 #include "lox_callable.h"
 
 const char * obj_typeLiteral(ObjectType type);
-Object * obj_dup(const Object *obj, GarbageCollector *collector);
-bool isTruthy(Object *object);
-bool isEqual(Object *a, Object *b);
-char * obj_stringify(const Object *object);
-char * obj_description(const Object *object);
-void obj_print(Object *obj);
+bool isTruthy(Value value);
+bool isEqual(Value a, Value b);
+char * obj_stringify_(Value value, const char *file, int line);
+#define obj_stringify(value) obj_stringify_(value, __FILE__, __LINE__)
+
+// NOTE: size of a buffer that holds any number formatted by
+//       obj_formatNumber(), with its terminating null character.
+#define OBJ_NUMBER_BUFFER_SIZE 32
+int32_t obj_formatNumber(double value, char *buffer);
+char * obj_description(Value value);
+void obj_print(Value value);
 
-#include "string.h"
 #include "lox_callable.h"
 
 #if DEBUG
-extern int32_t obj_debugID;
+extern thread_global int32_t obj_debugID;
 #endif
 
 struct GarbageCollector_tag;
 typedef struct GarbageCollector_tag GarbageCollector;
 Object * gcGetObject(GarbageCollector *collector);
 
-inline Object * objNew(ObjectType type, GarbageCollector *collector)
+// NOTE: the wrappers take the call site, that is recorded by the
+//       allocation sampler, see memory_sampler.h.
+inline Object * objNew_(ObjectType type, GarbageCollector *collector, const char *file, int line)
 {
     Object *object = gcGetObject(collector);
     object->type = type;
+#ifdef MEMORY_SAMPLING
+    // NOTE: all the objects are created here, so they are sampled by type.
+    sampler_bytesBeforeSample -= (int64_t)sizeof(Object);
+    if (sampler_bytesBeforeSample < 0)
+    {
+        sampler_recordSample(object, sizeof(Object), file, line, obj_typeLiteral(type));
+    }
+#endif
 #if DEBUG
     object->debugID = obj_debugID++;
 #endif
     return object;
 }
 
-inline Object * obj_newBoolean(bool value, GarbageCollector *collector)
-{
-    Object *object = objNew(OT_BOOLEAN, collector);
-    object->boolean = value;
-    return object;
-}
-
-inline Object * obj_wrapCallable(LoxCallable *callable, GarbageCollector *collector)
+inline Value obj_wrapCallable_(const LoxCallable *callable, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_CALLABLE, collector);
+    Object *object = objNew_(OT_CALLABLE, collector, file, line);
     object->callable = callable;
-    return object;
-}
-
-inline Object * obj_newCallable(LoxCallable *callable, GarbageCollector *collector)
-{
-    Object *object = objNew(OT_CALLABLE, collector);
-    object->callable = callableInit(callable->function, callable->arity);
-    return object;
+    return val_object(object);
 }
 
-inline Object * obj_wrapClass(LoxClass *klass, GarbageCollector *collector)
+inline Value obj_wrapClass_(LoxClass *klass, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_CLASS, collector);
+    Object *object = objNew_(OT_CLASS, collector, file, line);
     object->klass = klass;
-    return object;
+    return val_object(object);
 }
 
-inline Object * obj_wrapFunction(LoxFunction *function, GarbageCollector *collector)
+inline Value obj_wrapFunction_(LoxFunction *function, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_FUNCTION, collector);
+    Object *object = objNew_(OT_FUNCTION, collector, file, line);
     object->function = function;
-    return object;
+    return val_object(object);
 }
 
-inline Object * obj_wrapInstance(LoxInstance *instance, GarbageCollector *collector)
+inline Value obj_wrapInstance_(LoxInstance *instance, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_INSTANCE, collector);
+    Object *object = objNew_(OT_INSTANCE, collector, file, line);
     object->instance = instance;
-    return object;
+    return val_object(object);
 }
 
-inline Object * obj_newNil(GarbageCollector *collector)
+inline Value obj_wrapArray_(LoxArray *array, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_NIL, collector);
-    return object;
+    Object *object = objNew_(OT_ARRAY, collector, file, line);
+    object->array = array;
+    return val_object(object);
 }
 
-inline Object * obj_newNumber(double value, GarbageCollector *collector)
+inline Value obj_wrapMap_(LoxMap *map, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_NUMBER, collector);
-    object->number = value;
-    return object;
+    Object *object = objNew_(OT_MAP, collector, file, line);
+    object->map = map;
+    return val_object(object);
 }
 
-inline Object * obj_newString(const char *str, GarbageCollector *collector)
+inline Value obj_newString_(const char *str, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_STRING, collector);
-    object->string = str_dup(str);
-    return object;
+    Object *object = objNew_(OT_STRING, collector, file, line);
+    object->string = str_dup_(str, file, line);
+    return val_object(object);
 }
 
-inline Object * obj_wrapString(char *str, GarbageCollector *collector)
+inline Value obj_wrapString_(char *str, GarbageCollector *collector, const char *file, int line)
 {
-    Object *object = objNew(OT_STRING, collector);
+    Object *object = objNew_(OT_STRING, collector, file, line);
     object->string = str;
-    return object;
+    return val_object(object);
 }
 
-inline Object * obj_wrapArguments(LoxArguments *arguments, GarbageCollector *collector)
+#define obj_wrapCallable(callable, collector) obj_wrapCallable_(callable, collector, __FILE__, __LINE__)
+#define obj_wrapClass(klass, collector) obj_wrapClass_(klass, collector, __FILE__, __LINE__)
+#define obj_wrapFunction(function, collector) obj_wrapFunction_(function, collector, __FILE__, __LINE__)
+#define obj_wrapInstance(instance, collector) obj_wrapInstance_(instance, collector, __FILE__, __LINE__)
+#define obj_wrapArray(array, collector) obj_wrapArray_(array, collector, __FILE__, __LINE__)
+#define obj_wrapMap(map, collector) obj_wrapMap_(map, collector, __FILE__, __LINE__)
+#define obj_newString(str, collector) obj_newString_(str, collector, __FILE__, __LINE__)
+#define obj_wrapString(str, collector) obj_wrapString_(str, collector, __FILE__, __LINE__)
+
+Value obj_concatStrings_(Value left, const char *suffix, GarbageCollector *collector, const char *file, int line);
+#define obj_concatStrings(left, suffix, collector) obj_concatStrings_(left, suffix, collector, __FILE__, __LINE__)
+void obj_flattenString(Object *object);
+
+// Returns true iff `value` is a string, either flat or a view of a builder.
+inline bool val_isString(Value value)
 {
-    Object *object = objNew(OT_ARGUMENTS, collector);
-    object->arguments = arguments;
-    return object;
-}
-
-inline bool obj_unwrapBoolean(const Object *obj)
-{
-    assert(obj->type == OT_BOOLEAN);
-    return obj->boolean;
+    return val_isObjectType(value, OT_STRING) || val_isObjectType(value, OT_STRING_VIEW);
 }
 
-inline const LoxCallable * obj_unwrapCallable(const Object *obj)
+inline const LoxCallable * obj_unwrapCallable(Value value)
 {
-    assert(obj->type == OT_CALLABLE);
-    return obj->callable;
+    assert(val_isObjectType(value, OT_CALLABLE));
+    return val_asObject(value)->callable;
 }
 
-inline LoxFunction * obj_unwrapFunction(const Object *obj)
+inline LoxFunction * obj_unwrapFunction(Value value)
 {
-    assert(obj->type == OT_FUNCTION);
-    return obj->function;
+    assert(val_isObjectType(value, OT_FUNCTION));
+    return val_asObject(value)->function;
 }
 
-inline LoxClass * obj_unwrapClass(const Object *obj)
+inline LoxClass * obj_unwrapClass(Value value)
 {
-    if (obj == NULL)
-    {
-        return NULL;
-    }
-    assert(obj->type == OT_CLASS);
-    return obj->klass;
+    assert(val_isObjectType(value, OT_CLASS));
+    return val_asObject(value)->klass;
 }
 
-inline LoxInstance * obj_unwrapInstance(const Object *obj)
+inline LoxInstance * obj_unwrapInstance(Value value)
 {
-    assert(obj->type == OT_INSTANCE);
-    return obj->instance;
+    assert(val_isObjectType(value, OT_INSTANCE));
+    return val_asObject(value)->instance;
 }
 
-inline void * obj_unwrapNil(const Object *obj)
+inline LoxArray * obj_unwrapArray(Value value)
 {
-    assert(obj->type == OT_NIL);
-    return NULL;
+    assert(val_isObjectType(value, OT_ARRAY));
+    return val_asObject(value)->array;
 }
 
-inline double obj_unwrapNumber(const Object *obj)
+inline LoxMap * obj_unwrapMap(Value value)
 {
-    assert(obj->type == OT_NUMBER);
-    return obj->number;
+    assert(val_isObjectType(value, OT_MAP));
+    return val_asObject(value)->map;
 }
 
-inline const char * obj_unwrapString(const Object *obj)
+// NOTE: the longest view of a builder returns the string of the builder,
+//       that is only valid until the next append to the builder. The other
+//       views are converted to flat strings.
+inline const char * obj_unwrapString(Value value)
 {
-    assert(obj->type == OT_STRING);
-    return obj->string;
-}
-
-inline LoxArguments * obj_unwrapArguments(const Object *obj)
-{
-    assert(obj->type == OT_ARGUMENTS);
-    return obj->arguments;
+    assert(val_isString(value));
+    Object *object = val_asObject(value);
+    if (object->type == OT_STRING_VIEW)
+    {
+        if (object->length == STR_LENGTH(object->builder->string))
+        {
+            return object->builder->string;
+        }
+        obj_flattenString(object);
+    }
+    return object->string;
 }
 
 #endif /* objects_h */
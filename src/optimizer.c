@@ -0,0 +1,459 @@
+//
+//  optimizer.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "optimizer.h"
+
+#include "common.h"
+#include "objects.h"
+#include "string.h"
+
+/*
+ The optimizer runs on the resolved syntax tree, before it is executed. It
+ folds the operations whose operands are literals into literals, and removes
+ the branches of the if and while statements whose condition is a literal,
+ that can never be executed.
+ Only the operations that cannot fail are folded, so that the runtime errors
+ (e.g. the operands of the wrong type, or the divisions by zero) are still
+ reported when the code is executed. The blocks are never removed, so that
+ the slots computed by the resolver remain valid.
+ */
+
+static Expr * optimizeExpr(Expr *expr, Arena *arena);
+static Stmt * optimizeStatements(Stmt *statements, Arena *arena);
+
+static inline bool isLiteral(const Expr *expr)
+{
+    return expr->type == EXPR_Literal;
+}
+
+static inline const Token * literalToken(const Expr *expr)
+{
+    assert(isLiteral(expr));
+    return &((const Literal *)expr)->value;
+}
+
+static inline bool isNumberLiteral(const Expr *expr)
+{
+    return isLiteral(expr) && literalToken(expr)->type == TT_NUMBER;
+}
+
+static inline bool isStringLiteral(const Expr *expr)
+{
+    return isLiteral(expr) && literalToken(expr)->type == TT_STRING;
+}
+
+static inline double numberValue(const Expr *expr)
+{
+    return get_number_value(literalToken(expr));
+}
+
+// Returns the truthiness of the literal `expr`, as isTruthy().
+static bool isTruthyLiteral(const Expr *expr)
+{
+    TokenType type = literalToken(expr)->type;
+    return type != TT_NIL && type != TT_FALSE;
+}
+
+// Returns the equality of the literals `a` and `b`, as isEqual().
+static bool isEqualLiteral(const Expr *a, const Expr *b)
+{
+    const Token *tokenA = literalToken(a);
+    const Token *tokenB = literalToken(b);
+    if (tokenA->type != tokenB->type)
+    {
+        return false;
+    }
+    switch (tokenA->type)
+    {
+        case TT_NUMBER:
+            return get_number_value(tokenA) == get_number_value(tokenB);
+        case TT_STRING:
+            return str_isEqual(get_string_value(tokenA), get_string_value(tokenB));
+        default:
+            return true;
+    }
+}
+
+// Returns the string representation of a string or number literal, as it is
+// concatenated at runtime.
+static char * literalString(const Expr *expr)
+{
+    if (isStringLiteral(expr))
+    {
+        return str_dup(get_string_value(literalToken(expr)));
+    }
+    return obj_stringify(val_number(numberValue(expr)));
+}
+
+// Replaces `expr` with a new literal of type `type`. The literal takes the
+// place of `expr` in its list, and the location of `token`.
+static Expr * replaceWithLiteral(Expr *expr, TokenType type, const Token *token, Arena *arena)
+{
+    Token value = *token;
+    value.type = type;
+    value.literal = NULL;
+    value.number = 0.0;
+    Expr *literal = init_literal(&value, arena);
+    literal->next = expr->next;
+    return literal;
+}
+
+static Expr * replaceWithNumber(Expr *expr, double number, const Token *token, Arena *arena)
+{
+    Expr *literal = replaceWithLiteral(expr, TT_NUMBER, token, arena);
+    ((Literal *)literal)->value.number = number;
+    return literal;
+}
+
+static Expr * replaceWithBoolean(Expr *expr, bool boolean, const Token *token, Arena *arena)
+{
+    return replaceWithLiteral(expr, boolean ? TT_TRUE : TT_FALSE, token, arena);
+}
+
+static void freeFoldedString(void *data)
+{
+    str_free((char *)data);
+}
+
+// NOTE: `string` is freed with the arena.
+static Expr * replaceWithString(Expr *expr, char *string, const Token *token, Arena *arena)
+{
+    Expr *literal = replaceWithLiteral(expr, TT_STRING, token, arena);
+    ((Literal *)literal)->value.literal = string;
+    arena_addCleanup(freeFoldedString, string, arena);
+    return literal;
+}
+
+// Replaces `expr` with `replacement`, that takes its place in its list.
+static Expr * replaceWith(Expr *expr, Expr *replacement)
+{
+    replacement->next = expr->next;
+    return replacement;
+}
+
+static Expr * foldBinary(Binary *binary, Arena *arena)
+{
+    Expr *expr = AS_EXPR(binary);
+    Expr *left = binary->left;
+    Expr *right = binary->right;
+    if (!isLiteral(left) || !isLiteral(right))
+    {
+        return expr;
+    }
+    const Token *operator = binary->operator;
+    bool areNumbers = isNumberLiteral(left) && isNumberLiteral(right);
+    switch (operator->type)
+    {
+        case TT_PLUS:
+        {
+            if (areNumbers)
+            {
+                return replaceWithNumber(expr, numberValue(left) + numberValue(right), operator, arena);
+            }
+            // NOTE: strings are concatenated with strings and numbers
+            if ((isStringLiteral(left) && (isStringLiteral(right) || isNumberLiteral(right))) ||
+                (isNumberLiteral(left) && isStringLiteral(right)))
+            {
+                char *leftString = literalString(left);
+                char *rightString = literalString(right);
+                char *string = str_concat(leftString, rightString);
+                str_free(leftString);
+                str_free(rightString);
+                return replaceWithString(expr, string, operator, arena);
+            }
+        } break;
+        case TT_MINUS:
+        {
+            if (areNumbers)
+            {
+                return replaceWithNumber(expr, numberValue(left) - numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_STAR:
+        {
+            if (areNumbers)
+            {
+                return replaceWithNumber(expr, numberValue(left) * numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_SLASH:
+        {
+            // NOTE: the division by zero is reported at runtime
+            if (areNumbers && numberValue(right) != 0.0)
+            {
+                return replaceWithNumber(expr, numberValue(left) / numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_GREATER:
+        {
+            if (areNumbers)
+            {
+                return replaceWithBoolean(expr, numberValue(left) > numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_GREATER_EQUAL:
+        {
+            if (areNumbers)
+            {
+                return replaceWithBoolean(expr, numberValue(left) >= numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_LESS:
+        {
+            if (areNumbers)
+            {
+                return replaceWithBoolean(expr, numberValue(left) < numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_LESS_EQUAL:
+        {
+            if (areNumbers)
+            {
+                return replaceWithBoolean(expr, numberValue(left) <= numberValue(right), operator, arena);
+            }
+        } break;
+        case TT_EQUAL_EQUAL:
+        {
+            return replaceWithBoolean(expr, isEqualLiteral(left, right), operator, arena);
+        }
+        case TT_BANG_EQUAL:
+        {
+            return replaceWithBoolean(expr, !isEqualLiteral(left, right), operator, arena);
+        }
+        default:
+            break;
+    }
+    return expr;
+}
+
+static Expr * foldUnary(Unary *unary, Arena *arena)
+{
+    Expr *expr = AS_EXPR(unary);
+    Expr *right = unary->right;
+    if (!isLiteral(right))
+    {
+        return expr;
+    }
+    const Token *operator = unary->operator;
+    if (operator->type == TT_MINUS)
+    {
+        // NOTE: the negation of a value that is not a number is reported
+        //       at runtime
+        if (isNumberLiteral(right))
+        {
+            return replaceWithNumber(expr, -numberValue(right), operator, arena);
+        }
+        return expr;
+    }
+    assert(operator->type == TT_BANG);
+    return replaceWithBoolean(expr, !isTruthyLiteral(right), operator, arena);
+}
+
+// NOTE: a logical expression evaluates to one of its operands, so if the
+//       left operand is a literal the expression is replaced by the operand
+//       it evaluates to.
+static Expr * foldLogical(Logical *logical)
+{
+    Expr *expr = AS_EXPR(logical);
+    Expr *left = logical->left;
+    if (!isLiteral(left))
+    {
+        return expr;
+    }
+    bool isTruthy = isTruthyLiteral(left);
+    bool isLeftResult = (logical->operator->type == TT_OR) ? isTruthy : !isTruthy;
+    return replaceWith(expr, isLeftResult ? left : logical->right);
+}
+
+static Expr * optimizeList(Expr *expressions, Arena *arena)
+{
+    Expr *first = NULL;
+    Expr *last = NULL;
+    Expr *expr = expressions;
+    while (expr != NULL)
+    {
+        Expr *next = expr->next;
+        Expr *optimized = optimizeExpr(expr, arena);
+        if (last == NULL)
+        {
+            first = optimized;
+        }
+        else
+        {
+            last->next = optimized;
+        }
+        last = optimized;
+        expr = next;
+    }
+    return first;
+}
+
+// Returns the optimized expression that replaces `expr`.
+// NOTE: the replacement keeps the `next` link of `expr`.
+static Expr * optimizeExpr(Expr *expr, Arena *arena)
+{
+    if (expr == NULL)
+    {
+        return NULL;
+    }
+    switch (expr->type)
+    {
+        case EXPR_Assign: {
+            Assign *assign = (Assign *)expr;
+            assign->value = optimizeExpr(assign->value, arena);
+        } break;
+        case EXPR_Binary: {
+            Binary *binary = (Binary *)expr;
+            binary->left = optimizeExpr(binary->left, arena);
+            binary->right = optimizeExpr(binary->right, arena);
+            return foldBinary(binary, arena);
+        }
+        case EXPR_Call: {
+            Call *call = (Call *)expr;
+            call->callee = optimizeExpr(call->callee, arena);
+            call->arguments = optimizeList(call->arguments, arena);
+        } break;
+        case EXPR_Get: {
+            Get *get = (Get *)expr;
+            get->object = optimizeExpr(get->object, arena);
+        } break;
+        case EXPR_Grouping: {
+            // NOTE: the grouping only affects the parsing
+            Grouping *grouping = (Grouping *)expr;
+            return replaceWith(expr, optimizeExpr(grouping->expression, arena));
+        }
+        case EXPR_Logical: {
+            Logical *logical = (Logical *)expr;
+            logical->left = optimizeExpr(logical->left, arena);
+            logical->right = optimizeExpr(logical->right, arena);
+            return foldLogical(logical);
+        }
+        case EXPR_Set: {
+            Set *set = (Set *)expr;
+            set->object = optimizeExpr(set->object, arena);
+            set->value = optimizeExpr(set->value, arena);
+        } break;
+        case EXPR_Unary: {
+            Unary *unary = (Unary *)expr;
+            unary->right = optimizeExpr(unary->right, arena);
+            return foldUnary(unary, arena);
+        }
+        case EXPR_Literal:
+        case EXPR_Super:
+        case EXPR_This:
+        case EXPR_Variable:
+            break;
+    }
+    return expr;
+}
+
+// Returns the statement that replaces `stmt`, or NULL if it is removed.
+static Stmt * optimizeStmt(Stmt *stmt, Arena *arena)
+{
+    switch (stmt->type)
+    {
+        case STMT_Block: {
+            BlockStmt *block = (BlockStmt *)stmt;
+            block->statements = optimizeStatements(block->statements, arena);
+        } break;
+        case STMT_Class: {
+            ClassStmt *classStmt = (ClassStmt *)stmt;
+            classStmt->methods = (FunctionStmt *)optimizeStatements(AS_STMT(classStmt->methods), arena);
+        } break;
+        case STMT_Expression: {
+            ExpressionStmt *expression = (ExpressionStmt *)stmt;
+            expression->expression = optimizeExpr(expression->expression, arena);
+        } break;
+        case STMT_Function: {
+            FunctionStmt *function = (FunctionStmt *)stmt;
+            function->body = optimizeStatements(function->body, arena);
+        } break;
+        case STMT_If: {
+            IfStmt *ifStmt = (IfStmt *)stmt;
+            ifStmt->condition = optimizeExpr(ifStmt->condition, arena);
+            ifStmt->thenBranch = optimizeStmt(ifStmt->thenBranch, arena);
+            if (ifStmt->elseBranch != NULL)
+            {
+                ifStmt->elseBranch = optimizeStmt(ifStmt->elseBranch, arena);
+            }
+            if (isLiteral(ifStmt->condition))
+            {
+                return isTruthyLiteral(ifStmt->condition) ? ifStmt->thenBranch : ifStmt->elseBranch;
+            }
+            if (ifStmt->thenBranch == NULL)
+            {
+                // NOTE: the branches of an if statement are statements
+                ifStmt->thenBranch = initBlock(NULL, arena);
+            }
+        } break;
+        case STMT_Print: {
+            PrintStmt *print = (PrintStmt *)stmt;
+            print->expression = optimizeExpr(print->expression, arena);
+        } break;
+        case STMT_Return: {
+            ReturnStmt *ret = (ReturnStmt *)stmt;
+            ret->value = optimizeExpr(ret->value, arena);
+        } break;
+        case STMT_Var: {
+            VarStmt *var = (VarStmt *)stmt;
+            var->initializer = optimizeExpr(var->initializer, arena);
+        } break;
+        case STMT_While: {
+            WhileStmt *whileStmt = (WhileStmt *)stmt;
+            whileStmt->condition = optimizeExpr(whileStmt->condition, arena);
+            if (isLiteral(whileStmt->condition) && !isTruthyLiteral(whileStmt->condition))
+            {
+                return NULL;
+            }
+            whileStmt->body = optimizeStmt(whileStmt->body, arena);
+            if (whileStmt->body == NULL)
+            {
+                whileStmt->body = initBlock(NULL, arena);
+            }
+        } break;
+    }
+    return stmt;
+}
+
+// Optimizes the list of statements `statements` and returns its new head.
+static Stmt * optimizeStatements(Stmt *statements, Arena *arena)
+{
+    Stmt *first = NULL;
+    Stmt *last = NULL;
+    Stmt *stmt = statements;
+    while (stmt != NULL)
+    {
+        Stmt *next = stmt->next;
+        Stmt *optimized = optimizeStmt(stmt, arena);
+        if (optimized != NULL)
+        {
+            if (last == NULL)
+            {
+                first = optimized;
+            }
+            else
+            {
+                last->next = optimized;
+            }
+            last = optimized;
+        }
+        stmt = next;
+    }
+    if (last != NULL)
+    {
+        last->next = NULL;
+    }
+    return first;
+}
+
+// Folds the constant expressions and removes the unreachable branches of
+// the resolved syntax tree `statements`, and returns the optimized tree.
+// The new nodes are allocated in `arena`, the arena of the tree.
+Stmt * optimize(Stmt *statements, Arena *arena)
+{
+    return optimizeStatements(statements, arena);
+}
@@ -0,0 +1,16 @@
+//
+//  optimizer.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef optimizer_h
+#define optimizer_h
+
+#include "arena.h"
+#include "stmt.h"
+
+Stmt * optimize(Stmt *statements, Arena *arena);
+
+#endif /* optimizer_h */
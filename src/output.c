@@ -0,0 +1,91 @@
+//
+//  output.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "output.h"
+#include "objects.h"
+
+#include <unistd.h>
+
+extern inline void output_writeChars(const char *chars, size_t length, OutputBuffer *output);
+
+void output_init(OutputBuffer *output, FILE *file)
+{
+    output->data = lox_allocn(char, OUTPUT_BUFFER_SIZE);
+    if (output->data == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    output->count = 0;
+    output->capacity = OUTPUT_BUFFER_SIZE;
+    output->file = file;
+    output->isLineBuffered = isatty(fileno(file));
+}
+
+void output_free(OutputBuffer *output)
+{
+    output_flush(output);
+    lox_free(output->data);
+    output->data = NULL;
+    output->capacity = 0;
+}
+
+// Writes the whole buffer to the file, and flushes the file.
+void output_flush(OutputBuffer *output)
+{
+    if (output->count > 0)
+    {
+        fwrite(output->data, 1, output->count, output->file);
+        output->count = 0;
+    }
+    fflush(output->file);
+}
+
+// Writes the lines of the buffer to the file, and keeps the characters
+// after the last new line, if any, in the buffer.
+void output_writeLines(OutputBuffer *output)
+{
+    size_t length = output->count;
+    while (length > 0 && output->data[length - 1] != '\n')
+    {
+        --length;
+    }
+    if (length == 0)
+    {
+        return;
+    }
+    fwrite(output->data, 1, length, output->file);
+    output->count -= length;
+    memmove(output->data, output->data + length, output->count);
+}
+
+// Writes the description of `value` that print writes, followed by a new
+// line.
+void output_printValue(Value value, OutputBuffer *output)
+{
+    if (val_isNumber(value))
+    {
+        char buffer[OBJ_NUMBER_BUFFER_SIZE];
+        int32_t length = obj_formatNumber(val_asNumber(value), buffer);
+        output_writeChars(buffer, (size_t)length, output);
+    }
+    else if (val_isString(value))
+    {
+        const char *string = obj_unwrapString(value);
+        output_writeChars(string, str_length(string), output);
+    }
+    else
+    {
+        char *string = obj_stringify(value);
+        output_writeChars(string, str_length(string), output);
+        str_free(string);
+    }
+    output_writeChars("\n", 1, output);
+    if (output->isLineBuffered)
+    {
+        output_flush(output);
+    }
+}
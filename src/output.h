@@ -0,0 +1,61 @@
+//
+//  output.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef output_h
+#define output_h
+
+#include "common.h"
+#include "value.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ The print statements write to a buffer of the interpreter, instead of
+ formatting each value in a temporary string that is then printed. The
+ numbers and the strings are written directly in the buffer. The buffer is
+ written to its file when it is full, when the interpreter finishes running
+ a program or reports a runtime error, and when flush() is called. When the
+ file is a terminal, the buffer is also flushed at the end of each print, as
+ is usual for the lines of a terminal.
+ NOTE: a full buffer is written up to its last new line, so that the lines
+       of the interpreters that share the file, e.g. in batch mode, are not
+       split.
+ */
+
+typedef struct
+{
+    char *data;
+    size_t count;
+    size_t capacity;
+    FILE *file;
+    bool isLineBuffered;
+} OutputBuffer;
+
+void output_init(OutputBuffer *output, FILE *file);
+void output_free(OutputBuffer *output);
+void output_flush(OutputBuffer *output);
+void output_writeLines(OutputBuffer *output);
+void output_printValue(Value value, OutputBuffer *output);
+
+inline void output_writeChars(const char *chars, size_t length, OutputBuffer *output)
+{
+    if (output->count + length > output->capacity)
+    {
+        output_writeLines(output);
+        if (output->count + length > output->capacity)
+        {
+            output_flush(output);
+            fwrite(chars, 1, length, output->file);
+            return;
+        }
+    }
+    memcpy(output->data + output->count, chars, length);
+    output->count += length;
+}
+
+#endif /* output_h */
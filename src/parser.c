@@ -12,6 +12,8 @@
 #include "error.h"
 #include "expr.h"
 
+#include <string.h>
+
 typedef struct Parser
 {
     Token *tokens;
@@ -19,6 +21,15 @@ typedef struct Parser
     Token *previous;
     
     const char *source;
+    // NOTE: arena the syntax tree is allocated in
+    Arena *arena;
+    
+    // NOTE: if true, the bodies of the functions and methods declared at the
+    //       top level are skipped, see parse_lazyFunctionBody().
+    bool isLazy;
+    bool optimize;
+    int32_t blockDepth;
+    bool isInSubclass;
     
     Error *error;
 } Parser;
@@ -31,7 +42,7 @@ typedef struct
 
 /* Recursive descent parser */
 
-static Parser * parser_init(Token *tokens, const char *source)
+static Parser * parser_init(Token *tokens, const char *source, Arena *arena)
 {
     Parser *parser = lox_alloc(Parser);
     
@@ -40,6 +51,12 @@ static Parser * parser_init(Token *tokens, const char *source)
     parser->previous = NULL;
     
     parser->source = source;
+    parser->arena = arena;
+    
+    parser->isLazy = false;
+    parser->optimize = false;
+    parser->blockDepth = 0;
+    parser->isInSubclass = false;
     
     parser->error = NULL;
     
@@ -80,7 +97,7 @@ static inline Token * parser_advance(Parser *parser)
     if (!parser_isAtEnd(parser))
     {
         parser->previous = parser->current;
-        parser->current = parser->current->nextInScan;
+        parser->current++;
     }
     return parser_previous(parser);
 }
@@ -198,19 +215,19 @@ static Expr * parse_primary(Parser *parser)
     
     if (parser_match1(parser, TT_FALSE))
     {
-        result = init_bool_literal(false);
+        result = init_bool_literal(false, parser->arena);
     }
     else if (parser_match1(parser, TT_TRUE))
     {
-        result = init_bool_literal(true);
+        result = init_bool_literal(true, parser->arena);
     }
     else if (parser_match1(parser, TT_NIL))
     {
-        result = init_nil_literal();
+        result = init_nil_literal(parser->arena);
     }
     else if (parser_match(parser, ((TokenType[]){TT_NUMBER, TT_STRING})))
     {
-        result = init_literal(parser_previous(parser));
+        result = init_literal(parser_previous(parser), parser->arena);
     }
     else if (parser_match1(parser, TT_SUPER))
     {
@@ -221,33 +238,23 @@ static Expr * parse_primary(Parser *parser)
         }
         Token *method = parser_consume(parser, TT_IDENTIFIER,
                                        "Expect superclass method name.");
-        result = init_super(keyword, method);
+        result = init_super(keyword, method, parser->arena);
     }
     else if (parser_match1(parser, TT_THIS))
     {
-        result = init_this(parser_previous(parser));
+        result = init_this(parser_previous(parser), parser->arena);
     }
     else if (parser_match1(parser, TT_IDENTIFIER))
     {
-        result = init_variable(parser_previous(parser));
+        result = init_variable(parser_previous(parser), parser->arena);
     }
     else if (parser_match1(parser, TT_LEFT_PAREN))
     {
         Expr *expr = parse_expression(parser);
-        if(expr == NULL)
-        {
-            free_expr(expr);
-        }
-        else
+        if (expr != NULL &&
+            parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after expression."))
         {
-            if (!parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after expression."))
-            {
-                free_expr(expr);
-            }
-            else
-            {
-                result = init_grouping(expr);
-            }
+            result = init_grouping(expr, parser->arena);
         }
     }
     else
@@ -270,7 +277,7 @@ static Expr * parse_unary(Parser *parser)
         Expr *right = parse_unary(parser);
         if(right)
         {
-            result = init_unary(operator, right);
+            result = init_unary(operator, right, parser->arena);
         }
         else
         {
@@ -298,8 +305,6 @@ static Expr * parse_finishCall(Expr *callee, Parser *parser)
             Expr *expr = parse_expression(parser);
             if (expr == NULL)
             {
-                free_expr(arguments);
-                free_expr(callee);
                 return NULL;
             }
             arguments = expr_appendTo(arguments, expr);
@@ -309,12 +314,10 @@ static Expr * parse_finishCall(Expr *callee, Parser *parser)
     Token *paren = parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after arguments.");
     if (paren == NULL)
     {
-        free_expr(arguments);
-        free_expr(callee);
         return NULL;
     }
     
-    Expr *call = init_call(callee, paren, arguments);
+    Expr *call = init_call(callee, paren, arguments, parser->arena);
     return (void *)call;
 }
 
@@ -338,10 +341,9 @@ static Expr * parse_call(Parser *parser)
             Token *name = parser_consume(parser, TT_IDENTIFIER, "Expect property name after '.'.");
             if (name == NULL)
             {
-                free_expr(expr);
                 return NULL;
             }
-            expr = init_get(expr, name);
+            expr = init_get(expr, name, parser->arena);
         }
         else
         {
@@ -367,10 +369,9 @@ static Expr * parse_multiplication(Parser *parser)
         Expr *right = parse_unary(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_binary(expr, operator, right);
+        expr = init_binary(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -391,10 +392,9 @@ static Expr * parse_addition(Parser *parser)
         Expr *right = parse_multiplication(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_binary(expr, operator, right);
+        expr = init_binary(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -415,10 +415,9 @@ static Expr * parse_comparison(Parser *parser) {
         Expr *right = parse_addition(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_binary(expr, operator, right);
+        expr = init_binary(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -440,10 +439,9 @@ static Expr * parse_equality(Parser *parser)
         Expr *right = parse_comparison(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_binary(expr, operator, right);
+        expr = init_binary(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -464,10 +462,9 @@ static Expr * parse_and(Parser *parser)
         Expr *right = parse_equality(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_logical(expr, operator, right);
+        expr = init_logical(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -488,10 +485,9 @@ static Expr * parse_or(Parser *parser)
         Expr *right = parse_and(parser);
         if(right == NULL)
         {
-            free_expr(expr);
             return NULL;
         }
-        expr = init_logical(expr, operator, right);
+        expr = init_logical(expr, operator, right, parser->arena);
     }
     
     return expr;
@@ -511,16 +507,12 @@ static Expr * parse_assignment(Parser *parser)
         if (expr->type == EXPR_Variable)
         {
             Variable *varExpr = (Variable *)expr;
-            Token *name = varExpr->name;
-            lox_free(varExpr);
-            return init_assign(name, value);
+            return init_assign(varExpr->name, value, parser->arena);
         }
         else if (expr->type == EXPR_Get)
         {
             Get *getExpr = (Get *)expr;
-            Expr *setExpr = init_set(getExpr->object, getExpr->name, value);
-            lox_free(getExpr);
-            return setExpr;
+            return init_set(getExpr->object, getExpr->name, value, parser->arena);
         }
         parser_throwError(equals, "Invalid assignment target.", parser);
     }
@@ -545,11 +537,10 @@ static Stmt * parse_expressionStatement(Parser *parser)
 
     if(!parser_consume(parser, TT_SEMICOLON, "Expect ';' after expression."))
     {
-        free_expr(expr);
         return NULL;
     }
 
-    Stmt *result = initExpression(expr);
+    Stmt *result = initExpression(expr, parser->arena);
     return result;
 }
 
@@ -562,6 +553,7 @@ static Stmt * parse_block(Parser *parser)
     Stmt *first = NULL;
     Stmt *last = NULL;
 
+    parser->blockDepth++;
     while (!parser_check(parser, TT_RIGHT_BRACE) && !parser_isAtEnd(parser))
     {
         Stmt *statement = parse_declaration(parser);
@@ -581,10 +573,10 @@ static Stmt * parse_block(Parser *parser)
         last = statement;
         assert(last->next == NULL);
     }
+    parser->blockDepth--;
     
     if (!parser_consume(parser, TT_RIGHT_BRACE, "Expect '}' after block."))
     {
-        freeStmt(first);
         return NULL;
     }
 
@@ -601,11 +593,10 @@ static Stmt * parse_printStatement(Parser *parser)
     }
     if (!parser_consume(parser, TT_SEMICOLON, "Expect ';' after value."))
     {
-        free_expr(value);
         return NULL;
     }
     
-    Stmt *result = initPrint(value);
+    Stmt *result = initPrint(value, parser->arena);
     return result;
 }
 
@@ -622,11 +613,10 @@ static Stmt * parse_returnStatement(Parser *parser)
 
     if (!parser_consume(parser, TT_SEMICOLON, "Expect ';' after value."))
     {
-        free_expr(value);
         return NULL;
     }
     
-    Stmt *result = initReturn(keyword, value);
+    Stmt *result = initReturn(keyword, value, parser->arena);
     return result;
 }
 
@@ -658,7 +648,7 @@ static Stmt * parse_statement(Parser *parser)
     }
     if (parser_match1(parser, TT_LEFT_BRACE))
     {
-        return initBlock(parse_block(parser));
+        return initBlock(parse_block(parser), parser->arena);
     }
     return parse_expressionStatement(parser);
 }
@@ -699,14 +689,11 @@ static Stmt * parse_forStatement(Parser *parser)
         condition = parse_expression(parser);
         if (condition == NULL)
         {
-            freeStmt(initializer);
             return NULL;
         }
     }
     if (!parser_consume(parser, TT_SEMICOLON, "Expect ';' after loop condition."))
     {
-        freeStmt(initializer);
-        free_expr(condition);
         return NULL;
     }
     
@@ -716,16 +703,11 @@ static Stmt * parse_forStatement(Parser *parser)
         increment = parse_expression(parser);
         if (increment == NULL)
         {
-            freeStmt(initializer);
-            free_expr(condition);
             return NULL;
         }
     }
     if (!parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after for clauses."))
     {
-        freeStmt(initializer);
-        free_expr(condition);
-        free_expr(increment);
         return NULL;
     }
     
@@ -733,19 +715,19 @@ static Stmt * parse_forStatement(Parser *parser)
     
     if (increment != NULL)
     {
-        body = initBlock(stmt_appendTo(body, initExpression(increment)));
+        body = initBlock(stmt_appendTo(body, initExpression(increment, parser->arena)), parser->arena);
     }
     
     if (condition == NULL)
     {
-        condition = init_bool_literal(true);
+        condition = init_bool_literal(true, parser->arena);
     }
     
-    body = initWhile(condition, body);
+    body = initWhile(condition, body, parser->arena);
     
     if (initializer != NULL)
     {
-        body = initBlock(stmt_appendTo(initializer, body));
+        body = initBlock(stmt_appendTo(initializer, body), parser->arena);
     }
     
     return body;
@@ -768,14 +750,12 @@ static Stmt * parse_ifStatement(Parser *parser)
     
     if (!parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after if condition."))
     {
-        free_expr(condition);
         return NULL;
     }
 
     Stmt *thenBranch = parse_statement(parser);
     if(thenBranch == NULL)
     {
-        free_expr(condition);
         return NULL;
     }
 
@@ -785,13 +765,11 @@ static Stmt * parse_ifStatement(Parser *parser)
         elseBranch = parse_statement(parser);
         if(elseBranch == NULL)
         {
-            free_expr(condition);
-            freeStmt(thenBranch);
             return NULL;
         }
     }
     
-    Stmt *result = initIf(condition, thenBranch, elseBranch);
+    Stmt *result = initIf(condition, thenBranch, elseBranch, parser->arena);
     return result;
 }
 
@@ -814,11 +792,10 @@ static Stmt * parse_varDeclaration(Parser *parser)
     
     if (!parser_consume(parser, TT_SEMICOLON, "Expect ';' after variable declaration."))
     {
-        free_expr(initializer);
         return NULL;
     }
 
-    Stmt *result = initVar(name, initializer);
+    Stmt *result = initVar(name, initializer, parser->arena);
     return result;
 }
 
@@ -837,18 +814,16 @@ static Stmt * parse_whileStatement(Parser *parser)
     
     if (!parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after if condition."))
     {
-        free_expr(condition);
         return NULL;
     }
 
     Stmt *body = parse_statement(parser);
     if (body == NULL)
     {
-        free_expr(condition);
         return NULL;
     }
 
-    Stmt *result = initWhile(condition, body);
+    Stmt *result = initWhile(condition, body, parser->arena);
     return (void *)result;
 }
 
@@ -864,6 +839,37 @@ static char *FKErrorName = {"Expect function name."};
 static char *FKErrorParen = {"Expect '(' after function name."};
 static char *FKErrorBody = {"Expect '{' before function body."};
 
+// Skips the body of a function, starting from the token following the
+// opening brace, up to its closing brace, that is consumed. Returns the lazy
+// body, or NULL if the braces do not match.
+static LazyBody * parse_lazyFunctionBody(FunctionKind kind, Parser *parser)
+{
+    Token *start = parser->current;
+    int32_t depth = 1;
+    while (!parser_isAtEnd(parser))
+    {
+        TokenType type = parser_advance(parser)->type;
+        if (type == TT_LEFT_BRACE)
+        {
+            depth++;
+        }
+        else if (type == TT_RIGHT_BRACE && --depth == 0)
+        {
+            LazyBody *lazyBody = arena_alloc(LazyBody, parser->arena);
+            lazyBody->start = start;
+            lazyBody->source = parser->source;
+            lazyBody->arena = parser->arena;
+            lazyBody->isMethod = (kind == FK_Method);
+            lazyBody->hasSuperclass = (kind == FK_Method) && parser->isInSubclass;
+            lazyBody->optimize = parser->optimize;
+            lazyBody->hadError = false;
+            return lazyBody;
+        }
+    }
+    parser_throwError(parser_peek(parser), "Expect '}' after block.", parser);
+    return NULL;
+}
+
 //  function    → IDENTIFIER "(" parameters? ")" block ;
 static Stmt * parse_function(Parser *parser, FunctionKind kind)
 {
@@ -878,11 +884,7 @@ static Stmt * parse_function(Parser *parser, FunctionKind kind)
         return NULL;
     }
 
-    Token **parameters = lox_allocn(Token*, LOX_MAX_ARG_COUNT);
-    if(parameters == NULL)
-    {
-        fatal_outOfMemory();
-    }
+    Token *parameters[LOX_MAX_ARG_COUNT];
     int32_t parametersCount = 0;
     if (!parser_check(parser, TT_RIGHT_PAREN))
     {
@@ -891,7 +893,6 @@ static Stmt * parse_function(Parser *parser, FunctionKind kind)
             if (parametersCount >= LOX_MAX_ARG_COUNT)
             {
                 parser_throwError(parser_peek(parser), "Cannot have more than " XSTR(LOX_MAX_ARG_COUNT) " parameters.", parser);
-                lox_free(parameters);
                 return NULL;
             }
             
@@ -908,20 +909,34 @@ static Stmt * parse_function(Parser *parser, FunctionKind kind)
     }
     if(!parser_consume(parser, TT_RIGHT_PAREN, "Expect ')' after parameters."))
     {
-        lox_free(parameters);
         return NULL;
     }
 
     if(!parser_consume(parser, TT_LEFT_BRACE, FKErrorBody))
     {
-        lox_free(parameters);
         return NULL;
     }
 
-    Stmt *body = parse_block(parser);
-    // NOTE: if block is NULL, the function has an empty body. This is allowed.
+    Stmt *body = NULL;
+    LazyBody *lazyBody = NULL;
+    if (parser->isLazy && parser->blockDepth == 0)
+    {
+        lazyBody = parse_lazyFunctionBody(kind, parser);
+        if (lazyBody == NULL)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        body = parse_block(parser);
+        // NOTE: if block is NULL, the function has an empty body. This is allowed.
+    }
 
-    Stmt *function = initFunction(name, parameters, parametersCount, body);
+    Token **functionParameters = arena_allocn(Token *, parametersCount, parser->arena);
+    memcpy(functionParameters, parameters, parametersCount * sizeof(Token *));
+    Stmt *function = initFunction(name, functionParameters, parametersCount, body, parser->arena);
+    ((FunctionStmt *)function)->lazyBody = lazyBody;
     return function;
 }
 
@@ -936,7 +951,7 @@ static Stmt * parse_classDeclaration(Parser *parser)
         {
             return NULL;
         }
-        superclass = init_variable(parser_previous(parser));
+        superclass = init_variable(parser_previous(parser), parser->arena);
     }
     
     if ((name == NULL) ||
@@ -946,12 +961,12 @@ static Stmt * parse_classDeclaration(Parser *parser)
     }
     
     Stmt *methods = NULL;
+    parser->isInSubclass = (superclass != NULL);
     while (!parser_check(parser, TT_RIGHT_BRACE) && !parser_isAtEnd(parser))
     {
         Stmt *method = parse_function(parser, FK_Method);
         if (method == NULL)
         {
-            freeStmt(methods);
             return NULL;
         }
         method->next = methods;
@@ -963,7 +978,7 @@ static Stmt * parse_classDeclaration(Parser *parser)
         return NULL;
     }
     
-    Stmt *classStmt = initClass(name, superclass, (FunctionStmt *)methods);
+    Stmt *classStmt = initClass(name, superclass, (FunctionStmt *)methods, parser->arena);
     return classStmt;
 }
 
@@ -1023,11 +1038,39 @@ static Stmt * parse_program(Parser *parser)
     return firstStmt;
 }
 
-Stmt * parse(Token *tokens, const char *source)
+// Parses the tokens of `source`. The syntax tree is allocated in `arena`,
+// and it is freed with it.
+Stmt * parse(Token *tokens, const char *source, Arena *arena)
 {
-    Parser *parser = parser_init(tokens, source);
+    Parser *parser = parser_init(tokens, source, arena);
     Stmt *statements = parse_program(parser);
     parser_free(parser);
     
     return statements;
 }
+
+// Parses the tokens of `source` as parse(), but skips the bodies of the
+// functions and methods declared at the top level, that are only parsed by
+// parse_lazyBody() when they are first called. So a syntax error in a body
+// is only reported if the function is called. `optimize` tells if the
+// bodies must be optimized once parsed.
+Stmt * parseLazily(Token *tokens, const char *source, bool optimize, Arena *arena)
+{
+    Parser *parser = parser_init(tokens, source, arena);
+    parser->isLazy = true;
+    parser->optimize = optimize;
+    Stmt *statements = parse_program(parser);
+    parser_free(parser);
+    
+    return statements;
+}
+
+// Parses the body of a function declared lazily.
+Stmt * parse_lazyBody(const LazyBody *lazyBody)
+{
+    Parser *parser = parser_init(lazyBody->start, lazyBody->source, lazyBody->arena);
+    Stmt *body = parse_block(parser);
+    parser_free(parser);
+    
+    return body;
+}
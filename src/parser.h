@@ -57,6 +57,8 @@
 #include "token.h"
 #include "stmt.h"
 
-Stmt * parse(Token *tokens, const char *source);
+Stmt * parse(Token *tokens, const char *source, Arena *arena);
+Stmt * parseLazily(Token *tokens, const char *source, bool optimize, Arena *arena);
+Stmt * parse_lazyBody(const LazyBody *lazyBody);
 
 #endif /* parser_h */
@@ -0,0 +1,346 @@
+//
+//  profiler.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "profiler.h"
+
+#include "utility.h"
+
+#include <string.h>
+
+// Returns a copy of the array `items` of `count` elements of `itemSize`
+// bytes, with twice the capacity `*capacity`, and frees it.
+static void * profiler_grow(void *items, int32_t count, int32_t *capacity, size_t itemSize)
+{
+    int32_t newCapacity = 2 * *capacity;
+    uint8_t *grown = lox_allocn(uint8_t, (size_t)newCapacity * itemSize);
+    if (grown == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memcpy(grown, items, (size_t)count * itemSize);
+    lox_free(items);
+    *capacity = newCapacity;
+    return grown;
+}
+
+static inline uint32_t profiler_hashFunction(const FunctionStmt *function)
+{
+    uintptr_t address = (uintptr_t)function;
+    return (uint32_t)((address >> 3) * 2654435761u);
+}
+
+static int32_t * profiler_allocTable(int32_t capacity)
+{
+    int32_t *table = lox_allocn(int32_t, capacity);
+    if (table == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    for (int32_t i = 0; i < capacity; i++)
+    {
+        table[i] = -1;
+    }
+    return table;
+}
+
+// Returns the slot of the table of `profiler` for `function`: the slot of its
+// entry, or the empty slot where it should be inserted.
+static int32_t profiler_tableSlot(const FunctionStmt *function, const int32_t *table, int32_t capacity, const ProfileEntry *entries)
+{
+    int32_t mask = capacity - 1;
+    int32_t slot = (int32_t)(profiler_hashFunction(function) & (uint32_t)mask);
+    while (table[slot] != -1 && entries[table[slot]].function != function)
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int32_t profiler_addEntry(const FunctionStmt *function, Profiler *profiler)
+{
+    if (profiler->entriesCount == profiler->entriesCapacity)
+    {
+        profiler->entries = profiler_grow(profiler->entries, profiler->entriesCount, &profiler->entriesCapacity, sizeof(ProfileEntry));
+    }
+    int32_t index = profiler->entriesCount++;
+    ProfileEntry *entry = &profiler->entries[index];
+    entry->function = function;
+    entry->callsCount = 0;
+    entry->inclusiveTime = 0;
+    entry->selfTime = 0;
+    entry->allocationsCount = 0;
+    entry->activeCount = 0;
+    return index;
+}
+
+// Returns the index of the entry of `function`, that is created the first
+// time the function is called.
+static int32_t profiler_entryIndex(const FunctionStmt *function, Profiler *profiler)
+{
+    int32_t slot = profiler_tableSlot(function, profiler->table, profiler->tableCapacity, profiler->entries);
+    if (profiler->table[slot] != -1)
+    {
+        return profiler->table[slot];
+    }
+    // NOTE: the load factor is kept below 1/2
+    if (2 * (profiler->entriesCount + 1) > profiler->tableCapacity)
+    {
+        int32_t capacity = 2 * profiler->tableCapacity;
+        int32_t *table = profiler_allocTable(capacity);
+        for (int32_t i = 0; i < profiler->tableCapacity; i++)
+        {
+            int32_t index = profiler->table[i];
+            if (index != -1)
+            {
+                table[profiler_tableSlot(profiler->entries[index].function, table, capacity, profiler->entries)] = index;
+            }
+        }
+        lox_free(profiler->table);
+        profiler->table = table;
+        profiler->tableCapacity = capacity;
+        slot = profiler_tableSlot(function, table, capacity, profiler->entries);
+    }
+    int32_t index = profiler_addEntry(function, profiler);
+    profiler->table[slot] = index;
+    return index;
+}
+
+static int32_t profiler_addNode(int32_t entry, int32_t parent, Profiler *profiler)
+{
+    if (profiler->nodesCount == profiler->nodesCapacity)
+    {
+        profiler->nodes = profiler_grow(profiler->nodes, profiler->nodesCount, &profiler->nodesCapacity, sizeof(ProfileNode));
+    }
+    int32_t index = profiler->nodesCount++;
+    ProfileNode *node = &profiler->nodes[index];
+    node->entry = entry;
+    node->parent = parent;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    node->selfTime = 0;
+    if (parent != -1)
+    {
+        node->nextSibling = profiler->nodes[parent].firstChild;
+        profiler->nodes[parent].firstChild = index;
+    }
+    return index;
+}
+
+// Returns the node of the call stack made of the stack `parent` followed by
+// a call of the function of `entry`.
+static int32_t profiler_childNode(int32_t parent, int32_t entry, Profiler *profiler)
+{
+    for (int32_t child = profiler->nodes[parent].firstChild; child != -1; child = profiler->nodes[child].nextSibling)
+    {
+        if (profiler->nodes[child].entry == entry)
+        {
+            return child;
+        }
+    }
+    return profiler_addNode(entry, parent, profiler);
+}
+
+static void profiler_pushFrame(int32_t entry, int32_t node, Profiler *profiler)
+{
+    if (profiler->framesCount == profiler->framesCapacity)
+    {
+        profiler->frames = profiler_grow(profiler->frames, profiler->framesCount, &profiler->framesCapacity, sizeof(ProfileFrame));
+    }
+    ProfileFrame *frame = &profiler->frames[profiler->framesCount++];
+    frame->entry = entry;
+    frame->node = node;
+    frame->childrenTime = 0;
+    frame->childrenAllocations = 0;
+    ++profiler->entries[entry].callsCount;
+    ++profiler->entries[entry].activeCount;
+    // NOTE: the time is taken last, so that it does not include the
+    //       bookkeeping of the profiler.
+    frame->startAllocations = profiler->collector->stats.allocatedObjectsCount;
+    frame->startTime = timer_nanoSec();
+}
+
+// Creates a profiler, that starts recording the top-level code. The
+// allocations are counted by `collector`.
+Profiler * profiler_init(const GarbageCollector *collector)
+{
+    Profiler *profiler = lox_alloc(Profiler);
+    if (profiler == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    profiler->collector = collector;
+    profiler->entriesCount = 0;
+    profiler->entriesCapacity = PROFILER_INITIAL_CAPACITY;
+    profiler->entries = lox_allocn(ProfileEntry, PROFILER_INITIAL_CAPACITY);
+    profiler->tableCapacity = PROFILER_INITIAL_CAPACITY;
+    profiler->table = profiler_allocTable(PROFILER_INITIAL_CAPACITY);
+    profiler->nodesCount = 0;
+    profiler->nodesCapacity = PROFILER_INITIAL_CAPACITY;
+    profiler->nodes = lox_allocn(ProfileNode, PROFILER_INITIAL_CAPACITY);
+    profiler->framesCount = 0;
+    profiler->framesCapacity = PROFILER_INITIAL_CAPACITY;
+    profiler->frames = lox_allocn(ProfileFrame, PROFILER_INITIAL_CAPACITY);
+    if (profiler->entries == NULL || profiler->nodes == NULL || profiler->frames == NULL)
+    {
+        fatal_outOfMemory();
+    }
+
+    int32_t script = profiler_entryIndex(NULL, profiler);
+    int32_t root = profiler_addNode(script, -1, profiler);
+    profiler_pushFrame(script, root, profiler);
+    return profiler;
+}
+
+void profiler_free(Profiler *profiler)
+{
+    lox_free(profiler->entries);
+    lox_free(profiler->table);
+    lox_free(profiler->nodes);
+    lox_free(profiler->frames);
+    lox_free(profiler);
+}
+
+// Records the start of a call of `function`.
+void profiler_enter(const FunctionStmt *function, Profiler *profiler)
+{
+    assert(profiler->framesCount > 0);
+    int32_t entry = profiler_entryIndex(function, profiler);
+    int32_t parentNode = profiler->frames[profiler->framesCount - 1].node;
+    int32_t node = profiler_childNode(parentNode, entry, profiler);
+    profiler_pushFrame(entry, node, profiler);
+}
+
+// Records the end of the innermost call.
+void profiler_exit(Profiler *profiler)
+{
+    uint64_t endTime = timer_nanoSec();
+    uint64_t endAllocations = profiler->collector->stats.allocatedObjectsCount;
+    assert(profiler->framesCount > 0);
+    ProfileFrame *frame = &profiler->frames[--profiler->framesCount];
+    uint64_t elapsed = endTime - frame->startTime;
+    uint64_t allocations = endAllocations - frame->startAllocations;
+
+    ProfileEntry *entry = &profiler->entries[frame->entry];
+    uint64_t selfTime = elapsed > frame->childrenTime ? elapsed - frame->childrenTime : 0;
+    entry->selfTime += selfTime;
+    entry->allocationsCount += allocations - frame->childrenAllocations;
+    if (--entry->activeCount == 0)
+    {
+        entry->inclusiveTime += elapsed;
+    }
+    profiler->nodes[frame->node].selfTime += selfTime;
+
+    if (profiler->framesCount > 0)
+    {
+        ProfileFrame *caller = &profiler->frames[profiler->framesCount - 1];
+        caller->childrenTime += elapsed;
+        caller->childrenAllocations += allocations;
+    }
+}
+
+// Ends the calls that are still recorded, e.g. when the program is
+// interrupted by a runtime error, and the top-level code.
+void profiler_finish(Profiler *profiler)
+{
+    while (profiler->framesCount > 0)
+    {
+        profiler_exit(profiler);
+    }
+}
+
+// Writes in `buffer` the name of the function of `entry`, followed by the
+// line of its declaration.
+static void profiler_entryName(const ProfileEntry *entry, char *buffer, size_t size)
+{
+    if (entry->function == NULL)
+    {
+        snprintf(buffer, size, "<script>");
+    }
+    else
+    {
+        const Token *name = entry->function->name;
+        snprintf(buffer, size, "%s:%d", get_identifier_name(name), name->lexeme.line + 1);
+    }
+}
+
+static thread_global const ProfileEntry *profiler_sortedEntries;
+
+static int profiler_compareSelfTime(const void *a, const void *b)
+{
+    const ProfileEntry *entryA = &profiler_sortedEntries[*(const int32_t *)a];
+    const ProfileEntry *entryB = &profiler_sortedEntries[*(const int32_t *)b];
+    return (entryA->selfTime < entryB->selfTime) - (entryA->selfTime > entryB->selfTime);
+}
+
+// Prints on `file` the entries of `profiler`, sorted by self time.
+void profiler_printReport(FILE *file, const Profiler *profiler)
+{
+    int32_t *order = lox_allocn(int32_t, profiler->entriesCount);
+    if (order == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    uint64_t totalTime = 0;
+    for (int32_t i = 0; i < profiler->entriesCount; i++)
+    {
+        order[i] = i;
+        totalTime += profiler->entries[i].selfTime;
+    }
+    profiler_sortedEntries = profiler->entries;
+    qsort(order, (size_t)profiler->entriesCount, sizeof(int32_t), profiler_compareSelfTime);
+
+    fprintf(file, "%12s %12s %12s %7s %12s  %s\n", "calls", "self (ms)", "total (ms)", "self %", "allocations", "function");
+    for (int32_t i = 0; i < profiler->entriesCount; i++)
+    {
+        const ProfileEntry *entry = &profiler->entries[order[i]];
+        char name[256];
+        profiler_entryName(entry, name, sizeof(name));
+        double percent = totalTime > 0 ? 100.0 * (double)entry->selfTime / (double)totalTime : 0.0;
+        fprintf(file, "%12lld %12.3f %12.3f %7.2f %12llu  %s\n", (long long)entry->callsCount,
+                (double)entry->selfTime / 1e6, (double)entry->inclusiveTime / 1e6, percent,
+                (unsigned long long)entry->allocationsCount, name);
+    }
+    lox_free(order);
+}
+
+// Writes to `file` the names of the call stack ending in `node`, from the
+// outermost call, separated by semicolons.
+static void profiler_writeStack(FILE *file, int32_t node, const Profiler *profiler)
+{
+    const ProfileNode *current = &profiler->nodes[node];
+    if (current->parent != -1)
+    {
+        profiler_writeStack(file, current->parent, profiler);
+        fputc(';', file);
+    }
+    char name[256];
+    profiler_entryName(&profiler->entries[current->entry], name, sizeof(name));
+    fputs(name, file);
+}
+
+// Writes to the file `filename` the self time of each call stack in
+// microseconds, in the collapsed stacks format of flame graphs: one line per
+// stack, with the names of the calls separated by semicolons, followed by
+// the time. Returns false if the file could not be written.
+bool profiler_writeCollapsedStacks(const char *filename, const Profiler *profiler)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+    for (int32_t node = 0; node < profiler->nodesCount; node++)
+    {
+        uint64_t microseconds = profiler->nodes[node].selfTime / 1000;
+        if (microseconds > 0)
+        {
+            profiler_writeStack(file, node, profiler);
+            fprintf(file, " %llu\n", (unsigned long long)microseconds);
+        }
+    }
+    return fclose(file) == 0;
+}
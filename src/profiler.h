@@ -0,0 +1,91 @@
+//
+//  profiler.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef profiler_h
+#define profiler_h
+
+#include "garbage_collector.h"
+#include "stmt.h"
+
+#include <stdio.h>
+
+/*
+ The profiler records, for each Lox function and method, the number of
+ calls, the time spent in the calls (inclusive time) and the time spent in
+ the calls excluding the functions they call (self time), and the number
+ of objects allocated by the function itself. The time of the top-level code
+ is attributed to the "<script>" entry.
+ The profiler also keeps the tree of the call stacks, with the self time of
+ each stack, that can be written as collapsed stacks for flame graphs.
+ The calls are recorded by the interpreter and by the virtual machine when
+ `interpreter->profiler` is not NULL.
+ */
+
+typedef struct
+{
+    // NOTE: NULL for the top-level code
+    const FunctionStmt *function;
+    int64_t callsCount;
+    uint64_t inclusiveTime;
+    uint64_t selfTime;
+    uint64_t allocationsCount;
+    // NOTE: number of calls of the function in the current call stack, so
+    //       that the inclusive time of recursive calls is counted once.
+    int32_t activeCount;
+} ProfileEntry;
+
+// NOTE: node of the tree of the call stacks
+typedef struct
+{
+    int32_t entry;
+    int32_t parent;
+    int32_t firstChild;
+    int32_t nextSibling;
+    uint64_t selfTime;
+} ProfileNode;
+
+typedef struct
+{
+    int32_t entry;
+    int32_t node;
+    uint64_t startTime;
+    uint64_t childrenTime;
+    uint64_t startAllocations;
+    uint64_t childrenAllocations;
+} ProfileFrame;
+
+typedef struct Profiler_tag
+{
+    ProfileEntry *entries;
+    int32_t entriesCount;
+    int32_t entriesCapacity;
+
+    // NOTE: hash table of the indices of the entries of the functions, with
+    //       linear probing; -1 for the empty slots.
+    int32_t *table;
+    int32_t tableCapacity;
+
+    ProfileNode *nodes;
+    int32_t nodesCount;
+    int32_t nodesCapacity;
+
+    ProfileFrame *frames;
+    int32_t framesCount;
+    int32_t framesCapacity;
+
+    const GarbageCollector *collector;
+} Profiler;
+
+Profiler * profiler_init(const GarbageCollector *collector);
+void profiler_free(Profiler *profiler);
+void profiler_enter(const FunctionStmt *function, Profiler *profiler);
+void profiler_exit(Profiler *profiler);
+void profiler_finish(Profiler *profiler);
+void profiler_printReport(FILE *file, const Profiler *profiler);
+bool profiler_writeCollapsedStacks(const char *filename, const Profiler *profiler);
+
+#endif /* profiler_h */
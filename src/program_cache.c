@@ -0,0 +1,1886 @@
+//
+//  program_cache.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "program_cache.h"
+
+#include "common.h"
+#include "environment.h"
+#include "lox_array.h"
+#include "lox_class.h"
+#include "lox_function.h"
+#include "lox_instance.h"
+#include "lox_map.h"
+#include "string.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ The cache file is made of a header, followed by the nodes of the syntax
+ tree in pre-order. Each node starts with a byte with its type, or with
+ CACHE_NULL_TAG for a missing node; the lists of statements and of arguments
+ are terminated by CACHE_NULL_TAG. The tokens are stored with their lexeme,
+ so that the errors report the same location, and with their literal.
+ The slots of the global variables are not stored: they are assigned again
+ when the tree is loaded, as they depend on the globals already defined.
+ All the values are stored in the byte order of the machine; a cache written
+ on a machine with a different byte order does not match CACHE_MAGIC.
+ The hash of the payload detects a truncated or corrupt file, and the reader
+ checks that the data is a well formed tree. The resolved slots are trusted
+ as the source is: they are not resolved again.
+ */
+
+#define CACHE_MAGIC 0x434f4c58 // "XLOC" in little endian
+#define CACHE_NULL_TAG 0xff
+
+#define CACHE_FLAG_OPTIMIZED 1u
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t sourceLength;
+    uint64_t sourceHash;
+    uint64_t payloadSize;
+    uint64_t payloadHash;
+} CacheHeader;
+
+// Returns the 64 bit FNV-1a hash of the `count` bytes at `bytes`.
+static uint64_t cache_hash(const uint8_t *bytes, size_t count)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < count; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Returns the path of the cache file of the script `filename`, i.e. the path
+// of the script with the extension CACHE_FILE_EXTENSION in place of ".lox".
+// The returned string must be freed with str_free().
+char * cache_pathForScript(const char *filename)
+{
+    size_t length = strlen(filename);
+    const char *extension = ".lox";
+    size_t extensionLength = strlen(extension);
+    if (length >= extensionLength && strcmp(filename + length - extensionLength, extension) == 0)
+    {
+        length -= extensionLength;
+    }
+    char *path = str_substring(filename, substring(0, (str_size)length));
+    str_appendLiteral(path, CACHE_FILE_EXTENSION);
+    return path;
+}
+
+/**********/
+/* Writer */
+/**********/
+
+typedef struct
+{
+    uint8_t *bytes;
+    size_t count;
+    size_t capacity;
+} CacheWriter;
+
+static void writeBytes(const void *bytes, size_t count, CacheWriter *writer)
+{
+    if (writer->count + count > writer->capacity)
+    {
+        size_t capacity = max(2 * writer->capacity, writer->count + count);
+        uint8_t *grown = lox_allocn(uint8_t, capacity);
+        if (grown == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        if (writer->bytes != NULL)
+        {
+            memcpy(grown, writer->bytes, writer->count);
+            lox_free(writer->bytes);
+        }
+        writer->bytes = grown;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->bytes + writer->count, bytes, count);
+    writer->count += count;
+}
+
+static inline void writeU8(uint8_t value, CacheWriter *writer)
+{
+    writeBytes(&value, sizeof(value), writer);
+}
+
+static inline void writeU32(uint32_t value, CacheWriter *writer)
+{
+    writeBytes(&value, sizeof(value), writer);
+}
+
+static inline void writeI32(int32_t value, CacheWriter *writer)
+{
+    writeBytes(&value, sizeof(value), writer);
+}
+
+static inline void writeDouble(double value, CacheWriter *writer)
+{
+    writeBytes(&value, sizeof(value), writer);
+}
+
+static void writeString(const char *string, CacheWriter *writer)
+{
+    str_size length = str_length(string);
+    writeU32(length, writer);
+    writeBytes(string, length, writer);
+}
+
+static void writeToken(const Token *token, CacheWriter *writer)
+{
+    if (token == NULL)
+    {
+        writeU8(CACHE_NULL_TAG, writer);
+        return;
+    }
+    writeU8((uint8_t)token->type, writer);
+    writeU32(token->lexeme.start, writer);
+    writeU32(token->lexeme.count, writer);
+    writeI32(token->lexeme.line, writer);
+    switch (token->type)
+    {
+        case TT_NUMBER:
+            writeDouble(get_number_value(token), writer);
+            break;
+        case TT_STRING:
+            writeString(get_string_value(token), writer);
+            break;
+        case TT_IDENTIFIER:
+            writeString(get_identifier_name(token), writer);
+            break;
+        default:
+            break;
+    }
+}
+
+static inline void writeSlot(VariableSlot slot, CacheWriter *writer)
+{
+    writeI32(slot.depth, writer);
+    writeI32(slot.index, writer);
+}
+
+static void writeExpr(const Expr *expr, CacheWriter *writer);
+
+static void writeExprList(const Expr *expressions, CacheWriter *writer)
+{
+    for (const Expr *expr = expressions; expr != NULL; expr = expr->next)
+    {
+        writeExpr(expr, writer);
+    }
+    writeU8(CACHE_NULL_TAG, writer);
+}
+
+static void writeExpr(const Expr *expr, CacheWriter *writer)
+{
+    if (expr == NULL)
+    {
+        writeU8(CACHE_NULL_TAG, writer);
+        return;
+    }
+    writeU8((uint8_t)expr->type, writer);
+    switch (expr->type)
+    {
+        case EXPR_Assign: {
+            const Assign *assign = (const Assign *)expr;
+            writeToken(assign->name, writer);
+            writeExpr(assign->value, writer);
+            writeSlot(assign->slot, writer);
+        } break;
+        case EXPR_Binary: {
+            const Binary *binary = (const Binary *)expr;
+            writeExpr(binary->left, writer);
+            writeToken(binary->operator, writer);
+            writeExpr(binary->right, writer);
+        } break;
+        case EXPR_Call: {
+            const Call *call = (const Call *)expr;
+            writeExpr(call->callee, writer);
+            writeToken(call->paren, writer);
+            writeExprList(call->arguments, writer);
+        } break;
+        case EXPR_Get: {
+            const Get *get = (const Get *)expr;
+            writeExpr(get->object, writer);
+            writeToken(get->name, writer);
+        } break;
+        case EXPR_Grouping: {
+            const Grouping *grouping = (const Grouping *)expr;
+            writeExpr(grouping->expression, writer);
+        } break;
+        case EXPR_Literal: {
+            const Literal *literal = (const Literal *)expr;
+            writeToken(&literal->value, writer);
+        } break;
+        case EXPR_Logical: {
+            const Logical *logical = (const Logical *)expr;
+            writeExpr(logical->left, writer);
+            writeToken(logical->operator, writer);
+            writeExpr(logical->right, writer);
+        } break;
+        case EXPR_Set: {
+            const Set *set = (const Set *)expr;
+            writeExpr(set->object, writer);
+            writeToken(set->name, writer);
+            writeExpr(set->value, writer);
+        } break;
+        case EXPR_Super: {
+            const Super *super = (const Super *)expr;
+            writeToken(super->keyword, writer);
+            writeToken(super->method, writer);
+            writeSlot(super->slot, writer);
+        } break;
+        case EXPR_This: {
+            const This *this = (const This *)expr;
+            writeToken(this->keyword, writer);
+            writeSlot(this->slot, writer);
+        } break;
+        case EXPR_Unary: {
+            const Unary *unary = (const Unary *)expr;
+            writeToken(unary->operator, writer);
+            writeExpr(unary->right, writer);
+        } break;
+        case EXPR_Variable: {
+            const Variable *variable = (const Variable *)expr;
+            writeToken(variable->name, writer);
+            writeSlot(variable->slot, writer);
+        } break;
+    }
+}
+
+static void writeStmt(const Stmt *stmt, CacheWriter *writer);
+
+static void writeStmtList(const Stmt *statements, CacheWriter *writer)
+{
+    for (const Stmt *stmt = statements; stmt != NULL; stmt = stmt->next)
+    {
+        writeStmt(stmt, writer);
+    }
+    writeU8(CACHE_NULL_TAG, writer);
+}
+
+static void writeStmt(const Stmt *stmt, CacheWriter *writer)
+{
+    if (stmt == NULL)
+    {
+        writeU8(CACHE_NULL_TAG, writer);
+        return;
+    }
+    writeU8((uint8_t)stmt->type, writer);
+    switch (stmt->type)
+    {
+        case STMT_Block: {
+            const BlockStmt *block = (const BlockStmt *)stmt;
+            writeStmtList(block->statements, writer);
+            writeI32(block->slotsCount, writer);
+            writeU8(block->isCaptured, writer);
+        } break;
+        case STMT_Class: {
+            const ClassStmt *classStmt = (const ClassStmt *)stmt;
+            writeToken(classStmt->name, writer);
+            writeExpr(classStmt->superClass, writer);
+            writeStmtList(AS_STMT(classStmt->methods), writer);
+            writeSlot(classStmt->slot, writer);
+        } break;
+        case STMT_Expression: {
+            const ExpressionStmt *expression = (const ExpressionStmt *)stmt;
+            writeExpr(expression->expression, writer);
+        } break;
+        case STMT_Function: {
+            const FunctionStmt *function = (const FunctionStmt *)stmt;
+            writeToken(function->name, writer);
+            writeI32(function->arity, writer);
+            for (int32_t i = 0; i < function->arity; i++)
+            {
+                writeToken(function->parameters[i], writer);
+            }
+            writeStmtList(function->body, writer);
+            writeI32(function->slotsCount, writer);
+            writeU8(function->isCaptured, writer);
+        } break;
+        case STMT_If: {
+            const IfStmt *ifStmt = (const IfStmt *)stmt;
+            writeExpr(ifStmt->condition, writer);
+            writeStmt(ifStmt->thenBranch, writer);
+            writeStmt(ifStmt->elseBranch, writer);
+        } break;
+        case STMT_Print: {
+            const PrintStmt *print = (const PrintStmt *)stmt;
+            writeExpr(print->expression, writer);
+        } break;
+        case STMT_Return: {
+            const ReturnStmt *ret = (const ReturnStmt *)stmt;
+            writeToken(ret->keyword, writer);
+            writeExpr(ret->value, writer);
+        } break;
+        case STMT_Var: {
+            const VarStmt *var = (const VarStmt *)stmt;
+            writeToken(var->name, writer);
+            writeExpr(var->initializer, writer);
+        } break;
+        case STMT_While: {
+            const WhileStmt *whileStmt = (const WhileStmt *)stmt;
+            writeExpr(whileStmt->condition, writer);
+            writeStmt(whileStmt->body, writer);
+        } break;
+    }
+}
+
+// Writes a cache file with `flags` for `source` and the payload of `writer`
+// to `path`. The file is written to a temporary file first, and renamed, so
+// that a concurrent run never loads a partial file.
+static void cache_writeFile(const char *path, uint32_t flags, const char *source, const CacheWriter *writer)
+{
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_FORMAT_VERSION;
+    header.flags = flags;
+    header.sourceLength = str_length(source);
+    header.sourceHash = cache_hash((const uint8_t *)source, header.sourceLength);
+    header.payloadSize = writer->count;
+    header.payloadHash = cache_hash(writer->bytes, writer->count);
+
+    char temporaryPath[1024];
+    int length = snprintf(temporaryPath, sizeof(temporaryPath), "%s.%ld.tmp", path, (long)getpid());
+    if (length > 0 && (size_t)length < sizeof(temporaryPath))
+    {
+        FILE *fp = fopen(temporaryPath, "wb");
+        if (fp != NULL)
+        {
+            bool written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                           fwrite(writer->bytes, writer->count, 1, fp) == 1;
+            written = (fclose(fp) == 0) && written;
+            if (!written || rename(temporaryPath, path) != 0)
+            {
+                remove(temporaryPath);
+            }
+        }
+    }
+}
+
+// Writes the resolved syntax tree `statements` of `source` to the cache file
+// `cachePath`.
+// NOTE: the cache is an optimization, failing to write it is not an error.
+void cache_store(const char *cachePath, const char *source, bool isOptimized, Stmt *statements)
+{
+    CacheWriter writer = {NULL, 0, 0};
+    writeStmtList(statements, &writer);
+    cache_writeFile(cachePath, isOptimized ? CACHE_FLAG_OPTIMIZED : 0, source, &writer);
+    lox_free(writer.bytes);
+}
+
+/**********/
+/* Reader */
+/**********/
+
+typedef struct
+{
+    const uint8_t *current;
+    const uint8_t *end;
+    // NOTE: set when the data is not a valid tree; the following reads
+    //       return zeros.
+    bool failed;
+    str_size sourceLength;
+    Interpreter *interpreter;
+    Arena *arena;
+} CacheReader;
+
+static const uint8_t * readBytes(size_t count, CacheReader *reader)
+{
+    if (reader->failed || (size_t)(reader->end - reader->current) < count)
+    {
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t *bytes = reader->current;
+    reader->current += count;
+    return bytes;
+}
+
+#define DEFINE_READ(name, type)                         \
+static inline type name(CacheReader *reader)            \
+{                                                       \
+    type value = 0;                                     \
+    const uint8_t *bytes = readBytes(sizeof(type), reader); \
+    if (bytes != NULL)                                  \
+    {                                                   \
+        memcpy(&value, bytes, sizeof(type));            \
+    }                                                   \
+    return value;                                       \
+}
+
+DEFINE_READ(readU8, uint8_t)
+DEFINE_READ(readU32, uint32_t)
+DEFINE_READ(readI32, int32_t)
+DEFINE_READ(readDouble, double)
+#undef DEFINE_READ
+
+static inline void failed(CacheReader *reader)
+{
+    reader->failed = true;
+}
+
+// Frees the strings of the literals of a loaded tree with the arena.
+static void cache_freeLiteral(void *data)
+{
+    str_free((char *)data);
+}
+
+static Token * readToken(CacheReader *reader)
+{
+    uint8_t type = readU8(reader);
+    if (type == CACHE_NULL_TAG || reader->failed)
+    {
+        return NULL;
+    }
+    if (type >= TT_EOF)
+    {
+        failed(reader);
+        return NULL;
+    }
+    Token *token = arena_alloc(Token, reader->arena);
+    token->type = (TokenType)type;
+    token->lexeme.start = readU32(reader);
+    token->lexeme.count = readU32(reader);
+    token->lexeme.line = readI32(reader);
+    token->number = 0.0;
+    token->literal = NULL;
+    // NOTE: the errors print the lexeme from the source
+    if (token->lexeme.start > reader->sourceLength ||
+        token->lexeme.count > reader->sourceLength - token->lexeme.start)
+    {
+        failed(reader);
+        return token;
+    }
+    if (type == TT_NUMBER)
+    {
+        token->number = readDouble(reader);
+    }
+    else if (type == TT_STRING || type == TT_IDENTIFIER)
+    {
+        str_size length = readU32(reader);
+        const uint8_t *chars = readBytes(length, reader);
+        if (chars == NULL)
+        {
+            return token;
+        }
+        SubstringIndex index = substring(0, length);
+        if (type == TT_STRING)
+        {
+            token->literal = str_substring((const char *)chars, index);
+            arena_addCleanup(cache_freeLiteral, token->literal, reader->arena);
+        }
+        else
+        {
+            token->literal = str_internSubstring((const char *)chars, index);
+        }
+    }
+    return token;
+}
+
+// Reads a token that must be present.
+static Token * readRequiredToken(CacheReader *reader)
+{
+    Token *token = readToken(reader);
+    if (token == NULL)
+    {
+        failed(reader);
+    }
+    return token;
+}
+
+// Reads the slot of the variable `name`. The slots of the global variables
+// are assigned in the globals of the interpreter, as the resolver does.
+static VariableSlot readSlot(const Token *name, CacheReader *reader)
+{
+    VariableSlot slot;
+    slot.depth = readI32(reader);
+    slot.index = readI32(reader);
+    if (reader->failed)
+    {
+        return VAR_SLOT_UNRESOLVED;
+    }
+    if (slot.depth == VAR_DEPTH_GLOBAL)
+    {
+        if (name == NULL || name->type != TT_IDENTIFIER)
+        {
+            failed(reader);
+            return VAR_SLOT_UNRESOLVED;
+        }
+        slot.index = env_globalSlot(get_identifier_name(name), reader->interpreter->globals);
+        if (slot.index == -1)
+        {
+            failed(reader);
+        }
+    }
+    else if (slot.depth < 0 || slot.index < 0 || slot.index >= ENV_MAX_CAPACITY)
+    {
+        failed(reader);
+    }
+    return slot;
+}
+
+static Expr * readExpr(CacheReader *reader);
+
+static Expr * readExprList(CacheReader *reader)
+{
+    Expr *first = NULL;
+    Expr *last = NULL;
+    Expr *expr;
+    while ((expr = readExpr(reader)) != NULL)
+    {
+        if (last == NULL)
+        {
+            first = expr;
+        }
+        else
+        {
+            last->next = expr;
+        }
+        last = expr;
+    }
+    return first;
+}
+
+// Reads an expression that must be present.
+static Expr * readRequiredExpr(CacheReader *reader)
+{
+    Expr *expr = readExpr(reader);
+    if (expr == NULL)
+    {
+        failed(reader);
+    }
+    return expr;
+}
+
+static Expr * readExpr(CacheReader *reader)
+{
+    uint8_t type = readU8(reader);
+    if (type == CACHE_NULL_TAG || reader->failed)
+    {
+        return NULL;
+    }
+    Arena *arena = reader->arena;
+    Expr *expr = NULL;
+    switch (type)
+    {
+        case EXPR_Assign: {
+            Token *name = readRequiredToken(reader);
+            Expr *value = readRequiredExpr(reader);
+            expr = init_assign(name, value, arena);
+            ((Assign *)expr)->slot = readSlot(name, reader);
+        } break;
+        case EXPR_Binary: {
+            Expr *left = readRequiredExpr(reader);
+            Token *operator = readRequiredToken(reader);
+            Expr *right = readRequiredExpr(reader);
+            expr = init_binary(left, operator, right, arena);
+        } break;
+        case EXPR_Call: {
+            Expr *callee = readRequiredExpr(reader);
+            Token *paren = readRequiredToken(reader);
+            Expr *arguments = readExprList(reader);
+            expr = init_call(callee, paren, arguments, arena);
+        } break;
+        case EXPR_Get: {
+            Expr *object = readRequiredExpr(reader);
+            Token *name = readRequiredToken(reader);
+            expr = init_get(object, name, arena);
+        } break;
+        case EXPR_Grouping: {
+            Expr *expression = readRequiredExpr(reader);
+            expr = init_grouping(expression, arena);
+        } break;
+        case EXPR_Literal: {
+            Token *value = readRequiredToken(reader);
+            if (value == NULL)
+            {
+                return NULL;
+            }
+            if (value->type != TT_NUMBER && value->type != TT_STRING && value->type != TT_TRUE &&
+                value->type != TT_FALSE && value->type != TT_NIL)
+            {
+                failed(reader);
+            }
+            expr = init_literal(value, arena);
+        } break;
+        case EXPR_Logical: {
+            Expr *left = readRequiredExpr(reader);
+            Token *operator = readRequiredToken(reader);
+            Expr *right = readRequiredExpr(reader);
+            expr = init_logical(left, operator, right, arena);
+        } break;
+        case EXPR_Set: {
+            Expr *object = readRequiredExpr(reader);
+            Token *name = readRequiredToken(reader);
+            Expr *value = readRequiredExpr(reader);
+            expr = init_set(object, name, value, arena);
+        } break;
+        case EXPR_Super: {
+            Token *keyword = readRequiredToken(reader);
+            Token *method = readRequiredToken(reader);
+            expr = init_super(keyword, method, arena);
+            ((Super *)expr)->slot = readSlot(keyword, reader);
+        } break;
+        case EXPR_This: {
+            Token *keyword = readRequiredToken(reader);
+            expr = init_this(keyword, arena);
+            ((This *)expr)->slot = readSlot(keyword, reader);
+        } break;
+        case EXPR_Unary: {
+            Token *operator = readRequiredToken(reader);
+            Expr *right = readRequiredExpr(reader);
+            expr = init_unary(operator, right, arena);
+        } break;
+        case EXPR_Variable: {
+            Token *name = readRequiredToken(reader);
+            expr = init_variable(name, arena);
+            ((Variable *)expr)->slot = readSlot(name, reader);
+        } break;
+        default: {
+            failed(reader);
+        } break;
+    }
+    return reader->failed ? NULL : expr;
+}
+
+// Reads the number of slots of the environment of a block or of a call.
+static int32_t readSlotsCount(CacheReader *reader)
+{
+    int32_t slotsCount = readI32(reader);
+    if (slotsCount < 0 || slotsCount > ENV_MAX_CAPACITY)
+    {
+        failed(reader);
+        return 0;
+    }
+    return slotsCount;
+}
+
+static Stmt * readStmt(CacheReader *reader);
+
+static Stmt * readStmtList(CacheReader *reader)
+{
+    Stmt *first = NULL;
+    Stmt *last = NULL;
+    Stmt *stmt;
+    while ((stmt = readStmt(reader)) != NULL)
+    {
+        if (last == NULL)
+        {
+            first = stmt;
+        }
+        else
+        {
+            last->next = stmt;
+        }
+        last = stmt;
+    }
+    return first;
+}
+
+// Reads a statement that must be present.
+static Stmt * readRequiredStmt(CacheReader *reader)
+{
+    Stmt *stmt = readStmt(reader);
+    if (stmt == NULL)
+    {
+        failed(reader);
+    }
+    return stmt;
+}
+
+static Stmt * readStmt(CacheReader *reader)
+{
+    uint8_t type = readU8(reader);
+    if (type == CACHE_NULL_TAG || reader->failed)
+    {
+        return NULL;
+    }
+    Arena *arena = reader->arena;
+    Stmt *stmt = NULL;
+    switch (type)
+    {
+        case STMT_Block: {
+            Stmt *statements = readStmtList(reader);
+            stmt = initBlock(statements, arena);
+            ((BlockStmt *)stmt)->slotsCount = readSlotsCount(reader);
+            ((BlockStmt *)stmt)->isCaptured = readU8(reader) != 0;
+        } break;
+        case STMT_Class: {
+            Token *name = readRequiredToken(reader);
+            Expr *superClass = readExpr(reader);
+            Stmt *methods = readStmtList(reader);
+            for (Stmt *method = methods; method != NULL; method = method->next)
+            {
+                if (method->type != STMT_Function)
+                {
+                    failed(reader);
+                }
+            }
+            stmt = initClass(name, superClass, (FunctionStmt *)methods, arena);
+            ((ClassStmt *)stmt)->slot = readSlot(name, reader);
+        } break;
+        case STMT_Expression: {
+            Expr *expression = readRequiredExpr(reader);
+            stmt = initExpression(expression, arena);
+        } break;
+        case STMT_Function: {
+            Token *name = readRequiredToken(reader);
+            int32_t arity = readI32(reader);
+            if (arity < 0 || arity > LOX_MAX_ARG_COUNT)
+            {
+                failed(reader);
+                return NULL;
+            }
+            Token **parameters = arena_allocn(Token *, arity, arena);
+            for (int32_t i = 0; i < arity; i++)
+            {
+                parameters[i] = readRequiredToken(reader);
+            }
+            Stmt *body = readStmtList(reader);
+            stmt = initFunction(name, parameters, arity, body, arena);
+            ((FunctionStmt *)stmt)->slotsCount = readSlotsCount(reader);
+            ((FunctionStmt *)stmt)->isCaptured = readU8(reader) != 0;
+        } break;
+        case STMT_If: {
+            Expr *condition = readRequiredExpr(reader);
+            Stmt *thenBranch = readRequiredStmt(reader);
+            Stmt *elseBranch = readStmt(reader);
+            stmt = initIf(condition, thenBranch, elseBranch, arena);
+        } break;
+        case STMT_Print: {
+            Expr *expression = readRequiredExpr(reader);
+            stmt = initPrint(expression, arena);
+        } break;
+        case STMT_Return: {
+            Token *keyword = readRequiredToken(reader);
+            Expr *value = readExpr(reader);
+            stmt = initReturn(keyword, value, arena);
+        } break;
+        case STMT_Var: {
+            Token *name = readRequiredToken(reader);
+            Expr *initializer = readExpr(reader);
+            stmt = initVar(name, initializer, arena);
+        } break;
+        case STMT_While: {
+            Expr *condition = readRequiredExpr(reader);
+            Stmt *body = readRequiredStmt(reader);
+            stmt = initWhile(condition, body, arena);
+        } break;
+        default: {
+            failed(reader);
+        } break;
+    }
+    return reader->failed ? NULL : stmt;
+}
+
+// Maps the cache file `path`, and returns its payload, or NULL if there is
+// no such file, or if it was not written with `flags` for `source`, or if it
+// is corrupt. The file must be released with munmap() of the `mappedSize`
+// bytes at `*mapping`.
+static const uint8_t * cache_mapFile(const char *path, uint32_t flags, const char *source, const uint8_t **mapping, size_t *mappedSize, size_t *payloadSize)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    const uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    const uint8_t *payload = data + sizeof(header);
+    str_size sourceLength = str_length(source);
+    if (header.magic == CACHE_MAGIC &&
+        header.version == CACHE_FORMAT_VERSION &&
+        header.flags == flags &&
+        header.sourceLength == sourceLength &&
+        header.payloadSize == size - sizeof(header) &&
+        header.sourceHash == cache_hash((const uint8_t *)source, sourceLength) &&
+        header.payloadHash == cache_hash(payload, (size_t)header.payloadSize))
+    {
+        *mapping = data;
+        *mappedSize = size;
+        *payloadSize = (size_t)header.payloadSize;
+        return payload;
+    }
+    munmap((void *)data, size);
+    return NULL;
+}
+
+// Loads from the cache file `cachePath` the syntax tree of `source` in
+// `*statements`, allocated in `arena`. Returns false if there is no cache,
+// or if it does not match `source` and `isOptimized`, or if it is corrupt.
+// NOTE: if it returns false, `arena` may contain part of the tree.
+bool cache_load(const char *cachePath, const char *source, bool isOptimized, Stmt **statements, Interpreter *interpreter, Arena *arena)
+{
+    const uint8_t *mapping;
+    size_t mappedSize;
+    size_t payloadSize;
+    const uint8_t *payload = cache_mapFile(cachePath, isOptimized ? CACHE_FLAG_OPTIMIZED : 0, source, &mapping, &mappedSize, &payloadSize);
+    if (payload == NULL)
+    {
+        return false;
+    }
+    CacheReader reader = {payload, payload + payloadSize, false, str_length(source), interpreter, arena};
+    *statements = readStmtList(&reader);
+    bool loaded = !reader.failed && reader.current == reader.end;
+    munmap((void *)mapping, mappedSize);
+    return loaded;
+}
+
+/*****************/
+/* Heap snapshot */
+/*****************/
+
+/*
+ A snapshot is a cache file of a prelude, whose payload is the tree of the
+ prelude followed by the heap that is reachable from the globals once the
+ prelude has run. The heap is a list of nodes, i.e. objects, classes and
+ environments, grouped by kind in the order of SnapshotKind: a node is
+ created after the nodes it needs to exist, e.g. the classes after their
+ superclass and the environments of their methods, and the instances after
+ their class. The arrays and the maps come last, and their values and keys
+ are links. Once all the nodes exist, their references to the other nodes
+ are linked; the garbage collector is paused meanwhile, as the nodes are not
+ reachable yet.
+ The functions refer to their declaration by its index in the pre-order of
+ the function declarations of the tree, and the native functions by their
+ name. A heap that holds other state, e.g. an environment on the frame
+ stack or a native function that is not a global, is not stored.
+ */
+
+#define CACHE_FLAG_SNAPSHOT 2u
+
+// NOTE: reference to the global environment
+#define SNAPSHOT_GLOBALS -1
+
+// NOTE: tags of the values: the immediate values are stored as their bits
+#define SNAPSHOT_IMMEDIATE 0
+#define SNAPSHOT_REFERENCE 1
+
+typedef enum
+{
+    SNAPSHOT_STRING,
+    SNAPSHOT_NATIVE,
+    SNAPSHOT_ENVIRONMENT,
+    SNAPSHOT_FUNCTION,
+    SNAPSHOT_CLASS,
+    SNAPSHOT_INSTANCE,
+    SNAPSHOT_ARRAY,
+    SNAPSHOT_MAP,
+    SNAPSHOT_KINDS_COUNT
+} SnapshotKind;
+
+// Returns the path of the snapshot of the prelude `filename`, as the path of
+// its cache file with SNAPSHOT_FILE_EXTENSION in place of ".lox".
+char * cache_pathForSnapshot(const char *filename)
+{
+    char *path = cache_pathForScript(filename);
+    str_size length = str_length(path) - (str_size)strlen(CACHE_FILE_EXTENSION);
+    char *snapshotPath = str_substring(path, substring(0, length));
+    str_appendLiteral(snapshotPath, SNAPSHOT_FILE_EXTENSION);
+    str_free(path);
+    return snapshotPath;
+}
+
+/* Function declarations */
+
+typedef struct
+{
+    FunctionStmt **functions;
+    int32_t count;
+    int32_t capacity;
+} FunctionList;
+
+static void snapshot_addFunction(FunctionStmt *function, void *context)
+{
+    FunctionList *list = (FunctionList *)context;
+    if (list->count == list->capacity)
+    {
+        int32_t capacity = list->capacity == 0 ? 64 : 2 * list->capacity;
+        FunctionStmt **functions = lox_allocn(FunctionStmt *, capacity);
+        if (functions == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        if (list->functions != NULL)
+        {
+            memcpy(functions, list->functions, (size_t)list->count * sizeof(FunctionStmt *));
+            lox_free(list->functions);
+        }
+        list->functions = functions;
+        list->capacity = capacity;
+    }
+    list->functions[list->count++] = function;
+}
+
+// Adds the function declarations of `statements` to `list`, in pre-order.
+static inline void snapshot_listFunctions(Stmt *statements, FunctionList *list)
+{
+    stmt_forEachFunction(statements, snapshot_addFunction, list);
+}
+
+/* Map of pointers */
+
+typedef struct
+{
+    const void *key;
+    int32_t value;
+} SnapshotMapEntry;
+
+// NOTE: hash table with linear probing; the capacity is a power of 2.
+typedef struct
+{
+    SnapshotMapEntry *entries;
+    int32_t count;
+    int32_t capacity;
+} SnapshotMap;
+
+static SnapshotMapEntry * snapshot_mapEntry(const void *key, const SnapshotMap *map)
+{
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    uint32_t index = (uint32_t)(((uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (map->entries[index].key != NULL && map->entries[index].key != key)
+    {
+        index = (index + 1) & mask;
+    }
+    return &map->entries[index];
+}
+
+static void snapshot_mapInit(SnapshotMap *map)
+{
+    map->count = 0;
+    map->capacity = 256;
+    map->entries = lox_allocn(SnapshotMapEntry, map->capacity);
+    if (map->entries == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memset(map->entries, 0, (size_t)map->capacity * sizeof(SnapshotMapEntry));
+}
+
+static void snapshot_mapFree(SnapshotMap *map)
+{
+    lox_free(map->entries);
+}
+
+// Returns the value of `key`, or -1 if the map does not have it.
+static int32_t snapshot_mapGet(const void *key, const SnapshotMap *map)
+{
+    const SnapshotMapEntry *entry = snapshot_mapEntry(key, map);
+    return entry->key != NULL ? entry->value : -1;
+}
+
+static void snapshot_mapPut(const void *key, int32_t value, SnapshotMap *map)
+{
+    if (2 * (map->count + 1) > map->capacity)
+    {
+        SnapshotMap grown = {NULL, 0, 2 * map->capacity};
+        grown.entries = lox_allocn(SnapshotMapEntry, grown.capacity);
+        if (grown.entries == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        memset(grown.entries, 0, (size_t)grown.capacity * sizeof(SnapshotMapEntry));
+        for (int32_t index = 0; index < map->capacity; ++index)
+        {
+            if (map->entries[index].key != NULL)
+            {
+                *snapshot_mapEntry(map->entries[index].key, &grown) = map->entries[index];
+            }
+        }
+        grown.count = map->count;
+        lox_free(map->entries);
+        *map = grown;
+    }
+    SnapshotMapEntry *entry = snapshot_mapEntry(key, map);
+    if (entry->key == NULL)
+    {
+        entry->key = key;
+        ++map->count;
+    }
+    entry->value = value;
+}
+
+/* Snapshot writer */
+
+typedef struct
+{
+    // NOTE: the object, or the class or the environment
+    const void *pointer;
+    SnapshotKind kind;
+    // NOTE: position of the node in the snapshot
+    int32_t id;
+    // NOTE: length of the chain of superclasses of a class
+    int32_t depth;
+} SnapshotNode;
+
+typedef struct
+{
+    SnapshotNode *nodes;
+    int32_t count;
+    int32_t capacity;
+    // NOTE: maps the pointers of the nodes to their index in `nodes`
+    SnapshotMap indices;
+    // NOTE: maps the function declarations to their index in the tree
+    SnapshotMap functions;
+    const Interpreter *interpreter;
+    bool failed;
+} SnapshotWriter;
+
+static void snapshot_addNode(const void *pointer, SnapshotKind kind, SnapshotWriter *snapshot)
+{
+    if (snapshot_mapGet(pointer, &snapshot->indices) != -1)
+    {
+        return;
+    }
+    if (snapshot->count == snapshot->capacity)
+    {
+        int32_t capacity = snapshot->capacity == 0 ? 256 : 2 * snapshot->capacity;
+        SnapshotNode *nodes = lox_allocn(SnapshotNode, capacity);
+        if (nodes == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        if (snapshot->nodes != NULL)
+        {
+            memcpy(nodes, snapshot->nodes, (size_t)snapshot->count * sizeof(SnapshotNode));
+            lox_free(snapshot->nodes);
+        }
+        snapshot->nodes = nodes;
+        snapshot->capacity = capacity;
+    }
+    snapshot_mapPut(pointer, snapshot->count, &snapshot->indices);
+    snapshot->nodes[snapshot->count++] = (SnapshotNode){pointer, kind, 0, 0};
+}
+
+static void snapshot_visitValue(Value value, SnapshotWriter *snapshot)
+{
+    if (!val_isObject(value))
+    {
+        return;
+    }
+    const Object *object = val_asObject(value);
+    switch (object->type)
+    {
+        case OT_STRING:
+        case OT_STRING_VIEW:
+            snapshot_addNode(object, SNAPSHOT_STRING, snapshot);
+            break;
+        case OT_CALLABLE:
+            snapshot_addNode(object, SNAPSHOT_NATIVE, snapshot);
+            break;
+        case OT_CLASS:
+            snapshot_addNode(object->klass, SNAPSHOT_CLASS, snapshot);
+            break;
+        case OT_FUNCTION:
+            snapshot_addNode(object, SNAPSHOT_FUNCTION, snapshot);
+            break;
+        case OT_INSTANCE:
+            snapshot_addNode(object, SNAPSHOT_INSTANCE, snapshot);
+            break;
+        case OT_ARRAY:
+            snapshot_addNode(object, SNAPSHOT_ARRAY, snapshot);
+            break;
+        case OT_MAP:
+            snapshot_addNode(object, SNAPSHOT_MAP, snapshot);
+            break;
+        default:
+            snapshot->failed = true;
+            break;
+    }
+}
+
+static void snapshot_visitEnvironment(const Environment *environment, SnapshotWriter *snapshot)
+{
+    if (environment != snapshot->interpreter->globals)
+    {
+        snapshot_addNode(environment, SNAPSHOT_ENVIRONMENT, snapshot);
+    }
+}
+
+static void snapshot_visitFunction(const LoxFunction *function, SnapshotWriter *snapshot)
+{
+    if (snapshot_mapGet(function->declaration, &snapshot->functions) == -1)
+    {
+        snapshot->failed = true;
+    }
+    snapshot_visitEnvironment(function->closure, snapshot);
+    snapshot_visitValue(function->receiver, snapshot);
+}
+
+// Adds the nodes referenced by the node `index`.
+static void snapshot_scanNode(int32_t index, SnapshotWriter *snapshot)
+{
+    const SnapshotNode *node = &snapshot->nodes[index];
+    switch (node->kind)
+    {
+        case SNAPSHOT_ENVIRONMENT: {
+            const Environment *environment = node->pointer;
+            if (environment->isFrame || environment->enclosing == NULL)
+            {
+                snapshot->failed = true;
+                break;
+            }
+            snapshot_visitEnvironment(environment->enclosing, snapshot);
+            for (int32_t slot = 0; slot < environment->slotsUsed; ++slot)
+            {
+                snapshot_visitValue(environment->values[slot], snapshot);
+            }
+        } break;
+        case SNAPSHOT_FUNCTION:
+            snapshot_visitFunction(((const Object *)node->pointer)->function, snapshot);
+            break;
+        case SNAPSHOT_CLASS: {
+            const LoxClass *klass = node->pointer;
+            if (klass->superClass != NULL)
+            {
+                snapshot_addNode(klass->superClass, SNAPSHOT_CLASS, snapshot);
+            }
+            for (int32_t method = 0; method < klass->methodsCount; ++method)
+            {
+                snapshot_visitFunction(klass->methods[method].function, snapshot);
+            }
+        } break;
+        case SNAPSHOT_INSTANCE: {
+            const LoxInstance *instance = ((const Object *)node->pointer)->instance;
+            snapshot_addNode(instance->klass, SNAPSHOT_CLASS, snapshot);
+            for (int32_t field = 0; field < instanceFieldsCount(instance); ++field)
+            {
+                snapshot_visitValue(instance->fields[field], snapshot);
+            }
+        } break;
+        case SNAPSHOT_ARRAY: {
+            const LoxArray *array = ((const Object *)node->pointer)->array;
+            for (int32_t index = 0; index < array->count; ++index)
+            {
+                snapshot_visitValue(array->values[index], snapshot);
+            }
+        } break;
+        case SNAPSHOT_MAP: {
+            const LoxMap *map = ((const Object *)node->pointer)->map;
+            for (int32_t index = 0; index < map->capacity; ++index)
+            {
+                snapshot_visitValue(map->entries[index].key, snapshot);
+                snapshot_visitValue(map->entries[index].value, snapshot);
+            }
+        } break;
+        default:
+            break;
+    }
+}
+
+static int compareNodes(const void *a, const void *b)
+{
+    const SnapshotNode *nodeA = *(const SnapshotNode * const *)a;
+    const SnapshotNode *nodeB = *(const SnapshotNode * const *)b;
+    if (nodeA->kind != nodeB->kind)
+    {
+        return (int)nodeA->kind - (int)nodeB->kind;
+    }
+    if (nodeA->depth != nodeB->depth)
+    {
+        return nodeA->depth - nodeB->depth;
+    }
+    return (nodeA > nodeB) - (nodeA < nodeB);
+}
+
+// Numbers the nodes by kind, and the classes after their superclass, and
+// returns the nodes in this order.
+static SnapshotNode ** snapshot_sortNodes(SnapshotWriter *snapshot)
+{
+    SnapshotNode **sorted = lox_allocn(SnapshotNode *, max(snapshot->count, 1));
+    if (sorted == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    for (int32_t index = 0; index < snapshot->count; ++index)
+    {
+        SnapshotNode *node = &snapshot->nodes[index];
+        if (node->kind == SNAPSHOT_CLASS)
+        {
+            for (const LoxClass *klass = ((const LoxClass *)node->pointer)->superClass; klass != NULL; klass = klass->superClass)
+            {
+                ++node->depth;
+            }
+        }
+        sorted[index] = node;
+    }
+    qsort(sorted, (size_t)snapshot->count, sizeof(SnapshotNode *), compareNodes);
+    for (int32_t index = 0; index < snapshot->count; ++index)
+    {
+        sorted[index]->id = index;
+    }
+    return sorted;
+}
+
+static int32_t snapshot_id(const void *pointer, const SnapshotWriter *snapshot)
+{
+    return snapshot->nodes[snapshot_mapGet(pointer, &snapshot->indices)].id;
+}
+
+static void snapshot_writeValue(Value value, const SnapshotWriter *snapshot, CacheWriter *writer)
+{
+    if (!val_isObject(value))
+    {
+        writeU8(SNAPSHOT_IMMEDIATE, writer);
+        writeBytes(&value, sizeof(value), writer);
+        return;
+    }
+    const Object *object = val_asObject(value);
+    writeU8(SNAPSHOT_REFERENCE, writer);
+    writeI32(snapshot_id(object->type == OT_CLASS ? (const void *)object->klass : object, snapshot), writer);
+}
+
+static void snapshot_writeEnvironment(const Environment *environment, const SnapshotWriter *snapshot, CacheWriter *writer)
+{
+    writeI32(environment == snapshot->interpreter->globals ? SNAPSHOT_GLOBALS : snapshot_id(environment, snapshot), writer);
+}
+
+static void snapshot_writeChars(const char *chars, str_size length, CacheWriter *writer)
+{
+    writeU32(length, writer);
+    writeBytes(chars, length, writer);
+}
+
+// Returns the global name of the native function `callable`, or NULL if it
+// is not one of the natives of the interpreter.
+static const char * snapshot_nativeName(const LoxCallable *callable, const Interpreter *interpreter)
+{
+    const Environment *globals = interpreter->globals;
+    for (int32_t index = 0; index < interpreter->nativesCount; ++index)
+    {
+        Value value = globals->values[index];
+        if (val_isObjectType(value, OT_CALLABLE) && obj_unwrapCallable(value)->function == callable->function)
+        {
+            return env_globalName(index, globals);
+        }
+    }
+    return NULL;
+}
+
+// Writes the node, with what is needed to create it.
+static void snapshot_writeNode(const SnapshotNode *node, SnapshotWriter *snapshot, CacheWriter *writer)
+{
+    switch (node->kind)
+    {
+        case SNAPSHOT_STRING: {
+            const Object *object = node->pointer;
+            if (object->type == OT_STRING_VIEW)
+            {
+                snapshot_writeChars(object->builder->string, object->length, writer);
+            }
+            else
+            {
+                snapshot_writeChars(object->string, str_length(object->string), writer);
+            }
+        } break;
+        case SNAPSHOT_NATIVE: {
+            const char *name = snapshot_nativeName(((const Object *)node->pointer)->callable, snapshot->interpreter);
+            if (name == NULL)
+            {
+                snapshot->failed = true;
+                break;
+            }
+            writeString(name, writer);
+        } break;
+        case SNAPSHOT_ENVIRONMENT:
+            writeI32(((const Environment *)node->pointer)->capacity, writer);
+            break;
+        case SNAPSHOT_FUNCTION: {
+            const LoxFunction *function = ((const Object *)node->pointer)->function;
+            writeI32(snapshot_mapGet(function->declaration, &snapshot->functions), writer);
+            writeU8(function->isInitializer, writer);
+        } break;
+        case SNAPSHOT_CLASS: {
+            const LoxClass *klass = node->pointer;
+            writeString(klass->name, writer);
+            writeI32(klass->superClass != NULL ? snapshot_id(klass->superClass, snapshot) : -1, writer);
+            writeI32(klass->methodsCount, writer);
+            for (int32_t index = 0; index < klass->methodsCount; ++index)
+            {
+                const MethodEntry *method = &klass->methods[index];
+                writeString(method->name, writer);
+                writeI32(snapshot_mapGet(method->function->declaration, &snapshot->functions), writer);
+                snapshot_writeEnvironment(method->function->closure, snapshot, writer);
+                writeU8(method->function->isInitializer, writer);
+            }
+        } break;
+        case SNAPSHOT_INSTANCE:
+            writeI32(snapshot_id(((const Object *)node->pointer)->instance->klass, snapshot), writer);
+            break;
+        default:
+            break;
+    }
+}
+
+// Writes the references of the node to the other nodes.
+static void snapshot_writeLinks(const SnapshotNode *node, const SnapshotWriter *snapshot, CacheWriter *writer)
+{
+    switch (node->kind)
+    {
+        case SNAPSHOT_ENVIRONMENT: {
+            const Environment *environment = node->pointer;
+            snapshot_writeEnvironment(environment->enclosing, snapshot, writer);
+            writeI32(environment->slotsUsed, writer);
+            for (int32_t slot = 0; slot < environment->slotsUsed; ++slot)
+            {
+                snapshot_writeValue(environment->values[slot], snapshot, writer);
+            }
+        } break;
+        case SNAPSHOT_FUNCTION: {
+            const LoxFunction *function = ((const Object *)node->pointer)->function;
+            snapshot_writeEnvironment(function->closure, snapshot, writer);
+            snapshot_writeValue(function->receiver, snapshot, writer);
+        } break;
+        case SNAPSHOT_INSTANCE: {
+            const LoxInstance *instance = ((const Object *)node->pointer)->instance;
+            writeI32(instanceFieldsCount(instance), writer);
+            for (int32_t field = 0; field < instanceFieldsCount(instance); ++field)
+            {
+                writeString(instance->shape->names[field], writer);
+                snapshot_writeValue(instance->fields[field], snapshot, writer);
+            }
+        } break;
+        case SNAPSHOT_ARRAY: {
+            const LoxArray *array = ((const Object *)node->pointer)->array;
+            writeI32(array->count, writer);
+            for (int32_t index = 0; index < array->count; ++index)
+            {
+                snapshot_writeValue(array->values[index], snapshot, writer);
+            }
+        } break;
+        case SNAPSHOT_MAP: {
+            const LoxMap *map = ((const Object *)node->pointer)->map;
+            writeI32(map->count, writer);
+            for (int32_t index = 0; index < map->capacity; ++index)
+            {
+                const MapEntry *entry = &map->entries[index];
+                if (val_isObject(entry->key) || val_isNumber(entry->key))
+                {
+                    snapshot_writeValue(entry->key, snapshot, writer);
+                    snapshot_writeValue(entry->value, snapshot, writer);
+                }
+            }
+        } break;
+        default:
+            break;
+    }
+}
+
+// Writes the snapshot of the prelude `source`, whose resolved syntax tree is
+// `statements`, with the heap reachable from the globals of `interpreter`,
+// to `snapshotPath`. Returns false if the heap cannot be stored.
+// NOTE: the snapshot is an optimization, like the cache.
+bool cache_storeSnapshot(const char *snapshotPath, const char *source, bool isOptimized, Stmt *statements, const Interpreter *interpreter)
+{
+    SnapshotWriter snapshot = {NULL, 0, 0, {NULL, 0, 0}, {NULL, 0, 0}, interpreter, false};
+    snapshot_mapInit(&snapshot.indices);
+    snapshot_mapInit(&snapshot.functions);
+
+    FunctionList functions = {NULL, 0, 0};
+    snapshot_listFunctions(statements, &functions);
+    for (int32_t index = 0; index < functions.count; ++index)
+    {
+        snapshot_mapPut(functions.functions[index], index, &snapshot.functions);
+    }
+    if (functions.functions != NULL)
+    {
+        lox_free(functions.functions);
+    }
+
+    const Environment *globals = interpreter->globals;
+    for (int32_t slot = 0; slot < globals->slotsUsed; ++slot)
+    {
+        snapshot_visitValue(globals->values[slot], &snapshot);
+    }
+    for (int32_t index = 0; index < snapshot.count && !snapshot.failed; ++index)
+    {
+        snapshot_scanNode(index, &snapshot);
+    }
+
+    CacheWriter writer = {NULL, 0, 0};
+    if (!snapshot.failed)
+    {
+        SnapshotNode **sorted = snapshot_sortNodes(&snapshot);
+        writeStmtList(statements, &writer);
+        int32_t counts[SNAPSHOT_KINDS_COUNT] = {0};
+        for (int32_t index = 0; index < snapshot.count; ++index)
+        {
+            ++counts[snapshot.nodes[index].kind];
+        }
+        for (int32_t kind = 0; kind < SNAPSHOT_KINDS_COUNT; ++kind)
+        {
+            writeI32(counts[kind], &writer);
+        }
+        for (int32_t index = 0; index < snapshot.count; ++index)
+        {
+            snapshot_writeNode(sorted[index], &snapshot, &writer);
+        }
+        for (int32_t index = 0; index < snapshot.count; ++index)
+        {
+            snapshot_writeLinks(sorted[index], &snapshot, &writer);
+        }
+        writeI32(globals->slotsUsed, &writer);
+        for (int32_t slot = 0; slot < globals->slotsUsed; ++slot)
+        {
+            writeString(env_globalName(slot, globals), &writer);
+            snapshot_writeValue(globals->values[slot], &snapshot, &writer);
+        }
+        lox_free(sorted);
+    }
+    if (!snapshot.failed)
+    {
+        uint32_t flags = CACHE_FLAG_SNAPSHOT | (isOptimized ? CACHE_FLAG_OPTIMIZED : 0);
+        cache_writeFile(snapshotPath, flags, source, &writer);
+    }
+
+    if (writer.bytes != NULL)
+    {
+        lox_free(writer.bytes);
+    }
+    if (snapshot.nodes != NULL)
+    {
+        lox_free(snapshot.nodes);
+    }
+    snapshot_mapFree(&snapshot.indices);
+    snapshot_mapFree(&snapshot.functions);
+    return !snapshot.failed;
+}
+
+/* Snapshot reader */
+
+typedef struct
+{
+    // NOTE: the objects, and the environments, by id
+    void **nodes;
+    // NOTE: the ids of the nodes of kind `k` start at `kindStart[k]`
+    int32_t kindStart[SNAPSHOT_KINDS_COUNT + 1];
+    FunctionList functions;
+    Interpreter *interpreter;
+} SnapshotHeap;
+
+// Reads a number of items, each taking at least one byte of the payload.
+static int32_t snapshot_readCount(CacheReader *reader)
+{
+    int32_t count = readI32(reader);
+    if (count < 0 || (size_t)count > (size_t)(reader->end - reader->current))
+    {
+        failed(reader);
+        return 0;
+    }
+    return count;
+}
+
+// Reads a reference to a node of the kind `kind`, and returns its id, or -1
+// if the reference is invalid.
+static int32_t snapshot_readId(SnapshotKind kind, CacheReader *reader, const SnapshotHeap *heap)
+{
+    int32_t id = readI32(reader);
+    if (reader->failed || id < heap->kindStart[kind] || id >= heap->kindStart[kind + 1])
+    {
+        failed(reader);
+        return -1;
+    }
+    return id;
+}
+
+static Environment * snapshot_readEnvironment(CacheReader *reader, const SnapshotHeap *heap)
+{
+    Environment *globals = heap->interpreter->globals;
+    int32_t id = readI32(reader);
+    if (id == SNAPSHOT_GLOBALS)
+    {
+        return globals;
+    }
+    if (id < heap->kindStart[SNAPSHOT_ENVIRONMENT] || id >= heap->kindStart[SNAPSHOT_ENVIRONMENT + 1])
+    {
+        failed(reader);
+        return globals;
+    }
+    return (Environment *)heap->nodes[id];
+}
+
+static FunctionStmt * snapshot_readDeclaration(CacheReader *reader, const SnapshotHeap *heap)
+{
+    int32_t index = readI32(reader);
+    if (index < 0 || index >= heap->functions.count)
+    {
+        failed(reader);
+        return NULL;
+    }
+    return heap->functions.functions[index];
+}
+
+static const char * snapshot_readName(CacheReader *reader)
+{
+    str_size length = readU32(reader);
+    const uint8_t *chars = readBytes(length, reader);
+    if (chars == NULL || length == 0)
+    {
+        failed(reader);
+        return NULL;
+    }
+    return str_internSubstring((const char *)chars, substring(0, length));
+}
+
+static Value snapshot_readValue(CacheReader *reader, const SnapshotHeap *heap)
+{
+    uint8_t tag = readU8(reader);
+    if (tag == SNAPSHOT_IMMEDIATE)
+    {
+        Value value = VAL_NIL;
+        const uint8_t *bytes = readBytes(sizeof(value), reader);
+        if (bytes != NULL)
+        {
+            memcpy(&value, bytes, sizeof(value));
+        }
+        if (val_isObject(value))
+        {
+            failed(reader);
+            return VAL_NIL;
+        }
+        return value;
+    }
+    int32_t id = readI32(reader);
+    bool isObject = (id >= 0 && id < heap->kindStart[SNAPSHOT_ENVIRONMENT]) ||
+                    (id >= heap->kindStart[SNAPSHOT_FUNCTION] && id < heap->kindStart[SNAPSHOT_KINDS_COUNT]);
+    if (tag != SNAPSHOT_REFERENCE || !isObject)
+    {
+        failed(reader);
+        return VAL_NIL;
+    }
+    return val_object((Object *)heap->nodes[id]);
+}
+
+// Creates the node `id`, with no references to the nodes that may not exist
+// yet: they are set to the global environment, or to nil.
+static void * snapshot_readNode(int32_t id, CacheReader *reader, SnapshotHeap *heap)
+{
+    Interpreter *interpreter = heap->interpreter;
+    GarbageCollector *collector = interpreter->collector;
+    if (id < heap->kindStart[SNAPSHOT_NATIVE])
+    {
+        str_size length = readU32(reader);
+        const uint8_t *chars = readBytes(length, reader);
+        if (chars == NULL)
+        {
+            return NULL;
+        }
+        return val_asObject(obj_wrapString(str_substring((const char *)chars, substring(0, length)), collector));
+    }
+    if (id < heap->kindStart[SNAPSHOT_ENVIRONMENT])
+    {
+        const char *name = snapshot_readName(reader);
+        if (name == NULL)
+        {
+            return NULL;
+        }
+        int32_t slot = env_globalSlot(name, interpreter->globals);
+        if (slot < 0 || slot >= interpreter->nativesCount || !val_isObjectType(interpreter->globals->values[slot], OT_CALLABLE))
+        {
+            failed(reader);
+            return NULL;
+        }
+        return val_asObject(interpreter->globals->values[slot]);
+    }
+    if (id < heap->kindStart[SNAPSHOT_FUNCTION])
+    {
+        int32_t capacity = readI32(reader);
+        if (reader->failed || capacity < 0 || capacity > ENV_MAX_CAPACITY)
+        {
+            failed(reader);
+            return NULL;
+        }
+        Error *error = NULL;
+        Environment *environment = env_init(interpreter->globals, capacity, &error, collector);
+        if (environment == NULL)
+        {
+            freeError(error);
+            failed(reader);
+        }
+        return environment;
+    }
+    if (id < heap->kindStart[SNAPSHOT_CLASS])
+    {
+        FunctionStmt *declaration = snapshot_readDeclaration(reader, heap);
+        bool isInitializer = readU8(reader) != 0;
+        if (declaration == NULL)
+        {
+            return NULL;
+        }
+        return val_asObject(obj_wrapFunction(function_init(declaration, interpreter->globals, isInitializer), collector));
+    }
+    if (id < heap->kindStart[SNAPSHOT_INSTANCE])
+    {
+        const char *name = snapshot_readName(reader);
+        int32_t superId = readI32(reader);
+        int32_t methodsCount = snapshot_readCount(reader);
+        LoxClass *superClass = NULL;
+        if (superId != -1)
+        {
+            if (superId < heap->kindStart[SNAPSHOT_CLASS] || superId >= id)
+            {
+                failed(reader);
+                return NULL;
+            }
+            superClass = ((Object *)heap->nodes[superId])->klass;
+        }
+        if (reader->failed)
+        {
+            return NULL;
+        }
+        MethodEntry *methods = methodsCount > 0 ? slab_allocn(MethodEntry, methodsCount) : NULL;
+        for (int32_t index = 0; index < methodsCount; ++index)
+        {
+            const char *methodName = snapshot_readName(reader);
+            FunctionStmt *declaration = snapshot_readDeclaration(reader, heap);
+            Environment *closure = snapshot_readEnvironment(reader, heap);
+            bool isInitializer = readU8(reader) != 0;
+            if (reader->failed)
+            {
+                for (int32_t previous = 0; previous < index; ++previous)
+                {
+                    function_free(methods[previous].function);
+                }
+                slab_freen(methods, methodsCount);
+                return NULL;
+            }
+            methods[index].name = methodName;
+            methods[index].function = function_init(declaration, closure, isInitializer);
+        }
+        return val_asObject(obj_wrapClass(classInit(name, superClass, methods, methodsCount), collector));
+    }
+    if (id < heap->kindStart[SNAPSHOT_ARRAY])
+    {
+        int32_t classId = snapshot_readId(SNAPSHOT_CLASS, reader, heap);
+        if (classId == -1)
+        {
+            return NULL;
+        }
+        return val_asObject(obj_wrapInstance(instanceInit(((Object *)heap->nodes[classId])->klass), collector));
+    }
+    if (id < heap->kindStart[SNAPSHOT_MAP])
+    {
+        return val_asObject(obj_wrapArray(arrayInit(), collector));
+    }
+    return val_asObject(obj_wrapMap(mapInit(), collector));
+}
+
+// Sets the references of the node `id` to the other nodes.
+static void snapshot_readLinks(int32_t id, CacheReader *reader, SnapshotHeap *heap)
+{
+    if (id < heap->kindStart[SNAPSHOT_ENVIRONMENT] || (id >= heap->kindStart[SNAPSHOT_CLASS] && id < heap->kindStart[SNAPSHOT_INSTANCE]))
+    {
+        return;
+    }
+    if (id < heap->kindStart[SNAPSHOT_FUNCTION])
+    {
+        Environment *environment = (Environment *)heap->nodes[id];
+        environment->enclosing = snapshot_readEnvironment(reader, heap);
+        int32_t slotsUsed = readI32(reader);
+        if (slotsUsed < 0 || slotsUsed > environment->capacity)
+        {
+            failed(reader);
+            return;
+        }
+        for (int32_t slot = 0; slot < slotsUsed && !reader->failed; ++slot)
+        {
+            environment->values[slot] = snapshot_readValue(reader, heap);
+            environment->slotsUsed = slot + 1;
+        }
+    }
+    else if (id < heap->kindStart[SNAPSHOT_CLASS])
+    {
+        LoxFunction *function = ((Object *)heap->nodes[id])->function;
+        function->closure = snapshot_readEnvironment(reader, heap);
+        Value receiver = snapshot_readValue(reader, heap);
+        if (!val_isNil(receiver) && !val_isObjectType(receiver, OT_INSTANCE))
+        {
+            failed(reader);
+            return;
+        }
+        function->receiver = receiver;
+    }
+    else if (id < heap->kindStart[SNAPSHOT_ARRAY])
+    {
+        LoxInstance *instance = ((Object *)heap->nodes[id])->instance;
+        int32_t fieldsCount = snapshot_readCount(reader);
+        if (fieldsCount > LOX_INSTANCE_MAX_FIELDS)
+        {
+            failed(reader);
+            return;
+        }
+        for (int32_t field = 0; field < fieldsCount && !reader->failed; ++field)
+        {
+            const char *name = snapshot_readName(reader);
+            Value value = snapshot_readValue(reader, heap);
+            if (reader->failed || shape_indexOf(instance->shape, name) != -1)
+            {
+                failed(reader);
+                return;
+            }
+            instanceAddField(instance, name, value);
+        }
+    }
+    else if (id < heap->kindStart[SNAPSHOT_MAP])
+    {
+        LoxArray *array = ((Object *)heap->nodes[id])->array;
+        int32_t count = snapshot_readCount(reader);
+        for (int32_t index = 0; index < count && !reader->failed; ++index)
+        {
+            arrayPush(array, snapshot_readValue(reader, heap), heap->interpreter->collector);
+        }
+    }
+    else
+    {
+        LoxMap *map = ((Object *)heap->nodes[id])->map;
+        int32_t count = snapshot_readCount(reader);
+        for (int32_t index = 0; index < count && !reader->failed; ++index)
+        {
+            Value key = snapshot_readValue(reader, heap);
+            Value value = snapshot_readValue(reader, heap);
+            Value previous;
+            if (reader->failed || !mapIsValidKey(key) || mapGet(map, key, &previous))
+            {
+                failed(reader);
+                return;
+            }
+            mapSet(map, key, value, heap->interpreter->collector);
+        }
+    }
+}
+
+// Reads the heap of the snapshot, and defines the globals it holds.
+static void snapshot_readHeap(CacheReader *reader, SnapshotHeap *heap)
+{
+    heap->kindStart[0] = 0;
+    for (int32_t kind = 0; kind < SNAPSHOT_KINDS_COUNT; ++kind)
+    {
+        heap->kindStart[kind + 1] = heap->kindStart[kind] + snapshot_readCount(reader);
+    }
+    int32_t count = heap->kindStart[SNAPSHOT_KINDS_COUNT];
+    if (reader->failed || (size_t)count > (size_t)(reader->end - reader->current))
+    {
+        failed(reader);
+        return;
+    }
+    heap->nodes = lox_allocn(void *, max(count, 1));
+    if (heap->nodes == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    for (int32_t id = 0; id < count && !reader->failed; ++id)
+    {
+        heap->nodes[id] = snapshot_readNode(id, reader, heap);
+        if (heap->nodes[id] == NULL)
+        {
+            failed(reader);
+        }
+    }
+    for (int32_t id = 0; id < count && !reader->failed; ++id)
+    {
+        snapshot_readLinks(id, reader, heap);
+    }
+
+    Environment *globals = heap->interpreter->globals;
+    int32_t globalsCount = snapshot_readCount(reader);
+    for (int32_t index = 0; index < globalsCount && !reader->failed; ++index)
+    {
+        const char *name = snapshot_readName(reader);
+        Value value = snapshot_readValue(reader, heap);
+        int32_t slot = reader->failed ? -1 : env_globalSlot(name, globals);
+        if (slot == -1)
+        {
+            failed(reader);
+            break;
+        }
+        globals->values[slot] = value;
+    }
+}
+
+// Restores in `interpreter` the globals defined by the prelude `source`,
+// from its snapshot `snapshotPath`, without running it. The tree of the
+// prelude is returned in `statements`, and allocated in `arena`, that must
+// outlive the interpreter.
+// Returns false if there is no snapshot, or if it does not match `source`
+// and `isOptimized`, or if it is corrupt: the globals are then left as they
+// were.
+// NOTE: if it returns false, `arena` may contain part of the tree.
+bool cache_loadSnapshot(const char *snapshotPath, const char *source, bool isOptimized, Stmt **statements, Interpreter *interpreter, Arena *arena)
+{
+    GarbageCollector *collector = interpreter->collector;
+    if (collector->isMarking)
+    {
+        return false;
+    }
+    const uint8_t *mapping;
+    size_t mappedSize;
+    size_t payloadSize;
+    uint32_t flags = CACHE_FLAG_SNAPSHOT | (isOptimized ? CACHE_FLAG_OPTIMIZED : 0);
+    const uint8_t *payload = cache_mapFile(snapshotPath, flags, source, &mapping, &mappedSize, &payloadSize);
+    if (payload == NULL)
+    {
+        return false;
+    }
+
+    int32_t globalsCount = interpreter->globals->slotsUsed;
+    CacheReader reader = {payload, payload + payloadSize, false, str_length(source), interpreter, arena};
+    *statements = readStmtList(&reader);
+
+    SnapshotHeap heap = {NULL, {0}, {NULL, 0, 0}, interpreter};
+    if (!reader.failed)
+    {
+        snapshot_listFunctions(*statements, &heap.functions);
+        collector->isPaused = true;
+        snapshot_readHeap(&reader, &heap);
+        collector->isPaused = false;
+    }
+    bool loaded = !reader.failed && reader.current == reader.end;
+    if (!loaded)
+    {
+        // NOTE: the nodes that were created are not reachable, and are
+        //       collected with the garbage.
+        env_truncateGlobals(globalsCount, interpreter->globals);
+    }
+
+    if (heap.nodes != NULL)
+    {
+        lox_free(heap.nodes);
+    }
+    if (heap.functions.functions != NULL)
+    {
+        lox_free(heap.functions.functions);
+    }
+    munmap((void *)mapping, mappedSize);
+    return loaded;
+}
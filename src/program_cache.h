@@ -0,0 +1,34 @@
+//
+//  program_cache.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef program_cache_h
+#define program_cache_h
+
+#include "arena.h"
+#include "interpreter.h"
+#include "stmt.h"
+
+/*
+ The program cache stores the resolved syntax tree of a script in a file, so
+ that the following runs of the same script can load it instead of scanning,
+ parsing and resolving the source again. The cache file is keyed by the hash
+ of the source, and also records whether the tree was optimized; a cache that
+ does not match the source, or that is corrupt, is ignored.
+ The heap snapshot of a prelude also stores the globals the prelude defined,
+ with the objects and the environments they reach, so that it can be
+ restored without executing the prelude again.
+ */
+
+char * cache_pathForScript(const char *filename);
+bool cache_load(const char *cachePath, const char *source, bool isOptimized, Stmt **statements, Interpreter *interpreter, Arena *arena);
+void cache_store(const char *cachePath, const char *source, bool isOptimized, Stmt *statements);
+
+char * cache_pathForSnapshot(const char *filename);
+bool cache_loadSnapshot(const char *snapshotPath, const char *source, bool isOptimized, Stmt **statements, Interpreter *interpreter, Arena *arena);
+bool cache_storeSnapshot(const char *snapshotPath, const char *source, bool isOptimized, Stmt *statements, const Interpreter *interpreter);
+
+#endif /* program_cache_h */
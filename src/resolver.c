@@ -8,28 +8,70 @@
 #include "resolver.h"
 
 #include "common.h"
+#include "arena.h"
 #include "error.h"
 #include "expr.h"
 #include "memory.h"
 #include "string.h"
 
+/*
+ The symbols of the variables declared in the scopes being resolved are
+ kept on a single stack, in the order of their declarations, and each scope
+ starts at a marker, the index of its first symbol. A table maps each name
+ to its innermost symbol, and each symbol to the one it shadows, so that a
+ lookup is a probe of the table whatever the number and the depth of the
+ scopes. The names are interned, and are hashed and compared as pointers.
+ */
+
 typedef struct
 {
     const char *name;
-    int32_t index; // NOTE: unique id
+    // NOTE: slot of the variable in the environment of its scope
+    int32_t index;
+    // NOTE: the scope that declares the symbol, 0 for the outermost one
+    int32_t level;
+    // NOTE: the symbol with the same name that this one shadows, or -1
+    int32_t shadowed;
     bool isDefined;
-} ResolverEntry;
-
-typedef struct ResolverHashTable
+} ResolverSymbol;
+
+// NOTE: the scopes are allocated in the arena of the resolver, and the ones
+//       that end are reused by the following ones.
+typedef struct ResolverScope
+{
+    // NOTE: index of the first symbol of the scope
+    int32_t start;
+    // NOTE: true if a function or a method is declared in the scope or in
+    //       the scopes it encloses, so that its environment can be captured
+    bool isCaptured;
+    struct ResolverScope *enclosing;
+} ResolverScope;
+
+// NOTE: the names are never removed from the table; a name that is no
+//       longer declared maps to -1, and is dropped when the table grows.
+typedef struct
 {
-    ResolverEntry entries[RESOLVER_HASH_TABLE_SIZE];
-    int32_t entriesCount;
-    struct ResolverHashTable *nextInStack;
-} ResolverHashTable;
+    const char *name;
+    // NOTE: index of the innermost symbol with the name, or -1
+    int32_t symbol;
+} ResolverName;
 
 typedef struct
 {
-    ResolverHashTable *top;
+    ResolverScope *top;
+    // NOTE: number of scopes on the stack
+    int32_t depth;
+    ResolverScope *unused;
+    Arena *arena;
+
+    ResolverSymbol *symbols;
+    int32_t symbolsCount;
+    int32_t symbolsCapacity;
+
+    // NOTE: open addressing table, whose capacity is a power of two
+    ResolverName *names;
+    int32_t namesCount;
+    int32_t namesCapacity;
 } ResolverStack;
 
 typedef enum
@@ -57,8 +99,8 @@ typedef struct
     ClassType currentClass;
     Error *error;
     
-    char *thisString;
-    char *superString;
+    const char *thisString;
+    const char *superString;
 } Resolver;
 
 
@@ -78,26 +120,37 @@ static inline Error * resolver_throwError(Token *token, const char *message, Res
 
 // Stack
 
-static inline void
-push(ResolverHashTable *table, ResolverStack *stack)
+static void
+stack_init(ResolverStack *stack)
 {
-    table->nextInStack = stack->top;
-    stack->top = table;
-}
+    stack->top = NULL;
+    stack->depth = 0;
+    stack->unused = NULL;
+    stack->arena = arena_initSized(RESOLVER_ARENA_BLOCK_SIZE);
 
-static inline ResolverHashTable *
-pop(ResolverStack *stack)
-{
-    ResolverHashTable *table = stack->top;
-    stack->top = table->nextInStack;
-    return table;
+    stack->symbols = lox_allocn(ResolverSymbol, RESOLVER_INITIAL_SYMBOLS);
+    stack->names = lox_allocn(ResolverName, RESOLVER_INITIAL_NAMES);
+    if (stack->symbols == NULL || stack->names == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    stack->symbolsCount = 0;
+    stack->symbolsCapacity = RESOLVER_INITIAL_SYMBOLS;
+    for (int32_t i = 0; i < RESOLVER_INITIAL_NAMES; i++)
+    {
+        stack->names[i].name = NULL;
+    }
+    stack->namesCount = 0;
+    stack->namesCapacity = RESOLVER_INITIAL_NAMES;
 }
 
-static inline ResolverHashTable *
-peek(ResolverStack *stack)
+static void
+stack_free(ResolverStack *stack)
 {
-    ResolverHashTable *table = stack->top;
-    return table;
+    assert(stack->top == NULL);
+    arena_free(stack->arena);
+    lox_free(stack->symbols);
+    lox_free(stack->names);
 }
 
 static inline bool
@@ -107,115 +160,123 @@ stackIsEmpty(ResolverStack *stack)
     return result;
 }
 
-// HashMap
+static inline uint32_t
+name_hash(const char *name)
+{
+    // NOTE: the low bits of the pointers are always 0
+    uintptr_t bits = (uintptr_t)name >> 3;
+    return (uint32_t)(bits ^ (bits >> 15)) * 2654435761u;
+}
+
+// Returns the entry of `name` in the table, or the empty entry where it
+// would be inserted.
+static ResolverName *
+names_find(const char *name, ResolverStack *stack)
+{
+    uint32_t mask = (uint32_t)stack->namesCapacity - 1;
+    uint32_t index = name_hash(name) & mask;
+    while (stack->names[index].name != NULL && stack->names[index].name != name)
+    {
+        index = (index + 1) & mask;
+    }
+    return stack->names + index;
+}
 
-static inline ResolverHashTable*
-table_init()
+static void
+names_grow(ResolverStack *stack)
 {
-    ResolverHashTable *table = lox_alloc(ResolverHashTable);
-    if(table == NULL)
+    ResolverName *names = stack->names;
+    int32_t capacity = stack->namesCapacity;
+    stack->namesCapacity = 2 * capacity;
+    stack->names = lox_allocn(ResolverName, stack->namesCapacity);
+    if (stack->names == NULL)
     {
         fatal_outOfMemory();
     }
+    for (int32_t i = 0; i < stack->namesCapacity; i++)
+    {
+        stack->names[i].name = NULL;
+    }
+    stack->namesCount = 0;
+    for (int32_t i = 0; i < capacity; i++)
+    {
+        if (names[i].name != NULL && names[i].symbol != -1)
+        {
+            *names_find(names[i].name, stack) = names[i];
+            stack->namesCount++;
+        }
+    }
+    lox_free(names);
+}
 
-    for(int32_t i = 0; i < RESOLVER_HASH_TABLE_SIZE; i++)
+// Returns the innermost symbol of `name`, or NULL if it is not declared in
+// the scopes.
+static ResolverSymbol *
+lookup(const char *name, ResolverStack *stack)
+{
+    ResolverName *entry = names_find(name, stack);
+    if (entry->name == NULL || entry->symbol == -1)
     {
-        table->entries[i].name = NULL;
+        return NULL;
     }
-    table->entriesCount = 0;
-    
-    return table;
+    return stack->symbols + entry->symbol;
 }
 
-static inline void
-table_free(ResolverHashTable *table)
+// Returns true if `symbol` is declared in the innermost scope.
+static inline bool
+isInnermost(const ResolverSymbol *symbol, const ResolverStack *stack)
 {
-    lox_free(table);
+    return symbol->level == stack->depth - 1;
 }
 
+// Declares `name` in the innermost scope. Returns false if the scope cannot
+// store more variables.
 static bool
-table_insert(const char *name, bool isDefined, ResolverHashTable *table)
+addSymbol(const char *name, bool isDefined, ResolverStack *stack)
 {
-    static_assert(LOX_MAX_LOCAL_VARIABLES <= RESOLVER_HASH_TABLE_SIZE, "Resolver hash table size not large enough to store all local variables.");
-    if (table->entriesCount == LOX_MAX_LOCAL_VARIABLES)
+    assert(!stackIsEmpty(stack));
+    int32_t index = stack->symbolsCount - stack->top->start;
+    if (index == ENV_MAX_CAPACITY)
     {
-        // NOTE: Too many local variables
         return false;
     }
-    
-    int32_t tableIndex = (str_hash(name) % RESOLVER_HASH_TABLE_SIZE);
-    while (table->entries[tableIndex].name != NULL)
+    if (stack->symbolsCount == stack->symbolsCapacity)
     {
-        tableIndex++;
-        if (tableIndex == RESOLVER_HASH_TABLE_SIZE)
+        int32_t capacity = 2 * stack->symbolsCapacity;
+        ResolverSymbol *symbols = lox_realloc(stack->symbols, (size_t)capacity * sizeof(ResolverSymbol));
+        if (symbols == NULL)
         {
-            tableIndex = 0;
+            fatal_outOfMemory();
         }
+        stack->symbols = symbols;
+        stack->symbolsCapacity = capacity;
     }
-    
-    ResolverEntry *entry = table->entries + tableIndex;
-    
-    entry->name = name;
-    entry->index = table->entriesCount;
-    entry->isDefined = isDefined;
-
-#ifdef RESOLVER_VERBOSE
-    printf("R table_ins(%d) '%s' isDefined: %d\n", table->entriesCount, name, isDefined);
-#endif
-    
-    table->entriesCount++;
-    
-    return true;
-}
-
-static ResolverEntry *
-table_get(const char *name, ResolverHashTable *table)
-{
-    int32_t tableIndex = (str_hash(name) % RESOLVER_HASH_TABLE_SIZE);
-    
-    int32_t startIndex = tableIndex;
-    while(table->entries[tableIndex].name != NULL)
+    if (2 * (stack->namesCount + 1) > stack->namesCapacity)
     {
-        if (str_isEqual(name, table->entries[tableIndex].name))
-        {
-            ResolverEntry *entry = table->entries + tableIndex;
-            return entry;
-        }
-        tableIndex++;
-        if (tableIndex == RESOLVER_HASH_TABLE_SIZE)
-        {
-            tableIndex = 0;
-        }
-        if (tableIndex == startIndex)
-        {
-            break;
-        }
+        names_grow(stack);
     }
-    return NULL;
-}
 
-static bool
-table_containsKey(const char *name, ResolverHashTable *table)
-{
-    int32_t tableIndex = (str_hash(name) % RESOLVER_HASH_TABLE_SIZE);
-    int32_t startIndex = tableIndex;
-    while(table->entries[tableIndex].name != NULL)
+    ResolverName *entry = names_find(name, stack);
+    if (entry->name == NULL)
     {
-        if (str_isEqual(name, table->entries[tableIndex].name))
-        {
-            return true;
-        }
-        tableIndex++;
-        if (tableIndex == RESOLVER_HASH_TABLE_SIZE)
-        {
-            tableIndex = 0;
-        }
-        if (tableIndex == startIndex)
-        {
-            break;
-        }
+        entry->name = name;
+        entry->symbol = -1;
+        stack->namesCount++;
     }
-    return false;
+    ResolverSymbol *symbol = stack->symbols + stack->symbolsCount;
+    symbol->name = name;
+    symbol->index = index;
+    symbol->level = stack->depth - 1;
+    symbol->shadowed = entry->symbol;
+    symbol->isDefined = isDefined;
+    entry->symbol = stack->symbolsCount;
+
+#ifdef RESOLVER_VERBOSE
+    printf("R symbol(%d) '%s' level: %d isDefined: %d\n", index, name, symbol->level, isDefined);
+#endif
+
+    stack->symbolsCount++;
+    return true;
 }
 
 static void
@@ -244,30 +305,83 @@ resolveStmtList(Stmt *statements, Resolver *resolver)
 static void
 beginScope(Resolver *resolver)
 {
-    ResolverHashTable *table = table_init();
-    push(table, &resolver->scopes);
+    ResolverStack *stack = &resolver->scopes;
+    ResolverScope *scope = stack->unused;
+    if (scope != NULL)
+    {
+        stack->unused = scope->enclosing;
+    }
+    else
+    {
+        scope = arena_alloc(ResolverScope, stack->arena);
+    }
+    scope->start = stack->symbolsCount;
+    scope->isCaptured = false;
+    scope->enclosing = stack->top;
+    stack->top = scope;
+    stack->depth++;
+}
+
+// Ends the innermost scope, and returns the number of variables declared in
+// it. If `isCaptured` is not NULL, it is set to true if the environment of
+// the scope can be captured by a closure.
+static int32_t
+endScope(bool *isCaptured, Resolver *resolver)
+{
+    ResolverStack *stack = &resolver->scopes;
+    ResolverScope *scope = stack->top;
+    int32_t slotsCount = stack->symbolsCount - scope->start;
+    // NOTE: the names of the symbols of the scope map again to the symbols
+    //       they shadowed
+    while (stack->symbolsCount > scope->start)
+    {
+        const ResolverSymbol *symbol = stack->symbols + --stack->symbolsCount;
+        names_find(symbol->name, stack)->symbol = symbol->shadowed;
+    }
+    if (isCaptured != NULL)
+    {
+#ifdef ENV_USE_FRAME_STACK
+        *isCaptured = scope->isCaptured;
+#else
+        *isCaptured = true;
+#endif
+    }
+    stack->top = scope->enclosing;
+    stack->depth--;
+    scope->enclosing = stack->unused;
+    stack->unused = scope;
+    return slotsCount;
 }
 
+// Marks the enclosing scopes as captured by the closure of a function
+// declared in the innermost scope.
+// NOTE: the enclosing scopes of a captured scope are captured too, so the
+//       walk stops at the first one.
 static void
-endScope(Resolver *resolver)
+captureScopes(Resolver *resolver)
 {
-    ResolverHashTable *table = pop(&resolver->scopes);
-    table_free(table);
+    ResolverScope *scope = resolver->scopes.top;
+    while (scope != NULL && !scope->isCaptured)
+    {
+        scope->isCaptured = true;
+        scope = scope->enclosing;
+    }
 }
 
 static Error *
 declare(Token *name, Resolver *resolver)
 {
     Error *error = NULL;
-    if (!stackIsEmpty(&resolver->scopes))
+    ResolverStack *stack = &resolver->scopes;
+    if (!stackIsEmpty(stack))
     {
-        ResolverHashTable *scope = peek(&resolver->scopes);
         const char *nameStr = get_identifier_name(name);
-        if (table_containsKey(nameStr, scope))
+        const ResolverSymbol *symbol = lookup(nameStr, stack);
+        if (symbol != NULL && isInnermost(symbol, stack))
         {
             error = resolver_throwError(name, "Variable with this name already declared in this scope.", resolver);
         }
-        bool success = table_insert(nameStr, false, scope);
+        bool success = addSymbol(nameStr, false, stack);
         if (!success)
         {
             error = resolver_throwError(name, "Too many local variables in function.", resolver);
@@ -283,13 +397,12 @@ declare(Token *name, Resolver *resolver)
 static void
 define(Token *name, Resolver *resolver)
 {
-    if (!stackIsEmpty(&resolver->scopes))
+    ResolverStack *stack = &resolver->scopes;
+    if (!stackIsEmpty(stack))
     {
-        ResolverHashTable *scope = peek(&resolver->scopes);
-        const char *nameStr = get_identifier_name(name);
-        ResolverEntry *entry = table_get(nameStr, scope);
-        assert(entry != NULL);
-        entry->isDefined = true;
+        ResolverSymbol *symbol = lookup(get_identifier_name(name), stack);
+        assert(symbol != NULL && isInnermost(symbol, stack));
+        symbol->isDefined = true;
     }
     else
     {
@@ -297,38 +410,64 @@ define(Token *name, Resolver *resolver)
     }
 }
 
-static void
-resolveLocal(Expr *expr, const char *name, Resolver *resolver)
+// Resolves the variable `name` in the enclosing scopes, and stores its
+// location in `slot`. Returns false if it was not found, i.e. it is a global.
+static bool
+resolveLocal(VariableSlot *slot, const char *name, Resolver *resolver)
 {
-    ResolverHashTable *scope = peek(&resolver->scopes);
-    // Note: Number of scopes between the current innermost
-    //       scope and the scope where the variable was found.
-    int32_t depth = 0;
-    while(scope)
+    ResolverStack *stack = &resolver->scopes;
+    const ResolverSymbol *symbol = lookup(name, stack);
+    if (symbol == NULL)
     {
-        ResolverEntry *entry = table_get(name, scope);
-        if (entry != NULL)
-        {
+        // NOTE: Not found. Assume it is global.
+        return false;
+    }
+    // NOTE: Number of scopes between the current innermost scope and the
+    //       scope where the variable was found.
+    slot->depth = stack->depth - 1 - symbol->level;
+    slot->index = symbol->index;
 #ifdef RESOLVER_VERBOSE
-            printf("R Name '%s' resolved at depth %d (expr %p type %d)\n", name, depth, (void *)expr, expr->type);
+    printf("R Name '%s' resolved at depth %d index %d\n", name, slot->depth, slot->index);
 #endif
-            interpreter_resolve(expr, depth, entry->index, resolver->interpreter);
-            return;
-        }
-        ++depth;
-        scope = scope->nextInStack;
+    return true;
+}
+
+// Assigns to the global variable `name` its slot in the global environment.
+// The slot is reserved even if the variable is not defined yet, as it could
+// be defined later (by another REPL entry, or after a function using it).
+static void
+resolveGlobal(Token *name, VariableSlot *slot, Resolver *resolver)
+{
+    int32_t index = env_globalSlot(get_identifier_name(name), resolver->interpreter->globals);
+    if (index == -1)
+    {
+        resolver_throwError(name, "Too many global variables.", resolver);
     }
-    
-    // NOTE: Not found. Assume it is global.
+    slot->depth = VAR_DEPTH_GLOBAL;
+    slot->index = index;
 }
 
 static void
 resolveFunction(FunctionStmt *function, FunctionType type, Resolver *resolver)
 {
+    if (function->lazyBody != NULL)
+    {
+        // NOTE: the body is resolved when it is parsed, see resolveLazyBody().
+        //       Only the functions at the top level are lazy, so that their
+        //       enclosing scopes are known then.
+        return;
+    }
     FunctionType enclosingFunction = resolver->currentFunction;
     resolver->currentFunction = type;
     
+    captureScopes(resolver);
     beginScope(resolver);
+    if (type == FT_METHOD || type == FT_INITIALIZER)
+    {
+        // NOTE: "this" is stored in the environment of the call, before
+        //       the parameters.
+        addSymbol(resolver->thisString, true, &resolver->scopes);
+    }
     for(int32_t i = 0; i < function->arity; ++i)
     {
         Token *param = function->parameters[i];
@@ -340,7 +479,7 @@ resolveFunction(FunctionStmt *function, FunctionType type, Resolver *resolver)
         define(param, resolver);
     }
     resolveStmtList(function->body, resolver);
-    endScope(resolver);
+    function->slotsCount = endScope(&function->isCaptured, resolver);
     
     resolver->currentFunction = enclosingFunction;
 }
@@ -351,7 +490,7 @@ resolver_visitBlockStmt(BlockStmt *stmt, void *context)
     Resolver *resolver = (Resolver *)context;
     beginScope(resolver);
     resolveStmtList(stmt->statements, resolver);
-    endScope(resolver);
+    stmt->slotsCount = endScope(&stmt->isCaptured, resolver);
     return NULL;
 }
 
@@ -370,34 +509,31 @@ resolver_visitClassStmt(ClassStmt *stmt, void *context)
         resolver->currentClass = CT_SUBCLASS;
         resolveExpr(stmt->superClass, resolver);
         beginScope(resolver);
-        ResolverHashTable *scope = peek(&resolver->scopes);
-        table_insert(resolver->superString, true, scope);
+        addSymbol(resolver->superString, true, &resolver->scopes);
     }
     
-    beginScope(resolver);
-    ResolverHashTable *scope = peek(&resolver->scopes);
-    table_insert(resolver->thisString, true, scope);
-
     FunctionStmt *method = stmt->methods;
     while (method != NULL)
     {
         assert(method->stmt.type == STMT_Function);
         FunctionType declaration = FT_METHOD;
-        if (str_isEqual(get_identifier_name(method->name), "init"))
+        if (get_identifier_name(method->name) == str_internedInit)
         {
             declaration = FT_INITIALIZER;
         }
         resolveFunction(method, declaration, resolver);
         method = (FunctionStmt *)method->stmt.next;
     }
-    endScope(resolver);
     
     if (stmt->superClass != NULL)
     {
-        endScope(resolver);
+        endScope(NULL, resolver);
     }
 
-    resolveLocal((void *)stmt, get_identifier_name(stmt->name), resolver);
+    if (!resolveLocal(&stmt->slot, get_identifier_name(stmt->name), resolver))
+    {
+        resolveGlobal(stmt->name, &stmt->slot, resolver);
+    }
     resolver->currentClass = enclosingClass;
     return NULL;
 }
@@ -428,16 +564,18 @@ resolver_visitVariableExpr(Variable *expr, void *context)
     const char *name = get_identifier_name(expr->name);
     if (!stackIsEmpty(&resolver->scopes))
     {
-        ResolverHashTable *scope = peek(&resolver->scopes);
-        ResolverEntry *entry = table_get(name, scope);
-        if ((entry != NULL) && (entry->isDefined == false))
+        const ResolverSymbol *symbol = lookup(name, &resolver->scopes);
+        if (symbol != NULL && isInnermost(symbol, &resolver->scopes) && !symbol->isDefined)
         {
             Error *error = resolver_throwError(expr->name, "Cannot read local variable in its own initializer.", resolver);
             return error;
         }
     }
 
-    resolveLocal((Expr *)expr, name, resolver);
+    if (!resolveLocal(&expr->slot, name, resolver))
+    {
+        resolveGlobal(expr->name, &expr->slot, resolver);
+    }
     
     return NULL;
 }
@@ -449,7 +587,10 @@ resolver_visitAssignExpr(Assign *expr, void *context)
     
     resolveExpr(expr->value, resolver);
     const char *name = get_identifier_name(expr->name);
-    resolveLocal((Expr *)expr, name, resolver);
+    if (!resolveLocal(&expr->slot, name, resolver))
+    {
+        resolveGlobal(expr->name, &expr->slot, resolver);
+    }
 
     return NULL;
 }
@@ -609,7 +750,7 @@ resolver_visitSuperExpr(Super *expr, void *context)
         Error *error = resolver_throwError(expr->keyword, "Cannot use 'super' in a class with no superclass.", resolver);
         return error;
     }
-    resolveLocal((Expr *)expr, resolver->superString, resolver);
+    resolveLocal(&expr->slot, resolver->superString, resolver);
     return NULL;
 }
 
@@ -625,7 +766,7 @@ resolver_visitThisExpr(This *expr, void *context)
     }
 
     assert(expr->keyword->type == TT_THIS);
-    resolveLocal((Expr *)expr, resolver->thisString, resolver);
+    resolveLocal(&expr->slot, resolver->thisString, resolver);
     return NULL;
 }
 static void *
@@ -648,14 +789,14 @@ resolver_init(Interpreter *interpreter)
     resolver->interpreter = interpreter;
     
     // Initializes the stack of scopes
-    resolver->scopes.top = NULL;
+    stack_init(&resolver->scopes);
     
     resolver->currentFunction = FT_NONE;
     resolver->currentClass = CT_NONE;
     resolver->error = NULL;
     
-    resolver->thisString = str_fromLiteral("this");
-    resolver->superString = str_fromLiteral("super");
+    resolver->thisString = str_internedThis;
+    resolver->superString = str_internedSuper;
     
     // Initialize expression visitor
     {
@@ -685,9 +826,7 @@ static void resolver_free(Resolver *resolver)
     {
         freeError(resolver->error);
     }
-    str_free(resolver->thisString);
-    str_free(resolver->superString);
-    assert(stackIsEmpty(&resolver->scopes));
+    stack_free(&resolver->scopes);
     lox_free(resolver);
 }
 
@@ -698,3 +837,29 @@ void resolve(Stmt* statements, Interpreter *interpreter)
     resolver_free(resolver);
 }
 
+// Resolves the body of `function`, that was just parsed from `lazyBody`, in
+// the scopes enclosing a declaration at the top level.
+void resolveLazyBody(FunctionStmt *function, const LazyBody *lazyBody, Interpreter *interpreter)
+{
+    assert(function->lazyBody == NULL);
+    Resolver *resolver = resolver_init(interpreter);
+    FunctionType type = FT_FUNCTION;
+    if (lazyBody->isMethod)
+    {
+        resolver->currentClass = CT_CLASS;
+        type = (get_identifier_name(function->name) == str_internedInit) ? FT_INITIALIZER : FT_METHOD;
+    }
+    if (lazyBody->hasSuperclass)
+    {
+        resolver->currentClass = CT_SUBCLASS;
+        beginScope(resolver);
+        addSymbol(resolver->superString, true, &resolver->scopes);
+    }
+    resolveFunction(function, type, resolver);
+    if (lazyBody->hasSuperclass)
+    {
+        endScope(NULL, resolver);
+    }
+    resolver_free(resolver);
+}
+
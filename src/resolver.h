@@ -12,5 +12,6 @@
 #include "stmt.h"
 
 void resolve(Stmt* statements, Interpreter *interpreter);
+void resolveLazyBody(FunctionStmt *function, const LazyBody *lazyBody, Interpreter *interpreter);
 
 #endif /* resolver_h */
@@ -7,5 +7,5 @@
 
 #include "return.h"
 
-extern inline Return * return_init(Object *value, GarbageCollector *collector);
-extern inline Object * return_unwrap(Return *ret);
+extern inline Return * return_init(Value value, Return *ret);
+extern inline Value return_unwrap(Return *ret);
@@ -10,27 +10,23 @@
 
 #include "objects.h"
 
+// NOTE: A non-NULL Return signals that a return statement was executed. Only
+//       one return statement completes at a time, so the interpreter owns a
+//       single Return that carries the returned value.
 typedef struct
 {
-    Object value;
+    Value value;
 } Return;
 
-#include "garbage_collector.h"
-#include "memory.h"
-
-inline Return * return_init(Object *value, GarbageCollector *collector)
+inline Return * return_init(Value value, Return *ret)
 {
-    Return *ret = (Return *)value;
-    if(ret == NULL)
-    {
-        ret = (Return *)obj_newNil(collector);
-    }
+    ret->value = value;
     return ret;
 }
 
-inline Object * return_unwrap(Return *ret)
+inline Value return_unwrap(Return *ret)
 {
-    Object *value = (Object *)ret;
+    Value value = ret->value;
     return value;
 }
 
@@ -10,12 +10,17 @@
 #include "error.h"
 #include "utility.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 typedef struct Scanner
 {
     const char *source;
     
-    Token *first_token;
-    Token *last_token;
+    // NOTE: the tokens are stored in an array that grows when it is full
+    Token *tokens;
+    int32_t tokensCount;
+    int32_t tokensCapacity;
     
     str_size start;
     str_size current;
@@ -33,14 +38,23 @@ static Scanner * scanner_init(const char *source, int32_t firstLineNum)
     }
     scanner->source = source;
     
-    scanner->first_token = NULL;
-    scanner->last_token = NULL;
+    scanner->tokens = lox_allocn(Token, SCANNER_INITIAL_TOKENS);
+    if (scanner->tokens == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    scanner->tokensCount = 0;
+    scanner->tokensCapacity = SCANNER_INITIAL_TOKENS;
     
     scanner->start = 0;
     scanner->current = 0;
     assert(str_calculateLength(source) == str_length(source));
     scanner->end = str_length(source);
     
+#ifdef DEBUG
+    assert(keywords_isPerfectTable());
+#endif
+    
     // NOTE: internally the first line is num 0.
     scanner->line = firstLineNum - 1;
     
@@ -98,23 +112,90 @@ static inline char scanner_peek_next(const Scanner *scanner)
     return scanner->source[index_next];
 }
 
-static void scanner_add_token(Scanner *scanner, Token *token)
+/* Word at a time scanning */
+
+// NOTE: the runs of characters that end only at a few delimiters, i.e. the
+//       comments, the string bodies and the blanks, are skipped reading the
+//       source a word of 8 characters at a time, and the characters are
+//       compared one by one only in the word that contains a delimiter.
+typedef uint64_t ScannerWord;
+
+#define SCANNER_WORD_ONES  0x0101010101010101ull
+#define SCANNER_WORD_HIGHS 0x8080808080808080ull
+
+static inline ScannerWord scanner_loadWord(const char *chars)
+{
+    ScannerWord word;
+    memcpy(&word, chars, sizeof(ScannerWord));
+    return word;
+}
+
+// Returns a non-zero value if one of the characters of `word` is `c`.
+static inline ScannerWord scanner_wordHasChar(ScannerWord word, char c)
+{
+    ScannerWord bytes = word ^ (SCANNER_WORD_ONES * (uint8_t)c);
+    return (bytes - SCANNER_WORD_ONES) & ~bytes & SCANNER_WORD_HIGHS;
+}
+
+// Advances to the next `a` or `b`, or to the end of the source.
+static void scanner_skipUntil(Scanner *scanner, char a, char b)
 {
-    if(scanner->first_token == NULL)
+    const char *source = scanner->source;
+    str_size current = scanner->current;
+    while (current + sizeof(ScannerWord) <= scanner->end)
     {
-        scanner->first_token = token;
-        scanner->last_token = token;
+        ScannerWord word = scanner_loadWord(source + current);
+        if (scanner_wordHasChar(word, a) | scanner_wordHasChar(word, b))
+        {
+            break;
+        }
+        current += sizeof(ScannerWord);
     }
-    else
+    while (current < scanner->end && source[current] != a && source[current] != b)
     {
-        scanner->last_token->nextInScan = token;
-        scanner->last_token = token;
+        current++;
     }
+    scanner->current = current;
+}
+
+// Advances past the spaces that follow.
+static void scanner_skipSpaces(Scanner *scanner)
+{
+    const char *source = scanner->source;
+    str_size current = scanner->current;
+    while (current + sizeof(ScannerWord) <= scanner->end &&
+           scanner_loadWord(source + current) == SCANNER_WORD_ONES * ' ')
+    {
+        current += sizeof(ScannerWord);
+    }
+    while (current < scanner->end && source[current] == ' ')
+    {
+        current++;
+    }
+    scanner->current = current;
+}
+
+static void scanner_add_token(Scanner *scanner, Token token)
+{
+    if (scanner->tokensCount == scanner->tokensCapacity)
+    {
+        int32_t capacity = 2 * scanner->tokensCapacity;
+        Token *tokens = lox_allocn(Token, capacity);
+        if (tokens == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        memcpy(tokens, scanner->tokens, scanner->tokensCount * sizeof(Token));
+        lox_free(scanner->tokens);
+        scanner->tokens = tokens;
+        scanner->tokensCapacity = capacity;
+    }
+    scanner->tokens[scanner->tokensCount++] = token;
 }
 
 static void scanner_atomic(Scanner *scanner, TokenType type)
 {
-    Token *token = token_atomic(type, scanner_current_lexeme(scanner));
+    Token token = token_atomic(type, scanner_current_lexeme(scanner));
     scanner_add_token(scanner, token);
 }
 
@@ -137,23 +218,36 @@ static void scanner_number(Scanner *scanner)
         }
     }
     
-    char *text = str_substring(scanner->source, substringStartEnd(scanner->start, scanner->current));
-    double value = atof(text);
-    str_free(text);
+    // NOTE: the lexeme is copied, as strtod would also parse the characters
+    //       that follow it (e.g. an exponent).
+    Lexeme lexeme = scanner_current_lexeme(scanner);
+    double value;
+    if (lexeme.count < SCANNER_NUMBER_MAX_LENGTH)
+    {
+        char text[SCANNER_NUMBER_MAX_LENGTH];
+        memcpy(text, scanner->source + lexeme.start, lexeme.count);
+        text[lexeme.count] = '\0';
+        value = strtod(text, NULL);
+    }
+    else
+    {
+        char *text = str_substring(scanner->source, lexeme.index);
+        value = strtod(text, NULL);
+        str_free(text);
+    }
     
-    Token *token = token_number_literal(value, scanner_current_lexeme(scanner));
+    Token token = token_number_literal(value, lexeme);
     scanner_add_token(scanner, token);
 }
 
 static void scanner_string(Scanner *scanner)
 {
-    while (scanner_peek(scanner) != '\"' && !scanner_is_at_end(scanner))
+    scanner_skipUntil(scanner, '\"', '\n');
+    while (scanner_peek(scanner) == '\n')
     {
-        if (scanner_peek(scanner) == '\n')
-        {
-            scanner->line++;
-        }
+        scanner->line++;
         scanner_advance(scanner);
+        scanner_skipUntil(scanner, '\"', '\n');
     }
     
     // Unterminated string.
@@ -167,28 +261,24 @@ static void scanner_string(Scanner *scanner)
         scanner_advance(scanner);
         
         Lexeme lexeme = scanner_current_lexeme(scanner);
-        // Trim the surrounding quotes.
-        SubstringIndex index = substring_trimmed(lexeme.index);
-        char *value = str_substring(scanner->source, index);
-        
-        Token *token = token_string_literal(value, lexeme);
-        str_free(value);
-        
+        Token token = token_string_literal(scanner->source, lexeme);
         scanner_add_token(scanner, token);
     }
 }
 
 static void scanner_identifier(Scanner *scanner)
 {
-    while(is_alphanumeric(scanner_peek(scanner)))
+    const char *source = scanner->source;
+    str_size current = scanner->current;
+    while (current < scanner->end && is_alphanumeric(source[current]))
     {
-        scanner_advance(scanner);
+        current++;
     }
+    scanner->current = current;
     
-    // See if the identifier is a reserved word.
+    // See if the identifier is a reserved word, before its name is interned.
     Lexeme lexeme = scanner_current_lexeme(scanner);
-    char *str = str_substring(scanner->source, lexeme.index);
-    KeywordEntry *entry = lookup_keyword(str);
+    KeywordEntry *entry = lookup_keyword(scanner->source + lexeme.start, lexeme.count);
     
     if(keyword_is_valid(entry))
     {
@@ -196,10 +286,9 @@ static void scanner_identifier(Scanner *scanner)
     }
     else
     {
-        Token *token = token_identifier(str, lexeme);
+        Token token = token_identifier(scanner->source, lexeme);
         scanner_add_token(scanner, token);
     }
-    str_free(str);
 }
 
 static void scanner_scanToken(Scanner *scanner)
@@ -239,10 +328,7 @@ static void scanner_scanToken(Scanner *scanner)
             if (scanner_match(scanner, '/'))
             {
                 // A comment goes until the end of the line.
-                while ((scanner_peek(scanner) != '\n') && !scanner_is_at_end(scanner))
-                {
-                    scanner_advance(scanner);
-                }
+                scanner_skipUntil(scanner, '\n', '\n');
             }
             else if(scanner_match(scanner, '*'))
             {
@@ -250,6 +336,11 @@ static void scanner_scanToken(Scanner *scanner)
                 int level = 1;
                 while ((level > 0) && !scanner_is_at_end(scanner))
                 {
+                    scanner_skipUntil(scanner, '*', '/');
+                    if (scanner_is_at_end(scanner))
+                    {
+                        break;
+                    }
                     if((scanner_peek(scanner) == '*') && (scanner_peek_next(scanner) == '/'))
                     {
                         level--;
@@ -274,6 +365,10 @@ static void scanner_scanToken(Scanner *scanner)
         } break;
             
         case ' ':
+        {
+            scanner_skipSpaces(scanner);
+        } break;
+            
         case '\r':
         case '\t':
         {
@@ -317,12 +412,14 @@ static Token * scan_tokens(Scanner *scanner)
         scanner_scanToken(scanner);
     }
     
-    Token *eof = token_atomic(TT_EOF, scanner_current_lexeme(scanner));
+    Token eof = token_atomic(TT_EOF, scanner_current_lexeme(scanner));
     scanner_add_token(scanner, eof);
     
-    return scanner->first_token;
+    return scanner->tokens;
 }
 
+// Returns the array of the tokens in `source`, terminated by a TT_EOF token.
+// The tokens must be freed with tokens_free().
 Token * scanLine(const char *source, int32_t lineNumber)
 {
     Scanner *scanner = scanner_init(source, lineNumber);
@@ -0,0 +1,103 @@
+//
+//  shape.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "shape.h"
+
+#include "error.h"
+#include "memory.h"
+
+extern inline int32_t shape_indexOf(const Shape *shape, const char *name);
+
+static thread_global uint32_t shape_nextId = 1;
+
+// Returns the root shape of a class, that has no fields.
+Shape * shape_init(void)
+{
+    Shape *shape = lox_alloc(Shape);
+    if (shape == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    shape->id = shape_nextId++;
+    shape->names = NULL;
+    shape->fieldsCount = 0;
+    shape->transitions = NULL;
+    shape->transitionsCount = 0;
+    shape->transitionsCapacity = 0;
+    return shape;
+}
+
+// Frees `shape` and all the shapes that can be reached from it.
+void shape_free(Shape *shape)
+{
+    for (int32_t index = 0; index < shape->transitionsCount; ++index)
+    {
+        shape_free(shape->transitions[index]);
+    }
+    if (shape->transitions != NULL)
+    {
+        lox_free(shape->transitions);
+    }
+    if (shape->names != NULL)
+    {
+        lox_free(shape->names);
+    }
+    lox_free(shape);
+}
+
+// Returns the shape obtained adding the field `name` to `shape`.
+// The transition is created the first time it is taken.
+// NOTE: `name` must be interned, and must not be a field of `shape` already.
+Shape * shape_addField(Shape *shape, const char *name)
+{
+    assert(shape_indexOf(shape, name) == -1);
+    for (int32_t index = 0; index < shape->transitionsCount; ++index)
+    {
+        Shape *next = shape->transitions[index];
+        const char *fieldName = next->names[shape->fieldsCount];
+        if (fieldName == name)
+        {
+            return next;
+        }
+    }
+
+    Shape *next = shape_init();
+    next->fieldsCount = shape->fieldsCount + 1;
+    next->names = lox_allocn(const char *, next->fieldsCount);
+    if (next->names == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    for (int32_t index = 0; index < shape->fieldsCount; ++index)
+    {
+        next->names[index] = shape->names[index];
+    }
+    next->names[shape->fieldsCount] = name;
+
+    if (shape->transitionsCount == shape->transitionsCapacity)
+    {
+        int32_t capacity = shape->transitionsCapacity == 0 ? 2 : 2 * shape->transitionsCapacity;
+        Shape **transitions = lox_allocn(Shape *, capacity);
+        if (transitions == NULL)
+        {
+            fatal_outOfMemory();
+        }
+        for (int32_t index = 0; index < shape->transitionsCount; ++index)
+        {
+            transitions[index] = shape->transitions[index];
+        }
+        if (shape->transitions != NULL)
+        {
+            lox_free(shape->transitions);
+        }
+        shape->transitions = transitions;
+        shape->transitionsCapacity = capacity;
+    }
+    shape->transitions[shape->transitionsCount++] = next;
+
+    return next;
+}
@@ -0,0 +1,59 @@
+//
+//  shape.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef shape_h
+#define shape_h
+
+#include "common.h"
+#include "string.h"
+
+/*
+ A shape (hidden class) describes the layout of the fields of an instance:
+ the i-th field of an instance is stored in its i-th value slot, and its
+ name is `names[i]` in the shape of the instance.
+ Each class owns a tree of shapes. The root is the shape of the instances
+ without fields, and each edge is the transition that adds a field, so
+ that the instances that acquire the same fields in the same order share
+ their shape.
+ */
+
+typedef struct Shape_tag
+{
+    // NOTE: unique among all the shapes ever created, so that the inline
+    //       caches are not fooled by a shape allocated at the address of a
+    //       freed one. 0 is never used.
+    uint32_t id;
+
+    // NOTE: names of the fields, indexed by their slot
+    const char **names;
+    int32_t fieldsCount;
+
+    // NOTE: shapes obtained by adding one field to this shape
+    struct Shape_tag **transitions;
+    int32_t transitionsCount;
+    int32_t transitionsCapacity;
+} Shape;
+
+Shape * shape_init(void);
+void shape_free(Shape *shape);
+Shape * shape_addField(Shape *shape, const char *name);
+
+// Returns the slot of the field `name`, or -1 if the shape does not have it.
+// NOTE: the names of the fields are interned, and are compared as pointers.
+inline int32_t shape_indexOf(const Shape *shape, const char *name)
+{
+    for (int32_t index = 0; index < shape->fieldsCount; ++index)
+    {
+        if (shape->names[index] == name)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+#endif /* shape_h */
@@ -7,51 +7,74 @@
 
 #include "stmt.h"
 
-Stmt * initBlock(Stmt *statements)
+#include "chunk.h"
+
+Stmt * initBlock(Stmt *statements, Arena *arena)
 {
-    BlockStmt *stmt = lox_alloc(BlockStmt);
+    BlockStmt *stmt = arena_alloc(BlockStmt, arena);
     stmt->stmt.type = STMT_Block;
     stmt->stmt.next = NULL;
     stmt->statements = statements;
+    stmt->slotsCount = 0;
+    stmt->isCaptured = true;
     return AS_STMT(stmt);
 }
 
-Stmt * initExpression(Expr *expr)
+Stmt * initExpression(Expr *expr, Arena *arena)
 {
-    ExpressionStmt *stmt = lox_alloc(ExpressionStmt);
+    ExpressionStmt *stmt = arena_alloc(ExpressionStmt, arena);
     stmt->stmt.type = STMT_Expression;
     stmt->stmt.next = NULL;
     stmt->expression = expr;
     return AS_STMT(stmt);
 }
 
-Stmt * initClass(Token *name, Expr *superClass, FunctionStmt *methods)
+Stmt * initClass(Token *name, Expr *superClass, FunctionStmt *methods, Arena *arena)
 {
-    ClassStmt *stmt = lox_alloc(ClassStmt);
+    ClassStmt *stmt = arena_alloc(ClassStmt, arena);
     stmt->stmt.type = STMT_Class;
     stmt->stmt.next = NULL;
     stmt->name = name;
     stmt->superClass = superClass;
     stmt->methods = methods;
+    stmt->slot = VAR_SLOT_UNRESOLVED;
     return AS_STMT(stmt);
 }
 
-Stmt * initFunction(Token *name, Token **parameters, int32_t parametersCount, Stmt *body)
+// Frees the chunk of the function, when its arena is freed.
+static void stmt_freeFunctionChunk(void *data)
 {
-    FunctionStmt *stmt = lox_alloc(FunctionStmt);
+    FunctionStmt *stmt = (FunctionStmt *)data;
+    if (stmt->chunk)
+    {
+        chunk_free(stmt->chunk);
+    }
+}
+
+// NOTE: `parameters` must be allocated in `arena`.
+Stmt * initFunction(Token *name, Token **parameters, int32_t parametersCount, Stmt *body, Arena *arena)
+{
+    FunctionStmt *stmt = arena_alloc(FunctionStmt, arena);
     stmt->stmt.type = STMT_Function;
     stmt->stmt.next = NULL;
     stmt->name = name;
     stmt->parameters = parameters;
     stmt->arity = parametersCount;
     stmt->body = body;
+    stmt->slotsCount = 0;
+    stmt->isCaptured = true;
+    stmt->chunk = NULL;
+    stmt->lazyBody = NULL;
+    stmt->hotness = 0;
+    stmt->jitCode = NULL;
+    arena_addCleanup(stmt_freeFunctionChunk, stmt, arena);
 
     return AS_STMT(stmt);
 }
 
-Stmt * initIf(Expr *condition, Stmt *thenBranch, Stmt *elseBranch)
+Stmt * initIf(Expr *condition, Stmt *thenBranch, Stmt *elseBranch, Arena *arena)
 {
-    IfStmt *stmt = lox_alloc(IfStmt);
+    IfStmt *stmt = arena_alloc(IfStmt, arena);
     stmt->stmt.type = STMT_If;
     stmt->stmt.next = NULL;
     stmt->condition = condition;
@@ -60,18 +83,18 @@ Stmt * initIf(Expr *condition, Stmt *thenBranch, Stmt *elseBranch)
     return AS_STMT(stmt);
 }
 
-Stmt * initPrint(Expr *expr)
+Stmt * initPrint(Expr *expr, Arena *arena)
 {
-    PrintStmt *stmt = lox_alloc(PrintStmt);
+    PrintStmt *stmt = arena_alloc(PrintStmt, arena);
     stmt->stmt.type = STMT_Print;
     stmt->stmt.next = NULL;
     stmt->expression = expr;
     return AS_STMT(stmt);
 }
 
-Stmt * initReturn(Token *keyword, Expr *value)
+Stmt * initReturn(Token *keyword, Expr *value, Arena *arena)
 {
-    ReturnStmt *stmt = lox_alloc(ReturnStmt);
+    ReturnStmt *stmt = arena_alloc(ReturnStmt, arena);
     stmt->stmt.type = STMT_Return;
     stmt->stmt.next = NULL;
     stmt->keyword = keyword;
@@ -79,9 +102,9 @@ Stmt * initReturn(Token *keyword, Expr *value)
     return AS_STMT(stmt);
 }
 
-Stmt * initVar(Token *name, Expr *initializer)
+Stmt * initVar(Token *name, Expr *initializer, Arena *arena)
 {
-    VarStmt *stmt = lox_alloc(VarStmt);
+    VarStmt *stmt = arena_alloc(VarStmt, arena);
     stmt->stmt.type = STMT_Var;
     stmt->stmt.next = NULL;
     stmt->name = name;
@@ -89,71 +112,18 @@ Stmt * initVar(Token *name, Expr *initializer)
     return AS_STMT(stmt);
 }
 
-Stmt * initWhile(Expr *condition, Stmt *body)
+Stmt * initWhile(Expr *condition, Stmt *body, Arena *arena)
 {
-    WhileStmt *stmt = lox_alloc(WhileStmt);
+    WhileStmt *stmt = arena_alloc(WhileStmt, arena);
     stmt->stmt.type = STMT_While;
     stmt->stmt.next = NULL;
     stmt->condition = condition;
     stmt->body = body;
+    stmt->hotness = 0;
+    stmt->jitCode = NULL;
     return AS_STMT(stmt);
 }
 
-// Free the list of statements stmt.
-// If stmt is NULL the function does nothing.
-void freeStmt(Stmt *stmt)
-{
-    while(stmt)
-    {
-        switch (stmt->type) {
-            case STMT_Block: {
-                BlockStmt *block = (BlockStmt *)stmt;
-                freeStmt(block->statements);
-            } break;
-            case STMT_Class: {
-                ClassStmt *classStmt = (ClassStmt *)stmt;
-                freeStmt(AS_STMT(classStmt->methods));
-                free_expr(classStmt->superClass);
-            } break;
-            case STMT_Expression: {
-                ExpressionStmt *expression = (ExpressionStmt *)stmt;
-                free_expr(expression->expression);
-            } break;
-            case STMT_Function: {
-                FunctionStmt *fun = (FunctionStmt *)stmt;
-                freeStmt(fun->body);
-                lox_free(fun->parameters);
-            } break;
-            case STMT_If: {
-                IfStmt *ifStmt = (IfStmt *)stmt;
-                free_expr(ifStmt->condition);
-                freeStmt(ifStmt->thenBranch);
-                freeStmt(ifStmt->elseBranch);
-            } break;
-            case STMT_Print: {
-                PrintStmt *print = (PrintStmt *)stmt;
-                free_expr(print->expression);
-            } break;
-            case STMT_Return: {
-                ReturnStmt *ret = (ReturnStmt *)stmt;
-                free_expr(ret->value);
-            } break;
-            case STMT_Var: {
-                VarStmt *var = (VarStmt *)stmt;
-                free_expr(var->initializer);
-            } break;
-            case STMT_While: {
-                WhileStmt *whileStmt = (WhileStmt *)stmt;
-                free_expr(whileStmt->condition);
-                freeStmt(whileStmt->body);
-            } break;
-        }
-        Stmt *next = stmt->next;
-        lox_free(stmt);
-        stmt = next;
-    }
-}
-
 // Returns the last statement in a non-empty chain of statements.
 Stmt * stmt_last(Stmt *statements)
 {
@@ -178,6 +148,37 @@ Stmt * stmt_appendTo(Stmt *head, Stmt *tail)
     return head;
 }
 
+// Calls `callback` with each function declared in `statements`, including
+// the methods and the nested functions, in pre-order.
+void stmt_forEachFunction(Stmt *statements, StmtFunctionCallback callback, void *context)
+{
+    for (Stmt *stmt = statements; stmt != NULL; stmt = stmt->next)
+    {
+        switch (stmt->type)
+        {
+            case STMT_Block:
+                stmt_forEachFunction(((BlockStmt *)stmt)->statements, callback, context);
+                break;
+            case STMT_Class:
+                stmt_forEachFunction(AS_STMT(((ClassStmt *)stmt)->methods), callback, context);
+                break;
+            case STMT_Function:
+                callback((FunctionStmt *)stmt, context);
+                stmt_forEachFunction(((FunctionStmt *)stmt)->body, callback, context);
+                break;
+            case STMT_If:
+                stmt_forEachFunction(((IfStmt *)stmt)->thenBranch, callback, context);
+                stmt_forEachFunction(((IfStmt *)stmt)->elseBranch, callback, context);
+                break;
+            case STMT_While:
+                stmt_forEachFunction(((WhileStmt *)stmt)->body, callback, context);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
 void * stmt_accept_visitor(Stmt *stmt, StmtVisitor *visitor, void *context)
 {
     void *result = NULL;
@@ -10,6 +10,9 @@
 
 #include "expr.h"
 
+struct Chunk_tag;
+struct JitCode_tag;
+
 /*
  "Block      : List<Stmt> statements",
  "Class      : Token name, Expr superclass," +
@@ -48,6 +51,11 @@ typedef struct
 {
     Stmt stmt;
     Stmt *statements;
+    // NOTE: number of variables declared in the block, computed by the resolver
+    int32_t slotsCount;
+    // NOTE: false if no closure can capture the environment of the block, as
+    //       found by the resolver, so that it is pushed on the frame stack
+    bool isCaptured;
 } BlockStmt;
 
 // Expression : Expr expression
@@ -57,6 +65,22 @@ typedef struct
     Expr *expression;
 } ExpressionStmt;
 
+// NOTE: the body of a function declared at the top level of a source that is
+//       parsed lazily. Only its braces are matched by the parser, and it is
+//       parsed and resolved by the first call, see function_parseBody().
+typedef struct
+{
+    // NOTE: the token that follows the opening brace
+    Token *start;
+    const char *source;
+    Arena *arena;
+    bool isMethod;
+    bool hasSuperclass;
+    bool optimize;
+    // NOTE: true if the body could not be parsed or resolved
+    bool hadError;
+} LazyBody;
+
 // "Function   : Token name, List<Token> parameters, List<Stmt> body",
 typedef struct
 {
@@ -65,6 +89,21 @@ typedef struct
     Token **parameters;
     int32_t arity;
     Stmt *body;
+    // NOTE: number of slots of the environment of a call, i.e. "this", the
+    //       parameters and the variables declared in the body, computed by
+    //       the resolver
+    int32_t slotsCount;
+    // NOTE: false if no closure can capture the environment of a call, see
+    //       BlockStmt
+    bool isCaptured;
+    // NOTE: bytecode of the body, compiled for the virtual machine
+    struct Chunk_tag *chunk;
+    // NOTE: if not NULL, the body has not been parsed yet, and `body` is NULL
+    LazyBody *lazyBody;
+    // NOTE: number of calls run by the interpreter, and native code of the
+    //       body once it is hot, see jit.h
+    int32_t hotness;
+    struct JitCode_tag *jitCode;
 } FunctionStmt;
 
 // Class      : Token name, Expr superclass, List<Stmt.Function> methods
@@ -74,6 +113,8 @@ typedef struct
     Token *name;
     Expr *superClass;
     FunctionStmt *methods;
+    // NOTE: location of the variable the class is assigned to
+    VariableSlot slot;
 } ClassStmt;
 
 // If : Expr condition, Stmt thenBranch, Stmt elseBranch
@@ -114,21 +155,27 @@ typedef struct
     Stmt stmt;
     Expr *condition;
     Stmt *body;
+    // NOTE: number of iterations run by the interpreter, and native code of
+    //       the loop once it is hot, see jit.h
+    int32_t hotness;
+    struct JitCode_tag *jitCode;
 } WhileStmt;
 
-Stmt * initBlock(Stmt *statements);
-Stmt * initClass(Token *name, Expr *superClass, FunctionStmt *methods);
-Stmt * initExpression(Expr *expr);
-Stmt * initFunction(Token *name, Token **parameters, int32_t parametersCount, Stmt *body);
-Stmt * initIf(Expr *condition, Stmt *thenBranch, Stmt *elseBranch);
-Stmt * initPrint(Expr *expr);
-Stmt * initReturn(Token *keyword, Expr *value);
-Stmt * initVar(Token *name, Expr *initializer);
-Stmt * initWhile(Expr *condition, Stmt *body);
-void freeStmt(Stmt *stmt);
+Stmt * initBlock(Stmt *statements, Arena *arena);
+Stmt * initClass(Token *name, Expr *superClass, FunctionStmt *methods, Arena *arena);
+Stmt * initExpression(Expr *expr, Arena *arena);
+Stmt * initFunction(Token *name, Token **parameters, int32_t parametersCount, Stmt *body, Arena *arena);
+Stmt * initIf(Expr *condition, Stmt *thenBranch, Stmt *elseBranch, Arena *arena);
+Stmt * initPrint(Expr *expr, Arena *arena);
+Stmt * initReturn(Token *keyword, Expr *value, Arena *arena);
+Stmt * initVar(Token *name, Expr *initializer, Arena *arena);
+Stmt * initWhile(Expr *condition, Stmt *body, Arena *arena);
 Stmt * stmt_last(Stmt *statements);
 Stmt * stmt_appendTo(Stmt *head, Stmt *tail);
 
+typedef void (*StmtFunctionCallback)(FunctionStmt *function, void *context);
+void stmt_forEachFunction(Stmt *statements, StmtFunctionCallback callback, void *context);
+
 /* Visitor */
 
 typedef struct
@@ -14,13 +14,29 @@ extern inline void str_free(char *str);
 extern inline char *str_clear(char *str);
 extern inline str_size str_calculateLength(const char *str);
 extern inline str_size str_length(const char *str);
+extern inline void str_builderRetain(StringBuilder *builder);
+extern inline void str_builderRelease(StringBuilder *builder);
 
 extern inline SubstringIndex substring(str_size start, str_size count);
 extern inline SubstringIndex substringStartEnd(str_size start, str_size onePastLast);
 extern inline SubstringIndex substring_trimmed(SubstringIndex index);
 
-struct MemoryPool *str_smallPool;
-struct MemoryPool *str_mediumPool;
+thread_global struct MemoryPool *str_smallPool;
+thread_global struct MemoryPool *str_mediumPool;
+
+// NOTE: hash table of the interned strings, with linear probing. Interned
+//       strings are owned by the table, and are freed on exit. Each thread
+//       has its own table.
+static thread_global struct
+{
+    char **entries;
+    int32_t count;
+    int32_t capacity;
+} str_internTable;
+
+thread_global char *str_internedInit;
+thread_global char *str_internedThis;
+thread_global char *str_internedSuper;
 
 void str_initPools()
 {
@@ -28,8 +44,9 @@ void str_initPools()
 #ifdef DEBUG_VERBOSE
     printf("Initializing string pools.\n");
 #endif
-    str_smallPool = poolInit(STR_SMALL_SIZE);
-    str_mediumPool = poolInit(STR_MEDIUM_SIZE);
+    str_smallPool = slabPool(STR_SMALL_SIZE);
+    str_mediumPool = slabPool(STR_MEDIUM_SIZE);
+    assert(str_smallPool->objectSize == STR_SMALL_SIZE && str_mediumPool->objectSize == STR_MEDIUM_SIZE);
 #endif
 }
 
@@ -39,12 +56,148 @@ void str_freePools()
 #ifdef DEBUG_VERBOSE
     printf("Freeing string pools.\n");
 #endif
-    poolFree(str_smallPool);
-    poolFree(str_mediumPool);
+    // NOTE: the pools belong to the slab allocator, see slabFree().
+    str_smallPool = NULL;
+    str_mediumPool = NULL;
 #endif
 }
 
-char * str_alloc(str_size capacity)
+void str_initInternTable()
+{
+    int32_t capacity = STR_INTERN_INITIAL_CAPACITY;
+    str_internTable.entries = lox_allocn(char *, capacity);
+    if (str_internTable.entries == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memset(str_internTable.entries, 0, capacity * sizeof(char *));
+    str_internTable.count = 0;
+    str_internTable.capacity = capacity;
+
+    str_internedInit = str_intern("init");
+    str_internedThis = str_intern("this");
+    str_internedSuper = str_intern("super");
+}
+
+void str_freeInternTable()
+{
+    for (int32_t index = 0; index < str_internTable.capacity; ++index)
+    {
+        if (str_internTable.entries[index] != NULL)
+        {
+            str_free(str_internTable.entries[index]);
+        }
+    }
+    lox_free(str_internTable.entries);
+    str_internTable.entries = NULL;
+    str_internTable.count = 0;
+    str_internTable.capacity = 0;
+}
+
+// Returns the djb2 hash of the `length` characters at `chars`, as str_hash().
+static uint32_t str_hashChars(const char *chars, str_size length)
+{
+    const unsigned char *bytes = (const unsigned char *)chars;
+    unsigned long hash = 5381;
+    for (str_size index = 0; index < length; ++index)
+    {
+        hash = ((hash << 5) + hash) + bytes[index]; /* hash * 33 + c */
+    }
+    return (uint32_t)hash;
+}
+
+// Returns the index of the entry of the intern table that holds the
+// `length` characters at `chars`, or of the empty entry where it should be
+// inserted.
+static int32_t str_internIndex(char **entries, int32_t capacity, const char *chars, str_size length, uint32_t hash)
+{
+    int32_t mask = capacity - 1;
+    int32_t index = (int32_t)(hash & (uint32_t)mask);
+    while (entries[index] != NULL)
+    {
+        const char *entry = entries[index];
+        if ((uint32_t)str_hash(entry) == hash && STR_LENGTH(entry) == length &&
+            memcmp(entry, chars, length) == 0)
+        {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+static void str_growInternTable()
+{
+    int32_t capacity = 2 * str_internTable.capacity;
+    char **entries = lox_allocn(char *, capacity);
+    if (entries == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memset(entries, 0, capacity * sizeof(char *));
+    for (int32_t index = 0; index < str_internTable.capacity; ++index)
+    {
+        char *entry = str_internTable.entries[index];
+        if (entry != NULL)
+        {
+            uint32_t hash = (uint32_t)str_hash(entry);
+            entries[str_internIndex(entries, capacity, entry, STR_LENGTH(entry), hash)] = entry;
+        }
+    }
+    lox_free(str_internTable.entries);
+    str_internTable.entries = entries;
+    str_internTable.capacity = capacity;
+}
+
+// Returns the canonical copy of the `length` characters at `chars`, so
+// that interned strings with the same characters are the same pointer, and
+// can be compared as pointers. Their hash is computed once, when they are
+// interned.
+// NOTE: the returned string is owned by the intern table, and must not be
+//       modified or freed.
+static char * str_internChars(const char *chars, str_size length)
+{
+    uint32_t hash = str_hashChars(chars, length);
+    int32_t index = str_internIndex(str_internTable.entries, str_internTable.capacity, chars, length, hash);
+    char *interned = str_internTable.entries[index];
+    if (interned != NULL)
+    {
+        return interned;
+    }
+    // NOTE: the load factor is kept below 1/2
+    if (2 * (str_internTable.count + 1) > str_internTable.capacity)
+    {
+        str_growInternTable();
+        index = str_internIndex(str_internTable.entries, str_internTable.capacity, chars, length, hash);
+    }
+    interned = str_alloc(length);
+    memcpy(interned, chars, length);
+    interned[length] = '\0';
+    STR_LENGTH(interned) = length;
+#ifdef STR_STORE_HASH
+    STR_HASH(interned) = hash;
+#endif
+    str_internTable.entries[index] = interned;
+    str_internTable.count++;
+    return interned;
+}
+
+// Returns the interned copy of the C string `str`.
+char * str_intern(const char *str)
+{
+    return str_internChars(str, str_calculateLength(str));
+}
+
+// Returns the interned copy of the substring `index` of `source`, without
+// copying it first.
+char * str_internSubstring(const char *source, SubstringIndex index)
+{
+    return str_internChars(source + index.start, index.count);
+}
+
+// Returns a new empty string of capacity `capacity`, allocated by the code
+// at `file` and `line`, see str_alloc().
+char * str_alloc_(str_size capacity, const char *file, int line)
 {
     StringHeader *header;
 #ifdef STR_USE_MEMORY_POOLS
@@ -52,17 +205,23 @@ char * str_alloc(str_size capacity)
     {
         header = poolGetObject(str_smallPool);
         header->capacity = STR_SMALL_CAPACITY;
+#ifdef MEMORY_SAMPLING
+        sampler_countAllocation(header, STR_SMALL_SIZE, file, line, "char");
+#endif
     }
     else if (capacity <= STR_MEDIUM_CAPACITY)
     {
         header = poolGetObject(str_mediumPool);
         header->capacity = STR_MEDIUM_CAPACITY;
+#ifdef MEMORY_SAMPLING
+        sampler_countAllocation(header, STR_MEDIUM_SIZE, file, line, "char");
+#endif
     }
     else
 #endif
     {
         assert(capacity < STR_SIZE_MAX - STR_HEADER_SIZE - 1);
-        header = (StringHeader *)lox_allocn(char, STR_HEADER_SIZE + capacity + 1);
+        header = (StringHeader *)lox_allocnAt(char, STR_HEADER_SIZE + capacity + 1, file, line);
         if(header == NULL)
         {
             fatal_outOfMemory();
@@ -80,29 +239,35 @@ char * str_alloc(str_size capacity)
     return str;
 }
 
-char *str_realloc(char *str, str_size newCapacity)
+char *str_realloc(char *str, str_size newCapacity, const char *file, int line)
 {
     char *newString;
     StringHeader *header = STR_HEADER(str);
 #ifdef STR_USE_MEMORY_POOLS
     if (header->capacity == STR_SMALL_CAPACITY)
     {
-        newString = str_alloc(newCapacity);
+        newString = str_alloc_(newCapacity, file, line);
         memcpy(newString, STR_FROM_HEADER(header), header->length + 1);
         STR_LENGTH(newString) = header->length;
+#ifdef MEMORY_SAMPLING
+        sampler_countRelease(header);
+#endif
         poolReleaseObject(header, str_smallPool);
     }
     else if (header->capacity == STR_MEDIUM_CAPACITY)
     {
-        newString = str_alloc(newCapacity);
+        newString = str_alloc_(newCapacity, file, line);
         memcpy(newString, STR_FROM_HEADER(header), header->length + 1);
         STR_LENGTH(newString) = header->length;
+#ifdef MEMORY_SAMPLING
+        sampler_countRelease(header);
+#endif
         poolReleaseObject(header, str_mediumPool);
     }
     else
 #endif
     {
-        StringHeader *newHeader = (StringHeader *)lox_realloc(header, STR_HEADER_SIZE + newCapacity + 1);
+        StringHeader *newHeader = (StringHeader *)lox_reallocAt(header, STR_HEADER_SIZE + newCapacity + 1, file, line);
         
         if(newHeader == NULL)
         {
@@ -115,11 +280,11 @@ char *str_realloc(char *str, str_size newCapacity)
     return newString;
 }
 
-char * str_grow_(char *str, str_size newCapacity)
+char * str_grow_(char *str, str_size newCapacity, const char *file, int line)
 {
     if (STR_CAPACITY(str) < newCapacity)
     {
-        str = str_realloc(str, newCapacity);
+        str = str_realloc(str, newCapacity, file, line);
     }
     return str;
 }
@@ -129,31 +294,31 @@ void str_setLength(char *str)
     STR_LENGTH(str) = str_calculateLength(str);
 }
 
-char * str_fromLiteral(const char *source)
+char * str_fromLiteral_(const char *source, const char *file, int line)
 {
     str_size len = str_calculateLength(source);
-    char *result = str_alloc(len);
+    char *result = str_alloc_(len, file, line);
     memcpy(result, source, len + 1);
     assert(result[len] == '\0');
     STR_LENGTH(result) = len;
     return result;
 }
 
-char * str_dup(const char *source)
+char * str_dup_(const char *source, const char *file, int line)
 {
     str_size len = str_length(source);
-    char *result = str_alloc(len);
+    char *result = str_alloc_(len, file, line);
     memcpy(result, source, len + 1);
     assert(result[len] == '\0');
     STR_LENGTH(result) = len;
     return result;
 }
 
-char * str_concat(const char *str1, const char *str2)
+char * str_concat_(const char *str1, const char *str2, const char *file, int line)
 {
     str_size len1 = str_length(str1);
     str_size len2 = str_length(str2);
-    char *result = str_alloc(len1 + len2);
+    char *result = str_alloc_(len1 + len2, file, line);
     memcpy(result, str1, len1);
     memcpy(result + len1, str2, len2 + 1);
     str_size totalLen = len1 + len2;
@@ -162,13 +327,13 @@ char * str_concat(const char *str1, const char *str2)
     return result;
 }
 
-char * str_append_(char *str, const char *suffix)
+char * str_append_(char *str, const char *suffix, const char *file, int line)
 {
     str_size len = str_length(str);
     str_size suffixLen = str_length(suffix);
     str_size totalLen = len + suffixLen;
     
-    str_grow(str, totalLen);
+    str = str_grow_(str, totalLen, file, line);
     memcpy(str+len, suffix, suffixLen + 1);
     STR_LENGTH(str) = totalLen;
 #ifdef STR_STORE_HASH
@@ -178,13 +343,13 @@ char * str_append_(char *str, const char *suffix)
     return str;
 }
 
-char * str_appendLiteral_(char *str, const char *suffix)
+char * str_appendLiteral_(char *str, const char *suffix, const char *file, int line)
 {
     str_size len = str_length(str);
     str_size suffixLen = str_calculateLength(suffix);
     str_size totalLen = len + suffixLen;
     
-    str_grow(str, totalLen);
+    str = str_grow_(str, totalLen, file, line);
     memcpy(str+len, suffix, suffixLen + 1);
     STR_LENGTH(str) = totalLen;
 #ifdef STR_STORE_HASH
@@ -194,17 +359,63 @@ char * str_appendLiteral_(char *str, const char *suffix)
     return str;
 }
 
-char * str_fromDouble(double value)
+// Returns a new string builder containing the concatenation of `prefix`
+// and `suffix`. The builder is not retained.
+StringBuilder * str_builderInit_(const char *prefix, const char *suffix, const char *file, int line)
+{
+    StringBuilder *builder = lox_allocnAt(StringBuilder, 1, file, line);
+    if (builder == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    str_size prefixLen = str_length(prefix);
+    str_size suffixLen = str_length(suffix);
+    str_size totalLen = prefixLen + suffixLen;
+    builder->string = str_alloc_(2 * totalLen, file, line);
+    memcpy(builder->string, prefix, prefixLen);
+    memcpy(builder->string + prefixLen, suffix, suffixLen + 1);
+    STR_LENGTH(builder->string) = totalLen;
+    builder->refCount = 0;
+    return builder;
+}
+
+// Appends `suffix` to the builder, doubling its capacity if needed.
+// NOTE: `suffix` may be the string of the builder itself.
+void str_builderAppend_(StringBuilder *builder, const char *suffix, const char *file, int line)
+{
+    str_size len = str_length(builder->string);
+    str_size suffixLen = str_length(suffix);
+    str_size totalLen = len + suffixLen;
+    if (totalLen > STR_CAPACITY(builder->string))
+    {
+        bool isBuilderString = (suffix == builder->string);
+        builder->string = str_grow_(builder->string, 2 * totalLen, file, line);
+        if (isBuilderString)
+        {
+            suffix = builder->string;
+        }
+    }
+    // NOTE: memmove, as the suffix may overlap the destination if it is
+    //       the string of the builder.
+    memmove(builder->string + len, suffix, suffixLen);
+    builder->string[totalLen] = '\0';
+    STR_LENGTH(builder->string) = totalLen;
+#ifdef STR_STORE_HASH
+    STR_HASH(builder->string) = STR_HASH_UNAVAILABLE;
+#endif
+}
+
+char * str_fromDouble_(double value, const char *file, int line)
 {
-    char *result = str_alloc(64);
+    char *result = str_alloc_(64, file, line);
     sprintf(result, "%.*g", DBL_DIG, value);
     STR_LENGTH(result) = str_calculateLength(result);
     return result;
 }
 
-char * str_fromInt64(int64_t value)
+char * str_fromInt64_(int64_t value, const char *file, int line)
 {
-    char *result = str_alloc(64);
+    char *result = str_alloc_(64, file, line);
     sprintf(result, "%lld", value);
     STR_LENGTH(result) = str_calculateLength(result);
     return result;
@@ -212,9 +423,9 @@ char * str_fromInt64(int64_t value)
 
 // Returns a new string containing the substring of `str` defined
 // by `index`. The returned string must be freed with str_free().
-char * str_substring(const char * const str, SubstringIndex index)
+char * str_substring_(const char * const str, SubstringIndex index, const char *file, int line)
 {
-    char *substring = str_alloc(index.count);
+    char *substring = str_alloc_(index.count, file, line);
     
     char *dest = substring;
     const char *source = str + index.start;
@@ -26,24 +26,43 @@ typedef struct SubstringIndex
 
 void str_initPools(void);
 void str_freePools(void);
-
-char * str_alloc(str_size capacity);
+void str_initInternTable(void);
+void str_freeInternTable(void);
+char * str_intern(const char *str);
+char * str_internSubstring(const char *source, SubstringIndex index);
+
+// NOTE: interned names of the identifiers that the runtime looks up.
+extern thread_global char *str_internedInit;
+extern thread_global char *str_internedThis;
+extern thread_global char *str_internedSuper;
+
+char * str_alloc_(str_size capacity, const char *file, int line);
+// NOTE: the call site is recorded by the allocation sampler and by
+//       MEMORY_DEBUG, see memory_sampler.h.
+#define str_alloc(capacity) str_alloc_(capacity, __FILE__, __LINE__)
 void str_setLength(char *str);
-char * str_fromLiteral(const char *source);
-char * str_dup(const char *source);
-char * str_concat(const char *str1, const char *str2);
-char * str_fromDouble(double value);
-char * str_fromInt64(int64_t value);
+char * str_fromLiteral_(const char *source, const char *file, int line);
+char * str_dup_(const char *source, const char *file, int line);
+char * str_concat_(const char *str1, const char *str2, const char *file, int line);
+char * str_fromDouble_(double value, const char *file, int line);
+char * str_fromInt64_(int64_t value, const char *file, int line);
 bool str_isEqual(const char *s1, const char *s2);
 
-#define str_grow(str, newCapacity) do { str = str_grow_(str, newCapacity); } while(0);
-#define str_append(str, suffix) do { str = str_append_(str, suffix); } while(0);
-#define str_appendLiteral(str, suffix) do { str = str_appendLiteral_(str, suffix); } while(0);
+#define str_fromLiteral(source) str_fromLiteral_(source, __FILE__, __LINE__)
+#define str_dup(source) str_dup_(source, __FILE__, __LINE__)
+#define str_concat(str1, str2) str_concat_(str1, str2, __FILE__, __LINE__)
+#define str_fromDouble(value) str_fromDouble_(value, __FILE__, __LINE__)
+#define str_fromInt64(value) str_fromInt64_(value, __FILE__, __LINE__)
+
+#define str_grow(str, newCapacity) do { str = str_grow_(str, newCapacity, __FILE__, __LINE__); } while(0);
+#define str_append(str, suffix) do { str = str_append_(str, suffix, __FILE__, __LINE__); } while(0);
+#define str_appendLiteral(str, suffix) do { str = str_appendLiteral_(str, suffix, __FILE__, __LINE__); } while(0);
 
-char * str_append_(char* str, const char* suffix);
-char * str_appendLiteral_(char* str, const char* suffix);
+char * str_append_(char* str, const char* suffix, const char *file, int line);
+char * str_appendLiteral_(char* str, const char* suffix, const char *file, int line);
 
-char* str_substring(const char* const str, SubstringIndex index);
+char* str_substring_(const char* const str, SubstringIndex index, const char *file, int line);
+#define str_substring(str, index) str_substring_(str, index, __FILE__, __LINE__)
 
 unsigned long str_hashLiteral(const char *str);
 unsigned long str_hash(const char *str);
@@ -96,8 +115,8 @@ typedef struct
 
 #include "memory_pool.h"
 
-extern struct MemoryPool *str_smallPool;
-extern struct MemoryPool *str_mediumPool;
+extern thread_global struct MemoryPool *str_smallPool;
+extern thread_global struct MemoryPool *str_mediumPool;
 
 inline void str_free(char *str)
 {
@@ -105,10 +124,16 @@ inline void str_free(char *str)
 #ifdef STR_USE_MEMORY_POOLS
     if (header->capacity == STR_SMALL_CAPACITY)
     {
+#ifdef MEMORY_SAMPLING
+        sampler_countRelease(header);
+#endif
         poolReleaseObject(header, str_smallPool);
     }
     else if (header->capacity == STR_MEDIUM_CAPACITY)
     {
+#ifdef MEMORY_SAMPLING
+        sampler_countRelease(header);
+#endif
         poolReleaseObject(header, str_mediumPool);
     }
     else
@@ -144,5 +169,39 @@ inline str_size str_length(const char *str)
     return len;
 }
 
+/* String builders */
+
+// A string builder is a string with spare capacity, that is shared by all
+// the strings obtained by appending to it. Each of them is a prefix of the
+// builder, and the longest one can be extended in place, so that repeated
+// appends take amortized constant time. The builder is freed when it is
+// released by the last string that shares it.
+typedef struct
+{
+    // NOTE: its length is the length of the longest string sharing it
+    char *string;
+    int32_t refCount;
+} StringBuilder;
+
+StringBuilder * str_builderInit_(const char *prefix, const char *suffix, const char *file, int line);
+void str_builderAppend_(StringBuilder *builder, const char *suffix, const char *file, int line);
+#define str_builderInit(prefix, suffix) str_builderInit_(prefix, suffix, __FILE__, __LINE__)
+#define str_builderAppend(builder, suffix) str_builderAppend_(builder, suffix, __FILE__, __LINE__)
+
+inline void str_builderRetain(StringBuilder *builder)
+{
+    ++builder->refCount;
+}
+
+inline void str_builderRelease(StringBuilder *builder)
+{
+    assert(builder->refCount > 0);
+    if (--builder->refCount == 0)
+    {
+        str_free(builder->string);
+        lox_free(builder);
+    }
+}
+
 #endif /* string_h */
 
@@ -8,23 +8,94 @@
 #include "token.h"
 #include "error.h"
 
+#include <string.h>
+
 /* Keywords */
 
 extern inline bool keyword_is_valid(KeywordEntry *entry);
+extern inline uint32_t keyword_hash(const char *chars, str_size length);
+
+// NOTE: the slot of each keyword is its keyword_hash(), which has no
+//       collisions for the keywords of FOREACH_KEYWORD. The table must be
+//       updated when a keyword is added, see keywords_isPerfectTable().
+static KeywordEntry keyword_table[KEYWORD_TABLE_SIZE] = {
+    [ 0] = {"false",  TT_FALSE},
+    [ 1] = {"", 0}, [ 2] = {"", 0}, [ 3] = {"", 0},
+    [ 4] = {"eof",    TT_EOF},
+    [ 5] = {"", 0}, [ 6] = {"", 0}, [ 7] = {"", 0},
+    [ 8] = {"for",    TT_FOR},
+    [ 9] = {"", 0},
+    [10] = {"true",   TT_TRUE},
+    [11] = {"", 0},
+    [12] = {"this",   TT_THIS},
+    [13] = {"", 0}, [14] = {"", 0}, [15] = {"", 0},
+    [16] = {"super",  TT_SUPER},
+    [17] = {"and",    TT_AND},
+    [18] = {"", 0}, [19] = {"", 0},
+    [20] = {"or",     TT_OR},
+    [21] = {"class",  TT_CLASS},
+    [22] = {"nil",    TT_NIL},
+    [23] = {"", 0},
+    [24] = {"if",     TT_IF},
+    [25] = {"while",  TT_WHILE},
+    [26] = {"fun",    TT_FUN},
+    [27] = {"print",  TT_PRINT},
+    [28] = {"else",   TT_ELSE},
+    [29] = {"return", TT_RETURN},
+    [30] = {"var",    TT_VAR},
+    [31] = {"", 0},
+};
+
+static KeywordEntry keyword_notFound = {"", 0};
+
+// Returns the keyword made of the `length` characters at `chars`, or an
+// invalid entry if they are not a keyword. Only the keyword in the slot of
+// their hash is compared with the characters.
+KeywordEntry * lookup_keyword(const char *chars, str_size length)
+{
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
+    {
+        return &keyword_notFound;
+    }
+    KeywordEntry *entry = &keyword_table[keyword_hash(chars, length)];
+    if (entry->keyword[0] != chars[0] || strncmp(entry->keyword, chars, length) != 0 ||
+        entry->keyword[length] != '\0')
+    {
+        return &keyword_notFound;
+    }
+    return entry;
+}
 
-KeywordEntry * lookup_keyword(const char *keyword)
+#ifdef DEBUG
+// Returns true if each keyword is found in its slot of the table, and the
+// other slots are empty.
+bool keywords_isPerfectTable()
 {
-    KeywordEntry *entry = keywords;
-    while(keyword_is_valid(entry))
+    static const KeywordEntry keywords[] = {
+#define DEFINE_KEYWORD_ENTRY(name, string) \
+        {string, TT_##name},
+        FOREACH_KEYWORD(DEFINE_KEYWORD_ENTRY)
+#undef DEFINE_KEYWORD_ENTRY
+    };
+    int32_t keywordsCount = sizeof(keywords) / sizeof(keywords[0]);
+    int32_t usedSlots = 0;
+    for (int32_t index = 0; index < KEYWORD_TABLE_SIZE; index++)
+    {
+        usedSlots += keyword_is_valid(&keyword_table[index]);
+    }
+    for (int32_t index = 0; index < keywordsCount; index++)
     {
-        if(str_isEqual(entry->keyword, keyword))
+        const char *keyword = keywords[index].keyword;
+        str_size length = (str_size)strlen(keyword);
+        KeywordEntry *entry = lookup_keyword(keyword, length);
+        if (!keyword_is_valid(entry) || entry->type != keywords[index].type)
         {
-            break;
+            return false;
         }
-        entry++;
     }
-    return entry;
+    return usedSlots == keywordsCount;
 }
+#endif
 
 /* Tokens */
 
@@ -104,111 +175,60 @@ char * token_to_string(const Token * const token, const char * const source)
     return str;
 }
 
-static Token * get_token()
+static inline Token token_init(TokenType type, Lexeme lexeme)
 {
-    Token *token = lox_alloc(Token);
-    if(token == NULL)
-    {
-        fatal_outOfMemory();
-    }
-    token->literal = NULL;
-    token->nextInScan = NULL;
+    Token token;
+    token.type = type;
+    token.number = 0.0;
+    token.literal = NULL;
+    token.lexeme = lexeme;
     return token;
 }
 
-static inline void token_set_lexeme(Token * token, Lexeme lexeme)
-{
-    token->lexeme = lexeme;
-}
-
-Token *token_number_literal(double value, Lexeme lexeme)
+Token token_number_literal(double value, Lexeme lexeme)
 {
-    Token *result = get_token();
-    result->type = TT_NUMBER;
-    result->number = value;
-    token_set_lexeme(result, lexeme);
-
+    Token result = token_init(TT_NUMBER, lexeme);
+    result.number = value;
     return result;
 }
 
-Token * token_string_literal(const char * const str, Lexeme lexeme)
+// Returns a string literal token. Its value is a copy of the lexeme from
+// `source`, without the surrounding quotes.
+Token token_string_literal(const char *source, Lexeme lexeme)
 {
-    Token *result = get_token();
-    
-    result->type = TT_STRING;
-    result->literal = str_dup(str);
-    token_set_lexeme(result, lexeme);
-
+    Token result = token_init(TT_STRING, lexeme);
+    result.literal = str_substring(source, substring_trimmed(lexeme.index));
     return result;
 }
 
-Token * token_identifier(const char *str, Lexeme lexeme)
+// Returns an identifier token. Its name is interned directly from `source`.
+Token token_identifier(const char *source, Lexeme lexeme)
 {
-    Token *result = get_token();
-    
-    result->type = TT_IDENTIFIER;
-    result->literal = str_dup(str);
-    token_set_lexeme(result, lexeme);
-
+    Token result = token_init(TT_IDENTIFIER, lexeme);
+    result.literal = str_internSubstring(source, lexeme.index);
     return result;
 }
 
-Token * token_atomic(TokenType type, Lexeme lexeme)
+Token token_atomic(TokenType type, Lexeme lexeme)
 {
     assert(type != TT_STRING && type != TT_NUMBER);
-    Token *result = get_token();
-    result->type = type;
-    token_set_lexeme(result, lexeme);
-
-    return result;
-}
-
-void token_free(Token *token)
-{
-#ifdef TOKEN_UNION
-    if(token->type == TT_IDENTIFIER || token->type == TT_STRING)
-#else
-    if(token->literal)
-#endif
-    {
-        assert(token->type == TT_IDENTIFIER || token->type == TT_STRING);
-        str_free(token->literal);
-    }
-    lox_free(token);
+    return token_init(type, lexeme);
 }
 
-// Returns the number of elements in the list `elements`
-int32_t token_count(Token *elements)
+// Frees the array of tokens returned by the scanner.
+// NOTE: identifier names are interned, and are not owned by the tokens.
+void tokens_free(Token *tokens)
 {
-    int32_t count = 0;
-    while(elements != NULL)
+    for (Token *token = tokens; ; ++token)
     {
-        count++;
-        elements = elements->nextInScan;
-    }
-    return count;
-}
-
-// Returns the last token in a non-empty chain of tokens.
-Token * token_last(Token *expressions)
-{
-    assert(expressions != NULL);
-    
-    Token *last = expressions;
-    while(last->nextInScan)
-    {
-        last = last->nextInScan;
-    }
-    return last;
-}
-
-Token * token_appendTo(Token *head, Token *tail)
-{
-    if (head == NULL)
-    {
-        return tail;
+        if (token->type == TT_STRING)
+        {
+            str_free(token->literal);
+        }
+        else if (token->type == TT_EOF)
+        {
+            break;
+        }
     }
-    Token *last = token_last(head);
-    last->nextInScan = tail;
-    return head;
+    lox_free(tokens);
 }
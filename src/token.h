@@ -67,14 +67,17 @@ typedef struct KeywordEntry {
     TokenType type;
 } KeywordEntry;
 
-static KeywordEntry keywords[] = {
-#define DEFINE_KEYWORD_ENTRY(name, string) \
-    {string, TT_##name},
-    FOREACH_KEYWORD(DEFINE_KEYWORD_ENTRY)
-#undef DEFINE_KEYWORD_ENTRY
-    // NOTE: The following marks the end of the array and must come last.
-    {"", 0}
-};
+// NOTE: the keywords are found with a perfect hash of their length and first
+//       two characters, see lookup_keyword().
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 6
+
+inline uint32_t keyword_hash(const char *chars, str_size length)
+{
+    uint32_t hash = (uint32_t)length + 4 * (uint8_t)chars[0] + 3 * (uint8_t)chars[1];
+    return hash & (KEYWORD_TABLE_SIZE - 1);
+}
 
 typedef union
 {
@@ -93,31 +96,32 @@ typedef union
 
 /* Tokens */
 
+// NOTE: the scanner stores the tokens in a contiguous array, in the order
+//       they appear in the source code, terminated by a TT_EOF token.
+//       Identifiers and string literals are the only tokens with a
+//       literal: identifier names are interned, and the string literals
+//       are the only copies of the source made by the scanner.
 typedef struct Token_tag
 {
     double number;
     char *literal;
 
-    // Note: used by the scanner to link the tokens as they appear in the source code in a list
-    struct Token_tag *nextInScan;
-
     TokenType type;
     Lexeme lexeme;
 } Token;
 
-void token_free(Token *token);
-Token * token_atomic(TokenType type, Lexeme lexeme);
-Token * token_identifier(const char *str, Lexeme lexeme);
-Token * token_string_literal(const char * const str, Lexeme lexeme);
-Token * token_number_literal(double value, Lexeme lexeme);
+void tokens_free(Token *tokens);
+Token token_atomic(TokenType type, Lexeme lexeme);
+Token token_identifier(const char *source, Lexeme lexeme);
+Token token_string_literal(const char *source, Lexeme lexeme);
+Token token_number_literal(double value, Lexeme lexeme);
 char * token_to_string(const Token * const token, const char * const source);
 char * string_from_token_literal(const Token *token);
 
-int32_t token_count(Token *elements);
-Token * token_last(Token *expressions);
-Token * token_appendTo(Token *head, Token *tail);
-
-KeywordEntry * lookup_keyword(const char *keyword);
+KeywordEntry * lookup_keyword(const char *chars, str_size length);
+#ifdef DEBUG
+bool keywords_isPerfectTable(void);
+#endif
 
 inline bool keyword_is_valid(KeywordEntry *entry)
 {
@@ -137,6 +141,7 @@ inline const char * get_string_value(const Token *token)
     return token->literal;
 }
 
+// NOTE: identifier names are interned, see str_intern().
 inline const char * get_identifier_name(const Token *token)
 {
     assert(token->type == TT_IDENTIFIER);
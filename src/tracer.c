@@ -0,0 +1,134 @@
+//
+//  tracer.c
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#include "tracer.h"
+
+#include <assert.h>
+
+extern inline bool tracer_isEnabled(void);
+extern inline uint64_t tracer_begin(void);
+extern inline void tracer_end(const char *name, uint64_t startTime);
+
+thread_global FILE *tracer_file = NULL;
+thread_global bool tracer_tracesCalls = false;
+
+typedef struct
+{
+    // NOTE: the time of the start of the trace, the origin of the spans
+    uint64_t startTime;
+    // NOTE: the name of the function of the call from the top-level code in
+    //       progress, or NULL
+    const Token *callName;
+    uint64_t callStartTime;
+} Tracer;
+
+static thread_global Tracer tracer_;
+
+// Starts writing the trace to the file `path`. If `tracesCalls` is true, the
+// calls from the top-level code are traced too.
+// Returns false if the file could not be opened.
+bool tracer_start(const char *path, bool tracesCalls)
+{
+    assert(tracer_file == NULL);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, TRACER_BUFFER_SIZE);
+    tracer_.startTime = timer_nanoSec();
+    tracer_.callName = NULL;
+    fprintf(file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"loxi\"}}");
+    tracer_file = file;
+    tracer_tracesCalls = tracesCalls;
+    return true;
+}
+
+// Ends the trace and closes its file.
+void tracer_stop(void)
+{
+    if (tracer_file == NULL)
+    {
+        return;
+    }
+    tracer_endCall();
+    fprintf(tracer_file, "\n]\n");
+    fclose(tracer_file);
+    tracer_file = NULL;
+    tracer_tracesCalls = false;
+}
+
+// Writes `string` as a JSON string.
+static void tracer_writeString(const char *string, FILE *file)
+{
+    fputc('"', file);
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', file);
+            fputc(*c, file);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Writes the span `name` of the category `category`, that started at
+// `startTime` and ends now, with the `argsCount` values of `args`.
+void tracer_writeSpan(const char *category, const char *name, uint64_t startTime, const TraceArg *args, int32_t argsCount)
+{
+    assert(tracer_file != NULL);
+    uint64_t endTime = timer_nanoSec();
+    FILE *file = tracer_file;
+    fprintf(file, ",\n{\"name\":");
+    tracer_writeString(name, file);
+    // NOTE: the times are in microseconds
+    fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1",
+            category, (double)(int64_t)(startTime - tracer_.startTime) / 1e3, (double)(endTime - startTime) / 1e3);
+    if (argsCount > 0)
+    {
+        fprintf(file, ",\"args\":{");
+        for (int32_t i = 0; i < argsCount; i++)
+        {
+            fprintf(file, "%s\"%s\":%lld", (i > 0) ? "," : "", args[i].name, (long long)args[i].value);
+        }
+        fputc('}', file);
+    }
+    fputc('}', file);
+}
+
+// Starts the span of a call from the top-level code of the function `name`.
+// NOTE: a tail call of the function continues its span.
+void tracer_beginCall(const Token *name)
+{
+    if (tracer_.callName == NULL)
+    {
+        tracer_.callName = name;
+        tracer_.callStartTime = timer_nanoSec();
+    }
+}
+
+// Ends the span of the call from the top-level code in progress, if any,
+// e.g. after a runtime error.
+void tracer_endCall(void)
+{
+    if (tracer_.callName == NULL)
+    {
+        return;
+    }
+    TraceArg line = {"line", tracer_.callName->lexeme.line + 1};
+    tracer_writeSpan("call", get_identifier_name(tracer_.callName), tracer_.callStartTime, &line, 1);
+    tracer_.callName = NULL;
+}
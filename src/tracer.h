@@ -0,0 +1,70 @@
+//
+//  tracer.h
+//  loxi - a Lox interpreter
+//
+//  Created on 15/10/2026.
+//
+
+#ifndef tracer_h
+#define tracer_h
+
+#include "common.h"
+#include "token.h"
+#include "utility.h"
+
+#include <stdio.h>
+
+/*
+ The tracer writes a timeline of the run in the Trace Event Format, that
+ chrome://tracing and Perfetto open: a span for each phase of the front end
+ (scan, parse, resolve, optimize), for the interpretation of the script and
+ for the loading and storing of the cache, a span for each pause of the
+ garbage collector, with the objects and environments it marked and
+ recycled, and optionally a span for each call of a Lox function from the
+ top-level code, that covers its tail calls.
+ The spans are timed with timer_nanoSec(), like the pauses of the garbage
+ collector, and written as they end, in the JSON array format, whose
+ closing bracket may be missing: the file can be read even if the script
+ did not stop the tracer.
+ The tracer is local to the thread, like the allocation sampler; while it
+ is stopped, each span costs one branch.
+ */
+
+typedef struct
+{
+    const char *name;
+    int64_t value;
+} TraceArg;
+
+// NOTE: the trace file, NULL when the tracer is stopped
+extern thread_global FILE *tracer_file;
+// NOTE: true if the calls from the top-level code are traced
+extern thread_global bool tracer_tracesCalls;
+
+bool tracer_start(const char *path, bool tracesCalls);
+void tracer_stop(void);
+void tracer_writeSpan(const char *category, const char *name, uint64_t startTime, const TraceArg *args, int32_t argsCount);
+void tracer_beginCall(const Token *name);
+void tracer_endCall(void);
+
+inline bool tracer_isEnabled(void)
+{
+    return tracer_file != NULL;
+}
+
+// Returns the start time of a span, or 0 if the tracer is stopped.
+inline uint64_t tracer_begin(void)
+{
+    return tracer_isEnabled() ? timer_nanoSec() : 0;
+}
+
+// Writes the span of the phase `name`, that started at `startTime`.
+inline void tracer_end(const char *name, uint64_t startTime)
+{
+    if (tracer_isEnabled())
+    {
+        tracer_writeSpan("phase", name, startTime, NULL, 0);
+    }
+}
+
+#endif /* tracer_h */
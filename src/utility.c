@@ -5,12 +5,25 @@
 //  Created by Marco Caldarelli on 23/10/2017.
 //
 
+// NOTE: for pthread_getattr_np()
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "utility.h"
 #include "common.h"
 #include "string.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <pthread.h>
+#endif
 
 /* File I/O */
 
@@ -57,6 +70,70 @@ char * readFile(const char *filename)
     return buffer;
 }
 
+// Maps the file `filename` in memory, so that its contents are not copied.
+// The contents are a string, whose header is stored at the end of the page
+// that precedes them, and that is terminated by the zeros that follow the
+// end of the file. `*mappedSize` is set to the size of the mapping, or to 0
+// if the file was read with readFile() instead (e.g. if it is empty).
+// The string must be released with unmapFile().
+char * mapFile(const char *filename, size_t *mappedSize)
+{
+    *mappedSize = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        return readFile(filename);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0 || (uint64_t)info.st_size >= UINT32_MAX)
+    {
+        close(fd);
+        return readFile(filename);
+    }
+    size_t size = (size_t)info.st_size;
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    // NOTE: a page for the header, and at least one zero byte after the end
+    //       of the file.
+    size_t totalSize = pageSize + ((size + pageSize) / pageSize) * pageSize;
+
+    char *region = mmap(NULL, totalSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        close(fd);
+        return readFile(filename);
+    }
+    char *contents = mmap(region + pageSize, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (contents == MAP_FAILED)
+    {
+        munmap(region, totalSize);
+        return readFile(filename);
+    }
+
+    StringHeader *header = STR_HEADER(contents);
+    header->capacity = (str_size)size;
+    header->length = str_calculateLength(contents);
+#ifdef STR_STORE_HASH
+    header->hash = STR_HASH_UNAVAILABLE;
+#endif
+    *mappedSize = totalSize;
+    return contents;
+}
+
+// Releases a string returned by mapFile().
+void unmapFile(char *source, size_t mappedSize)
+{
+    if (mappedSize == 0)
+    {
+        str_free(source);
+    }
+    else
+    {
+        size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        munmap(source - pageSize, mappedSize);
+    }
+}
+
 
 /* Char utilities */
 
@@ -65,6 +142,39 @@ extern inline bool is_digit(char c);
 extern inline bool is_alphanumeric(char c);
 
 
+/* Stack */
+
+extern inline bool stack_isExhausted(void);
+
+thread_global uintptr_t stack_limit = 0;
+
+// Sets the limit of the stack of the calling thread, LOX_STACK_RESERVE bytes
+// above its lowest address. The limit stays 0, i.e. the stack is not
+// checked, on the platforms where the stack of a thread cannot be found.
+void stack_initLimit(void)
+{
+    uintptr_t bottom = 0;
+    size_t size = 0;
+#if defined(__APPLE__)
+    pthread_t thread = pthread_self();
+    size = pthread_get_stacksize_np(thread);
+    bottom = (uintptr_t)pthread_get_stackaddr_np(thread) - size;
+#elif defined(__linux__)
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0)
+    {
+        void *address;
+        if (pthread_attr_getstack(&attributes, &address, &size) == 0)
+        {
+            bottom = (uintptr_t)address;
+        }
+        pthread_attr_destroy(&attributes);
+    }
+#endif
+    stack_limit = (bottom != 0 && size > LOX_STACK_RESERVE) ? bottom + LOX_STACK_RESERVE : 0;
+}
+
+
 /* Time utils */
 
 #include <unistd.h>
@@ -100,3 +210,21 @@ void timer_reset(Timer *timer)
     timer->start = clock();
 #endif
 }
+
+// Returns the time elapsed since an arbitrary reference time in nanoseconds,
+// from a monotonic clock with a finer resolution than the one of the Timer.
+uint64_t timer_nanoSec(void)
+{
+#ifdef USE_MACH_TIME
+    static thread_global mach_timebase_info_data_t timebaseInfo;
+    if (timebaseInfo.denom == 0)
+    {
+        mach_timebase_info(&timebaseInfo);
+    }
+    return mach_absolute_time() * timebaseInfo.numer / timebaseInfo.denom;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+#endif
+}
@@ -10,10 +10,13 @@
 
 #include "common.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 /*  File I/O  */
 
 char * readFile(const char *filename);
+char * mapFile(const char *filename, size_t *mappedSize);
+void unmapFile(char *source, size_t mappedSize);
 
 
 /* Char utils */
@@ -36,6 +39,23 @@ inline bool is_alphanumeric(char c)
 }
 
 
+/* Stack */
+
+// NOTE: the lowest address of the C stack of the thread that the recursive
+//       functions may reach, or 0 if it is unknown, see stack_initLimit().
+extern thread_global uintptr_t stack_limit;
+
+void stack_initLimit(void);
+
+// Returns true if less than LOX_STACK_RESERVE bytes of the stack remain.
+// NOTE: the stack grows downwards on the supported platforms.
+inline bool stack_isExhausted(void)
+{
+    char marker;
+    return (uintptr_t)&marker < stack_limit;
+}
+
+
 /* Time utils */
 
 #ifdef USE_MACH_TIME
@@ -58,6 +78,7 @@ typedef struct Timer
 
 Timer timer_init(void);
 void timer_reset(Timer *timer);
+uint64_t timer_nanoSec(void);
 
 inline double timer_elapsedSec(Timer *timer)
 {
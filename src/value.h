@@ -0,0 +1,116 @@
+//
+//  value.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef value_h
+#define value_h
+
+#include "common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ Values are NaN-boxed in 64 bits. Numbers are stored as doubles; nil, the
+ booleans and pointers to heap objects are encoded in the payload of a quiet
+ NaN, so that only strings, functions, classes and instances (and the other
+ heap objects) are allocated by the garbage collector.
+
+ Objects have the sign bit set, and their pointer in the lower 48 bits; the
+ remaining quiet NaNs hold the singleton values below.
+ */
+
+typedef uint64_t Value;
+
+struct Object_tag;
+
+#define VAL_SIGN_BIT ((uint64_t)0x8000000000000000)
+#define VAL_QNAN     ((uint64_t)0x7ffc000000000000)
+
+#define VAL_TAG_NIL       1
+#define VAL_TAG_FALSE     2
+#define VAL_TAG_TRUE      3
+#define VAL_TAG_UNDEFINED 4
+#define VAL_TAG_UNBOUND   5
+
+#define VAL_NIL   ((Value)(VAL_QNAN | VAL_TAG_NIL))
+#define VAL_FALSE ((Value)(VAL_QNAN | VAL_TAG_FALSE))
+#define VAL_TRUE  ((Value)(VAL_QNAN | VAL_TAG_TRUE))
+// NOTE: value of a variable that was defined but not assigned a value
+#define VAL_UNDEFINED ((Value)(VAL_QNAN | VAL_TAG_UNDEFINED))
+// NOTE: value of a global slot reserved by the resolver for a variable
+//       that has not been defined yet
+#define VAL_UNBOUND ((Value)(VAL_QNAN | VAL_TAG_UNBOUND))
+
+inline Value val_number(double number)
+{
+    Value value;
+    memcpy(&value, &number, sizeof(double));
+    return value;
+}
+
+inline Value val_boolean(bool boolean)
+{
+    return boolean ? VAL_TRUE : VAL_FALSE;
+}
+
+inline Value val_object(const struct Object_tag *object)
+{
+    assert(object != NULL);
+    return (Value)(VAL_SIGN_BIT | VAL_QNAN | (uint64_t)(uintptr_t)object);
+}
+
+inline bool val_isNumber(Value value)
+{
+    return (value & VAL_QNAN) != VAL_QNAN;
+}
+
+inline bool val_isNil(Value value)
+{
+    return value == VAL_NIL;
+}
+
+inline bool val_isBoolean(Value value)
+{
+    return (value | 1) == VAL_TRUE;
+}
+
+inline bool val_isUndefined(Value value)
+{
+    return value == VAL_UNDEFINED;
+}
+
+inline bool val_isUnbound(Value value)
+{
+    return value == VAL_UNBOUND;
+}
+
+inline bool val_isObject(Value value)
+{
+    return (value & (VAL_QNAN | VAL_SIGN_BIT)) == (VAL_QNAN | VAL_SIGN_BIT);
+}
+
+inline double val_asNumber(Value value)
+{
+    assert(val_isNumber(value));
+    double number;
+    memcpy(&number, &value, sizeof(Value));
+    return number;
+}
+
+inline bool val_asBoolean(Value value)
+{
+    assert(val_isBoolean(value));
+    return value == VAL_TRUE;
+}
+
+inline struct Object_tag * val_asObject(Value value)
+{
+    assert(val_isObject(value));
+    return (struct Object_tag *)(uintptr_t)(value & ~(VAL_SIGN_BIT | VAL_QNAN));
+}
+
+#endif /* value_h */
@@ -0,0 +1,629 @@
+//
+//  vm.c
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#include "vm.h"
+
+#include "common.h"
+#include "compiler.h"
+#include "garbage_collector.h"
+#include "lox_callable.h"
+#include "lox_class.h"
+#include "lox_instance.h"
+#include "objects.h"
+#include "profiler.h"
+#include "tracer.h"
+
+#include <string.h>
+
+/*
+ The virtual machine executes the bytecode produced by the compiler. Calls
+ do not recurse on the C stack: each call to a Lox function pushes a new
+ frame, and the dispatch loop continues with the chunk of the callee.
+ Local variables still live in environments, that are shared with the
+ closures exactly as in the tree-walking interpreter.
+ */
+
+// NOTE: accessors of the operand stack
+#define STACK_TOP (collector->lockedCount)
+#define PEEK(distance) (collector->locked[collector->lockedCount - 1 - (distance)])
+
+#define PUSH(value) do {                                                               \
+    if (gcLock(value, collector) == false)                                            \
+        interpreter_throwNewError(instructionToken(instruction, frame), "Stack overflow.", interpreter); \
+} while (0)
+
+#define POP() gcPopLock(collector)
+
+#define READ_BYTE() (*ip++)
+#define READ_OPERAND() (ip += CHUNK_OPERAND_SIZE, chunk_readOperand(ip - CHUNK_OPERAND_SIZE))
+#define READ_CONSTANT() (frame->chunk->constants[READ_OPERAND()])
+#define READ_TOKEN() ((Token *)READ_CONSTANT())
+
+// Returns the token used to report runtime errors of `instruction`.
+static inline Token * instructionToken(const uint8_t *instruction, const CallFrame *frame)
+{
+    int32_t offset = (int32_t)(instruction - frame->chunk->code);
+    Token *token = (Token *)chunk_tokenAt(offset, frame->chunk);
+    return token;
+}
+
+static inline void vm_throwError(Error *error, Token *token, Interpreter *interpreter)
+{
+    assert(error->token == NULL);
+    error->token = token;
+    interpreter_throwError(error, interpreter);
+}
+
+// Doubles the number of frames of `vm`. Throws a stack overflow error if
+// there are already LOX_MAX_CALL_DEPTH frames.
+static void vm_growFrames(Token *paren, VM *vm, Interpreter *interpreter)
+{
+    if (vm->framesCapacity >= LOX_MAX_CALL_DEPTH)
+    {
+        interpreter_throwNewError(paren, "Stack overflow.", interpreter);
+    }
+    int32_t capacity = min(2 * vm->framesCapacity, LOX_MAX_CALL_DEPTH);
+    CallFrame *frames = lox_allocn(CallFrame, capacity);
+    if (frames == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    memcpy(frames, vm->frames, vm->frameCount * sizeof(CallFrame));
+    lox_free(vm->frames);
+    vm->frames = frames;
+    vm->framesCapacity = capacity;
+}
+
+// Parses and compiles the body of a function declared lazily, at its first
+// call. Throws an error if it had an error in an earlier call.
+__attribute__((__noinline__))
+static void vm_compileLazyFunction(FunctionStmt *declaration, Token *paren, Interpreter *interpreter)
+{
+    LazyBody *lazyBody = declaration->lazyBody;
+    assert(lazyBody != NULL);
+    if (!function_parseBody(declaration, interpreter))
+    {
+        interpreter_throwNewError(paren, "Could not compile the body of the function.", interpreter);
+    }
+    const char *source = interpreter->source;
+    interpreter->source = lazyBody->source;
+    compileLazyFunction(declaration, interpreter);
+    interpreter->source = source;
+}
+
+// Pushes a frame that executes `function`, whose arguments are on the top
+// of the stack, right above the callee. `receiver` is stored as "this" if
+// `function` is a method.
+static CallFrame * vm_callFunction(const LoxFunction *function, Value receiver, int32_t argumentsCount, Token *paren, VM *vm, Interpreter *interpreter)
+{
+    GarbageCollector *collector = interpreter->collector;
+    if (vm->frameCount == vm->framesCapacity)
+    {
+        vm_growFrames(paren, vm, interpreter);
+    }
+    if (function->declaration->chunk == NULL)
+    {
+        vm_compileLazyFunction(function->declaration, paren, interpreter);
+    }
+
+    Error *error = NULL;
+    Environment *environment;
+    if (function->declaration->isCaptured)
+    {
+        environment = env_init(function->closure, function->declaration->slotsCount, &error, collector);
+        if (error)
+        {
+            vm_throwError(error, paren, interpreter);
+        }
+    }
+    else
+    {
+        environment = env_pushFrame(function->closure, function->declaration->slotsCount, &interpreter->frames);
+    }
+    if (!val_isNil(receiver))
+    {
+        env_defineThis(receiver, environment);
+    }
+    Value *arguments = collector->locked + collector->lockedCount - argumentsCount;
+    for (int32_t i = 0; i < argumentsCount; i++)
+    {
+        Token *parameter = function->declaration->parameters[i];
+        error = env_defineLocal(parameter, arguments[i], environment);
+        assert(error == NULL);
+    }
+
+    CallFrame *frame = &vm->frames[vm->frameCount++];
+    frame->chunk = function->declaration->chunk;
+    frame->ip = frame->chunk->code;
+    frame->stackBase = collector->lockedCount - argumentsCount - 1;
+    frame->environment = environment;
+    frame->previous = interpreter->environment;
+    frame->function = function;
+
+    interpreter->environment = environment;
+    interpreter->currentFunction = function->declaration;
+    if (interpreter->profiler != NULL)
+    {
+        profiler_enter(function->declaration, interpreter->profiler);
+    }
+    // NOTE: the first frame runs the top-level code
+    if (tracer_tracesCalls && vm->frameCount == 2)
+    {
+        tracer_beginCall(function->declaration->name);
+    }
+    return frame;
+}
+
+// Returns true if the call whose instruction ends at `ip` is a tail call of
+// the function of `frame`, i.e. its result is returned right away.
+// NOTE: the initializers return "this", and not the result of their calls.
+static inline bool vm_isTailCall(const uint8_t *ip, const CallFrame *frame, const Interpreter *interpreter)
+{
+    return *ip == OP_RETURN && frame->function != NULL && !frame->function->isInitializer && interpreter->useTailCalls;
+}
+
+// Pops `frame`, that ends with a tail call, so that the called function can
+// take its place: the environments of the frame are released, and the callee
+// and the arguments on the top of the stack are moved to its base.
+static void vm_popTailFrame(CallFrame *frame, int32_t argumentsCount, VM *vm, Interpreter *interpreter)
+{
+    GarbageCollector *collector = interpreter->collector;
+    Environment *environment = interpreter->environment;
+    while (environment != frame->environment)
+    {
+        Environment *enclosing = environment->enclosing;
+        env_release(environment, &interpreter->frames);
+        environment = enclosing;
+    }
+    env_release(frame->environment, &interpreter->frames);
+    interpreter->environment = frame->previous;
+    if (interpreter->profiler != NULL)
+    {
+        profiler_exit(interpreter->profiler);
+    }
+
+    int32_t calleeIndex = STACK_TOP - argumentsCount - 1;
+    memmove(collector->locked + frame->stackBase, collector->locked + calleeIndex, (size_t)(argumentsCount + 1) * sizeof(Value));
+    gcPopLockn(calleeIndex - frame->stackBase, collector);
+    vm->frameCount--;
+}
+
+// Calls `callee`, whose arguments are on the top of the stack, right above
+// it. Returns the frame where the execution continues: a new frame if a
+// Lox function is called, or `frame` with the result of the call in place
+// of the callee and the arguments.
+static CallFrame * vm_callValue(Value callee, int32_t argumentsCount, Token *paren, CallFrame *frame, VM *vm, Interpreter *interpreter)
+{
+    GarbageCollector *collector = interpreter->collector;
+    Value *calleeSlot = collector->locked + collector->lockedCount - argumentsCount - 1;
+    if (isLoxCallable(callee))
+    {
+        const LoxCallable *function = obj_unwrapCallable(callee);
+        if (argumentsCount != callableArity(function))
+        {
+            interpreter_throwArityError(paren, callableArity(function), argumentsCount, interpreter);
+        }
+        LoxArguments arguments = {calleeSlot + 1, argumentsCount};
+        interpreter->nativeCallToken = paren;
+        Value result = function->function(&arguments, interpreter);
+        // NOTE: the native function may have moved the stack
+        calleeSlot = collector->locked + collector->lockedCount - argumentsCount - 1;
+        *calleeSlot = result;
+        gcPopLockn(argumentsCount, collector);
+        return frame;
+    }
+    if (isLoxFunction(callee))
+    {
+        const LoxFunction *function = obj_unwrapFunction(callee);
+        if (argumentsCount != function->declaration->arity)
+        {
+            interpreter_throwArityError(paren, function->declaration->arity, argumentsCount, interpreter);
+        }
+        return vm_callFunction(function, function->receiver, argumentsCount, paren, vm, interpreter);
+    }
+    if (isLoxClass(callee))
+    {
+        LoxClass *klass = obj_unwrapClass(callee);
+        if (argumentsCount != klass->arity)
+        {
+            interpreter_throwArityError(paren, klass->arity, argumentsCount, interpreter);
+        }
+        Value instance = obj_wrapInstance(instanceInit(klass), collector);
+        // NOTE: the instance takes the place of the class on the stack, so
+        //       that it is retained until the initializer returns.
+        *calleeSlot = instance;
+        const LoxFunction *initializer = klass->initializer;
+        if (initializer != NULL)
+        {
+            return vm_callFunction(initializer, instance, argumentsCount, paren, vm, interpreter);
+        }
+        gcPopLockn(argumentsCount, collector);
+        return frame;
+    }
+    interpreter_throwNewError(paren, "Can only call functions and classes.", interpreter);
+}
+
+static void vm_run(VM *vm, const Chunk *chunk, Interpreter *interpreter)
+{
+    GarbageCollector *collector = interpreter->collector;
+    Profiler *profiler = interpreter->profiler;
+
+    CallFrame *frame = &vm->frames[vm->frameCount++];
+    frame->chunk = chunk;
+    frame->ip = chunk->code;
+    frame->stackBase = collector->lockedCount;
+    frame->environment = interpreter->environment;
+    frame->previous = interpreter->environment;
+    frame->function = NULL;
+
+    const uint8_t *ip = frame->ip;
+    while (true)
+    {
+        const uint8_t *instruction = ip;
+        switch (READ_BYTE())
+        {
+            case OP_CONSTANT:
+            {
+                const Token *value = READ_TOKEN();
+                Value object = interpreter_literalValue(value, interpreter);
+                PUSH(object);
+            } break;
+            case OP_NIL:
+            {
+                Value object = VAL_NIL;
+                PUSH(object);
+            } break;
+            case OP_TRUE:
+            {
+                Value object = VAL_TRUE;
+                PUSH(object);
+            } break;
+            case OP_FALSE:
+            {
+                Value object = VAL_FALSE;
+                PUSH(object);
+            } break;
+            case OP_POP:
+            {
+                POP();
+            } break;
+            case OP_GET_LOCAL:
+            {
+                int32_t depth = READ_OPERAND();
+                int32_t index = READ_OPERAND();
+                Error *error = NULL;
+                Token *name = instructionToken(instruction, frame);
+                Value value = env_getAt(name, depth, index, interpreter->environment, &error);
+                if (error)
+                {
+                    interpreter_throwError(error, interpreter);
+                }
+                PUSH(value);
+            } break;
+            case OP_SET_LOCAL:
+            {
+                int32_t depth = READ_OPERAND();
+                int32_t index = READ_OPERAND();
+                env_assignAt(PEEK(0), depth, index, interpreter->environment, collector);
+            } break;
+            case OP_GET_GLOBAL:
+            {
+                int32_t index = READ_OPERAND();
+                Error *error = NULL;
+                Token *name = instructionToken(instruction, frame);
+                Value value = env_getGlobal(name, index, interpreter->globals, &error);
+                if (error)
+                {
+                    interpreter_throwError(error, interpreter);
+                }
+                PUSH(value);
+            } break;
+            case OP_SET_GLOBAL:
+            {
+                int32_t index = READ_OPERAND();
+                Token *name = instructionToken(instruction, frame);
+                Error *error = env_assignGlobal(name, index, PEEK(0), interpreter->globals);
+                if (error)
+                {
+                    interpreter_throwError(error, interpreter);
+                }
+            } break;
+            case OP_DEFINE:
+            {
+                Token *name = READ_TOKEN();
+                Error *error = env_define(name, PEEK(0), interpreter->environment);
+                if (error)
+                {
+                    interpreter_throwError(error, interpreter);
+                }
+                POP();
+            } break;
+            case OP_DECLARE:
+            {
+                Token *name = READ_TOKEN();
+                Error *error = env_define(name, VAL_UNDEFINED, interpreter->environment);
+                if (error)
+                {
+                    interpreter_throwError(error, interpreter);
+                }
+            } break;
+            case OP_GET_PROPERTY:
+            {
+                Get *expr = (Get *)READ_CONSTANT();
+                Value result = interpreter_getProperty(PEEK(0), expr->name, &expr->cache, interpreter);
+                POP();
+                PUSH(result);
+            } break;
+            case OP_CHECK_FIELDS:
+            {
+                if (!isLoxInstance(PEEK(0)))
+                {
+                    interpreter_throwNewError(instructionToken(instruction, frame), "Only instances have fields.", interpreter);
+                }
+            } break;
+            case OP_SET_PROPERTY:
+            {
+                Set *expr = (Set *)READ_CONSTANT();
+                Value value = PEEK(0);
+                LoxInstance *instance = obj_unwrapInstance(PEEK(1));
+                instanceSet(instance, expr->name, &expr->cache, value, collector);
+                POP();
+                POP();
+                PUSH(value);
+            } break;
+            case OP_GET_SUPER:
+            {
+                Super *expr = (Super *)READ_CONSTANT();
+                int32_t depth = READ_OPERAND();
+                int32_t index = READ_OPERAND();
+                Value result = interpreter_superMethod(expr->keyword, expr->method, depth, index, &expr->cache, interpreter);
+                PUSH(result);
+            } break;
+            case OP_BINARY:
+            {
+                Token *operator = READ_TOKEN();
+                Value result = interpreter_binaryOperation(operator, PEEK(1), PEEK(0), interpreter);
+                gcPopLockn(2, collector);
+                PUSH(result);
+            } break;
+            case OP_UNARY:
+            {
+                Token *operator = READ_TOKEN();
+                Value result = interpreter_unaryOperation(operator, PEEK(0), interpreter);
+                POP();
+                PUSH(result);
+            } break;
+            case OP_PRINT:
+            {
+                output_printValue(PEEK(0), &interpreter->output);
+                POP();
+            } break;
+            case OP_JUMP:
+            {
+                int32_t offset = READ_OPERAND();
+                ip += offset;
+            } break;
+            case OP_JUMP_IF_FALSE:
+            {
+                int32_t offset = READ_OPERAND();
+                if (!isTruthy(PEEK(0)))
+                {
+                    ip += offset;
+                }
+            } break;
+            case OP_LOOP:
+            {
+                int32_t offset = READ_OPERAND();
+                ip -= offset;
+            } break;
+            case OP_CALL:
+            {
+                int32_t argumentsCount = READ_OPERAND();
+                Token *paren = instructionToken(instruction, frame);
+                Value callee = PEEK(argumentsCount);
+                frame->ip = ip;
+                if (isLoxFunction(callee) && vm_isTailCall(ip, frame, interpreter))
+                {
+                    const LoxFunction *function = obj_unwrapFunction(callee);
+                    if (argumentsCount != function->declaration->arity)
+                    {
+                        interpreter_throwArityError(paren, function->declaration->arity, argumentsCount, interpreter);
+                    }
+                    vm_popTailFrame(frame, argumentsCount, vm, interpreter);
+                    frame = vm_callFunction(function, function->receiver, argumentsCount, paren, vm, interpreter);
+                }
+                else
+                {
+                    frame = vm_callValue(callee, argumentsCount, paren, frame, vm, interpreter);
+                }
+                ip = frame->ip;
+            } break;
+            case OP_INVOKE:
+            {
+                const Call *call = READ_CONSTANT();
+                int32_t argumentsCount = READ_OPERAND();
+                Get *get = (Get *)call->callee;
+                Value receiver = PEEK(argumentsCount);
+                Value field = VAL_NIL;
+                const LoxFunction *method = interpreter_getMethod(receiver, get->name, &get->cache, &field, interpreter);
+                frame->ip = ip;
+                if (method != NULL)
+                {
+                    if (argumentsCount != method->declaration->arity)
+                    {
+                        interpreter_throwArityError(call->paren, method->declaration->arity, argumentsCount, interpreter);
+                    }
+                    if (vm_isTailCall(ip, frame, interpreter))
+                    {
+                        vm_popTailFrame(frame, argumentsCount, vm, interpreter);
+                    }
+                    frame = vm_callFunction(method, receiver, argumentsCount, call->paren, vm, interpreter);
+                }
+                else
+                {
+                    PEEK(argumentsCount) = field;
+                    frame = vm_callValue(field, argumentsCount, call->paren, frame, vm, interpreter);
+                }
+                ip = frame->ip;
+            } break;
+            case OP_FUNCTION:
+            {
+                FunctionStmt *declaration = (FunctionStmt *)READ_CONSTANT();
+                LoxFunction *function = function_init(declaration, interpreter->environment, false);
+                Value object = obj_wrapFunction(function, collector);
+                PUSH(object);
+            } break;
+            case OP_CLASS:
+            {
+                ClassStmt *stmt = (ClassStmt *)READ_CONSTANT();
+                Value superClass = VAL_NIL;
+                if (stmt->superClass != NULL)
+                {
+                    superClass = PEEK(0);
+                }
+                Value classObj = interpreter_createClass(stmt, superClass, interpreter);
+                if (stmt->superClass != NULL)
+                {
+                    POP();
+                }
+                PUSH(classObj);
+            } break;
+            case OP_BEGIN_SCOPE:
+            {
+                int32_t slotsCount = READ_OPERAND();
+                Error *error = NULL;
+                Environment *environment = env_init(interpreter->environment, slotsCount, &error, collector);
+                if (error)
+                {
+                    vm_throwError(error, instructionToken(instruction, frame), interpreter);
+                }
+                interpreter->environment = environment;
+            } break;
+            case OP_BEGIN_FRAME:
+            {
+                int32_t slotsCount = READ_OPERAND();
+                interpreter->environment = env_pushFrame(interpreter->environment, slotsCount, &interpreter->frames);
+            } break;
+            case OP_END_SCOPE:
+            {
+                Environment *environment = interpreter->environment;
+                interpreter->environment = environment->enclosing;
+                env_release(environment, &interpreter->frames);
+            } break;
+            case OP_RETURN:
+            {
+                Value result = PEEK(0);
+                const LoxFunction *function = frame->function;
+
+                // NOTE: release the environments of the blocks we are returning from
+                Environment *environment = interpreter->environment;
+                while (environment != frame->environment)
+                {
+                    Environment *enclosing = environment->enclosing;
+                    env_release(environment, &interpreter->frames);
+                    environment = enclosing;
+                }
+                if (function == NULL)
+                {
+                    // NOTE: end of the top-level code
+                    POP();
+                    vm->frameCount--;
+                    return;
+                }
+
+                if (function->isInitializer)
+                {
+                    // NOTE: "this" is the first slot of the environment
+                    result = frame->environment->values[0];
+                }
+                env_release(frame->environment, &interpreter->frames);
+                interpreter->environment = frame->previous;
+                if (profiler != NULL)
+                {
+                    profiler_exit(profiler);
+                }
+                if (tracer_tracesCalls && vm->frameCount == 2)
+                {
+                    tracer_endCall();
+                }
+
+                gcPopLockn(STACK_TOP - frame->stackBase, collector);
+                vm->frameCount--;
+                frame = &vm->frames[vm->frameCount - 1];
+                ip = frame->ip;
+                interpreter->currentFunction = (frame->function != NULL) ? frame->function->declaration : NULL;
+                PUSH(result);
+            } break;
+            INVALID_DEFAULT_CASE;
+        }
+    }
+}
+
+// Compiles the functions declared in `statements` without executing them,
+// e.g. the functions of a prelude whose globals were restored from a
+// snapshot.
+void vm_compileFunctions(Stmt *statements, Interpreter *interpreter)
+{
+    Chunk *chunk = compile(statements, interpreter);
+    chunk_free(chunk);
+}
+
+void vm_interpret(Stmt *statements, Interpreter *interpreter)
+{
+    Chunk *chunk = compile(statements, interpreter);
+#ifdef VM_PRINT_CODE
+    chunk_disassemble(chunk, "script", interpreter->source);
+#endif
+
+    VM *vm = lox_alloc(VM);
+    if (vm == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    vm->frames = lox_allocn(CallFrame, VM_INITIAL_FRAMES);
+    if (vm->frames == NULL)
+    {
+        fatal_outOfMemory();
+    }
+    vm->frameCount = 0;
+    vm->framesCapacity = VM_INITIAL_FRAMES;
+
+    switch (setjmp(interpreter->catchLocation))
+    {
+        case LOX_EXCEPTION_SETUP_LONGJMP:
+        {
+            vm_run(vm, chunk, interpreter);
+        } break;
+
+        case LOX_EXCEPTION_RUNTIME_ERROR:
+        {
+            interpreter->environment = interpreter->globals;
+            interpreter->currentFunction = NULL;
+            env_clearFrames(&interpreter->frames);
+            gcClearLocks(interpreter->collector);
+            // NOTE: the output printed before the error comes first
+            output_flush(&interpreter->output);
+            lox_runtimeError(interpreter->runtimeError);
+        } break;
+
+        case LOX_EXCEPTION_EXIT:
+        case LOX_EXCEPTION_COMPILE_ERROR:
+        {
+            interpreter->environment = interpreter->globals;
+            interpreter->currentFunction = NULL;
+            env_clearFrames(&interpreter->frames);
+            gcClearLocks(interpreter->collector);
+        } break;
+
+            INVALID_DEFAULT_CASE;
+    }
+
+    output_flush(&interpreter->output);
+    lox_free(vm->frames);
+    lox_free(vm);
+    chunk_free(chunk);
+}
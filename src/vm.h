@@ -0,0 +1,46 @@
+//
+//  vm.h
+//  loxi - a Lox interpreter
+//
+//  Created on 14/10/2026.
+//
+
+#ifndef vm_h
+#define vm_h
+
+#include "chunk.h"
+#include "interpreter.h"
+#include "lox_function.h"
+#include "stmt.h"
+
+typedef struct
+{
+    const Chunk *chunk;
+    const uint8_t *ip;
+    // NOTE: index in the stack of the callee; the stack is truncated
+    //       here when the frame returns.
+    int32_t stackBase;
+    // NOTE: environment created for the call, and environment that is
+    //       restored when the frame returns.
+    Environment *environment;
+    Environment *previous;
+    // NOTE: NULL for the top-level code
+    const LoxFunction *function;
+} CallFrame;
+
+// NOTE: The operand stack of the virtual machine is the stack of locked
+//       objects of the garbage collector, so that all temporaries are
+//       retained while they are in use.
+// NOTE: the frames grow when they are full, up to LOX_MAX_CALL_DEPTH, so
+//       pointers to the frames are invalidated when a frame is pushed.
+typedef struct
+{
+    CallFrame *frames;
+    int32_t frameCount;
+    int32_t framesCapacity;
+} VM;
+
+void vm_interpret(Stmt *statements, Interpreter *interpreter);
+void vm_compileFunctions(Stmt *statements, Interpreter *interpreter);
+
+#endif /* vm_h */